@@ -0,0 +1,103 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Evaluate many recipes in one process
+//!
+//! Tools walking a whole recipe tree, i.e. for bulk bumps or to graph build
+//! dependencies, load the macros once and share them across all recipes, which
+//! are parsed in parallel through the [`compiled::Cache`].
+
+use std::path::{Path, PathBuf};
+
+use rayon::iter::{IntoParallelRefIterator, ParallelIterator};
+
+use crate::{compiled, macros, recipe, Env, Macros, Recipe};
+
+pub struct Batch {
+    pub macros: Macros,
+    cache: compiled::Cache,
+}
+
+impl Batch {
+    pub fn new(env: &Env) -> Result<Self, macros::Error> {
+        Ok(Self {
+            macros: Macros::load(env)?,
+            cache: compiled::Cache::new(env),
+        })
+    }
+
+    /// Load all recipes at `paths`, in the same order
+    pub fn load<P: AsRef<Path> + Sync>(&self, paths: &[P]) -> Vec<(PathBuf, Result<Recipe, recipe::Error>)> {
+        self.evaluate(paths, |recipe, _| recipe)
+    }
+
+    /// Load all recipes at `paths` and evaluate them with `f` against the
+    /// shared macros, in parallel but reported in the same order
+    pub fn evaluate<P, T, F>(&self, paths: &[P], f: F) -> Vec<(PathBuf, Result<T, recipe::Error>)>
+    where
+        P: AsRef<Path> + Sync,
+        T: Send,
+        F: Fn(Recipe, &Macros) -> T + Sync,
+    {
+        paths
+            .par_iter()
+            .map(|path| {
+                let path = path.as_ref();
+                let result = Recipe::load(path, &self.cache).map(|recipe| f(recipe, &self.macros));
+
+                (path.to_path_buf(), result)
+            })
+            .collect()
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use std::{collections::BTreeMap, process};
+
+    use fs_err as fs;
+
+    use super::*;
+
+    #[test]
+    fn evaluate_in_order() {
+        let dir = std::env::temp_dir().join(format!("boulder-batch-test-{}", process::id()));
+        let _ = fs::remove_dir_all(&dir);
+        fs::create_dir_all(&dir).unwrap();
+
+        let batch = Batch {
+            macros: Macros {
+                arch: BTreeMap::new(),
+                actions: vec![],
+            },
+            cache: compiled::Cache::at(dir.join("compiled")),
+        };
+
+        let valid = include_str!("../../test/boulder-stone.yml");
+        let paths = (0..8)
+            .map(|i| dir.join(format!("{i}.yaml")))
+            .chain([dir.join("missing.yaml"), dir.join("invalid.yaml")])
+            .collect::<Vec<_>>();
+        for (i, path) in paths.iter().take(8).enumerate() {
+            fs::write(
+                path,
+                valid.replace("name        : boulder", &format!("name        : boulder-{i}")),
+            )
+            .unwrap();
+        }
+        fs::write(&paths[9], "name: [").unwrap();
+
+        let results = batch.evaluate(&paths, |recipe, _| recipe.parsed.source.name);
+
+        assert_eq!(results.len(), paths.len());
+        for (i, (path, result)) in results.iter().enumerate().take(8) {
+            assert_eq!(path, &paths[i]);
+            assert_eq!(result.as_ref().unwrap(), &format!("boulder-{i}"));
+        }
+        assert!(matches!(results[8].1, Err(recipe::Error::MissingRecipe(_))));
+        assert!(matches!(results[9].1, Err(recipe::Error::Decode(_))));
+
+        fs::remove_dir_all(&dir).unwrap();
+    }
+}
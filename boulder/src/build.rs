@@ -31,7 +31,8 @@ mod upstream;
 
 use self::job::Job;
 use crate::{
-    architecture::BuildTarget, container, macros, profile, recipe, timing, util, Env, Macros, Paths, Recipe, Timing,
+    architecture::BuildTarget, compiled, container, macros, profile, recipe, timing, util, Env, Macros, Paths, Recipe,
+    Timing,
 };
 
 pub struct Builder {
@@ -57,7 +58,7 @@ impl Builder {
         ccache: bool,
         output_dir: impl Into<PathBuf>,
     ) -> Result<Self, Error> {
-        let recipe = Recipe::load(recipe_path)?;
+        let recipe = Recipe::load(recipe_path, &compiled::Cache::new(&env))?;
 
         let macros = Macros::load(&env)?;
 
@@ -130,13 +130,12 @@ impl Phase {
             let macros = macros
                 .arch
                 .get(arch)
-                .cloned()
                 .ok_or_else(|| Error::MissingArchMacros(arch.to_owned()))?;
 
             parser.add_macros(macros.clone());
         }
 
-        for macros in macros.actions.clone() {
+        for macros in &macros.actions {
             parser.add_macros(macros.clone());
         }
 
@@ -4,15 +4,19 @@
 
 use std::collections::BTreeSet;
 use std::io;
+use std::time::Instant;
 
 use fs_err as fs;
 use moss::{repository, runtime, Installation};
 use stone_recipe::{tuning::Toolchain, Upstream};
 use thiserror::Error;
+use tui::Styled;
 
 use crate::build::Builder;
 use crate::{container, timing, util, Timing};
 
+mod snapshot;
+
 pub fn populate(
     builder: &Builder,
     repositories: repository::Map,
@@ -23,11 +27,12 @@ pub fn populate(
     let packages = packages(builder);
 
     let rootfs = builder.paths.rootfs().host;
+    let snapshots = snapshot::Cache::new(builder.paths.snapshots());
 
     // Create the moss client
     let installation = Installation::open(&builder.env.moss_dir, None)?;
     let mut moss_client =
-        moss::Client::with_explicit_repositories("boulder", installation, repositories)?.ephemeral(rootfs)?;
+        moss::Client::with_explicit_repositories("boulder", installation, repositories)?.ephemeral(&rootfs)?;
 
     if update_repos {
         runtime::block_on(moss_client.refresh_repositories())?;
@@ -42,10 +47,50 @@ pub fn populate(
 
     timing.finish(initialize_timer);
 
+    let resolve_start = Instant::now();
+    let resolved = moss_client
+        .resolve_install(&packages)?
+        .into_iter()
+        .collect::<BTreeSet<_>>();
+    let resolve_elapsed = resolve_start.elapsed();
+
+    // Restore the closest snapshot so moss only blits the difference
+    //
+    // Snapshots are best effort, on any failure the root is installed from scratch
+    let snapshot_start = Instant::now();
+    let mut snapshot = snapshots.find(&resolved).unwrap_or_else(|error| {
+        println!("{} | Ignoring build root snapshots: {error}", "Warning".yellow());
+        None
+    });
+    if let Some(found) = &snapshot {
+        if let Err(error) = snapshots.restore(found, &rootfs) {
+            println!(
+                "{} | Failed to restore build root snapshot: {error}",
+                "Warning".yellow()
+            );
+            util::recreate_dir(&rootfs)?;
+            snapshot = None;
+        }
+    }
+    let mut snapshot_elapsed = snapshot_start.elapsed();
+
+    if let Some(snapshot::Match::Exact(_)) = snapshot {
+        timing.record(timing::Populate::Resolve, resolve_elapsed);
+        timing.record(timing::Populate::Snapshot, snapshot_elapsed);
+        return Ok(());
+    }
+
     // Install packages
     let install_timing = moss_client.install(&packages, true)?;
 
-    timing.record(timing::Populate::Resolve, install_timing.resolve);
+    let save_start = Instant::now();
+    if let Err(error) = snapshots.save(&resolved, &rootfs) {
+        println!("{} | Failed to save build root snapshot: {error}", "Warning".yellow());
+    }
+    snapshot_elapsed += save_start.elapsed();
+
+    timing.record(timing::Populate::Resolve, resolve_elapsed + install_timing.resolve);
+    timing.record(timing::Populate::Snapshot, snapshot_elapsed);
     timing.record(timing::Populate::Fetch, install_timing.fetch);
     timing.record(timing::Populate::Blit, install_timing.blit);
 
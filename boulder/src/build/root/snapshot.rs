@@ -0,0 +1,254 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Snapshots of populated build roots
+//!
+//! Most recipes share the same base of build dependencies, so each populated
+//! root is kept as a snapshot of its resolved package set. A build resolving to
+//! the exact same set restores that snapshot instead of installing anything.
+//! Otherwise the closest snapshot is restored, along with the manifest of its
+//! ephemeral blit, so moss only blits the difference.
+//!
+//! Restoring hardlinks the files that moss linked from its asset store, as a
+//! blit would, and copies everything else (i.e. files written by triggers), so
+//! a build can't write through to a snapshot.
+
+use std::{
+    collections::BTreeSet,
+    io,
+    os::unix::fs::MetadataExt,
+    path::{Path, PathBuf},
+    process,
+    time::SystemTime,
+};
+
+use fs_err::{self as fs, os::unix::fs::symlink};
+use moss::package;
+use sha2::{Digest, Sha256};
+
+/// Snapshots kept around, least recently used are removed first
+const MAX_SNAPSHOTS: usize = 4;
+
+const PACKAGES_FILE: &str = "packages";
+const ROOT_DIR: &str = "root";
+
+/// A snapshot matching a resolved package set
+#[derive(Debug)]
+pub enum Match {
+    /// Holds all of the packages and nothing else
+    Exact(PathBuf),
+    /// Shares most of the packages
+    Closest(PathBuf),
+}
+
+impl Match {
+    fn path(&self) -> &Path {
+        match self {
+            Match::Exact(path) | Match::Closest(path) => path,
+        }
+    }
+}
+
+#[derive(Debug)]
+pub struct Cache {
+    dir: PathBuf,
+}
+
+impl Cache {
+    pub fn new(dir: impl Into<PathBuf>) -> Self {
+        Self { dir: dir.into() }
+    }
+
+    /// Find the snapshot to restore for `packages`
+    ///
+    /// Snapshots sharing half of the packages or less aren't considered, as
+    /// moss blits the whole tree rather than such a large difference.
+    pub fn find(&self, packages: &BTreeSet<package::Id>) -> io::Result<Option<Match>> {
+        let exact = self.dir.join(key(packages));
+        if exact.join(PACKAGES_FILE).exists() {
+            return Ok(Some(Match::Exact(exact)));
+        }
+
+        let closest = self
+            .snapshots()?
+            .into_iter()
+            .filter_map(|path| {
+                let content = fs::read_to_string(path.join(PACKAGES_FILE)).ok()?;
+                let shared = content
+                    .lines()
+                    .filter(|&id| packages.contains(&package::Id::from(id.to_owned())))
+                    .count();
+
+                Some((shared, path))
+            })
+            .filter(|(shared, _)| shared * 2 > packages.len())
+            .max_by_key(|(shared, _)| *shared);
+
+        Ok(closest.map(|(_, path)| Match::Closest(path)))
+    }
+
+    /// Restore the snapshot into an empty `rootfs`
+    pub fn restore(&self, snapshot: &Match, rootfs: &Path) -> io::Result<()> {
+        let path = snapshot.path();
+
+        // Track usage for eviction
+        fs::File::options()
+            .write(true)
+            .open(path.join(PACKAGES_FILE))?
+            .file()
+            .set_modified(SystemTime::now())?;
+
+        clone_tree(&path.join(ROOT_DIR), rootfs)
+    }
+
+    /// Save `rootfs`, freshly populated with `packages`, as a snapshot
+    pub fn save(&self, packages: &BTreeSet<package::Id>, rootfs: &Path) -> io::Result<()> {
+        let key = key(packages);
+        let staging = self.dir.join(format!(".{key}.{}", process::id()));
+
+        if staging.exists() {
+            fs::remove_dir_all(&staging)?;
+        }
+        fs::create_dir_all(staging.join(ROOT_DIR))?;
+
+        clone_tree(rootfs, &staging.join(ROOT_DIR))?;
+        // Written last, marking the snapshot complete
+        fs::write(
+            staging.join(PACKAGES_FILE),
+            packages.iter().map(|id| format!("{id}\n")).collect::<String>(),
+        )?;
+
+        // A concurrent build may have saved the same snapshot already
+        if fs::rename(&staging, self.dir.join(&key)).is_err() {
+            fs::remove_dir_all(&staging)?;
+        }
+
+        self.evict()
+    }
+
+    fn snapshots(&self) -> io::Result<Vec<PathBuf>> {
+        if !self.dir.exists() {
+            return Ok(vec![]);
+        }
+
+        let mut snapshots = vec![];
+
+        for entry in fs::read_dir(&self.dir)? {
+            let entry = entry?;
+
+            // Skip the staging dirs of saves in progress
+            if !entry.file_name().to_string_lossy().starts_with('.') && entry.file_type()?.is_dir() {
+                snapshots.push(entry.path());
+            }
+        }
+
+        Ok(snapshots)
+    }
+
+    fn evict(&self) -> io::Result<()> {
+        let mut snapshots = self
+            .snapshots()?
+            .into_iter()
+            .map(|path| {
+                let used = fs::metadata(path.join(PACKAGES_FILE))
+                    .and_then(|metadata| metadata.modified())
+                    .unwrap_or(SystemTime::UNIX_EPOCH);
+                (used, path)
+            })
+            .collect::<Vec<_>>();
+
+        // Most recently used first
+        snapshots.sort_by(|a, b| b.0.cmp(&a.0));
+
+        for (_, path) in snapshots.into_iter().skip(MAX_SNAPSHOTS) {
+            fs::remove_dir_all(path)?;
+        }
+
+        Ok(())
+    }
+}
+
+/// Identifies the snapshot of a resolved package set
+fn key(packages: &BTreeSet<package::Id>) -> String {
+    let mut hasher = Sha256::new();
+
+    for id in packages {
+        hasher.update(AsRef::<str>::as_ref(id));
+        hasher.update(b"\n");
+    }
+
+    hex::encode(hasher.finalize())
+}
+
+/// Clone the contents of `source` into the existing dir `target`
+fn clone_tree(source: &Path, target: &Path) -> io::Result<()> {
+    for entry in fs::read_dir(source)? {
+        let entry = entry?;
+        let from = entry.path();
+        let to = target.join(entry.file_name());
+        let file_type = entry.file_type()?;
+
+        if file_type.is_dir() {
+            fs::create_dir(&to)?;
+            clone_tree(&from, &to)?;
+            // Only once populated, in case it's read-only
+            fs::set_permissions(&to, entry.metadata()?.permissions())?;
+        } else if file_type.is_symlink() {
+            symlink(fs::read_link(&from)?, &to)?;
+        } else if file_type.is_file() {
+            // Linked from the asset store, so never written to
+            if entry.metadata()?.nlink() > 1 {
+                fs::hard_link(&from, &to)?;
+            } else {
+                fs::copy(&from, &to)?;
+            }
+        }
+        // Special files are never blitted
+    }
+
+    Ok(())
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn restore_closest() {
+        let dir = std::env::temp_dir().join(format!("boulder-snapshot-test-{}", process::id()));
+        let rootfs = dir.join("rootfs");
+        let cache = Cache::new(dir.join("snapshots"));
+        let packages = |ids: &[&str]| {
+            ids.iter()
+                .map(|&id| package::Id::from(id.to_owned()))
+                .collect::<BTreeSet<_>>()
+        };
+
+        fs::create_dir_all(rootfs.join("usr/lib")).unwrap();
+        fs::write(rootfs.join("usr/lib/asset"), "shared").unwrap();
+        fs::hard_link(rootfs.join("usr/lib/asset"), dir.join("asset")).unwrap();
+        fs::write(rootfs.join("usr/lib/generated"), "own").unwrap();
+        symlink("lib", rootfs.join("usr/lib64")).unwrap();
+
+        let base = packages(&["a", "b", "c"]);
+        assert!(cache.find(&base).unwrap().is_none());
+        cache.save(&base, &rootfs).unwrap();
+        fs::remove_dir_all(&rootfs).unwrap();
+        fs::create_dir(&rootfs).unwrap();
+
+        assert!(matches!(cache.find(&base).unwrap(), Some(Match::Exact(_))));
+        assert!(cache.find(&packages(&["a", "d", "e"])).unwrap().is_none());
+
+        let snapshot = cache.find(&packages(&["a", "b", "c", "d"])).unwrap().unwrap();
+        assert!(matches!(snapshot, Match::Closest(_)));
+        cache.restore(&snapshot, &rootfs).unwrap();
+
+        assert_eq!(fs::read_link(rootfs.join("usr/lib64")).unwrap(), Path::new("lib"));
+        // Assets are shared, anything else is a copy
+        assert_eq!(fs::metadata(rootfs.join("usr/lib/asset")).unwrap().nlink(), 3);
+        assert_eq!(fs::metadata(rootfs.join("usr/lib/generated")).unwrap().nlink(), 1);
+
+        fs::remove_dir_all(&dir).unwrap();
+    }
+}
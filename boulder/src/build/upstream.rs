@@ -5,14 +5,13 @@
 use std::{
     io,
     path::{Path, PathBuf},
+    process,
     str::FromStr,
     time::Duration,
 };
 
-use fs_err as fs;
 use futures_util::{stream, StreamExt, TryStreamExt};
 use moss::runtime;
-use nix::unistd::{linkat, LinkatFlags};
 use sha2::{Digest, Sha256};
 use thiserror::Error;
 use tokio::io::AsyncWriteExt;
@@ -124,15 +123,7 @@ impl Installed {
     fn share(&self, dest_dir: &Path) -> Result<(), Error> {
         match self {
             Installed::Plain { name, path, .. } => {
-                let target = dest_dir.join(name);
-
-                // Attempt hard link
-                let link_result = linkat(None, path, None, &target, LinkatFlags::NoSymlinkFollow);
-
-                // Copy instead
-                if link_result.is_err() {
-                    fs::copy(path, &target)?;
-                }
+                util::hardlink_or_copy(path, &dest_dir.join(name))?;
             }
             Installed::Git { name, path, .. } => {
                 let target = dest_dir.join(name);
@@ -216,26 +207,19 @@ impl Plain {
         }
     }
 
+    /// Path in the host-wide store, keyed by content so any recipe
+    /// (or uri) for the same tarball shares a single download
     fn path(&self, paths: &Paths) -> PathBuf {
-        // Hash uri and file hash together
-        // for a unique file path that can
-        // be used for caching purposes and
-        // is busted if either uri or hash
-        // change
-        let mut hasher = Sha256::new();
-        hasher.update(self.uri.as_str());
-        hasher.update(&self.hash.0);
-
-        let hash = hex::encode(hasher.finalize());
+        let hash = self.hash.0.to_lowercase();
 
         paths
             .upstreams()
             .host
-            .join("fetched")
+            .join("sha256")
             // Type safe guaranteed to be >= 5 bytes
             .join(&hash[..5])
             .join(&hash[hash.len() - 5..])
-            .join(hash)
+            .join(&hash)
     }
 
     async fn fetch(&self, paths: &Paths, pb: &ProgressBar) -> Result<Installed, Error> {
@@ -250,7 +234,8 @@ impl Plain {
 
         let name = self.name();
         let path = self.path(paths);
-        let partial_path = path.with_extension("part");
+        // Unique per process as concurrent builds share the store
+        let partial_path = path.with_extension(format!("{}.part", process::id()));
 
         if let Some(parent) = path.parent().map(Path::to_path_buf) {
             runtime::unblock(move || util::ensure_dir_exists(&parent)).await?;
@@ -280,7 +265,7 @@ impl Plain {
 
         let hash = hex::encode(hasher.finalize());
 
-        if hash != self.hash.0 {
+        if !hash.eq_ignore_ascii_case(&self.hash.0) {
             fs::remove_file(&partial_path).await?;
 
             return Err(Error::HashMismatch {
@@ -320,7 +305,9 @@ impl Git {
             .join(util::uri_relative_path(&self.uri))
     }
 
-    fn staging_path(&self, paths: &Paths) -> PathBuf {
+    /// Bare mirror of the remote, fetched into the checkout so history is only
+    /// ever downloaded once
+    fn mirror_path(&self, paths: &Paths) -> PathBuf {
         paths
             .upstreams()
             .host
@@ -329,33 +316,31 @@ impl Git {
             .join(util::uri_relative_path(&self.uri))
     }
 
-    async fn fetch(&self, paths: &Paths, pb: &ProgressBar) -> Result<Installed, Error> {
-        use tokio::fs;
+    /// A full commit id can't move, so once present there's nothing to fetch
+    fn is_pinned(&self) -> bool {
+        self.ref_id.len() == 40 && self.ref_id.chars().all(|c| c.is_ascii_hexdigit())
+    }
 
+    async fn fetch(&self, paths: &Paths, pb: &ProgressBar) -> Result<Installed, Error> {
         pb.set_style(
             ProgressStyle::with_template(" {spinner} {wide_msg} ")
                 .unwrap()
                 .tick_chars("--=≡■≡=--"),
         );
 
-        let clone_path = if self.staging {
-            self.staging_path(paths)
-        } else {
-            self.final_path(paths)
-        };
-        let clone_path_string = clone_path.display().to_string();
+        let mirror_path = self.mirror_path(paths);
+        let mirror_path_string = mirror_path.display().to_string();
 
         let final_path = self.final_path(paths);
         let final_path_string = final_path.display().to_string();
 
-        if let Some(parent) = clone_path.parent().map(Path::to_path_buf) {
-            runtime::unblock(move || util::ensure_dir_exists(&parent)).await?;
-        }
-        if let Some(parent) = final_path.parent().map(Path::to_path_buf) {
-            runtime::unblock(move || util::ensure_dir_exists(&parent)).await?;
+        for path in [&mirror_path, &final_path] {
+            if let Some(parent) = path.parent().map(Path::to_path_buf) {
+                runtime::unblock(move || util::ensure_dir_exists(&parent)).await?;
+            }
         }
 
-        if self.ref_exists(&final_path).await? {
+        if self.is_pinned() && self.has_ref(&final_path).await {
             self.reset_to_ref(&final_path).await?;
             return Ok(Installed::Git {
                 name: self.name().to_owned(),
@@ -364,21 +349,45 @@ impl Git {
             });
         }
 
-        let _ = fs::remove_dir_all(&clone_path).await;
         if self.staging {
-            let _ = fs::remove_dir_all(&final_path).await;
-        }
-
-        let mut args = vec!["clone"];
-        if self.staging {
-            args.push("--mirror");
-        }
-        args.extend(["--", self.uri.as_str(), &clone_path_string]);
+            if !mirror_path.exists() {
+                self.run(
+                    &["clone", "--mirror", "--", self.uri.as_str(), &mirror_path_string],
+                    None,
+                )
+                .await?;
+            } else if !(self.is_pinned() && self.has_ref(&mirror_path).await) {
+                self.run(&["remote", "update", "--prune"], Some(&mirror_path)).await?;
+            }
 
-        self.run(&args, None).await?;
+            // Local clones hardlink the mirror's objects
+            if !final_path.exists() {
+                self.run(
+                    &["clone", "--no-checkout", "--", &mirror_path_string, &final_path_string],
+                    None,
+                )
+                .await?;
+                // Resolve relative submodule urls against the remote, not the mirror
+                self.run(&["remote", "set-url", "origin", self.uri.as_str()], Some(&final_path))
+                    .await?;
+            }
 
-        if self.staging {
-            self.run(&["clone", "--", &clone_path_string, &final_path_string], None)
+            self.run(
+                &[
+                    "fetch",
+                    "--tags",
+                    "--prune",
+                    "--",
+                    &mirror_path_string,
+                    "+refs/heads/*:refs/remotes/origin/*",
+                ],
+                Some(&final_path),
+            )
+            .await?;
+        } else if final_path.exists() {
+            self.run(&["fetch", "--tags"], Some(&final_path)).await?;
+        } else {
+            self.run(&["clone", "--", self.uri.as_str(), &final_path_string], None)
                 .await?;
         }
 
@@ -391,16 +400,19 @@ impl Git {
         })
     }
 
-    async fn ref_exists(&self, path: &Path) -> Result<bool, Error> {
+    async fn has_ref(&self, path: &Path) -> bool {
+        use tokio::process;
+
         if !path.exists() {
-            return Ok(false);
+            return false;
         }
 
-        self.run(&["fetch"], Some(path)).await?;
-
-        let result = self.run(&["cat-file", "-e", &self.ref_id], Some(path)).await;
-
-        Ok(result.is_ok())
+        process::Command::new("git")
+            .args(["cat-file", "-e", &format!("{}^{{commit}}", self.ref_id)])
+            .current_dir(path)
+            .output()
+            .await
+            .is_ok_and(|output| output.status.success())
     }
 
     async fn reset_to_ref(&self, path: &Path) -> Result<(), Error> {
@@ -6,7 +6,7 @@ use std::{io, path::PathBuf, process};
 
 use boulder::{
     architecture::{self, BuildTarget},
-    build, container, macros, recipe, Env, Macros, Paths, Recipe,
+    build, compiled, container, macros, recipe, Env, Macros, Paths, Recipe,
 };
 use clap::Parser;
 use fs_err as fs;
@@ -22,7 +22,7 @@ pub struct Command {
 pub fn handle(command: Command, env: Env) -> Result<(), Error> {
     let Command { recipe: recipe_path } = command;
 
-    let recipe = Recipe::load(recipe_path)?;
+    let recipe = Recipe::load(recipe_path, &compiled::Cache::new(&env))?;
     let macros = Macros::load(&env)?;
     let paths = Paths::new(&recipe, env.cache_dir, "/mason", ".")?;
 
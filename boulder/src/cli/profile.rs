@@ -72,6 +72,7 @@ fn parse_repository(s: &str) -> Result<(repository::Id, Repository), String> {
             uri,
             priority: repository::Priority::new(priority),
             active: true,
+            mirrors: vec![],
         },
     ))
 }
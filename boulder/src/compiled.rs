@@ -0,0 +1,119 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Persistent cache of compiled recipes & macros
+//!
+//! Documents are kept in their [`stone_recipe::compiled`] form, keyed by a hash
+//! of their source, type & the boulder version, so unchanged recipes & macros
+//! skip the YAML parser on every following load. A document is only kept once
+//! its compiled form is known to decode equal to the source, otherwise it's
+//! always parsed as YAML.
+
+use std::{
+    any,
+    path::{Path, PathBuf},
+    process,
+};
+
+use fs_err as fs;
+use serde::de::DeserializeOwned;
+use sha2::{Digest, Sha256};
+use stone_recipe::compiled;
+
+use crate::Env;
+
+#[derive(Debug, Clone)]
+pub struct Cache {
+    dir: PathBuf,
+}
+
+impl Cache {
+    pub fn new(env: &Env) -> Self {
+        Self::at(env.cache_dir.join("compiled"))
+    }
+
+    pub(crate) fn at(dir: impl Into<PathBuf>) -> Self {
+        Self { dir: dir.into() }
+    }
+
+    /// Deserialize the YAML `source`, from its compiled form when cached
+    ///
+    /// The cache is best effort, failing to read or write it falls back to
+    /// parsing the source.
+    pub fn load<T: DeserializeOwned + PartialEq>(&self, source: &[u8]) -> Result<T, stone_recipe::Error> {
+        let path = self.path::<T>(source);
+
+        if let Ok(compiled) = fs::read(&path) {
+            if let Ok(value) = compiled::from_compiled(&compiled) {
+                return Ok(value);
+            }
+        }
+
+        let value = serde_yaml::from_slice::<T>(source)?;
+
+        if let Ok(compiled) = compiled::compile(source) {
+            if compiled::from_compiled::<T>(&compiled).is_ok_and(|decoded| decoded == value) {
+                let _ = store(&path, &compiled);
+            }
+        }
+
+        Ok(value)
+    }
+
+    /// Entries of documents deserialized as `T`
+    ///
+    /// The boulder version & type name stand in for the schema of `T`, as a
+    /// changed schema could decode an older entry differently than its source.
+    fn path<T>(&self, source: &[u8]) -> PathBuf {
+        let mut hasher = Sha256::new();
+        hasher.update([compiled::VERSION]);
+        hasher.update(env!("CARGO_PKG_VERSION"));
+        hasher.update([0]);
+        hasher.update(any::type_name::<T>());
+        hasher.update([0]);
+        hasher.update(source);
+        let key = hex::encode(hasher.finalize());
+
+        self.dir.join(&key[..2]).join(key)
+    }
+}
+
+/// Write the entry in one go, so concurrent loads never read it partially
+fn store(path: &Path, compiled: &[u8]) -> std::io::Result<()> {
+    let Some(parent) = path.parent() else {
+        return Ok(());
+    };
+    fs::create_dir_all(parent)?;
+
+    let staging = path.with_extension(format!("{}.part", process::id()));
+    fs::write(&staging, compiled)?;
+    fs::rename(&staging, path)
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn load_cached() {
+        let dir = std::env::temp_dir().join(format!("boulder-compiled-test-{}", process::id()));
+        let cache = Cache::at(&dir);
+        let source = include_bytes!("../../test/boulder-stone.yml");
+
+        let parsed = cache.load::<stone_recipe::Recipe>(source).unwrap();
+        assert!(cache.path::<stone_recipe::Recipe>(source).exists());
+
+        let cached = cache.load::<stone_recipe::Recipe>(source).unwrap();
+        assert_eq!(cached, parsed);
+
+        // Other types don't share entries
+        assert!(!cache.path::<stone_recipe::Macros>(source).exists());
+
+        // A corrupt entry is parsed from source again
+        fs::write(cache.path::<stone_recipe::Recipe>(source), b"corrupt").unwrap();
+        assert!(cache.load::<stone_recipe::Recipe>(source).is_ok());
+
+        fs::remove_dir_all(&dir).unwrap();
+    }
+}
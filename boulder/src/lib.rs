@@ -10,7 +10,9 @@ pub use self::recipe::Recipe;
 pub use self::timing::Timing;
 
 pub mod architecture;
+pub mod batch;
 pub mod build;
+pub mod compiled;
 pub mod container;
 pub mod draft;
 pub mod env;
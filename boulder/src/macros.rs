@@ -6,9 +6,10 @@ use std::collections::BTreeMap;
 use std::{io, path::Path};
 
 use fs_err as fs;
+use rayon::iter::{IntoParallelIterator, ParallelIterator};
 use thiserror::Error;
 
-use crate::{util, Env};
+use crate::{compiled, util, Env};
 
 #[derive(Debug)]
 pub struct Macros {
@@ -27,26 +28,28 @@ impl Macros {
         let arch_files = util::enumerate_files(&arch_dir, matcher).map_err(Error::ArchFiles)?;
         let action_files = util::enumerate_files(&actions_dir, matcher).map_err(Error::ActionFiles)?;
 
-        let mut arch = BTreeMap::new();
-        let mut actions = vec![];
+        let cache = compiled::Cache::new(env);
+        let load = |file: &Path| -> Result<stone_recipe::Macros, Error> {
+            let bytes = fs::read(file)?;
+            Ok(cache.load(&bytes)?)
+        };
 
-        for file in arch_files {
-            let relative = file.strip_prefix(&arch_dir).unwrap_or_else(|_| unreachable!());
+        let arch = arch_files
+            .into_par_iter()
+            .map(|file| {
+                let relative = file.strip_prefix(&arch_dir).unwrap_or_else(|_| unreachable!());
 
-            let identifier = relative.with_extension("").display().to_string();
+                let identifier = relative.with_extension("").display().to_string();
 
-            let bytes = fs::read(&file)?;
-            let macros = stone_recipe::macros::from_slice(&bytes)?;
+                Ok((identifier, load(&file)?))
+            })
+            .collect::<Result<BTreeMap<_, _>, Error>>()?;
 
-            arch.insert(identifier, macros);
-        }
-
-        for file in action_files {
-            let bytes = fs::read(&file)?;
-            let macros = stone_recipe::macros::from_slice(&bytes)?;
-
-            actions.push(macros);
-        }
+        // Collected in order, as later actions override earlier ones
+        let actions = action_files
+            .into_par_iter()
+            .map(|file| load(&file))
+            .collect::<Result<Vec<_>, _>>()?;
 
         Ok(Self { arch, actions })
     }
@@ -73,7 +73,7 @@ impl<'a> Packager<'a> {
         // Process all paths with the analysis chain
         // This will determine which files get included
         // and what deps / provides they produce
-        let mut analysis = analysis::Chain::new(self.paths, self.recipe, &self.collector, &mut hasher);
+        let mut analysis = analysis::Chain::new(self.paths, self.recipe, &self.collector);
         analysis.process(paths).map_err(Error::Analysis)?;
 
         timing.finish(timer);
@@ -102,7 +102,7 @@ impl<'a> Packager<'a> {
             .collect::<Vec<_>>();
 
         // Emit package stones and manifest files to artefact directory
-        emit(self.paths, self.recipe, &packages).map_err(Error::Emit)?;
+        emit(self.paths, self.recipe, &packages, timing).map_err(Error::Emit)?;
 
         timing.finish(timer);
 
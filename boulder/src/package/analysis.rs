@@ -2,13 +2,13 @@
 //
 // SPDX-License-Identifier: MPL-2.0
 
-use std::collections::BTreeMap;
-use std::{
-    collections::{BTreeSet, VecDeque},
-    path::PathBuf,
-};
+use std::collections::{BTreeMap, BTreeSet};
+use std::os::unix::fs::MetadataExt;
+use std::{mem, path::PathBuf};
 
+use itertools::Itertools;
 use moss::{Dependency, Provider};
+use rayon::iter::{IntoParallelIterator, ParallelIterator};
 use stone::write::digest;
 use tui::{ProgressBar, ProgressStyle, Styled};
 
@@ -18,19 +18,18 @@ use super::collect::{Collector, PathInfo};
 
 mod handler;
 
-pub type BoxError = Box<dyn std::error::Error>;
+pub type BoxError = Box<dyn std::error::Error + Send + Sync>;
 
 pub struct Chain<'a> {
-    handlers: Vec<Box<dyn Handler>>,
+    handlers: Vec<Box<dyn Handler + Send + Sync>>,
     recipe: &'a Recipe,
     paths: &'a Paths,
     collector: &'a Collector,
-    hasher: &'a mut digest::Hasher,
     pub buckets: BTreeMap<String, Bucket>,
 }
 
 impl<'a> Chain<'a> {
-    pub fn new(paths: &'a Paths, recipe: &'a Recipe, collector: &'a Collector, hasher: &'a mut digest::Hasher) -> Self {
+    pub fn new(paths: &'a Paths, recipe: &'a Recipe, collector: &'a Collector) -> Self {
         Self {
             handlers: vec![
                 Box::new(handler::ignore_blocked),
@@ -45,15 +44,20 @@ impl<'a> Chain<'a> {
             paths,
             recipe,
             collector,
-            hasher,
             buckets: Default::default(),
         }
     }
 
+    /// Run all paths through the handlers, in parallel
+    ///
+    /// Paths are analyzed in waves: first the given paths, then any paths
+    /// generated while analyzing those, and so on. The results of each wave
+    /// are merged into the buckets in queue order, so the output is the same
+    /// as analyzing every path in turn.
     pub fn process(&mut self, paths: impl IntoIterator<Item = PathInfo>) -> Result<(), BoxError> {
         println!("│Analyzing artefacts (» = Include, × = Ignore)");
 
-        let mut queue = paths.into_iter().collect::<VecDeque<_>>();
+        let mut queue = paths.into_iter().collect::<Vec<_>>();
 
         let pb = ProgressBar::new(queue.len() as u64)
             .with_message("Analyzing")
@@ -64,34 +68,27 @@ impl<'a> Chain<'a> {
             );
         pb.tick();
 
-        'paths: while let Some(mut path) = queue.pop_front() {
-            let bucket = self.buckets.entry(path.package.clone()).or_default();
+        while !queue.is_empty() {
+            let wave = mem::take(&mut queue);
 
-            pb.set_message(format!("Analyzing {}", path.target_path.display()));
+            for analyzed in self.analyze(wave, &pb) {
+                let Analyzed {
+                    path,
+                    decision,
+                    providers,
+                    dependencies,
+                    generated,
+                } = analyzed?;
 
-            'handlers: for handler in &self.handlers {
-                // Only give handlers ability to update
-                // certain bucket fields
-                let mut bucket_mut = BucketMut {
-                    providers: &mut bucket.providers,
-                    dependencies: &mut bucket.dependencies,
-                    hasher: self.hasher,
-                    recipe: self.recipe,
-                    paths: self.paths,
-                };
+                let bucket = self.buckets.entry(path.package.clone()).or_default();
+                bucket.providers.extend(providers);
+                bucket.dependencies.extend(dependencies);
 
-                let response = handler.handle(&mut bucket_mut, &mut path)?;
+                pb.inc_length(generated.len() as u64);
+                queue.extend(generated);
 
-                response.generated_paths.into_iter().try_for_each(|path| {
-                    let info = self.collector.path(&path, self.hasher)?;
-
-                    queue.push_back(info);
-
-                    Ok(()) as Result<(), BoxError>
-                })?;
-
-                match response.decision {
-                    Decision::NextHandler => continue 'handlers,
+                match decision {
+                    Decision::NextHandler => {}
                     Decision::IgnoreFile { reason } => {
                         pb.suspend(|| {
                             println!(
@@ -101,14 +98,10 @@ impl<'a> Chain<'a> {
                                 format!("({reason})").yellow()
                             );
                         });
-                        pb.inc(1);
-                        continue 'paths;
                     }
                     Decision::IncludeFile => {
                         pb.suspend(|| println!("│A{} {}", "│ »".green(), path.target_path.display()));
-                        pb.inc(1);
                         bucket.paths.push(path);
-                        continue 'paths;
                     }
                 }
             }
@@ -119,6 +112,114 @@ impl<'a> Chain<'a> {
 
         Ok(())
     }
+
+    /// Analyze a wave of paths, returning the results in the same order
+    fn analyze(&self, wave: Vec<PathInfo>, pb: &ProgressBar) -> Vec<Result<Analyzed, BoxError>> {
+        // Handlers modify files in place (i.e. stripping), so hardlinks
+        // of the same file are kept on one worker
+        let groups = wave
+            .into_iter()
+            .enumerate()
+            .into_group_map_by(|(index, path)| {
+                let inode = path
+                    .is_file()
+                    .then(|| path.path.symlink_metadata().ok())
+                    .flatten()
+                    .map(|metadata| (metadata.dev(), metadata.ino()));
+
+                match inode {
+                    Some((dev, ino)) => Group::Inode(dev, ino),
+                    None => Group::Path(*index),
+                }
+            })
+            .into_values()
+            .collect::<Vec<_>>();
+
+        let mut results = groups
+            .into_par_iter()
+            .map_init(digest::Hasher::new, |hasher, group| {
+                group
+                    .into_iter()
+                    .map(|(index, path)| {
+                        let result = self.analyze_path(path, hasher, pb);
+                        pb.inc(1);
+                        (index, result)
+                    })
+                    .collect::<Vec<_>>()
+            })
+            .flatten_iter()
+            .collect::<Vec<_>>();
+
+        results.sort_by_key(|(index, _)| *index);
+        results.into_iter().map(|(_, result)| result).collect()
+    }
+
+    fn analyze_path(
+        &self,
+        mut path: PathInfo,
+        hasher: &mut digest::Hasher,
+        pb: &ProgressBar,
+    ) -> Result<Analyzed, BoxError> {
+        pb.set_message(format!("Analyzing {}", path.target_path.display()));
+
+        let mut providers = BTreeSet::new();
+        let mut dependencies = BTreeSet::new();
+        let mut generated = vec![];
+
+        for handler in &self.handlers {
+            // Only give handlers ability to update
+            // certain bucket fields
+            let mut bucket_mut = BucketMut {
+                providers: &mut providers,
+                dependencies: &mut dependencies,
+                hasher,
+                recipe: self.recipe,
+                paths: self.paths,
+            };
+
+            let response = handler.handle(&mut bucket_mut, &mut path)?;
+
+            for generated_path in response.generated_paths {
+                generated.push(self.collector.path(&generated_path, hasher)?);
+            }
+
+            match response.decision {
+                Decision::NextHandler => continue,
+                decision => {
+                    return Ok(Analyzed {
+                        path,
+                        decision,
+                        providers,
+                        dependencies,
+                        generated,
+                    })
+                }
+            }
+        }
+
+        Ok(Analyzed {
+            path,
+            decision: Decision::NextHandler,
+            providers,
+            dependencies,
+            generated,
+        })
+    }
+}
+
+/// Handler results for a single path, to be merged into its bucket
+struct Analyzed {
+    path: PathInfo,
+    decision: Decision,
+    providers: BTreeSet<Provider>,
+    dependencies: BTreeSet<Dependency>,
+    generated: Vec<PathInfo>,
+}
+
+#[derive(Debug, PartialEq, Eq, Hash)]
+enum Group {
+    Inode(u64, u64),
+    Path(usize),
 }
 
 #[derive(Debug, Default)]
@@ -1,5 +1,7 @@
 use std::{
     ffi::CStr,
+    io,
+    os::unix::fs::MetadataExt,
     path::{Path, PathBuf},
     process::Command,
 };
@@ -11,7 +13,8 @@ use elf::{
     note::Note,
     to_str,
 };
-use fs_err::File;
+use fs_err as fs;
+use fs_err::{File, OpenOptions};
 
 use moss::{dependency, Dependency, Provider};
 use stone_recipe::tuning::Toolchain;
@@ -56,26 +59,35 @@ pub fn elf(bucket: &mut BucketMut<'_>, info: &mut PathInfo) -> Result<Response,
 
     let mut generated_paths = vec![];
 
-    if let Some(build_id) = build_id {
-        match split_debug(bucket, info, bit_size, &build_id) {
-            Ok(Some(debug_path)) => {
+    // Nothing to split or strip from an already stripped file
+    if let Some(build_id) = build_id.filter(|_| has_symbols(&mut elf)) {
+        let debug_info_path = debug_info_path(bucket, bit_size, &build_id);
+
+        let debuglink = match split_debug(bucket, info, &debug_info_path) {
+            Ok(true) => {
                 // Add new split file to be analyzed
-                generated_paths.push(debug_path);
+                generated_paths.push(debug_info_path.clone());
+                Some(debug_info_path)
             }
-            Ok(None) => {}
+            // Split from another file with the same build id, which may still be writing it
+            Ok(false) => None,
             // TODO: Error logging
             Err(err) => {
                 eprintln!("error splitting debug info from {}: {err}", info.path.display());
+                None
             }
-        }
+        };
 
-        if let Err(err) = strip(bucket, info) {
+        if let Err(err) = strip(bucket, info, debuglink.as_deref()) {
             // TODO: Error logging
             eprintln!("error stripping {}: {err}", info.path.display());
         }
 
         // Restat original file after split & strip
         info.restat(bucket.hasher)?;
+    } else if fs::metadata(&info.path)?.size() != info.size {
+        // Stripped through another hardlink since it was collected
+        info.restat(bucket.hasher)?;
     }
 
     Ok(Response {
@@ -329,84 +341,96 @@ fn parse_build_id(elf: &mut elf::ElfStream<AnyEndian, File>) -> Option<String> {
     None
 }
 
-fn split_debug(
-    bucket: &BucketMut<'_>,
-    info: &PathInfo,
-    bit_size: Class,
-    build_id: &str,
-) -> Result<Option<PathBuf>, BoxError> {
-    let use_llvm = matches!(bucket.recipe.parsed.options.toolchain, Toolchain::Llvm);
-    let objcopy = if use_llvm {
+/// Whether the file still has a symbol table or debug info to remove
+fn has_symbols(elf: &mut elf::ElfStream<AnyEndian, File>) -> bool {
+    [".symtab", ".debug_info", ".zdebug_info"]
+        .into_iter()
+        .any(|name| matches!(elf.section_header_by_name(name), Ok(Some(_))))
+}
+
+fn objcopy(bucket: &BucketMut<'_>) -> &'static str {
+    if matches!(bucket.recipe.parsed.options.toolchain, Toolchain::Llvm) {
         "/usr/bin/llvm-objcopy"
     } else {
         "/usr/bin/objcopy"
-    };
+    }
+}
 
+/// Debug files are shared by all files with the same build id
+fn debug_info_path(bucket: &BucketMut<'_>, bit_size: Class, build_id: &str) -> PathBuf {
     let debug_dir = if matches!(bit_size, Class::ELF64) {
         Path::new("usr/lib/debug/.build-id")
     } else {
         Path::new("usr/lib32/debug/.build-id")
     };
-    let debug_info_relative_dir = debug_dir.join(&build_id[..2]);
-    let debug_info_dir = bucket.paths.install().guest.join(debug_info_relative_dir);
-    let debug_info_path = debug_info_dir.join(format!("{}.debug", &build_id[2..]));
 
-    // Is it possible we already split this?
-    if debug_info_path.exists() {
-        return Ok(None);
-    }
-
-    util::ensure_dir_exists(&debug_info_dir)?;
+    bucket
+        .paths
+        .install()
+        .guest
+        .join(debug_dir)
+        .join(&build_id[..2])
+        .join(format!("{}.debug", &build_id[2..]))
+}
 
-    let output = Command::new(objcopy)
-        .arg("--only-keep-debug")
-        .arg(&info.path)
-        .arg(&debug_info_path)
-        .output()?;
+/// Split the debug info into `debug_info_path`, returning `false` if it was
+/// already split from another file
+fn split_debug(bucket: &BucketMut<'_>, info: &PathInfo, debug_info_path: &Path) -> Result<bool, BoxError> {
+    if let Some(debug_info_dir) = debug_info_path.parent() {
+        util::ensure_dir_exists(debug_info_dir)?;
+    }
 
-    if !output.status.success() {
-        return Err(String::from_utf8(output.stderr).unwrap_or_default().into());
+    // Files sharing a build id may be analyzed concurrently, so claim the
+    // debug file before writing it
+    match OpenOptions::new().write(true).create_new(true).open(debug_info_path) {
+        Ok(_) => {}
+        Err(err) if err.kind() == io::ErrorKind::AlreadyExists => return Ok(false),
+        Err(err) => return Err(err.into()),
     }
 
-    let output = Command::new(objcopy)
-        .arg("--add-gnu-debuglink")
-        .arg(&debug_info_path)
+    let output = Command::new(objcopy(bucket))
+        .arg("--only-keep-debug")
         .arg(&info.path)
+        .arg(debug_info_path)
         .output()?;
 
     if !output.status.success() {
+        let _ = fs::remove_file(debug_info_path);
         return Err(String::from_utf8(output.stderr).unwrap_or_default().into());
     }
 
-    Ok(Some(debug_info_path))
+    Ok(true)
 }
 
-fn strip(bucket: &BucketMut<'_>, info: &PathInfo) -> Result<(), BoxError> {
-    if !bucket.recipe.parsed.options.strip {
+/// Strip the file and link it to its split debug info, in a single pass
+fn strip(bucket: &BucketMut<'_>, info: &PathInfo, debuglink: Option<&Path>) -> Result<(), BoxError> {
+    let strip = bucket.recipe.parsed.options.strip;
+
+    if !strip && debuglink.is_none() {
         return Ok(());
     }
 
-    let use_llvm = matches!(bucket.recipe.parsed.options.toolchain, Toolchain::Llvm);
-    let strip = if use_llvm {
-        "/usr/bin/llvm-strip"
-    } else {
-        "/usr/bin/strip"
-    };
     let is_executable = info
         .path
         .parent()
         .map(|parent| parent.ends_with("bin") || parent.ends_with("sbin"))
         .unwrap_or_default();
 
-    let mut command = Command::new(strip);
+    let mut command = Command::new(objcopy(bucket));
 
-    if is_executable {
-        command.arg(&info.path);
-    } else {
-        command.args(["-g", "--strip-unneeded"]).arg(&info.path);
+    if strip {
+        if is_executable {
+            command.arg("--strip-all");
+        } else {
+            command.args(["--strip-debug", "--strip-unneeded"]);
+        }
     }
 
-    let output = command.output()?;
+    if let Some(debug_info_path) = debuglink {
+        command.arg(format!("--add-gnu-debuglink={}", debug_info_path.display()));
+    }
+
+    let output = command.arg(&info.path).output()?;
 
     if !output.status.success() {
         return Err(String::from_utf8(output.stderr).unwrap_or_default().into());
@@ -414,3 +438,81 @@ fn strip(bucket: &BucketMut<'_>, info: &PathInfo) -> Result<(), BoxError> {
 
     Ok(())
 }
+
+#[cfg(test)]
+mod test {
+    use std::collections::BTreeSet;
+
+    use chrono::Utc;
+    use stone::write::digest;
+
+    use super::*;
+    use crate::{Paths, Recipe};
+
+    #[test]
+    fn strip_hardlinks() {
+        let exe = std::env::current_exe().unwrap();
+
+        // Needs binutils and a build id, as when building
+        if !Path::new("/usr/bin/objcopy").exists() || parse_build_id(&mut parse_elf(&exe).unwrap()).is_none() {
+            return;
+        }
+
+        let dir = std::env::temp_dir().join(format!("boulder-elf-test-{}", std::process::id()));
+        let bin_dir = dir.join("install/usr/bin");
+        fs::create_dir_all(&bin_dir).unwrap();
+
+        let source = "name: test\nversion: 1\nrelease: 1\nhomepage: https://localhost\nlicense: MIT\ntoolchain: gnu\n";
+        fs::write(dir.join("stone.yaml"), source).unwrap();
+        let recipe = Recipe {
+            path: dir.join("stone.yaml"),
+            source: source.to_owned(),
+            parsed: stone_recipe::from_str(source).unwrap(),
+            build_time: Utc::now(),
+        };
+        // Guest paths in the same dir, as split debug info is written there
+        let paths = Paths::new(&recipe, &dir, dir.join("guest"), dir.join("out")).unwrap();
+
+        // Any unstripped ELF will do, such as this test binary
+        let first = bin_dir.join("first");
+        let second = bin_dir.join("second");
+        fs::copy(&exe, &first).unwrap();
+        fs::hard_link(&first, &second).unwrap();
+
+        let mut hasher = digest::Hasher::new();
+        let path_info = |path: &Path, hasher: &mut digest::Hasher| {
+            let target = Path::new("/usr/bin").join(path.file_name().unwrap());
+            PathInfo::new(
+                path.to_owned(),
+                target,
+                &fs::metadata(path).unwrap(),
+                hasher,
+                "test".to_owned(),
+            )
+            .unwrap()
+        };
+        // Both collected before either is stripped
+        let mut infos = [path_info(&first, &mut hasher), path_info(&second, &mut hasher)];
+
+        let (mut providers, mut dependencies) = (BTreeSet::new(), BTreeSet::new());
+        for info in &mut infos {
+            let mut bucket = BucketMut {
+                providers: &mut providers,
+                dependencies: &mut dependencies,
+                hasher: &mut hasher,
+                recipe: &recipe,
+                paths: &paths,
+            };
+            elf(&mut bucket, info).unwrap();
+        }
+
+        let stripped = path_info(&first, &mut hasher);
+        assert!(stripped.size < fs::metadata(&exe).unwrap().size());
+        for info in &infos {
+            assert_eq!(info.size, stripped.size);
+            assert_eq!(info.file_hash(), stripped.file_hash());
+        }
+
+        fs::remove_dir_all(&dir).unwrap();
+    }
+}
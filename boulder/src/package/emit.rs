@@ -2,23 +2,31 @@
 //
 // SPDX-License-Identifier: MPL-2.0
 use std::{
-    io::{self, Write},
+    cmp::Reverse,
+    io::{self, BufWriter, Write},
     num::NonZeroU64,
-    time::Duration,
+    sync::Mutex,
+    thread,
+    time::{Duration, Instant},
 };
 
 use fs_err::{self as fs, File};
 use itertools::Itertools;
 use moss::{package::Meta, Dependency, Provider};
+use stone::payload::Index;
 use thiserror::Error;
-use tui::{ProgressBar, ProgressStyle, Styled};
+use tui::{MultiProgress, ProgressBar, ProgressStyle, Styled};
 
 use self::manifest::Manifest;
-use super::analysis;
-use crate::{architecture, util, Architecture, Paths, Recipe};
+use super::{analysis, collect::PathInfo};
+use crate::{architecture, timing, util, Architecture, Paths, Recipe, Timing};
 
 mod manifest;
 
+/// Plain size of each independently compressed content frame, trading a
+/// little compression for parallel and random access unpacking
+const CONTENT_FRAME_SIZE: u64 = 8 * 1024 * 1024;
+
 #[derive(Debug)]
 pub struct Package<'a> {
     pub name: &'a str,
@@ -115,7 +123,7 @@ impl Ord for Package<'_> {
     }
 }
 
-pub fn emit(paths: &Paths, recipe: &Recipe, packages: &[Package<'_>]) -> Result<(), Error> {
+pub fn emit(paths: &Paths, recipe: &Recipe, packages: &[Package<'_>], timing: &mut Timing) -> Result<(), Error> {
     let mut manifest = Manifest::new(paths, recipe, architecture::host());
 
     println!("Packaging");
@@ -124,10 +132,77 @@ pub fn emit(paths: &Paths, recipe: &Recipe, packages: &[Package<'_>]) -> Result<
         if !package.is_dbginfo() {
             manifest.add_package(package);
         }
+    }
+
+    // Start with the largest packages so they aren't left compressing
+    // on their own once the smaller ones are done
+    let jobs = packages
+        .iter()
+        .map(|package| (package, content_files(package)))
+        .sorted_by_key(|(_, files)| Reverse(total_size(files)))
+        .collect::<Vec<_>>();
+
+    // All packages share one budget of zstd workers. Each emitter has one of
+    // its own and borrows spare ones in proportion to its package's share of
+    // the content left to emit, giving them back once the package is written.
+    // The last packages thereby pick up the workers freed by the others.
+    let budget = util::num_cpus().get();
+    let content_size = jobs.iter().map(|(_, files)| total_size(files)).sum::<u64>();
+    let num_emitters = budget.min(jobs.len());
+
+    let queue = Mutex::new((jobs.into_iter(), content_size));
+    let spare = Mutex::new(budget - num_emitters);
+    let results = Mutex::new(vec![]);
+    let mp = MultiProgress::new();
+
+    thread::scope(|scope| {
+        for _ in 0..num_emitters {
+            scope.spawn(|| loop {
+                let (package, files, share) = {
+                    let mut queue = queue.lock().expect("mutex guard");
+                    let (jobs, remaining) = &mut *queue;
+
+                    let Some((package, files)) = jobs.next() else {
+                        break;
+                    };
+
+                    let size = total_size(&files);
+                    let share = (budget as u64 * size).div_ceil((*remaining).max(1));
+                    *remaining -= size;
+
+                    (package, files, share)
+                };
+
+                let borrowed = {
+                    let mut spare = spare.lock().expect("mutex guard");
+                    let borrowed = (share.saturating_sub(1) as usize).min(*spare);
+                    *spare -= borrowed;
+                    borrowed
+                };
+
+                let started = Instant::now();
+                let result = emit_package(paths, package, files, 1 + borrowed as u32, &mp);
+
+                *spare.lock().expect("mutex guard") += borrowed;
+
+                results
+                    .lock()
+                    .expect("mutex guard")
+                    .push((package, started.elapsed(), result));
+            });
+        }
+    });
+
+    let mut results = results.into_inner().expect("mutex guard");
+    results.sort_by_key(|(package, _, _)| *package);
 
-        emit_package(paths, package)?;
+    for (package, elapsed, result) in results {
+        result?;
+        timing.record(timing::Kind::EmitPackage(package.name.to_owned()), elapsed);
     }
 
+    mp.clear()?;
+
     manifest.write_binary()?;
     manifest.write_json()?;
 
@@ -136,11 +211,9 @@ pub fn emit(paths: &Paths, recipe: &Recipe, packages: &[Package<'_>]) -> Result<
     Ok(())
 }
 
-fn emit_package(paths: &Paths, package: &Package<'_>) -> Result<(), Error> {
-    let filename = package.filename();
-
-    // Filter for all files -> dedupe by hash -> sort largest to smallest
-    let files = package
+/// Distinct files of the package, largest to smallest
+fn content_files<'a>(package: &'a Package<'_>) -> Vec<(u128, &'a PathInfo)> {
+    package
         .analysis
         .paths
         .iter()
@@ -150,18 +223,33 @@ fn emit_package(paths: &Paths, package: &Package<'_>) -> Result<(), Error> {
         .unique_by(|(hash, _)| *hash)
         // Sort largest to smallest
         .sorted_by(|(_, a), (_, b)| a.size.cmp(&b.size).reverse())
-        .map(|(_, info)| info)
-        .collect::<Vec<_>>();
+        .collect()
+}
 
-    let total_file_size = files.iter().map(|info| info.size).sum();
+fn total_size(files: &[(u128, &PathInfo)]) -> u64 {
+    files.iter().map(|(_, info)| info.size).sum()
+}
 
-    let pb = ProgressBar::new(total_file_size)
-        .with_message(format!("Generating {filename}"))
-        .with_style(
-            ProgressStyle::with_template(" {spinner} |{percent:>3}%| {wide_msg} {binary_bytes_per_sec:>.dim} ")
-                .unwrap()
-                .tick_chars("--=≡■≡=--"),
-        );
+fn emit_package(
+    paths: &Paths,
+    package: &Package<'_>,
+    files: Vec<(u128, &PathInfo)>,
+    num_workers: u32,
+    mp: &MultiProgress,
+) -> Result<(), Error> {
+    let filename = package.filename();
+
+    let total_file_size = total_size(&files);
+
+    let pb = mp.add(
+        ProgressBar::new(total_file_size)
+            .with_message(format!("Generating {filename}"))
+            .with_style(
+                ProgressStyle::with_template(" {spinner} |{percent:>3}%| {wide_msg} {binary_bytes_per_sec:>.dim} ")
+                    .unwrap()
+                    .tick_chars("--=≡■≡=--"),
+            ),
+    );
     pb.enable_steady_tick(Duration::from_millis(150));
 
     // Output file to artefacts directory
@@ -169,7 +257,7 @@ fn emit_package(paths: &Paths, package: &Package<'_>) -> Result<(), Error> {
     if out_path.exists() {
         fs::remove_file(&out_path)?;
     }
-    let mut out_file = File::create(out_path)?;
+    let mut out_file = BufWriter::new(File::create(out_path)?);
 
     // Create stone binary writer
     let mut writer = stone::Writer::new(&mut out_file, stone::header::v1::FileType::Binary)?;
@@ -195,37 +283,40 @@ fn emit_package(paths: &Paths, package: &Package<'_>) -> Result<(), Error> {
 
     // Only add content payload if we have some files
     if !files.is_empty() {
-        // Temp file for building content payload
-        let temp_content_path = format!("/tmp/{}.tmp", &filename);
-        let mut temp_content = fs::OpenOptions::new()
-            .read(true)
-            .append(true)
-            .create(true)
-            .open(&temp_content_path)?;
-
-        // Convert to content writer using pledged size = total size of all files
-        let mut writer =
-            writer.with_content(&mut temp_content, Some(total_file_size), util::num_cpus().get() as u32)?;
-
-        for info in files {
+        // Analysis already hashed every file, so the index is known up front and
+        // content is compressed straight into the stone
+        let mut start = 0;
+        let indices = files
+            .iter()
+            .map(|(hash, info)| {
+                let index = Index {
+                    start,
+                    end: start + info.size,
+                    digest: *hash,
+                };
+                start = index.end;
+                index
+            })
+            .collect();
+
+        let mut writer = writer.with_framed_content(indices, CONTENT_FRAME_SIZE, num_workers)?;
+
+        for (_, info) in files {
             let file = File::open(&info.path)?;
             writer.add_content(&mut pb.wrap_read(&file))?;
         }
 
-        // Finalize & flush
         writer.finalize()?;
-        out_file.flush()?;
-
-        // Remove temp content file
-        fs::remove_file(temp_content_path)?;
     } else {
-        // Finalize & flush
         writer.finalize()?;
-        out_file.flush()?;
     }
 
-    pb.suspend(|| println!("{} {filename}", "Emitted".green()));
-    pb.finish_and_clear();
+    // Flush
+    out_file.flush()?;
+
+    pb.finish();
+    mp.remove(&pb);
+    mp.suspend(|| println!("{} {filename}", "Emitted".green()));
 
     Ok(())
 }
@@ -98,6 +98,11 @@ impl Paths {
         }
     }
 
+    /// Snapshots of populated roots, shared between recipes
+    pub fn snapshots(&self) -> PathBuf {
+        self.host_root.join("snapshots")
+    }
+
     pub fn recipe(&self) -> Mapping {
         Mapping {
             host: self.recipe_dir.clone(),
@@ -13,6 +13,7 @@ use fs_err as fs;
 use thiserror::Error;
 
 use crate::architecture::{self, BuildTarget};
+use crate::compiled;
 
 pub type Parsed = stone_recipe::Recipe;
 
@@ -25,10 +26,10 @@ pub struct Recipe {
 }
 
 impl Recipe {
-    pub fn load(path: impl AsRef<Path>) -> Result<Self, Error> {
+    pub fn load(path: impl AsRef<Path>, cache: &compiled::Cache) -> Result<Self, Error> {
         let path = resolve_path(path)?;
         let source = fs::read_to_string(&path)?;
-        let parsed = stone_recipe::from_str(&source)?;
+        let parsed = cache.load(source.as_bytes())?;
         let build_time = resolve_build_time(&path);
 
         Ok(Self {
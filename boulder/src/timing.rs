@@ -19,6 +19,7 @@ pub struct Timing {
     build: BTreeMap<BuildTarget, BTreeMap<Option<build::pgo::Stage>, BTreeMap<build::job::Phase, BuildEntry>>>,
     analyze: Duration,
     emit: Duration,
+    emit_packages: BTreeMap<String, Duration>,
 }
 
 impl Timing {
@@ -53,6 +54,9 @@ impl Timing {
             }
             Kind::Analyze => self.analyze = elapsed,
             Kind::Emit => self.emit = elapsed,
+            Kind::EmitPackage(name) => {
+                self.emit_packages.insert(name, elapsed);
+            }
         }
     }
 
@@ -73,7 +77,14 @@ impl Timing {
             // .max("Fetch".len())
             // .max("Analyze".len())
             // .max("Emit".len());
-            .max("Populate (moss)".len());
+            .max("Populate (moss)".len())
+            .max(
+                self.emit_packages
+                    .keys()
+                    .map(|name| name.len() + 1)
+                    .max()
+                    .unwrap_or_default(),
+            );
         let total_elapsed = self
             .build
             .values()
@@ -151,6 +162,19 @@ impl Timing {
             fmt_elapsed(self.emit),
             fmt_progress(self.emit, total_elapsed),
         );
+        // Packages are emitted concurrently, so these overlap within "Emit"
+        for (name, elapsed) in &self.emit_packages {
+            let gap = max_prefix_length - (name.len() + 1);
+
+            println!(
+                "│{}{}{}  {} {}",
+                "│".dim(),
+                name,
+                " ".repeat(gap),
+                fmt_elapsed(*elapsed),
+                fmt_progress(*elapsed, total_elapsed)
+            );
+        }
         println!(
             "{}",
             "─".repeat(1 + max_prefix_length + 2 + ELAPSED_WIDTH + 1 + PROGRESS_WIDTH),
@@ -180,12 +204,16 @@ pub enum Kind {
     Analyze,
     /// Emit artefacts
     Emit,
+    /// Emit a single package, within [`Kind::Emit`]
+    EmitPackage(String),
 }
 
 #[derive(Debug, PartialEq, Eq, PartialOrd, Ord, strum::Display)]
 pub enum Populate {
     /// Resolve DAG
     Resolve,
+    /// Restore & save root snapshots
+    Snapshot,
     /// Fetch packages
     Fetch,
     /// Blit packages
@@ -196,6 +224,7 @@ impl Populate {
     fn styled(&self) -> impl fmt::Display {
         match self {
             Populate::Resolve => self.to_string().cyan(),
+            Populate::Snapshot => self.to_string().magenta(),
             Populate::Fetch => self.to_string().blue(),
             Populate::Blit => self.to_string().green(),
         }
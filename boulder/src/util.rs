@@ -5,7 +5,7 @@
 use std::{
     io,
     num::NonZeroUsize,
-    os::unix::fs::symlink,
+    os::{fd::AsRawFd, unix::fs::symlink},
     path::{Path, PathBuf},
     thread,
 };
@@ -98,14 +98,34 @@ pub fn hardlink_or_copy(from: &Path, to: &Path) -> io::Result<()> {
     // Attempt hard link
     let link_result = linkat(None, from, None, to, LinkatFlags::NoSymlinkFollow);
 
-    // Copy instead
-    if link_result.is_err() {
+    // Reflink or copy instead
+    if link_result.is_err() && reflink(from, to).is_err() {
         fs::copy(from, to)?;
     }
 
     Ok(())
 }
 
+/// Clone the extents of `from` into a new file at `to`, on filesystems that support it
+pub fn reflink(from: &Path, to: &Path) -> io::Result<()> {
+    // _IOW(0x94, 9, int)
+    const FICLONE: nix::libc::c_ulong = 0x4004_9409;
+
+    let source = fs::File::open(from)?;
+    let target = fs::File::create(to)?;
+
+    let result = unsafe { nix::libc::ioctl(target.as_raw_fd(), FICLONE as _, source.as_raw_fd()) };
+
+    if result < 0 {
+        let error = io::Error::last_os_error();
+        drop(target);
+        let _ = fs::remove_file(to);
+        return Err(error);
+    }
+
+    Ok(())
+}
+
 pub fn uri_file_name(uri: &Url) -> &str {
     let path = uri.path();
 
@@ -28,6 +28,7 @@ mod idmap;
 pub struct Container {
     root: PathBuf,
     work_dir: Option<PathBuf>,
+    overlay: Option<Overlay>,
     binds: Vec<Bind>,
     networking: bool,
     hostname: Option<String>,
@@ -40,6 +41,7 @@ impl Container {
         Self {
             root: root.into(),
             work_dir: None,
+            overlay: None,
             binds: vec![],
             networking: false,
             hostname: None,
@@ -55,6 +57,27 @@ impl Container {
         }
     }
 
+    /// Mount the rootfs as an overlay of read-only `lower` dirs, in order of precedence,
+    /// with writes going to `upper`
+    ///
+    /// `work` must be an empty dir on the same filesystem as `upper`. Rootless containers
+    /// fall back to `fuse-overlayfs` when the kernel doesn't allow unprivileged overlays.
+    pub fn overlay(
+        self,
+        lower: impl IntoIterator<Item = impl Into<PathBuf>>,
+        upper: impl Into<PathBuf>,
+        work: impl Into<PathBuf>,
+    ) -> Self {
+        Self {
+            overlay: Some(Overlay {
+                lower: lower.into_iter().map(Into::into).collect(),
+                upper: upper.into(),
+                work: work.into(),
+            }),
+            ..self
+        }
+    }
+
     /// Create a read-write bind mount
     pub fn bind_rw(mut self, host: impl Into<PathBuf>, guest: impl Into<PathBuf>) -> Self {
         self.binds.push(Bind {
@@ -125,7 +148,7 @@ impl Container {
 
         let pid = unsafe {
             clone(
-                Box::new(|| match enter(&self, sync, &mut f) {
+                Box::new(|| match enter(&self, rootless, sync, &mut f) {
                     Ok(_) => 0,
                     // Write error back to parent process
                     Err(error) => {
@@ -200,7 +223,12 @@ impl Container {
 }
 
 /// Reenter the container
-fn enter<E>(container: &Container, sync: (i32, i32), mut f: impl FnMut() -> Result<(), E>) -> Result<(), ContainerError>
+fn enter<E>(
+    container: &Container,
+    rootless: bool,
+    sync: (i32, i32),
+    mut f: impl FnMut() -> Result<(), E>,
+) -> Result<(), ContainerError>
 where
     E: std::error::Error + 'static,
 {
@@ -215,13 +243,20 @@ where
     // Close unused read end
     close(sync.0).map_err(ContainerError::CloseReadFd)?;
 
-    setup(container)?;
+    setup(container, rootless)?;
 
     f().map_err(|e| ContainerError::Run(Box::new(e)))
 }
 
 /// Setup the container
-fn setup(container: &Container) -> Result<(), ContainerError> {
+fn setup(container: &Container, rootless: bool) -> Result<(), ContainerError> {
+    // Keep all mounts, including the overlay, from propagating to the host
+    add_mount(None, "/", None, MsFlags::MS_REC | MsFlags::MS_PRIVATE)?;
+
+    if let Some(overlay) = &container.overlay {
+        mount_overlay(&container.root, overlay, rootless)?;
+    }
+
     if container.networking {
         setup_networking(&container.root)?;
     }
@@ -247,7 +282,6 @@ fn pivot(root: &Path, binds: &[Bind]) -> Result<(), ContainerError> {
 
     let old_root = root.join(OLD_PATH);
 
-    add_mount(None, "/", None, MsFlags::MS_REC | MsFlags::MS_PRIVATE)?;
     add_mount(Some(root), root, None, MsFlags::MS_BIND)?;
 
     for bind in binds {
@@ -295,6 +329,103 @@ fn pivot(root: &Path, binds: &[Bind]) -> Result<(), ContainerError> {
     Ok(())
 }
 
+/// Mount the overlay at `root`
+fn mount_overlay(root: &Path, overlay: &Overlay, rootless: bool) -> Result<(), ContainerError> {
+    ensure_directory(&overlay.upper)?;
+    ensure_directory(&overlay.work)?;
+
+    let options = overlay_options(overlay)?;
+
+    ensure_directory(root)?;
+
+    let result = mount(
+        Some("overlay"),
+        root,
+        Some("overlay"),
+        MsFlags::empty(),
+        Some(kernel_overlay_options(&options, rootless).as_str()),
+    );
+
+    match overlay_mount(result, rootless) {
+        OverlayMount::Mounted => Ok(()),
+        OverlayMount::Fuse => {
+            let output = Command::new("fuse-overlayfs")
+                .arg("-o")
+                .arg(&options)
+                .arg(root)
+                .output()
+                .map_err(ContainerError::FuseOverlayfs)?;
+
+            if output.status.success() {
+                Ok(())
+            } else {
+                Err(ContainerError::FuseOverlayfsFailed(
+                    String::from_utf8_lossy(&output.stderr).trim().to_owned(),
+                ))
+            }
+        }
+        OverlayMount::Failed(err) => Err(ContainerError::Mount {
+            target: root.to_owned(),
+            err,
+        }),
+    }
+}
+
+/// Outcome of mounting an overlay through the kernel
+#[derive(Debug, PartialEq, Eq)]
+enum OverlayMount {
+    Mounted,
+    /// Retry through `fuse-overlayfs`
+    Fuse,
+    Failed(nix::Error),
+}
+
+/// Rootless containers fall back to `fuse-overlayfs` when the kernel refuses
+/// the overlay, i.e. before 5.11 or with unprivileged overlays disabled
+fn overlay_mount(result: nix::Result<()>, rootless: bool) -> OverlayMount {
+    match result {
+        Ok(()) => OverlayMount::Mounted,
+        Err(_) if rootless => OverlayMount::Fuse,
+        Err(err) => OverlayMount::Failed(err),
+    }
+}
+
+/// Mount options shared by the kernel overlay & `fuse-overlayfs`
+fn overlay_options(overlay: &Overlay) -> Result<String, ContainerError> {
+    let mut dirs = Vec::with_capacity(overlay.lower.len());
+    for dir in &overlay.lower {
+        dirs.push(overlay_path(dir)?);
+    }
+
+    Ok(format!(
+        "lowerdir={},upperdir={},workdir={}",
+        dirs.join(":"),
+        overlay_path(&overlay.upper)?,
+        overlay_path(&overlay.work)?,
+    ))
+}
+
+/// Unprivileged overlays can't use trusted xattrs, which `fuse-overlayfs` doesn't accept
+fn kernel_overlay_options(options: &str, rootless: bool) -> String {
+    if rootless {
+        format!("{options},userxattr")
+    } else {
+        options.to_owned()
+    }
+}
+
+/// Canonicalize an overlay dir, rejecting characters that delimit the mount options
+fn overlay_path(path: &Path) -> Result<String, ContainerError> {
+    let path = path.fs_err_canonicalize()?;
+    let path = path.to_string_lossy();
+
+    if path.contains([':', ',']) {
+        return Err(ContainerError::OverlayPath(path.into_owned()));
+    }
+
+    Ok(path.into_owned())
+}
+
 fn setup_networking(root: &Path) -> Result<(), ContainerError> {
     ensure_directory(root.join("etc"))?;
     fs::copy("/etc/resolv.conf", root.join("etc/resolv.conf"))?;
@@ -428,6 +559,12 @@ fn sources(error: &dyn std::error::Error) -> Vec<String> {
     sources
 }
 
+struct Overlay {
+    lower: Vec<PathBuf>,
+    upper: PathBuf,
+    work: PathBuf,
+}
+
 struct Bind {
     source: PathBuf,
     target: PathBuf,
@@ -470,6 +607,12 @@ enum ContainerError {
     PivotRoot(#[source] nix::Error),
     #[error("unmount old root")]
     UnmountOldRoot(#[source] nix::Error),
+    #[error("overlay dir contains `:` or `,`: {0}")]
+    OverlayPath(String),
+    #[error("spawn fuse-overlayfs")]
+    FuseOverlayfs(#[source] io::Error),
+    #[error("fuse-overlayfs: {0}")]
+    FuseOverlayfsFailed(String),
     #[error("mount {}", target.display())]
     Mount {
         target: PathBuf,
@@ -482,3 +625,59 @@ enum ContainerError {
 enum Message {
     Continue = 1,
 }
+
+#[cfg(test)]
+mod test {
+    use nix::errno::Errno;
+
+    use super::*;
+
+    #[test]
+    fn overlay_mount_options() {
+        let dir = std::env::temp_dir().join(format!("container-overlay-test-{}", std::process::id()));
+        for name in ["base", "snapshot", "upper", "work", "bad,dir"] {
+            fs::create_dir_all(dir.join(name)).unwrap();
+        }
+        let dir = dir.fs_err_canonicalize().unwrap();
+        let path = |name: &str| dir.join(name).display().to_string();
+
+        let mut overlay = Overlay {
+            lower: vec![dir.join("snapshot"), dir.join("base")],
+            upper: dir.join("upper"),
+            work: dir.join("work"),
+        };
+
+        // Lower dirs keep their order of precedence
+        let options = overlay_options(&overlay).unwrap();
+        assert_eq!(
+            options,
+            format!(
+                "lowerdir={}:{},upperdir={},workdir={}",
+                path("snapshot"),
+                path("base"),
+                path("upper"),
+                path("work")
+            )
+        );
+
+        assert_eq!(kernel_overlay_options(&options, false), options);
+        assert_eq!(kernel_overlay_options(&options, true), format!("{options},userxattr"));
+
+        // Delimiters would split the options
+        overlay.lower.push(dir.join("bad,dir"));
+        assert!(matches!(overlay_options(&overlay), Err(ContainerError::OverlayPath(_))));
+
+        fs::remove_dir_all(&dir).unwrap();
+    }
+
+    #[test]
+    fn overlay_fallback() {
+        assert_eq!(overlay_mount(Ok(()), false), OverlayMount::Mounted);
+        assert_eq!(overlay_mount(Ok(()), true), OverlayMount::Mounted);
+        assert_eq!(overlay_mount(Err(Errno::EPERM), true), OverlayMount::Fuse);
+        assert_eq!(
+            overlay_mount(Err(Errno::EPERM), false),
+            OverlayMount::Failed(Errno::EPERM)
+        );
+    }
+}
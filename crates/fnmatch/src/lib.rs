@@ -5,7 +5,8 @@
 //! Use fnmatch to generate regex matchers from glob-style strings.
 //!
 //! This crate extends the conventional `glob` style strings to add matching groups
-//! by compiling to an internal [Regex].
+//! by compiling to an internal [Regex]. Many patterns may be matched at once
+//! through a [PatternSet].
 //!
 //!
 //! # Example
@@ -17,7 +18,7 @@
 use std::collections::{BTreeMap, BTreeSet};
 use std::str::FromStr;
 
-use regex::Regex;
+use regex::{Regex, RegexSet};
 use serde::{de, Deserialize};
 use thiserror::Error;
 
@@ -101,6 +102,8 @@ pub struct Pattern {
     pattern: String,
     regex: Regex,
     groups: Vec<String>,
+    /// Literal text every matching path starts with
+    prefix: String,
 }
 
 /// Path match for a [Pattern]
@@ -141,6 +144,73 @@ impl Pattern {
     pub fn groups(&self) -> Vec<String> {
         self.groups.clone()
     }
+
+    /// Whether the pattern captures any variables
+    pub fn has_groups(&self) -> bool {
+        !self.groups.is_empty()
+    }
+
+    /// Literal prefix shared by every path this pattern matches
+    pub fn prefix(&self) -> &str {
+        &self.prefix
+    }
+}
+
+/// A set of [Pattern]s compiled into a single matcher
+///
+/// Paths are tested against all patterns in one pass, after a cheap
+/// check against the literal prefixes of the patterns (i.e. `/usr/lib/modules/`)
+/// rejects paths no pattern can match.
+#[derive(Debug, Clone)]
+pub struct PatternSet {
+    patterns: Vec<Pattern>,
+    set: RegexSet,
+    /// Distinct literal prefixes, none of which starts with another
+    prefixes: Vec<String>,
+}
+
+impl PatternSet {
+    pub fn new(patterns: impl IntoIterator<Item = Pattern>) -> Result<Self, Error> {
+        let patterns = patterns.into_iter().collect::<Vec<_>>();
+        let set = RegexSet::new(patterns.iter().map(|pattern| pattern.regex.as_str()))?;
+
+        // Sorted, a prefix is always directly followed by those it covers
+        let mut prefixes = patterns
+            .iter()
+            .map(|pattern| pattern.prefix.clone())
+            .collect::<BTreeSet<_>>()
+            .into_iter()
+            .collect::<Vec<_>>();
+        prefixes.dedup_by(|prefix, shorter| prefix.starts_with(shorter.as_str()));
+
+        Ok(Self {
+            patterns,
+            set,
+            prefixes,
+        })
+    }
+
+    /// The patterns of this set, in the order they were given
+    pub fn patterns(&self) -> &[Pattern] {
+        &self.patterns
+    }
+
+    /// Indices of all patterns matching `path`, ascending
+    pub fn matches(&self, path: &str) -> Vec<usize> {
+        if !self.prefixes.iter().any(|prefix| path.starts_with(prefix.as_str())) {
+            return vec![];
+        }
+
+        self.set.matches(path).into_iter().collect()
+    }
+
+    /// [Match] of every pattern matching `path`, with the pattern index
+    pub fn match_path(&self, path: &str) -> Vec<(usize, Match)> {
+        self.matches(path)
+            .into_iter()
+            .filter_map(|index| Some((index, self.patterns[index].match_path(path)?)))
+            .collect()
+    }
 }
 
 /// [thiserror] compatible Error
@@ -233,6 +303,39 @@ fn fragment_to_regex_str(fragment: &Fragment) -> (String, Vec<String>) {
     (string, groups)
 }
 
+/// Leading text of the fragments which matches only itself
+fn literal_prefix(fragments: &[Fragment]) -> String {
+    let mut prefix = String::new();
+
+    for fragment in fragments {
+        match fragment {
+            Fragment::ForwardSlash => prefix.push('/'),
+            Fragment::Dot => prefix.push('.'),
+            Fragment::Text(text) => {
+                // Text is passed to the regex as is, so stop at anything it treats specially
+                let literal = text
+                    .find(|c: char| regex_syntax_char(c))
+                    .map_or(text.as_str(), |end| &text[..end]);
+                prefix.push_str(literal);
+
+                if literal.len() != text.len() {
+                    break;
+                }
+            }
+            Fragment::MatchOne | Fragment::MatchAny | Fragment::BackSlash | Fragment::Group(..) => break,
+        }
+    }
+
+    prefix
+}
+
+fn regex_syntax_char(c: char) -> bool {
+    matches!(
+        c,
+        '\\' | '.' | '+' | '*' | '?' | '(' | ')' | '|' | '[' | ']' | '{' | '}' | '^' | '$'
+    )
+}
+
 impl FromStr for Pattern {
     type Err = Error;
 
@@ -253,6 +356,7 @@ impl FromStr for Pattern {
             pattern: s.into(),
             regex: Regex::new(&format!("^{compiled}$"))?,
             groups: groups.into_iter().collect(),
+            prefix: literal_prefix(&fragments),
         })
     }
 }
@@ -294,7 +398,7 @@ impl Ord for Pattern {
 
 #[cfg(test)]
 pub mod path_tests {
-    use super::Pattern;
+    use super::{Pattern, PatternSet};
 
     /// test me
     #[test]
@@ -312,4 +416,44 @@ pub mod path_tests {
         let wide = k.match_path("/usr/lib/modules/6.6.67-51.kvm/kernel/net/netfilter/nft_hash.ko.zst");
         assert!(wide.is_none());
     }
+
+    #[test]
+    fn test_pattern_set() {
+        let patterns = [
+            "/usr/lib/modules/(version:*)/*",
+            "/usr/lib/*.so",
+            "/usr/share/icons/*",
+            "/usr/lib/modules/(version:*)",
+        ]
+        .map(|pattern| pattern.parse::<Pattern>().unwrap());
+        assert_eq!(patterns[0].prefix(), "/usr/lib/modules/");
+        assert_eq!(patterns[1].prefix(), "/usr/lib/");
+
+        let set = PatternSet::new(patterns.clone()).unwrap();
+        assert_eq!(set.prefixes, ["/usr/lib/", "/usr/share/icons/"]);
+
+        let matches = set.match_path("/usr/lib/modules/6.2.6/modules.symbols");
+        assert_eq!(matches.len(), 1);
+        assert_eq!(matches[0].0, 0);
+        assert_eq!(matches[0].1.variables.get("version").unwrap(), "6.2.6");
+
+        assert_eq!(set.matches("/usr/lib/libz.so"), [1]);
+        assert_eq!(set.matches("/usr/lib/modules/6.2.6"), [3]);
+        assert!(set.matches("/usr/bin/bash").is_empty());
+
+        // Same results as matching each pattern on its own
+        for path in [
+            "/usr/lib/modules/6.2.6/kernel",
+            "/usr/share/icons/hicolor",
+            "/etc/fstab",
+        ] {
+            let expected = patterns
+                .iter()
+                .enumerate()
+                .filter(|(_, pattern)| pattern.match_path(path).is_some())
+                .map(|(index, _)| index)
+                .collect::<Vec<_>>();
+            assert_eq!(set.matches(path), expected);
+        }
+    }
 }
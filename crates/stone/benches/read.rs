@@ -9,6 +9,7 @@ use std::{
 };
 
 use criterion::{black_box, criterion_group, criterion_main, Criterion};
+use stone::payload::Kind;
 
 fn read_unbuffered(path: impl AsRef<Path>) {
     read(File::open(path).unwrap());
@@ -28,6 +29,56 @@ fn read<R: Read + Seek>(reader: R) {
     }
 }
 
+fn read_mapped(path: impl AsRef<Path>) {
+    let stone = stone::Mapped::open(&File::open(path).unwrap()).unwrap();
+
+    for payload in stone.payloads() {
+        let payload = payload.unwrap();
+
+        match payload.header.kind {
+            Kind::Content => payload.unpack_content(&mut sink()).unwrap(),
+            _ => {
+                let body = payload.decode().unwrap();
+                black_box(body.meta().into_iter().flatten().count());
+                black_box(body.layout().into_iter().flatten().count());
+                black_box(body.index().into_iter().flatten().count());
+                black_box(body.attributes().into_iter().flatten().count());
+            }
+        }
+    }
+}
+
+fn layouts_buffered(path: impl AsRef<Path>) {
+    let mut stone = stone::read(BufReader::new(File::open(path).unwrap())).unwrap();
+
+    for payload in stone.payloads().unwrap() {
+        if let Some(layouts) = payload.unwrap().layout() {
+            black_box(
+                layouts
+                    .body
+                    .iter()
+                    .map(|layout| layout.entry.target().len())
+                    .sum::<usize>(),
+            );
+        }
+    }
+}
+
+fn layouts_mapped(path: impl AsRef<Path>) {
+    let stone = stone::Mapped::open(&File::open(path).unwrap()).unwrap();
+
+    for payload in stone.payloads_of(Kind::Layout) {
+        let body = payload.unwrap().decode().unwrap();
+        black_box(
+            body.layout()
+                .into_iter()
+                .flatten()
+                .map(|layout| layout.unwrap().entry.target().len())
+                .sum::<usize>(),
+        );
+    }
+}
+
 fn criterion_benchmark(c: &mut Criterion) {
     c.bench_function("read unbuffered", |b| {
         b.iter(|| read_unbuffered(black_box("../test/bash-completion-2.11-1-1-x86_64.stone")));
@@ -35,6 +86,15 @@ fn criterion_benchmark(c: &mut Criterion) {
     c.bench_function("read buffered", |b| {
         b.iter(|| read_buffered(black_box("../test/bash-completion-2.11-1-1-x86_64.stone")));
     });
+    c.bench_function("read mapped", |b| {
+        b.iter(|| read_mapped(black_box("../test/bash-completion-2.11-1-1-x86_64.stone")));
+    });
+    c.bench_function("layouts buffered", |b| {
+        b.iter(|| layouts_buffered(black_box("../test/bash-completion-2.11-1-1-x86_64.stone")));
+    });
+    c.bench_function("layouts mapped", |b| {
+        b.iter(|| layouts_mapped(black_box("../test/bash-completion-2.11-1-1-x86_64.stone")));
+    });
 }
 
 criterion_group!(benches, criterion_benchmark);
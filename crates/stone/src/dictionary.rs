@@ -0,0 +1,76 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Trained zstd dictionaries for small payloads
+//!
+//! Meta, layout and index payloads are small, repetitive records, so most of
+//! their redundancy is left in place when each is compressed on its own. A
+//! [`Dictionary`] trained on a corpus of them is shared out of band instead.
+//! Payloads compressed with one are marked [`Compression::ZstdDictionary`],
+//! and their zstd frame header references the dictionary by its id.
+//!
+//! [`Compression::ZstdDictionary`]: crate::payload::Compression::ZstdDictionary
+
+use std::{fmt, io, num::NonZeroU32, sync::Arc};
+
+use thiserror::Error;
+use zstd::dict::DecoderDictionary;
+
+/// Default size limit for [`Dictionary::train`], same as zstd's own
+pub const MAX_SIZE: usize = 110 * 1024;
+
+/// A zstd dictionary, prepared once for decoding and cheap to clone
+#[derive(Clone)]
+pub struct Dictionary(Arc<Inner>);
+
+struct Inner {
+    id: NonZeroU32,
+    data: Vec<u8>,
+    decoder: DecoderDictionary<'static>,
+}
+
+impl Dictionary {
+    pub fn new(data: Vec<u8>) -> Result<Self, Error> {
+        // Raw content dictionaries have no id to reference them by
+        let id = zstd::zstd_safe::get_dict_id(&data).ok_or(Error::Invalid)?;
+        let decoder = DecoderDictionary::copy(&data);
+
+        Ok(Self(Arc::new(Inner { id, data, decoder })))
+    }
+
+    /// Train a dictionary of up to `max_size` bytes from the plain bytes of sample payloads
+    pub fn train<S: AsRef<[u8]>>(samples: &[S], max_size: usize) -> Result<Self, Error> {
+        Self::new(zstd::dict::from_samples(samples, max_size).map_err(Error::Train)?)
+    }
+
+    pub fn id(&self) -> u32 {
+        self.0.id.get()
+    }
+
+    /// Encoded dictionary, as passed to [`Dictionary::new`]
+    pub fn as_bytes(&self) -> &[u8] {
+        &self.0.data
+    }
+
+    pub(crate) fn decoder(&self) -> &DecoderDictionary<'static> {
+        &self.0.decoder
+    }
+}
+
+impl fmt::Debug for Dictionary {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_struct("Dictionary")
+            .field("id", &self.id())
+            .field("size", &self.0.data.len())
+            .finish()
+    }
+}
+
+#[derive(Debug, Error)]
+pub enum Error {
+    #[error("not a zstd dictionary")]
+    Invalid,
+    #[error("train dictionary")]
+    Train(#[source] io::Error),
+}
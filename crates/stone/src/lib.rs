@@ -4,14 +4,16 @@
 
 use std::io::{Read, Result, Write};
 
+pub mod dictionary;
 pub mod header;
 pub mod payload;
 pub mod read;
 pub mod write;
 
+pub use self::dictionary::Dictionary;
 pub use self::header::Header;
 pub use self::payload::Payload;
-pub use self::read::{read, read_bytes, Reader};
+pub use self::read::{read, read_bytes, Mapped, Reader};
 pub use self::write::Writer;
 
 pub trait ReadExt: Read {
@@ -178,4 +180,215 @@ mod test {
             out_stone.len()
         );
     }
+
+    #[test]
+    fn indexed_content() {
+        let in_stone = include_bytes!("../../../test/bash-completion-2.11-1-1-x86_64.stone");
+
+        let mut reader = read_bytes(in_stone).unwrap();
+
+        let payloads = reader
+            .payloads()
+            .unwrap()
+            .collect::<std::result::Result<Vec<_>, _>>()
+            .unwrap();
+        let meta = payloads.iter().find_map(read::PayloadKind::meta).unwrap();
+        let indices = payloads.iter().find_map(read::PayloadKind::index).unwrap();
+        let content = payloads.iter().find_map(read::PayloadKind::content).unwrap();
+
+        let mut content_buffer = vec![];
+        reader.unpack_content(content, &mut content_buffer).unwrap();
+
+        let files = indices
+            .body
+            .iter()
+            .map(|index| &content_buffer[index.start as usize..index.end as usize])
+            .collect::<Vec<_>>();
+
+        // Buffered
+        let mut buffered = vec![];
+        let mut writer = Writer::new(&mut buffered, header::v1::FileType::Binary)
+            .unwrap()
+            .with_content(Cursor::new(vec![]), Some(content_buffer.len() as u64), 0)
+            .unwrap();
+        writer.add_payload(meta.body.as_slice()).unwrap();
+        for mut file in files.iter().copied() {
+            writer.add_content(&mut file).unwrap();
+        }
+        writer.finalize().unwrap();
+
+        // Streamed
+        let mut streamed = Cursor::new(vec![]);
+        let mut writer = Writer::new(&mut streamed, header::v1::FileType::Binary).unwrap();
+        writer.add_payload(meta.body.as_slice()).unwrap();
+        let mut writer = writer.with_indexed_content(indices.body.clone(), 0).unwrap();
+        for mut file in files.iter().copied() {
+            writer.add_content(&mut file).unwrap();
+        }
+        writer.finalize().unwrap();
+
+        assert_eq!(streamed.into_inner(), buffered);
+
+        // Content must match the index
+        let mut writer = Writer::new(Cursor::new(vec![]), header::v1::FileType::Binary)
+            .unwrap()
+            .with_indexed_content(indices.body.clone(), 0)
+            .unwrap();
+        assert!(writer.add_content(&mut &files[0][1..]).is_err());
+    }
+
+    #[test]
+    fn framed_content() {
+        let in_stone = include_bytes!("../../../test/bash-completion-2.11-1-1-x86_64.stone");
+
+        let mut reader = read_bytes(in_stone).unwrap();
+
+        let payloads = reader
+            .payloads()
+            .unwrap()
+            .collect::<std::result::Result<Vec<_>, _>>()
+            .unwrap();
+        let indices = payloads.iter().find_map(read::PayloadKind::index).unwrap();
+        let content = payloads.iter().find_map(read::PayloadKind::content).unwrap();
+
+        let mut content_buffer = vec![];
+        reader.unpack_content(content, &mut content_buffer).unwrap();
+
+        let mut framed = Cursor::new(vec![]);
+        let mut writer = Writer::new(&mut framed, header::v1::FileType::Binary)
+            .unwrap()
+            .with_framed_content(indices.body.clone(), 16 * 1024, 0)
+            .unwrap();
+        for index in &indices.body {
+            writer
+                .add_content(&mut &content_buffer[index.start as usize..index.end as usize])
+                .unwrap();
+        }
+        writer.finalize().unwrap();
+
+        let framed = framed.into_inner();
+        let mut reader = read_bytes(&framed).unwrap();
+        let payloads = reader
+            .payloads()
+            .unwrap()
+            .collect::<std::result::Result<Vec<_>, _>>()
+            .unwrap();
+        let content = payloads.iter().find_map(read::PayloadKind::content).unwrap();
+        let seek_table = content.body.seek_table().unwrap().clone();
+
+        assert_eq!(content.header.version, payload::content::VERSION);
+        assert!(seek_table.frames().len() > 1);
+
+        // Still readable as a single stream
+        let mut unpacked = vec![];
+        reader.unpack_content(content, &mut unpacked).unwrap();
+        assert_eq!(unpacked, content_buffer);
+
+        // Or frame by frame
+        let mut unpacked = vec![];
+        for frame in seek_table.frames() {
+            reader.unpack_frame(content, frame, &mut unpacked).unwrap();
+        }
+        assert_eq!(unpacked, content_buffer);
+
+        let mapped = Mapped::new(framed.as_slice()).unwrap();
+        let raw = mapped.payloads_of(payload::Kind::Content).next().unwrap().unwrap();
+        assert_eq!(raw.seek_table().unwrap(), Some(seek_table.clone()));
+
+        let mut unpacked = vec![];
+        for frame in seek_table.frames() {
+            raw.unpack_frame(frame, &mut unpacked).unwrap();
+        }
+        assert_eq!(unpacked, content_buffer);
+
+        // Or across workers, also with more workers than frames
+        for threads in [1, 3, 64] {
+            let mut unpacked = vec![];
+            raw.unpack_content_parallel(&mut unpacked, threads.try_into().unwrap())
+                .unwrap();
+            assert_eq!(unpacked, content_buffer);
+        }
+
+        // Workers stop once the output fails
+        let mut full = [0; 1];
+        assert!(raw
+            .unpack_content_parallel(&mut full.as_mut_slice(), 3.try_into().unwrap())
+            .is_err());
+
+        for index in &indices.body {
+            let mut entry = vec![];
+            reader.unpack_entry(content, index, &mut entry).unwrap();
+            assert_eq!(entry, &content_buffer[index.start as usize..index.end as usize]);
+        }
+    }
+
+    #[test]
+    fn dictionary() {
+        let mut reader = read_bytes(include_bytes!("../../../test/bash-completion-2.11-1-1-x86_64.stone")).unwrap();
+
+        let payloads = reader
+            .payloads()
+            .unwrap()
+            .collect::<std::result::Result<Vec<_>, _>>()
+            .unwrap();
+        let layouts = payloads.iter().find_map(read::PayloadKind::layout).unwrap();
+
+        let samples = layouts
+            .body
+            .chunks(4)
+            .map(|chunk| {
+                let mut sample = vec![];
+                payload::encode_records(&mut sample, chunk).unwrap();
+                sample
+            })
+            .collect::<Vec<_>>();
+        let dictionary = Dictionary::train(&samples, 16 * 1024).unwrap();
+
+        let write = |dictionary: Option<&Dictionary>| {
+            let mut out = vec![];
+            let mut writer = Writer::new(&mut out, header::v1::FileType::Binary).unwrap();
+            if let Some(dictionary) = dictionary {
+                writer = writer.with_dictionary(dictionary).unwrap();
+            }
+            for chunk in layouts.body.chunks(4) {
+                writer.add_payload(chunk).unwrap();
+            }
+            writer.finalize().unwrap();
+            out
+        };
+        let plain = write(None);
+        let trained = write(Some(&dictionary));
+
+        assert!(trained.len() < plain.len());
+
+        // Payloads can't be decoded without it
+        let mut reader = read_bytes(&trained).unwrap();
+        assert!(matches!(
+            reader.payloads().unwrap().next(),
+            Some(Err(read::Error::MissingDictionary))
+        ));
+
+        let mut reader = read_bytes(&trained).unwrap().with_dictionary(dictionary.clone());
+        let decoded = reader
+            .payloads()
+            .unwrap()
+            .flat_map(|payload| payload.unwrap().layout().unwrap().body.clone())
+            .collect::<Vec<_>>();
+        assert_eq!(&decoded, &layouts.body);
+
+        assert!(Mapped::new(plain.as_slice())
+            .unwrap()
+            .payloads()
+            .all(|payload| payload.unwrap().dictionary_id().is_none()));
+
+        let mapped = Mapped::new(trained.as_slice())
+            .unwrap()
+            .with_dictionary(dictionary.clone());
+        for payload in mapped.payloads() {
+            let payload = payload.unwrap();
+            assert_eq!(payload.header.compression, payload::Compression::ZstdDictionary);
+            assert_eq!(payload.dictionary_id(), Some(dictionary.id()));
+            assert!(payload.decode().unwrap().layout().unwrap().all(|layout| layout.is_ok()));
+        }
+    }
 }
@@ -0,0 +1,175 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Framed encoding of the content payload
+//!
+//! A version 2 content payload is a sequence of independently compressed zstd
+//! frames, each holding whole [`Index`](super::Index) entries, followed by a
+//! [`SeekTable`] stored in a zstd skippable frame. Decoders skip that frame, so
+//! to a version 1 reader the payload is still one valid zstd stream.
+
+use std::io::{Read, Write};
+use std::ops::Range;
+
+use super::{DecodeError, EncodeError};
+use crate::{ReadExt, WriteExt};
+
+/// Payload version of the framed content encoding
+pub const VERSION: u16 = 2;
+
+/// Skippable frame magic, see RFC 8878 section 3.1.2
+const MAGIC: u32 = 0x184D_2A5D;
+
+/// Magic + frame size, both little endian per the zstd format
+const FRAME_HEADER_SIZE: usize = 4 + 4;
+const ENTRY_SIZE: usize = 8 + 8;
+/// Trailing bytes of a framed payload, holding the number of frames
+pub const FOOTER_SIZE: usize = 4;
+
+/// A single zstd frame of content
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Frame {
+    /// Range within the decompressed content
+    pub plain: Range<u64>,
+    /// Range within the stored payload
+    pub stored: Range<u64>,
+}
+
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct SeekTable {
+    frames: Vec<Frame>,
+}
+
+impl SeekTable {
+    /// Append the next frame of the given sizes
+    pub fn push(&mut self, plain_size: u64, stored_size: u64) {
+        let (plain, stored) = self
+            .frames
+            .last()
+            .map_or((0, 0), |frame| (frame.plain.end, frame.stored.end));
+
+        self.frames.push(Frame {
+            plain: plain..plain + plain_size,
+            stored: stored..stored + stored_size,
+        });
+    }
+
+    pub fn frames(&self) -> &[Frame] {
+        &self.frames
+    }
+
+    /// Position of the frame holding the content `offset`
+    pub fn position(&self, offset: u64) -> Option<usize> {
+        let position = self.frames.partition_point(|frame| frame.plain.end <= offset);
+
+        // Trailing empty entries sit at the end of the last frame
+        if position == self.frames.len() && self.frames.last()?.plain.end == offset {
+            return Some(position - 1);
+        }
+
+        (position < self.frames.len()).then_some(position)
+    }
+
+    /// Size of the encoded table, including its skippable frame header
+    pub fn size(&self) -> usize {
+        Self::size_of(self.frames.len())
+    }
+
+    fn size_of(num_frames: usize) -> usize {
+        FRAME_HEADER_SIZE + num_frames * ENTRY_SIZE + FOOTER_SIZE
+    }
+
+    /// Size of the table ending in `footer`, the trailing bytes of a
+    /// payload, to know how many bytes to read for [`SeekTable::decode`]
+    pub fn encoded_size(footer: [u8; FOOTER_SIZE]) -> usize {
+        Self::size_of(u32::from_be_bytes(footer) as usize)
+    }
+
+    pub fn decode<R: Read>(mut reader: R) -> Result<Self, DecodeError> {
+        let magic = u32::from_le_bytes(reader.read_array()?);
+        let frame_size = u32::from_le_bytes(reader.read_array()?) as usize;
+
+        if magic != MAGIC || frame_size < FOOTER_SIZE || (frame_size - FOOTER_SIZE) % ENTRY_SIZE != 0 {
+            return Err(DecodeError::InvalidSeekTable);
+        }
+
+        let mut table = Self::default();
+
+        for _ in 0..(frame_size - FOOTER_SIZE) / ENTRY_SIZE {
+            let stored_size = reader.read_u64()?;
+            let plain_size = reader.read_u64()?;
+            table.push(plain_size, stored_size);
+        }
+
+        if reader.read_u32()? as usize != table.frames.len() {
+            return Err(DecodeError::InvalidSeekTable);
+        }
+
+        Ok(table)
+    }
+
+    pub fn encode<W: Write>(&self, writer: &mut W) -> Result<(), EncodeError> {
+        writer.write_array(MAGIC.to_le_bytes())?;
+        writer.write_array(((self.size() - FRAME_HEADER_SIZE) as u32).to_le_bytes())?;
+
+        for frame in &self.frames {
+            writer.write_u64(frame.stored.end - frame.stored.start)?;
+            writer.write_u64(frame.plain.end - frame.plain.start)?;
+        }
+
+        writer.write_u32(self.frames.len() as u32)?;
+
+        Ok(())
+    }
+
+    /// Ensure the table describes a payload of the given sizes, where
+    /// `stored_size` includes the table itself
+    pub fn validate(&self, plain_size: u64, stored_size: u64) -> Result<(), DecodeError> {
+        let (plain, stored) = self
+            .frames
+            .last()
+            .map_or((0, 0), |frame| (frame.plain.end, frame.stored.end));
+
+        if plain != plain_size || stored + self.size() as u64 != stored_size {
+            return Err(DecodeError::InvalidSeekTable);
+        }
+
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn roundtrip() {
+        let mut table = SeekTable::default();
+        table.push(10, 4);
+        table.push(0, 9);
+        table.push(5, 3);
+
+        let mut encoded = vec![];
+        table.encode(&mut encoded).unwrap();
+        assert_eq!(encoded.len(), table.size());
+        assert_eq!(
+            SeekTable::encoded_size(encoded[encoded.len() - 4..].try_into().unwrap()),
+            table.size()
+        );
+
+        let decoded = SeekTable::decode(encoded.as_slice()).unwrap();
+        assert_eq!(decoded, table);
+        assert!(decoded.validate(15, 16 + table.size() as u64).is_ok());
+        assert!(decoded.validate(15, 16).is_err());
+
+        assert_eq!(decoded.frames()[2].stored, 13..16);
+        assert_eq!(decoded.position(9), Some(0));
+        assert_eq!(decoded.position(10), Some(2));
+        assert_eq!(decoded.position(15), Some(2));
+        assert_eq!(decoded.position(16), None);
+
+        encoded[0] ^= 1;
+        assert!(SeekTable::decode(encoded.as_slice()).is_err());
+    }
+}
@@ -34,6 +34,22 @@ pub enum FileType {
     Socket,
 }
 
+impl FileType {
+    pub(crate) fn decode(i: u8) -> Result<Self, DecodeError> {
+        let result = match i {
+            1 => FileType::Regular,
+            2 => FileType::Symlink,
+            3 => FileType::Directory,
+            4 => FileType::CharacterDevice,
+            5 => FileType::BlockDevice,
+            6 => FileType::Fifo,
+            7 => FileType::Socket,
+            _ => return Err(DecodeError::UnknownFileType(i)),
+        };
+        Ok(result)
+    }
+}
+
 #[derive(Debug, Clone, PartialEq, Eq)]
 pub enum Entry {
     Regular(u128, String),
@@ -106,16 +122,7 @@ impl Record for Layout {
         let target_length = reader.read_u16()?;
         let sanitize = |s: String| s.trim_end_matches('\0').to_owned();
 
-        let file_type = match reader.read_u8()? {
-            1 => FileType::Regular,
-            2 => FileType::Symlink,
-            3 => FileType::Directory,
-            4 => FileType::CharacterDevice,
-            5 => FileType::BlockDevice,
-            6 => FileType::Fifo,
-            7 => FileType::Socket,
-            t => return Err(DecodeError::UnknownFileType(t)),
-        };
+        let file_type = FileType::decode(reader.read_u8()?)?;
 
         let _padding = reader.read_array::<11>()?;
 
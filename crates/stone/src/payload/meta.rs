@@ -134,8 +134,36 @@ pub enum Tag {
     SourceRef = 20,
 }
 
+/// Helper to decode a meta record's encoded tag
+pub(crate) fn decode_tag(i: u16) -> Result<Tag, DecodeError> {
+    let result = match i {
+        1 => Tag::Name,
+        2 => Tag::Architecture,
+        3 => Tag::Version,
+        4 => Tag::Summary,
+        5 => Tag::Description,
+        6 => Tag::Homepage,
+        7 => Tag::SourceID,
+        8 => Tag::Depends,
+        9 => Tag::Provides,
+        10 => Tag::Conflicts,
+        11 => Tag::Release,
+        12 => Tag::License,
+        13 => Tag::BuildRelease,
+        14 => Tag::PackageURI,
+        15 => Tag::PackageHash,
+        16 => Tag::PackageSize,
+        17 => Tag::BuildDepends,
+        18 => Tag::SourceURI,
+        19 => Tag::SourcePath,
+        20 => Tag::SourceRef,
+        _ => return Err(DecodeError::UnknownMetaTag(i)),
+    };
+    Ok(result)
+}
+
 /// Helper to decode a dependency's encoded kind
-fn decode_dependency(i: u8) -> Result<Dependency, DecodeError> {
+pub(crate) fn decode_dependency(i: u8) -> Result<Dependency, DecodeError> {
     let result = match i {
         0 => Dependency::PackageName,
         1 => Dependency::SharedLibrary,
@@ -155,29 +183,7 @@ impl Record for Meta {
     fn decode<R: Read>(mut reader: R) -> Result<Self, DecodeError> {
         let length = reader.read_u32()?;
 
-        let tag = match reader.read_u16()? {
-            1 => Tag::Name,
-            2 => Tag::Architecture,
-            3 => Tag::Version,
-            4 => Tag::Summary,
-            5 => Tag::Description,
-            6 => Tag::Homepage,
-            7 => Tag::SourceID,
-            8 => Tag::Depends,
-            9 => Tag::Provides,
-            10 => Tag::Conflicts,
-            11 => Tag::Release,
-            12 => Tag::License,
-            13 => Tag::BuildRelease,
-            14 => Tag::PackageURI,
-            15 => Tag::PackageHash,
-            16 => Tag::PackageSize,
-            17 => Tag::BuildDepends,
-            18 => Tag::SourceURI,
-            19 => Tag::SourcePath,
-            20 => Tag::SourceRef,
-            t => return Err(DecodeError::UnknownMetaTag(t)),
-        };
+        let tag = decode_tag(reader.read_u16()?)?;
 
         let kind = reader.read_u8()?;
         let _padding = reader.read_array::<1>()?;
@@ -3,6 +3,7 @@
 // SPDX-License-Identifier: MPL-2.0
 
 mod attribute;
+pub mod content;
 mod index;
 pub mod layout;
 pub mod meta;
@@ -41,6 +42,8 @@ pub enum Compression {
     None = 1,
     // Payload uses ZSTD compression
     Zstd = 2,
+    // Payload uses ZSTD compression with a shared dictionary
+    ZstdDictionary = 3,
 }
 
 #[derive(Debug, Clone, Copy, PartialEq, Eq)]
@@ -78,6 +81,7 @@ impl Header {
         let compression = match reader.read_u8()? {
             1 => Compression::None,
             2 => Compression::Zstd,
+            3 => Compression::ZstdDictionary,
             d => return Err(DecodeError::UnknownCompression(d)),
         };
 
@@ -152,6 +156,8 @@ pub enum DecodeError {
     UnknownFileType(u8),
     #[error("Unknown dependency type: {0}")]
     UnknownDependency(u8),
+    #[error("Invalid content seek table")]
+    InvalidSeekTable,
     #[error("io")]
     Io(#[from] io::Error),
 }
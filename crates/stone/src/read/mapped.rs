@@ -0,0 +1,665 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Zero-copy reader over a memory mapped stone
+//!
+//! Unlike [`Reader`](super::Reader), walking the payloads only decodes their
+//! headers. Callers pick the payloads they need and [`decode`](RawPayload::decode)
+//! them into a [`Body`], from which records are borrowed on demand. Checksums
+//! are only validated for the payloads which are actually decoded.
+
+use std::{
+    borrow::Cow,
+    fs::File,
+    io::{self, Read, Write},
+    marker::PhantomData,
+    num::NonZeroUsize,
+    str,
+    sync::mpsc,
+    thread,
+};
+
+use memmap2::Mmap;
+use xxhash_rust::xxh3::xxh3_64;
+
+use super::{Error, PayloadReader};
+use crate::payload::content::{self, Frame, SeekTable};
+use crate::payload::{self, layout, meta, Compression, DecodeError, Index, Kind, Record};
+use crate::{Dictionary, Header, ReadExt};
+
+/// A stone whose bytes are held in memory, typically mapped from disk
+pub struct Mapped<B = Mmap> {
+    pub header: Header,
+    data: B,
+    dictionary: Option<Dictionary>,
+}
+
+impl Mapped {
+    /// Map `file` into memory
+    ///
+    /// The file must not be truncated or modified while it's mapped
+    pub fn open(file: &File) -> Result<Self, Error> {
+        // SAFETY: Stones are never modified in place once written
+        let data = unsafe { Mmap::map(file)? };
+
+        Self::new(data)
+    }
+}
+
+impl<B: AsRef<[u8]>> Mapped<B> {
+    pub fn new(data: B) -> Result<Self, Error> {
+        let header = Header::decode(data.as_ref()).map_err(Error::HeaderDecode)?;
+
+        Ok(Self {
+            header,
+            data,
+            dictionary: None,
+        })
+    }
+
+    /// Decode payloads compressed with `dictionary`
+    pub fn with_dictionary(self, dictionary: Dictionary) -> Self {
+        Self {
+            dictionary: Some(dictionary),
+            ..self
+        }
+    }
+
+    /// Iterate the payload headers, without decoding or validating any payload body
+    pub fn payloads(&self) -> Payloads<'_> {
+        Payloads {
+            data: &self.data.as_ref()[Header::SIZE..],
+            remaining: self.header.num_payloads(),
+            dictionary: self.dictionary.as_ref(),
+        }
+    }
+
+    /// All payloads of the given `kind`
+    pub fn payloads_of(&self, kind: Kind) -> impl Iterator<Item = Result<RawPayload<'_>, Error>> {
+        self.payloads()
+            .filter(move |payload| payload.as_ref().map_or(true, |payload| payload.header.kind == kind))
+    }
+}
+
+pub struct Payloads<'a> {
+    data: &'a [u8],
+    remaining: u16,
+    dictionary: Option<&'a Dictionary>,
+}
+
+impl<'a> Iterator for Payloads<'a> {
+    type Item = Result<RawPayload<'a>, Error>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        // Trailing payloads may be missing, same as the streaming reader
+        if self.remaining == 0 || self.data.is_empty() {
+            return None;
+        }
+
+        let result = payload::Header::decode(&mut self.data)
+            .and_then(|header| Ok((header, take(&mut self.data, header.stored_size as usize)?)))
+            .map(|(header, stored)| RawPayload {
+                header,
+                stored,
+                dictionary: self.dictionary,
+            })
+            .map_err(Error::PayloadDecode);
+
+        // Nothing after a malformed payload can be trusted
+        self.remaining = if result.is_ok() { self.remaining - 1 } else { 0 };
+
+        Some(result)
+    }
+}
+
+/// A payload which hasn't been checked or decompressed yet
+#[derive(Debug, Clone, Copy)]
+pub struct RawPayload<'a> {
+    pub header: payload::Header,
+    stored: &'a [u8],
+    dictionary: Option<&'a Dictionary>,
+}
+
+impl<'a> RawPayload<'a> {
+    /// The stored (possibly compressed) payload bytes
+    pub fn stored(&self) -> &'a [u8] {
+        self.stored
+    }
+
+    /// Id of the dictionary the payload is compressed with, as referenced by its zstd frame
+    pub fn dictionary_id(&self) -> Option<u32> {
+        match self.header.compression {
+            Compression::ZstdDictionary => zstd::zstd_safe::get_dict_id_from_frame(self.stored).map(|id| id.get()),
+            Compression::None | Compression::Zstd => None,
+        }
+    }
+
+    pub fn verify(&self) -> Result<(), Error> {
+        let got = xxh3_64(self.stored);
+        let expected = u64::from_be_bytes(self.header.checksum);
+
+        if got != expected {
+            Err(Error::PayloadChecksum { got, expected })
+        } else {
+            Ok(())
+        }
+    }
+
+    /// Validate and decompress the payload records
+    ///
+    /// Uncompressed payloads are borrowed from the mapping as-is
+    pub fn decode(&self) -> Result<Body<'a>, Error> {
+        self.verify()?;
+
+        let data = match self.header.compression {
+            Compression::None => Cow::Borrowed(self.stored),
+            Compression::Zstd | Compression::ZstdDictionary => {
+                let mut plain = plain_buffer(self.header.plain_size);
+                PayloadReader::new(self.stored, self.header.compression, self.dictionary)?.read_to_end(&mut plain)?;
+                Cow::Owned(plain)
+            }
+        };
+
+        Ok(Body {
+            header: self.header,
+            data,
+        })
+    }
+
+    /// Validate and decompress content into `writer`
+    pub fn unpack_content<W: Write>(&self, writer: &mut W) -> Result<(), Error> {
+        self.verify()?;
+
+        let mut reader = PayloadReader::new(self.stored, self.header.compression, self.dictionary)?;
+        io::copy(&mut reader, writer)?;
+
+        Ok(())
+    }
+
+    /// Validate and decompress content into `writer`, decoding its frames on
+    /// up to `threads` workers
+    ///
+    /// zstd can only compress with multiple threads, so content is decoded in
+    /// parallel by its independent frames. Content without a seek table, or a
+    /// single thread, is decoded as a stream by [`RawPayload::unpack_content`].
+    pub fn unpack_content_parallel<W: Write>(&self, writer: &mut W, threads: NonZeroUsize) -> Result<(), Error> {
+        let table = match self.seek_table()? {
+            Some(table) if threads.get() > 1 && table.frames().len() > 1 => table,
+            _ => return self.unpack_content(writer),
+        };
+
+        self.verify()?;
+
+        let frames = table.frames();
+        let threads = threads.get().min(frames.len());
+
+        thread::scope(|scope| {
+            // Worker `i` decodes every `threads`th frame from frame `i`, so cycling
+            // through the workers yields all frames in order. Each runs at most one
+            // frame ahead, bounding peak memory to about `2 * threads` frames.
+            let decoded = (0..threads)
+                .map(|worker| {
+                    let (sender, receiver) = mpsc::sync_channel(1);
+
+                    scope.spawn(move || {
+                        for frame in frames.iter().skip(worker).step_by(threads) {
+                            let mut plain = plain_buffer(frame.plain.end - frame.plain.start);
+                            let result = self.unpack_frame(frame, &mut plain).map(|()| plain);
+                            let failed = result.is_err();
+
+                            // Stop once the output fails, or on our own failure
+                            if sender.send(result).is_err() || failed {
+                                break;
+                            }
+                        }
+                    });
+
+                    receiver
+                })
+                .collect::<Vec<_>>();
+
+            for i in 0..frames.len() {
+                let plain = decoded[i % threads].recv().expect("frame decoder panicked")?;
+                writer.write_all(&plain)?;
+            }
+
+            Ok(())
+        })
+    }
+
+    /// Seek table of framed content, see [`payload::content`]
+    pub fn seek_table(&self) -> Result<Option<SeekTable>, Error> {
+        if self.header.kind != Kind::Content || self.header.version != content::VERSION {
+            return Ok(None);
+        }
+
+        let footer = self
+            .stored
+            .len()
+            .checked_sub(content::FOOTER_SIZE)
+            .ok_or(DecodeError::InvalidSeekTable)?;
+        let size = SeekTable::encoded_size(self.stored[footer..].try_into().expect("footer size"));
+        let start = self
+            .stored
+            .len()
+            .checked_sub(size)
+            .ok_or(DecodeError::InvalidSeekTable)?;
+
+        let table = SeekTable::decode(&self.stored[start..])?;
+        table.validate(self.header.plain_size, self.header.stored_size)?;
+
+        Ok(Some(table))
+    }
+
+    /// Decompress a single frame of framed content into `writer`
+    ///
+    /// Frames are independent, so they can be decoded concurrently. The payload
+    /// checksum covers all of them and isn't validated here, see [`RawPayload::verify`].
+    pub fn unpack_frame<W: Write>(&self, frame: &Frame, writer: &mut W) -> Result<(), Error> {
+        let stored = self
+            .stored
+            .get(frame.stored.start as usize..frame.stored.end as usize)
+            .ok_or(DecodeError::InvalidSeekTable)?;
+
+        let mut reader = PayloadReader::new(stored, self.header.compression, self.dictionary)?;
+
+        if io::copy(&mut reader, writer)? != frame.plain.end - frame.plain.start {
+            return Err(Error::Io(io::ErrorKind::UnexpectedEof.into()));
+        }
+
+        Ok(())
+    }
+}
+
+/// Most memory reserved up front for plain bytes, larger payloads grow as they decode
+const MAX_RESERVE: usize = 16 * 1024 * 1024;
+
+/// Buffer for `plain_size` decoded bytes
+///
+/// Sizes come from the untrusted headers and seek table, so they're only a
+/// capacity hint up to [`MAX_RESERVE`]
+fn plain_buffer(plain_size: u64) -> Vec<u8> {
+    Vec::with_capacity(usize::try_from(plain_size).map_or(MAX_RESERVE, |size| size.min(MAX_RESERVE)))
+}
+
+/// Plain bytes of a decoded payload
+pub struct Body<'a> {
+    pub header: payload::Header,
+    data: Cow<'a, [u8]>,
+}
+
+impl Body<'_> {
+    pub fn bytes(&self) -> &[u8] {
+        &self.data
+    }
+
+    pub fn meta(&self) -> Option<Records<'_, MetaRef<'_>>> {
+        self.records(Kind::Meta)
+    }
+
+    pub fn attributes(&self) -> Option<Records<'_, AttributeRef<'_>>> {
+        self.records(Kind::Attributes)
+    }
+
+    pub fn layout(&self) -> Option<Records<'_, LayoutRef<'_>>> {
+        self.records(Kind::Layout)
+    }
+
+    pub fn index(&self) -> Option<Records<'_, Index>> {
+        self.records(Kind::Index)
+    }
+
+    fn records<'b, T: Decode<'b>>(&'b self, kind: Kind) -> Option<Records<'b, T>> {
+        (self.header.kind == kind).then_some(Records {
+            data: &self.data,
+            remaining: self.header.num_records,
+            _marker: PhantomData,
+        })
+    }
+}
+
+/// Records borrowed from a [`Body`], decoded as they're iterated
+pub struct Records<'a, T> {
+    data: &'a [u8],
+    remaining: usize,
+    _marker: PhantomData<T>,
+}
+
+impl<'a, T: Decode<'a>> Iterator for Records<'a, T> {
+    type Item = Result<T, Error>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.remaining == 0 {
+            return None;
+        }
+
+        let result = T::decode(&mut self.data).map_err(Error::PayloadDecode);
+
+        self.remaining = if result.is_ok() { self.remaining - 1 } else { 0 };
+
+        Some(result)
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        (0, Some(self.remaining))
+    }
+}
+
+/// A record which can be decoded in place
+pub trait Decode<'a>: Sized {
+    fn decode(data: &mut &'a [u8]) -> Result<Self, DecodeError>;
+}
+
+impl Decode<'_> for Index {
+    fn decode(data: &mut &[u8]) -> Result<Self, DecodeError> {
+        <Index as Record>::decode(data)
+    }
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct MetaRef<'a> {
+    pub tag: meta::Tag,
+    pub kind: KindRef<'a>,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum KindRef<'a> {
+    Int8(i8),
+    Uint8(u8),
+    Int16(i16),
+    Uint16(u16),
+    Int32(i32),
+    Uint32(u32),
+    Int64(i64),
+    Uint64(u64),
+    String(&'a str),
+    Dependency(meta::Dependency, &'a str),
+    Provider(meta::Dependency, &'a str),
+}
+
+impl MetaRef<'_> {
+    pub fn to_meta(&self) -> payload::Meta {
+        let kind = match self.kind {
+            KindRef::Int8(i) => meta::Kind::Int8(i),
+            KindRef::Uint8(i) => meta::Kind::Uint8(i),
+            KindRef::Int16(i) => meta::Kind::Int16(i),
+            KindRef::Uint16(i) => meta::Kind::Uint16(i),
+            KindRef::Int32(i) => meta::Kind::Int32(i),
+            KindRef::Uint32(i) => meta::Kind::Uint32(i),
+            KindRef::Int64(i) => meta::Kind::Int64(i),
+            KindRef::Uint64(i) => meta::Kind::Uint64(i),
+            KindRef::String(s) => meta::Kind::String(s.to_owned()),
+            KindRef::Dependency(dependency, s) => meta::Kind::Dependency(dependency, s.to_owned()),
+            KindRef::Provider(dependency, s) => meta::Kind::Provider(dependency, s.to_owned()),
+        };
+
+        payload::Meta { tag: self.tag, kind }
+    }
+}
+
+impl<'a> Decode<'a> for MetaRef<'a> {
+    fn decode(data: &mut &'a [u8]) -> Result<Self, DecodeError> {
+        let length = data.read_u32()? as usize;
+        let tag = meta::decode_tag(data.read_u16()?)?;
+        let kind = data.read_u8()?;
+        let _padding = data.read_array::<1>()?;
+
+        let kind = match kind {
+            1 => KindRef::Int8(data.read_u8()? as i8),
+            2 => KindRef::Uint8(data.read_u8()?),
+            3 => KindRef::Int16(data.read_u16()? as i16),
+            4 => KindRef::Uint16(data.read_u16()?),
+            5 => KindRef::Int32(data.read_u32()? as i32),
+            6 => KindRef::Uint32(data.read_u32()?),
+            7 => KindRef::Int64(data.read_u64()? as i64),
+            8 => KindRef::Uint64(data.read_u64()?),
+            9 => KindRef::String(string(data, length)?),
+            // DependencyKind u8 subtracted from length
+            10 => KindRef::Dependency(
+                meta::decode_dependency(data.read_u8()?)?,
+                string(data, length.saturating_sub(1))?,
+            ),
+            11 => KindRef::Provider(
+                meta::decode_dependency(data.read_u8()?)?,
+                string(data, length.saturating_sub(1))?,
+            ),
+            k => return Err(DecodeError::UnknownMetaKind(k)),
+        };
+
+        Ok(Self { tag, kind })
+    }
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct AttributeRef<'a> {
+    pub key: &'a [u8],
+    pub value: &'a [u8],
+}
+
+impl<'a> Decode<'a> for AttributeRef<'a> {
+    fn decode(data: &mut &'a [u8]) -> Result<Self, DecodeError> {
+        let key_length = data.read_u64()? as usize;
+        let value_length = data.read_u64()? as usize;
+
+        let key = take(data, key_length)?;
+        let value = take(data, value_length)?;
+
+        Ok(Self { key, value })
+    }
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct LayoutRef<'a> {
+    pub uid: u32,
+    pub gid: u32,
+    pub mode: u32,
+    pub tag: u32,
+    pub entry: EntryRef<'a>,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum EntryRef<'a> {
+    Regular(u128, &'a str),
+    Symlink(&'a str, &'a str),
+    Directory(&'a str),
+    CharacterDevice(&'a str),
+    BlockDevice(&'a str),
+    Fifo(&'a str),
+    Socket(&'a str),
+}
+
+impl<'a> EntryRef<'a> {
+    pub fn target(&self) -> &'a str {
+        match *self {
+            EntryRef::Regular(_, target) => target,
+            EntryRef::Symlink(_, target) => target,
+            EntryRef::Directory(target) => target,
+            EntryRef::CharacterDevice(target) => target,
+            EntryRef::BlockDevice(target) => target,
+            EntryRef::Fifo(target) => target,
+            EntryRef::Socket(target) => target,
+        }
+    }
+}
+
+impl LayoutRef<'_> {
+    pub fn to_layout(&self) -> payload::Layout {
+        let entry = match self.entry {
+            EntryRef::Regular(hash, target) => layout::Entry::Regular(hash, target.to_owned()),
+            EntryRef::Symlink(source, target) => layout::Entry::Symlink(source.to_owned(), target.to_owned()),
+            EntryRef::Directory(target) => layout::Entry::Directory(target.to_owned()),
+            EntryRef::CharacterDevice(target) => layout::Entry::CharacterDevice(target.to_owned()),
+            EntryRef::BlockDevice(target) => layout::Entry::BlockDevice(target.to_owned()),
+            EntryRef::Fifo(target) => layout::Entry::Fifo(target.to_owned()),
+            EntryRef::Socket(target) => layout::Entry::Socket(target.to_owned()),
+        };
+
+        payload::Layout {
+            uid: self.uid,
+            gid: self.gid,
+            mode: self.mode,
+            tag: self.tag,
+            entry,
+        }
+    }
+}
+
+impl<'a> Decode<'a> for LayoutRef<'a> {
+    fn decode(data: &mut &'a [u8]) -> Result<Self, DecodeError> {
+        let uid = data.read_u32()?;
+        let gid = data.read_u32()?;
+        let mode = data.read_u32()?;
+        let tag = data.read_u32()?;
+
+        let source_length = data.read_u16()? as usize;
+        let target_length = data.read_u16()? as usize;
+        let file_type = layout::FileType::decode(data.read_u8()?)?;
+        let _padding = data.read_array::<11>()?;
+
+        let source = take(data, source_length)?;
+        let target = string(data, target_length)?;
+
+        let entry = match file_type {
+            // BUG: boulder stores xxh128 as le bytes not be
+            layout::FileType::Regular => EntryRef::Regular(
+                u128::from_be_bytes(
+                    source
+                        .try_into()
+                        .map_err(|_| invalid_data("regular source isn't a hash"))?,
+                ),
+                target,
+            ),
+            layout::FileType::Symlink => EntryRef::Symlink(sanitize(source)?, target),
+            layout::FileType::Directory => EntryRef::Directory(target),
+            layout::FileType::CharacterDevice => EntryRef::CharacterDevice(target),
+            layout::FileType::BlockDevice => EntryRef::BlockDevice(target),
+            layout::FileType::Fifo => EntryRef::Fifo(target),
+            layout::FileType::Socket => EntryRef::Socket(target),
+        };
+
+        Ok(Self {
+            uid,
+            gid,
+            mode,
+            tag,
+            entry,
+        })
+    }
+}
+
+fn take<'a>(data: &mut &'a [u8], length: usize) -> io::Result<&'a [u8]> {
+    if data.len() < length {
+        return Err(io::ErrorKind::UnexpectedEof.into());
+    }
+
+    let (head, tail) = data.split_at(length);
+    *data = tail;
+
+    Ok(head)
+}
+
+fn string<'a>(data: &mut &'a [u8], length: usize) -> io::Result<&'a str> {
+    sanitize(take(data, length)?)
+}
+
+/// Borrow `bytes` as a string without its nul terminator
+fn sanitize(bytes: &[u8]) -> io::Result<&str> {
+    str::from_utf8(bytes)
+        .map(|s| s.trim_end_matches('\0'))
+        .map_err(|_| invalid_data("stream did not contain valid UTF-8"))
+}
+
+fn invalid_data(message: &'static str) -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, message)
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+    use crate::read::{read_bytes, PayloadKind};
+
+    const BASH_COMPLETION: &[u8] = include_bytes!("../../../../test/bash-completion-2.11-1-1-x86_64.stone");
+
+    #[test]
+    fn matches_reader() {
+        let mut reader = read_bytes(BASH_COMPLETION).unwrap();
+        let payloads = reader.payloads().unwrap().collect::<Result<Vec<_>, _>>().unwrap();
+
+        let mapped = Mapped::new(BASH_COMPLETION).unwrap();
+        assert_eq!(mapped.header, reader.header);
+
+        let raw = mapped.payloads().collect::<Result<Vec<_>, _>>().unwrap();
+        assert_eq!(raw.len(), payloads.len());
+
+        for (raw, payload) in raw.iter().zip(&payloads) {
+            match payload {
+                PayloadKind::Meta(meta) => {
+                    let body = raw.decode().unwrap();
+                    let records = body.meta().unwrap().collect::<Result<Vec<_>, _>>().unwrap();
+                    assert!(records.iter().map(MetaRef::to_meta).eq(meta.body.iter().cloned()));
+                }
+                PayloadKind::Layout(layouts) => {
+                    let body = raw.decode().unwrap();
+                    let records = body.layout().unwrap().collect::<Result<Vec<_>, _>>().unwrap();
+                    assert!(records
+                        .iter()
+                        .map(LayoutRef::to_layout)
+                        .eq(layouts.body.iter().cloned()));
+                }
+                PayloadKind::Index(indices) => {
+                    let body = raw.decode().unwrap();
+                    let records = body.index().unwrap().collect::<Result<Vec<_>, _>>().unwrap();
+                    assert_eq!(records, indices.body);
+                }
+                PayloadKind::Attributes(attributes) => {
+                    let body = raw.decode().unwrap();
+                    assert_eq!(body.attributes().unwrap().count(), attributes.body.len());
+                }
+                PayloadKind::Content(content) => {
+                    let (mut expected, mut unpacked) = (vec![], vec![]);
+                    reader.unpack_content(content, &mut expected).unwrap();
+                    raw.unpack_content(&mut unpacked).unwrap();
+                    assert_eq!(unpacked, expected);
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn lazy_checksum() {
+        let mut corrupt = BASH_COMPLETION.to_vec();
+
+        // Flip the last byte of the content payload
+        *corrupt.last_mut().unwrap() ^= 0xff;
+
+        let mapped = Mapped::new(corrupt.as_slice()).unwrap();
+
+        // Payloads we don't decode aren't validated
+        let layout = mapped.payloads_of(Kind::Layout).next().unwrap().unwrap();
+        assert!(layout.decode().is_ok());
+
+        let content = mapped.payloads_of(Kind::Content).next().unwrap().unwrap();
+        assert!(matches!(
+            content.unpack_content(&mut io::sink()),
+            Err(Error::PayloadChecksum { .. })
+        ));
+    }
+
+    #[test]
+    fn untrusted_plain_size() {
+        let mut forged = BASH_COMPLETION.to_vec();
+
+        // Claim the first payload decodes to u64::MAX bytes
+        let plain_size = Header::SIZE + 8;
+        forged[plain_size..plain_size + 8].copy_from_slice(&u64::MAX.to_be_bytes());
+
+        let mapped = Mapped::new(forged.as_slice()).unwrap();
+        let payload = mapped.payloads().next().unwrap().unwrap();
+        assert_eq!(payload.header.plain_size, u64::MAX);
+        assert_ne!(payload.header.compression, Compression::None);
+
+        // Reserves a bounded buffer rather than aborting on the allocation
+        assert!(payload.decode().is_ok());
+    }
+}
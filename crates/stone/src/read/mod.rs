@@ -5,13 +5,16 @@
 use std::io::{self, Cursor, Read, Seek, SeekFrom, Write};
 use thiserror::Error;
 
+use crate::payload::content::{self, Frame, SeekTable};
 use crate::payload::{Attribute, Compression, Index, Layout, Meta};
-use crate::{header, Payload};
+use crate::{header, Dictionary, Payload, ReadExt};
 use crate::{payload, Header};
 
+pub use self::mapped::Mapped;
 use self::zstd::Zstd;
 
 mod digest;
+pub mod mapped;
 mod zstd;
 
 pub fn read<R: Read + Seek>(mut reader: R) -> Result<Reader<R>, Error> {
@@ -21,6 +24,7 @@ pub fn read<R: Read + Seek>(mut reader: R) -> Result<Reader<R>, Error> {
         header,
         reader,
         hasher: digest::Hasher::new(),
+        dictionary: None,
     })
 }
 
@@ -32,6 +36,17 @@ pub struct Reader<R> {
     pub header: Header,
     reader: R,
     hasher: digest::Hasher,
+    dictionary: Option<Dictionary>,
+}
+
+impl<R> Reader<R> {
+    /// Decode payloads compressed with `dictionary`
+    pub fn with_dictionary(self, dictionary: Dictionary) -> Self {
+        Self {
+            dictionary: Some(dictionary),
+            ..self
+        }
+    }
 }
 
 impl<R: Read + Seek> Reader<R> {
@@ -41,8 +56,9 @@ impl<R: Read + Seek> Reader<R> {
             self.reader.seek(SeekFrom::Start(Header::SIZE as u64))?;
         }
 
-        Ok((0..self.header.num_payloads())
-            .flat_map(|_| PayloadKind::decode(&mut self.reader, &mut self.hasher).transpose()))
+        Ok((0..self.header.num_payloads()).flat_map(|_| {
+            PayloadKind::decode(&mut self.reader, &mut self.hasher, self.dictionary.as_ref()).transpose()
+        }))
     }
 
     pub fn unpack_content<W>(&mut self, content: &Payload<Content>, writer: &mut W) -> Result<(), Error>
@@ -54,20 +70,92 @@ impl<R: Read + Seek> Reader<R> {
 
         let mut hashed = digest::Reader::new(&mut self.reader, &mut self.hasher);
         let mut framed = (&mut hashed).take(content.header.stored_size);
-        let mut reader = PayloadReader::new(&mut framed, content.header.compression)?;
+        let mut reader = PayloadReader::new(&mut framed, content.header.compression, self.dictionary.as_ref())?;
 
         io::copy(&mut reader, writer)?;
+        // Return the decoder to the pool
+        drop(reader);
 
         // Validate checksum
         validate_checksum(&self.hasher, &content.header)?;
 
         Ok(())
     }
+
+    /// Decompress a single frame of framed content into `writer`
+    ///
+    /// The payload checksum covers all frames so it isn't validated here,
+    /// entries should be checked against their [`Index`] digest instead.
+    pub fn unpack_frame<W>(&mut self, content: &Payload<Content>, frame: &Frame, writer: &mut W) -> Result<(), Error>
+    where
+        W: Write,
+    {
+        self.reader
+            .seek(SeekFrom::Start(content.body.offset + frame.stored.start))?;
+
+        let mut framed = (&mut self.reader).take(frame.stored.end - frame.stored.start);
+        let mut reader = PayloadReader::new(&mut framed, content.header.compression, self.dictionary.as_ref())?;
+
+        if io::copy(&mut reader, writer)? != frame.plain.end - frame.plain.start {
+            return Err(Error::Io(io::ErrorKind::UnexpectedEof.into()));
+        }
+
+        Ok(())
+    }
+
+    /// Decompress the content of a single entry into `writer`, validating its digest
+    ///
+    /// For framed content only the frame holding the entry is decoded, otherwise
+    /// all content leading up to it is.
+    pub fn unpack_entry<W>(&mut self, content: &Payload<Content>, index: &Index, writer: &mut W) -> Result<(), Error>
+    where
+        W: Write,
+    {
+        let frame = content
+            .body
+            .seek_table
+            .as_ref()
+            .and_then(|table| Some(&table.frames()[table.position(index.start)?]))
+            .filter(|frame| index.end <= frame.plain.end);
+        let (start, stored) = match frame {
+            Some(frame) => (frame.plain.start, frame.stored.clone()),
+            None => (0, 0..content.header.stored_size),
+        };
+
+        self.reader.seek(SeekFrom::Start(content.body.offset + stored.start))?;
+
+        let mut framed = (&mut self.reader).take(stored.end - stored.start);
+        let mut reader = PayloadReader::new(&mut framed, content.header.compression, self.dictionary.as_ref())?;
+
+        io::copy(&mut (&mut reader).take(index.start - start), &mut io::sink())?;
+
+        self.hasher.reset();
+        let mut hashed = digest::Reader::new(&mut reader, &mut self.hasher);
+        let len = io::copy(&mut (&mut hashed).take(index.end - index.start), writer)?;
+
+        let got = self.hasher.digest128();
+        if len != index.end - index.start || got != index.digest {
+            return Err(Error::EntryDigest {
+                got,
+                expected: index.digest,
+            });
+        }
+
+        Ok(())
+    }
 }
 
-#[derive(Debug, Clone, Copy)]
+#[derive(Debug, Clone)]
 pub struct Content {
     offset: u64,
+    /// Set for framed (version 2) content, see [`content`]
+    seek_table: Option<SeekTable>,
+}
+
+impl Content {
+    pub fn seek_table(&self) -> Option<&SeekTable> {
+        self.seek_table.as_ref()
+    }
 }
 
 enum PayloadReader<R: Read> {
@@ -76,10 +164,14 @@ enum PayloadReader<R: Read> {
 }
 
 impl<R: Read> PayloadReader<R> {
-    fn new(reader: R, compression: Compression) -> Result<Self, Error> {
+    fn new(reader: R, compression: Compression, dictionary: Option<&Dictionary>) -> Result<Self, Error> {
         Ok(match compression {
             Compression::None => PayloadReader::Plain(reader),
             Compression::Zstd => PayloadReader::Zstd(Zstd::new(reader)?),
+            Compression::ZstdDictionary => PayloadReader::Zstd(Zstd::with_dictionary(
+                reader,
+                dictionary.ok_or(Error::MissingDictionary)?,
+            )?),
         })
     }
 }
@@ -103,7 +195,11 @@ pub enum PayloadKind {
 }
 
 impl PayloadKind {
-    fn decode<R: Read + Seek>(mut reader: R, hasher: &mut digest::Hasher) -> Result<Option<Self>, Error> {
+    fn decode<R: Read + Seek>(
+        mut reader: R,
+        hasher: &mut digest::Hasher,
+        dictionary: Option<&Dictionary>,
+    ) -> Result<Option<Self>, Error> {
         match payload::Header::decode(&mut reader) {
             Ok(header) => {
                 hasher.reset();
@@ -114,40 +210,46 @@ impl PayloadKind {
                     payload::Kind::Meta => PayloadKind::Meta(Payload {
                         header,
                         body: payload::decode_records(
-                            PayloadReader::new(&mut framed, header.compression)?,
+                            PayloadReader::new(&mut framed, header.compression, dictionary)?,
                             header.num_records,
                         )?,
                     }),
                     payload::Kind::Layout => PayloadKind::Layout(Payload {
                         header,
                         body: payload::decode_records(
-                            PayloadReader::new(&mut framed, header.compression)?,
+                            PayloadReader::new(&mut framed, header.compression, dictionary)?,
                             header.num_records,
                         )?,
                     }),
                     payload::Kind::Index => PayloadKind::Index(Payload {
                         header,
                         body: payload::decode_records(
-                            PayloadReader::new(&mut framed, header.compression)?,
+                            PayloadReader::new(&mut framed, header.compression, dictionary)?,
                             header.num_records,
                         )?,
                     }),
                     payload::Kind::Attributes => PayloadKind::Attributes(Payload {
                         header,
                         body: payload::decode_records(
-                            PayloadReader::new(&mut framed, header.compression)?,
+                            PayloadReader::new(&mut framed, header.compression, dictionary)?,
                             header.num_records,
                         )?,
                     }),
                     payload::Kind::Content => {
                         let offset = reader.stream_position()?;
 
+                        let seek_table = if header.version == content::VERSION {
+                            Some(read_seek_table(&mut reader, &header)?)
+                        } else {
+                            None
+                        };
+
                         // Skip past, these are read by user later
-                        reader.seek(SeekFrom::Current(header.stored_size as i64))?;
+                        reader.seek(SeekFrom::Start(offset + header.stored_size))?;
 
                         PayloadKind::Content(Payload {
                             header,
-                            body: Content { offset },
+                            body: Content { offset, seek_table },
                         })
                     }
                     payload::Kind::Dumb => unimplemented!("??"),
@@ -206,6 +308,27 @@ impl PayloadKind {
     }
 }
 
+/// Read the seek table from the end of the content payload at the current position
+fn read_seek_table<R: Read + Seek>(mut reader: R, header: &payload::Header) -> Result<SeekTable, Error> {
+    let end = reader.stream_position()? + header.stored_size;
+
+    if header.stored_size < content::FOOTER_SIZE as u64 {
+        return Err(Error::PayloadDecode(payload::DecodeError::InvalidSeekTable));
+    }
+    reader.seek(SeekFrom::Start(end - content::FOOTER_SIZE as u64))?;
+
+    let size = SeekTable::encoded_size(reader.read_array()?) as u64;
+    if size > header.stored_size {
+        return Err(Error::PayloadDecode(payload::DecodeError::InvalidSeekTable));
+    }
+    reader.seek(SeekFrom::Start(end - size))?;
+
+    let table = SeekTable::decode(&mut reader)?;
+    table.validate(header.plain_size, header.stored_size)?;
+
+    Ok(table)
+}
+
 fn validate_checksum(hasher: &digest::Hasher, header: &payload::Header) -> Result<(), Error> {
     let got = hasher.digest();
     let expected = u64::from_be_bytes(header.checksum);
@@ -227,6 +350,10 @@ pub enum Error {
     PayloadDecode(#[from] payload::DecodeError),
     #[error("payload checksum mismatch: got {got:02x}, expected {expected:02x}")]
     PayloadChecksum { got: u64, expected: u64 },
+    #[error("payload requires a zstd dictionary")]
+    MissingDictionary,
+    #[error("content digest mismatch: got {got:02x}, expected {expected:02x}")]
+    EntryDigest { got: u128, expected: u128 },
     #[error("io")]
     Io(#[from] io::Error),
 }
@@ -2,25 +2,174 @@
 //
 // SPDX-License-Identifier: MPL-2.0
 
-use std::io::{BufReader, Read, Result};
+use std::cell::RefCell;
+use std::io::{self, Read, Result};
 
-use zstd::stream::read::Decoder;
+use zstd::zstd_safe::{self, DCtx, DParameter, InBuffer, OutBuffer, ResetDirective};
+
+use crate::Dictionary;
+
+/// Contexts kept per thread, enough for readers of a stone's payloads and
+/// the frames being decoded alongside them
+const MAX_POOLED: usize = 4;
+
+thread_local! {
+    /// Decompression contexts & input buffers of finished readers, reused by
+    /// the next reader on the same thread
+    static POOL: RefCell<Vec<(DCtx<'static>, Vec<u8>)>> = const { RefCell::new(Vec::new()) };
+}
 
 pub struct Zstd<R: Read> {
-    decoder: Decoder<'static, BufReader<R>>,
+    reader: R,
+    /// Taken back into the pool on drop
+    context: Option<DCtx<'static>>,
+    input: Vec<u8>,
+    /// Unconsumed range of `input`
+    pos: usize,
+    len: usize,
+    eof: bool,
+    in_frame: bool,
+    /// Keeps the prepared dictionary referenced by `context` alive, so
+    /// must be dropped after it
+    _dictionary: Option<Dictionary>,
 }
 
 impl<R: Read> Zstd<R> {
     pub fn new(reader: R) -> Result<Self> {
-        let mut decoder = Decoder::new(reader)?;
-        decoder.window_log_max(31)?;
+        let (mut context, input) = POOL
+            .with_borrow_mut(Vec::pop)
+            .unwrap_or_else(|| (DCtx::create(), vec![0; DCtx::in_size()]));
+
+        context
+            .set_parameter(DParameter::WindowLogMax(31))
+            .map_err(map_error_code)?;
+
+        Ok(Self {
+            reader,
+            context: Some(context),
+            input,
+            pos: 0,
+            len: 0,
+            eof: false,
+            in_frame: false,
+            _dictionary: None,
+        })
+    }
+
+    pub fn with_dictionary(reader: R, dictionary: &Dictionary) -> Result<Self> {
+        let dictionary = dictionary.clone();
 
-        Ok(Self { decoder })
+        let mut zstd = Self::new(reader)?;
+        zstd.context_mut()
+            .ref_ddict(dictionary.decoder().as_ddict())
+            .map_err(map_error_code)?;
+        zstd._dictionary = Some(dictionary);
+
+        Ok(zstd)
+    }
+
+    fn context_mut(&mut self) -> &mut DCtx<'static> {
+        self.context.as_mut().expect("context until dropped")
     }
 }
 
 impl<R: Read> Read for Zstd<R> {
     fn read(&mut self, buf: &mut [u8]) -> Result<usize> {
-        self.decoder.read(buf)
+        if buf.is_empty() {
+            return Ok(0);
+        }
+
+        loop {
+            if self.pos == self.len && !self.eof {
+                self.len = self.reader.read(&mut self.input)?;
+                self.pos = 0;
+                self.eof = self.len == 0;
+            }
+
+            if self.eof && self.pos == self.len && !self.in_frame {
+                return Ok(0);
+            }
+
+            let mut input = InBuffer::around(&self.input[self.pos..self.len]);
+            let mut output = OutBuffer::around(&mut *buf);
+
+            let context = self.context.as_mut().expect("context until dropped");
+            let hint = context
+                .decompress_stream(&mut output, &mut input)
+                .map_err(map_error_code)?;
+
+            if input.pos() > 0 || output.pos() > 0 {
+                // Zero once a frame is fully decoded & flushed
+                self.in_frame = hint != 0;
+            }
+            self.pos += input.pos();
+
+            if output.pos() > 0 {
+                return Ok(output.pos());
+            }
+
+            if self.eof && self.pos == self.len {
+                return if self.in_frame {
+                    Err(io::ErrorKind::UnexpectedEof.into())
+                } else {
+                    Ok(0)
+                };
+            }
+        }
+    }
+}
+
+impl<R: Read> Drop for Zstd<R> {
+    fn drop(&mut self) {
+        let Some(mut context) = self.context.take() else {
+            return;
+        };
+
+        // Also drops the reference to any dictionary
+        if context.reset(ResetDirective::SessionAndParameters).is_err() {
+            return;
+        }
+
+        let input = std::mem::take(&mut self.input);
+
+        POOL.with_borrow_mut(|pool| {
+            if pool.len() < MAX_POOLED {
+                pool.push((context, input));
+            }
+        });
+    }
+}
+
+fn map_error_code(code: usize) -> io::Error {
+    let msg = zstd_safe::get_error_name(code);
+    io::Error::new(io::ErrorKind::Other, msg.to_owned())
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn reuse_context() {
+        let plain = (0..64 * 1024).map(|i| (i % 251) as u8).collect::<Vec<_>>();
+        let compressed = [
+            zstd::encode_all(&plain[..], 3).unwrap(),
+            zstd::encode_all(&b"tail"[..], 3).unwrap(),
+        ]
+        .concat();
+
+        for _ in 0..3 {
+            let mut decoded = vec![];
+            Zstd::new(&compressed[..]).unwrap().read_to_end(&mut decoded).unwrap();
+            assert_eq!(decoded, [&plain[..], b"tail"].concat());
+        }
+        assert_eq!(POOL.with_borrow(Vec::len), 1);
+
+        // A truncated frame is an error, not a short read
+        let mut decoded = vec![];
+        let truncated = Zstd::new(&compressed[..compressed.len() / 2])
+            .unwrap()
+            .read_to_end(&mut decoded);
+        assert_eq!(truncated.unwrap_err().kind(), io::ErrorKind::UnexpectedEof);
     }
 }
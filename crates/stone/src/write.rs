@@ -7,8 +7,8 @@ use thiserror::Error;
 
 use crate::{
     header,
-    payload::{self, Attribute, Index, Layout, Meta},
-    Header,
+    payload::{self, content::SeekTable, Attribute, Index, Layout, Meta},
+    Dictionary, Header,
 };
 
 pub mod digest;
@@ -36,6 +36,14 @@ impl<W: Write> Writer<W, ()> {
         })
     }
 
+    /// Compress all payloads except content with `dictionary`
+    ///
+    /// Readers need the same dictionary to decode them, see [`crate::dictionary`].
+    pub fn with_dictionary(mut self, dictionary: &Dictionary) -> Result<Self, Error> {
+        self.encoder.set_dictionary(dictionary.as_bytes())?;
+        Ok(self)
+    }
+
     pub fn add_payload<'a>(&mut self, payload: impl Into<Payload<'a>>) -> Result<(), Error> {
         self.payloads.push(encode_payload(
             payload.into().into(),
@@ -78,6 +86,85 @@ impl<W: Write> Writer<W, ()> {
     }
 }
 
+impl<W: Write + Seek> Writer<W, ()> {
+    /// Compress content straight into the output, rather than through a buffer
+    ///
+    /// This requires the [`Index`] of all content up front, since it's written
+    /// ahead of the content. Content must then be added in the same order, and
+    /// its digests are checked against the index as it's added.
+    ///
+    /// All other payloads must have been added before calling this.
+    pub fn with_indexed_content(self, indices: Vec<Index>, num_workers: u32) -> Result<Writer<W, Streamed>, Error> {
+        self.streamed(indices, None, num_workers)
+    }
+
+    /// Same as [`Writer::with_indexed_content`], but compress content as independent
+    /// frames of at least `frame_size` plain bytes, see [`payload::content`]
+    ///
+    /// Frames only end between entries, so any entry can be decoded from a single frame.
+    pub fn with_framed_content(
+        self,
+        indices: Vec<Index>,
+        frame_size: u64,
+        num_workers: u32,
+    ) -> Result<Writer<W, Streamed>, Error> {
+        self.streamed(indices, Some(frame_size), num_workers)
+    }
+
+    fn streamed(
+        mut self,
+        indices: Vec<Index>,
+        frame_size: Option<u64>,
+        num_workers: u32,
+    ) -> Result<Writer<W, Streamed>, Error> {
+        let plain_size = indices.last().map(|index| index.end).unwrap_or_default();
+        let framing = frame_size.map(|frame_size| Framing::new(&indices, frame_size));
+
+        self.payloads.push(encode_payload(
+            InnerPayload::Index(&indices),
+            &mut self.payload_hasher,
+            &mut self.encoder,
+        )?);
+
+        Header::V1(header::v1::Header {
+            num_payloads: self.payloads.len() as u16 + 1,
+            file_type: self.file_type,
+        })
+        .encode(&mut self.writer)?;
+
+        for payload in self.payloads.drain(..) {
+            payload.header.encode(&mut self.writer)?;
+            self.writer.write_all(&payload.content)?;
+        }
+
+        // Placeholder until the stored size & checksum are known
+        let header_position = self.writer.stream_position()?;
+        content_header(0, plain_size, 0, 1).encode(&mut self.writer)?;
+
+        let mut encoder = zstd::Encoder::new()?;
+        encoder.set_pledged_size(Some(framing.as_ref().map_or(plain_size, |framing| framing.current.0)))?;
+        encoder.set_num_workers(num_workers)?;
+
+        Ok(Writer {
+            writer: self.writer,
+            content: Streamed {
+                header_position,
+                plain_size,
+                indices: indices.into_iter(),
+                stored_size: 0,
+                index_hasher: digest::Hasher::new(),
+                buffer_hasher: digest::Hasher::new(),
+                encoder,
+                framing,
+            },
+            file_type: self.file_type,
+            payloads: self.payloads,
+            payload_hasher: self.payload_hasher,
+            encoder: self.encoder,
+        })
+    }
+}
+
 impl<W, B> Writer<W, Content<B>>
 where
     W: Write,
@@ -158,6 +245,91 @@ where
     }
 }
 
+impl<W> Writer<W, Streamed>
+where
+    W: Write + Seek,
+{
+    /// Add the content of the next [`Index`]
+    pub fn add_content<R: Read>(&mut self, content: &mut R) -> Result<(), Error> {
+        let index = self.content.indices.next().ok_or(Error::UnindexedContent)?;
+
+        self.content.index_hasher.reset();
+
+        // Bytes -> index digest -> compression -> payload checksum -> output
+        let mut payload_checksum_writer = digest::Writer::new(&mut self.writer, &mut self.content.buffer_hasher);
+        let mut zstd_writer = zstd::Writer::new(&mut payload_checksum_writer, &mut self.content.encoder);
+        let mut index_digest_writer = digest::Writer::new(&mut zstd_writer, &mut self.content.index_hasher);
+
+        io::copy(content, &mut index_digest_writer)?;
+        let plain_size = index_digest_writer.bytes as u64;
+
+        zstd_writer.flush()?;
+
+        let stored_size = payload_checksum_writer.bytes as u64;
+        self.content.stored_size += stored_size;
+
+        if plain_size != index.end - index.start || self.content.index_hasher.digest128() != index.digest {
+            return Err(Error::IndexMismatch(index.digest));
+        }
+
+        // Close the frame once its last entry is in
+        if let Some(framing) = &mut self.content.framing {
+            if framing.add(stored_size) {
+                let stored_size = self.finish_frame()?;
+                let framing = self.content.framing.as_mut().expect("framed content");
+                let next_size = framing.finish(stored_size);
+                self.content.encoder.set_pledged_size(Some(next_size))?;
+            }
+        }
+
+        Ok(())
+    }
+
+    pub fn finalize(mut self) -> Result<(), Error> {
+        if !self.content.indices.as_slice().is_empty() {
+            return Err(Error::MissingContent(self.content.indices.len()));
+        }
+
+        let version = match self.content.framing.take() {
+            // Every frame was finished along with its last entry
+            Some(framing) => {
+                let mut writer = digest::Writer::new(&mut self.writer, &mut self.content.buffer_hasher);
+                framing.table.encode(&mut writer)?;
+                self.content.stored_size += writer.bytes as u64;
+                payload::content::VERSION
+            }
+            None => {
+                self.finish_frame()?;
+                1
+            }
+        };
+        let checksum = self.content.buffer_hasher.digest();
+
+        // Fill in the placeholder header
+        let end = self.writer.stream_position()?;
+        self.writer.seek(SeekFrom::Start(self.content.header_position))?;
+        content_header(self.content.stored_size, self.content.plain_size, checksum, version)
+            .encode(&mut self.writer)?;
+        self.writer.seek(SeekFrom::Start(end))?;
+
+        self.writer.flush()?;
+
+        Ok(())
+    }
+
+    /// End the current zstd frame, returning its trailing stored bytes
+    fn finish_frame(&mut self) -> Result<u64, Error> {
+        let mut writer = digest::Writer::new(&mut self.writer, &mut self.content.buffer_hasher);
+        self.content.encoder.finish(&mut writer)?;
+        writer.flush()?;
+
+        let stored_size = writer.bytes as u64;
+        self.content.stored_size += stored_size;
+
+        Ok(stored_size)
+    }
+}
+
 pub struct Content<B> {
     buffer: B,
     plain_size: u64,
@@ -172,6 +344,74 @@ pub struct Content<B> {
     encoder: zstd::Encoder,
 }
 
+/// Content compressed directly into the output, see [`Writer::with_indexed_content`]
+pub struct Streamed {
+    /// Offset of the content payload header in the output
+    header_position: u64,
+    plain_size: u64,
+    stored_size: u64,
+    /// Remaining indices of content yet to be added
+    indices: std::vec::IntoIter<Index>,
+    index_hasher: digest::Hasher,
+    buffer_hasher: digest::Hasher,
+    encoder: zstd::Encoder,
+    framing: Option<Framing>,
+}
+
+/// Frame boundaries of [`Writer::with_framed_content`]
+struct Framing {
+    /// Plain size & number of entries of each frame after the current one
+    frames: std::vec::IntoIter<(u64, usize)>,
+    /// Plain size & number of entries left of the current frame
+    current: (u64, usize),
+    /// Stored size of the current frame so far
+    stored_size: u64,
+    table: SeekTable,
+}
+
+impl Framing {
+    fn new(indices: &[Index], frame_size: u64) -> Self {
+        let mut frames = vec![];
+        let mut current = (0, 0);
+
+        for index in indices {
+            current.0 += index.end - index.start;
+            current.1 += 1;
+
+            if current.0 >= frame_size {
+                frames.push(std::mem::take(&mut current));
+            }
+        }
+        if current.1 > 0 {
+            frames.push(current);
+        }
+
+        let mut frames = frames.into_iter();
+
+        Self {
+            current: frames.next().unwrap_or_default(),
+            frames,
+            stored_size: 0,
+            table: SeekTable::default(),
+        }
+    }
+
+    /// Account for an added entry, returning true if it completes the frame
+    fn add(&mut self, stored_size: u64) -> bool {
+        self.stored_size += stored_size;
+        self.current.1 -= 1;
+        self.current.1 == 0
+    }
+
+    /// Record the completed frame and move onto the next, returning its plain size
+    fn finish(&mut self, stored_size: u64) -> u64 {
+        self.table.push(self.current.0, self.stored_size + stored_size);
+        self.current = self.frames.next().unwrap_or_default();
+        self.stored_size = 0;
+        self.current.0
+    }
+}
+
 struct EncodedPayload {
     header: payload::Header,
     content: Vec<u8>,
@@ -291,7 +531,11 @@ fn encode_payload(
         num_records: payload.num_records(),
         version: 1,
         kind: payload.kind(),
-        compression: payload::Compression::Zstd,
+        compression: if encoder.has_dictionary() {
+            payload::Compression::ZstdDictionary
+        } else {
+            payload::Compression::Zstd
+        },
     };
 
     Ok(EncodedPayload { header, content })
@@ -318,16 +562,7 @@ fn finalize<W: Write, B: Read + Seek>(
 
     // Write content payload header + buffer
     if let Some((mut content, checksum)) = content {
-        payload::Header {
-            stored_size: content.stored_size,
-            plain_size: content.plain_size,
-            checksum: checksum.to_be_bytes(),
-            num_records: 0,
-            version: 1,
-            kind: payload::Kind::Content,
-            compression: payload::Compression::Zstd,
-        }
-        .encode(writer)?;
+        content_header(content.stored_size, content.plain_size, checksum, 1).encode(writer)?;
         // Seek to beginning & copy content buffer
         content.buffer.seek(SeekFrom::Start(0))?;
         io::copy(&mut content.buffer, writer)?;
@@ -338,10 +573,28 @@ fn finalize<W: Write, B: Read + Seek>(
     Ok(())
 }
 
+fn content_header(stored_size: u64, plain_size: u64, checksum: u64, version: u16) -> payload::Header {
+    payload::Header {
+        stored_size,
+        plain_size,
+        checksum: checksum.to_be_bytes(),
+        num_records: 0,
+        version,
+        kind: payload::Kind::Content,
+        compression: payload::Compression::Zstd,
+    }
+}
+
 #[derive(Debug, Error)]
 pub enum Error {
     #[error("payload encode")]
     PayloadEncode(#[from] payload::EncodeError),
     #[error("io")]
     Io(#[from] io::Error),
+    #[error("content added beyond the index")]
+    UnindexedContent,
+    #[error("content doesn't match its index digest {0:02x}")]
+    IndexMismatch(u128),
+    #[error("{0} indexed content entries were never added")]
+    MissingContent(usize),
 }
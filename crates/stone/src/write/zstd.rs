@@ -2,6 +2,7 @@
 //
 // SPDX-License-Identifier: MPL-2.0
 
+use std::cell::RefCell;
 use std::io::{self, Result, Write};
 
 use zstd::zstd_safe::zstd_sys::ZSTD_EndDirective;
@@ -10,6 +11,15 @@ use zstd::zstd_safe::{CParameter, ResetDirective};
 
 type Context = zstd_safe::CCtx<'static>;
 
+/// Encoders kept per thread, a writer holds one for its payloads and one for content
+const MAX_POOLED: usize = 2;
+
+thread_local! {
+    /// Compression contexts & output buffers of dropped encoders, reused by the
+    /// next encoder on the same thread as their workspace is several MB at our level
+    static POOL: RefCell<Vec<(Context, Vec<u8>)>> = const { RefCell::new(Vec::new()) };
+}
+
 /// Transparent encapsulation of zstd compression with the purpose
 /// of encoding moss (.stone) payloads to a stream
 pub struct Writer<'a, W: Write> {
@@ -47,9 +57,8 @@ impl<W: Write> Write for Writer<'_, W> {
         while !finished {
             let mut output_buffer = OutBuffer::around(&mut self.encoder.output);
 
-            let _status = self
-                .encoder
-                .context
+            let context = self.encoder.context.as_mut().expect("context until dropped");
+            let _status = context
                 .compress_stream2(&mut output_buffer, &mut input, ZSTD_EndDirective::ZSTD_e_continue)
                 .map_err(map_error_code)?;
 
@@ -68,15 +77,19 @@ impl<W: Write> Write for Writer<'_, W> {
 }
 
 pub struct Encoder {
-    context: Context,
+    /// Taken back into the pool on drop
+    context: Option<Context>,
     output: Vec<u8>,
     read_size: usize,
+    dictionary: bool,
 }
 
 impl Encoder {
     /// Concrete zstd encoder
     pub fn new() -> Result<Self> {
-        let mut context = Context::create();
+        let (mut context, output) = POOL
+            .with_borrow_mut(Vec::pop)
+            .unwrap_or_else(|| (Context::create(), vec![0; Context::out_size()]));
         context
             .set_parameter(CParameter::CompressionLevel(18))
             .map_err(map_error_code)?;
@@ -84,22 +97,34 @@ impl Encoder {
             .set_parameter(CParameter::WindowLog(31))
             .map_err(map_error_code)?;
         Ok(Self {
-            context,
-            output: vec![0; Context::out_size()],
+            context: Some(context),
+            output,
             read_size: Context::in_size(),
+            dictionary: false,
         })
     }
 
+    /// Compress all following frames with `dictionary`
+    pub fn set_dictionary(&mut self, dictionary: &[u8]) -> Result<()> {
+        self.context_mut().load_dictionary(dictionary).map_err(map_error_code)?;
+        self.dictionary = true;
+        Ok(())
+    }
+
+    pub fn has_dictionary(&self) -> bool {
+        self.dictionary
+    }
+
     /// Let zstd know of the final uncompressed size, to optimise compression
     pub fn set_pledged_size(&mut self, pledged_size: Option<u64>) -> Result<()> {
-        self.context
+        self.context_mut()
             .set_pledged_src_size(pledged_size)
             .map_err(map_error_code)?;
         Ok(())
     }
 
     pub fn set_num_workers(&mut self, num_workers: u32) -> Result<()> {
-        self.context
+        self.context_mut()
             .set_parameter(CParameter::NbWorkers(num_workers))
             .map_err(map_error_code)?;
         Ok(())
@@ -112,8 +137,8 @@ impl Encoder {
         while !finished {
             let mut output_buffer = OutBuffer::around(&mut self.output);
 
-            let remaining = self
-                .context
+            let context = self.context.as_mut().expect("context until dropped");
+            let remaining = context
                 .compress_stream2(
                     &mut output_buffer,
                     &mut InBuffer::around(&[]),
@@ -126,13 +151,37 @@ impl Encoder {
             finished = remaining == 0;
         }
 
-        self.context
-            .reset(ResetDirective::SessionOnly)
-            .map_err(map_error_code)?;
-        self.context.set_pledged_src_size(None).map_err(map_error_code)?;
+        let context = self.context_mut();
+        context.reset(ResetDirective::SessionOnly).map_err(map_error_code)?;
+        context.set_pledged_src_size(None).map_err(map_error_code)?;
 
         Ok(())
     }
+
+    fn context_mut(&mut self) -> &mut Context {
+        self.context.as_mut().expect("context until dropped")
+    }
+}
+
+impl Drop for Encoder {
+    fn drop(&mut self) {
+        let Some(mut context) = self.context.take() else {
+            return;
+        };
+
+        // Parameters are reapplied by `Encoder::new`, this also drops any dictionary
+        if context.reset(ResetDirective::SessionAndParameters).is_err() {
+            return;
+        }
+
+        let output = std::mem::take(&mut self.output);
+
+        POOL.with_borrow_mut(|pool| {
+            if pool.len() < MAX_POOLED {
+                pool.push((context, output));
+            }
+        });
+    }
 }
 
 fn map_error_code(code: usize) -> io::Error {
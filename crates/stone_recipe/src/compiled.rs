@@ -0,0 +1,408 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Compact binary form of parsed recipe & macro documents
+//!
+//! Parsing YAML dominates loading recipes & macros, so tools loading many of
+//! them can [`compile`] each document once and keep the result, i.e. keyed by
+//! a hash of its source. A compiled document holds the value tree YAML resolved
+//! to and is deserialized from in place, with strings borrowed from it.
+//!
+//! Scalars are resolved up front, so a plain scalar deserialized other than
+//! the way YAML resolves it (i.e. `1.10` as a string) may not decode the same
+//! as its source. Callers should compare against a regular parse before
+//! keeping a compiled document.
+
+use serde::de::{self, value::BorrowedStrDeserializer, DeserializeSeed, Visitor};
+use serde::Deserialize;
+use serde_yaml::Value;
+
+use crate::Error;
+
+/// Format version of compiled documents, which is their first byte
+pub const VERSION: u8 = 1;
+
+const NULL: u8 = 0;
+const FALSE: u8 = 1;
+const TRUE: u8 = 2;
+const UINT: u8 = 3;
+const INT: u8 = 4;
+const FLOAT: u8 = 5;
+const STRING: u8 = 6;
+const SEQUENCE: u8 = 7;
+const MAPPING: u8 = 8;
+
+/// Parse a YAML document into its compiled form
+///
+/// Documents using YAML tags can't be compiled
+pub fn compile(yaml: &[u8]) -> Result<Vec<u8>, Error> {
+    let value = serde_yaml::from_slice::<Value>(yaml)?;
+
+    let mut compiled = vec![VERSION];
+    encode(&value, &mut compiled)?;
+
+    Ok(compiled)
+}
+
+/// Deserialize a document produced by [`compile`]
+pub fn from_compiled<'de, T: Deserialize<'de>>(compiled: &'de [u8]) -> Result<T, Error> {
+    let Some((&VERSION, data)) = compiled.split_first() else {
+        return Err(de::Error::custom("unsupported compiled document version"));
+    };
+
+    let mut deserializer = Deserializer { data };
+    let value = T::deserialize(&mut deserializer)?;
+
+    if !deserializer.data.is_empty() {
+        return Err(de::Error::custom("trailing bytes after compiled document"));
+    }
+
+    Ok(value)
+}
+
+fn encode(value: &Value, out: &mut Vec<u8>) -> Result<(), Error> {
+    match value {
+        Value::Null => out.push(NULL),
+        Value::Bool(false) => out.push(FALSE),
+        Value::Bool(true) => out.push(TRUE),
+        Value::Number(number) => {
+            if let Some(n) = number.as_u64() {
+                out.push(UINT);
+                out.extend(n.to_le_bytes());
+            } else if let Some(n) = number.as_i64() {
+                out.push(INT);
+                out.extend(n.to_le_bytes());
+            } else {
+                out.push(FLOAT);
+                out.extend(number.as_f64().unwrap_or(f64::NAN).to_bits().to_le_bytes());
+            }
+        }
+        Value::String(s) => {
+            out.push(STRING);
+            encode_len(s.len(), out)?;
+            out.extend(s.as_bytes());
+        }
+        Value::Sequence(sequence) => {
+            out.push(SEQUENCE);
+            encode_len(sequence.len(), out)?;
+            for value in sequence {
+                encode(value, out)?;
+            }
+        }
+        Value::Mapping(mapping) => {
+            out.push(MAPPING);
+            encode_len(mapping.len(), out)?;
+            for (key, value) in mapping {
+                encode(key, out)?;
+                encode(value, out)?;
+            }
+        }
+        Value::Tagged(_) => return Err(de::Error::custom("tagged values can't be compiled")),
+    }
+
+    Ok(())
+}
+
+fn encode_len(len: usize, out: &mut Vec<u8>) -> Result<(), Error> {
+    let len = u32::try_from(len).map_err(|_| de::Error::custom("node too large to compile"))?;
+    out.extend(len.to_le_bytes());
+    Ok(())
+}
+
+struct Deserializer<'de> {
+    data: &'de [u8],
+}
+
+impl<'de> Deserializer<'de> {
+    fn take(&mut self, len: usize) -> Result<&'de [u8], Error> {
+        if self.data.len() < len {
+            return Err(de::Error::custom("truncated compiled document"));
+        }
+
+        let (head, tail) = self.data.split_at(len);
+        self.data = tail;
+
+        Ok(head)
+    }
+
+    fn byte(&mut self) -> Result<u8, Error> {
+        Ok(self.take(1)?[0])
+    }
+
+    fn peek(&self) -> Option<u8> {
+        self.data.first().copied()
+    }
+
+    fn len(&mut self) -> Result<u32, Error> {
+        Ok(u32::from_le_bytes(self.take(4)?.try_into().expect("4 bytes")))
+    }
+
+    fn u64(&mut self) -> Result<u64, Error> {
+        Ok(u64::from_le_bytes(self.take(8)?.try_into().expect("8 bytes")))
+    }
+
+    fn str(&mut self) -> Result<&'de str, Error> {
+        let len = self.len()? as usize;
+        std::str::from_utf8(self.take(len)?).map_err(de::Error::custom)
+    }
+
+    /// Skip the next node, i.e. the elements a visitor didn't consume
+    fn skip(&mut self) -> Result<(), Error> {
+        match self.byte()? {
+            NULL | FALSE | TRUE => {}
+            UINT | INT | FLOAT => {
+                self.take(8)?;
+            }
+            STRING => {
+                self.str()?;
+            }
+            SEQUENCE => {
+                for _ in 0..self.len()? {
+                    self.skip()?;
+                }
+            }
+            MAPPING => {
+                for _ in 0..u64::from(self.len()?) * 2 {
+                    self.skip()?;
+                }
+            }
+            node => return Err(invalid_node(node)),
+        }
+
+        Ok(())
+    }
+
+    fn visit_nodes<V: Visitor<'de>>(&mut self, nodes: u64, visitor: V, mapping: bool) -> Result<V::Value, Error> {
+        let mut access = Access { de: &mut *self, nodes };
+        let value = if mapping {
+            visitor.visit_map(&mut access)?
+        } else {
+            visitor.visit_seq(&mut access)?
+        };
+
+        for _ in 0..access.nodes {
+            self.skip()?;
+        }
+
+        Ok(value)
+    }
+}
+
+impl<'de> de::Deserializer<'de> for &mut Deserializer<'de> {
+    type Error = Error;
+
+    fn deserialize_any<V: Visitor<'de>>(self, visitor: V) -> Result<V::Value, Error> {
+        match self.byte()? {
+            NULL => visitor.visit_unit(),
+            FALSE => visitor.visit_bool(false),
+            TRUE => visitor.visit_bool(true),
+            UINT => visitor.visit_u64(self.u64()?),
+            INT => visitor.visit_i64(self.u64()? as i64),
+            FLOAT => visitor.visit_f64(f64::from_bits(self.u64()?)),
+            STRING => visitor.visit_borrowed_str(self.str()?),
+            SEQUENCE => {
+                let len = self.len()?;
+                self.visit_nodes(u64::from(len), visitor, false)
+            }
+            MAPPING => {
+                let len = self.len()?;
+                self.visit_nodes(u64::from(len) * 2, visitor, true)
+            }
+            node => Err(invalid_node(node)),
+        }
+    }
+
+    /// Plain integers where a string is expected, as YAML would
+    fn deserialize_str<V: Visitor<'de>>(self, visitor: V) -> Result<V::Value, Error> {
+        match self.peek() {
+            Some(UINT) => {
+                self.byte()?;
+                visitor.visit_string(self.u64()?.to_string())
+            }
+            Some(INT) => {
+                self.byte()?;
+                visitor.visit_string((self.u64()? as i64).to_string())
+            }
+            _ => self.deserialize_any(visitor),
+        }
+    }
+
+    fn deserialize_string<V: Visitor<'de>>(self, visitor: V) -> Result<V::Value, Error> {
+        self.deserialize_str(visitor)
+    }
+
+    fn deserialize_identifier<V: Visitor<'de>>(self, visitor: V) -> Result<V::Value, Error> {
+        self.deserialize_str(visitor)
+    }
+
+    fn deserialize_option<V: Visitor<'de>>(self, visitor: V) -> Result<V::Value, Error> {
+        if self.peek() == Some(NULL) {
+            self.byte()?;
+            visitor.visit_none()
+        } else {
+            visitor.visit_some(self)
+        }
+    }
+
+    fn deserialize_newtype_struct<V: Visitor<'de>>(self, _name: &'static str, visitor: V) -> Result<V::Value, Error> {
+        visitor.visit_newtype_struct(self)
+    }
+
+    fn deserialize_enum<V: Visitor<'de>>(
+        self,
+        _name: &'static str,
+        _variants: &'static [&'static str],
+        visitor: V,
+    ) -> Result<V::Value, Error> {
+        match self.peek() {
+            // Unit variant
+            Some(STRING) => {
+                self.byte()?;
+                visitor.visit_enum(BorrowedStrDeserializer::new(self.str()?))
+            }
+            // Single entry mapping of variant to its value
+            Some(MAPPING) => {
+                self.byte()?;
+                if self.len()? != 1 {
+                    return Err(de::Error::custom("expected a single entry mapping for an enum"));
+                }
+                visitor.visit_enum(self)
+            }
+            _ => Err(de::Error::custom("expected a string or mapping for an enum")),
+        }
+    }
+
+    serde::forward_to_deserialize_any! {
+        bool i8 i16 i32 i64 i128 u8 u16 u32 u64 u128 f32 f64 char bytes byte_buf
+        unit unit_struct seq tuple tuple_struct map struct ignored_any
+    }
+}
+
+/// Elements of a sequence or keys & values of a mapping
+struct Access<'a, 'de> {
+    de: &'a mut Deserializer<'de>,
+    nodes: u64,
+}
+
+impl<'de> Access<'_, 'de> {
+    fn next<T: DeserializeSeed<'de>>(&mut self, seed: T) -> Result<Option<T::Value>, Error> {
+        if self.nodes == 0 {
+            return Ok(None);
+        }
+
+        self.nodes -= 1;
+        seed.deserialize(&mut *self.de).map(Some)
+    }
+}
+
+impl<'de> de::SeqAccess<'de> for Access<'_, 'de> {
+    type Error = Error;
+
+    fn next_element_seed<T: DeserializeSeed<'de>>(&mut self, seed: T) -> Result<Option<T::Value>, Error> {
+        self.next(seed)
+    }
+
+    fn size_hint(&self) -> Option<usize> {
+        usize::try_from(self.nodes).ok()
+    }
+}
+
+impl<'de> de::MapAccess<'de> for Access<'_, 'de> {
+    type Error = Error;
+
+    fn next_key_seed<K: DeserializeSeed<'de>>(&mut self, seed: K) -> Result<Option<K::Value>, Error> {
+        self.next(seed)
+    }
+
+    fn next_value_seed<V: DeserializeSeed<'de>>(&mut self, seed: V) -> Result<V::Value, Error> {
+        self.next(seed)?
+            .ok_or_else(|| de::Error::custom("mapping key without a value"))
+    }
+
+    fn size_hint(&self) -> Option<usize> {
+        usize::try_from(self.nodes / 2).ok()
+    }
+}
+
+impl<'de> de::EnumAccess<'de> for &mut Deserializer<'de> {
+    type Error = Error;
+    type Variant = Self;
+
+    fn variant_seed<V: DeserializeSeed<'de>>(self, seed: V) -> Result<(V::Value, Self), Error> {
+        let variant = seed.deserialize(&mut *self)?;
+        Ok((variant, self))
+    }
+}
+
+impl<'de> de::VariantAccess<'de> for &mut Deserializer<'de> {
+    type Error = Error;
+
+    fn unit_variant(self) -> Result<(), Error> {
+        <()>::deserialize(self)
+    }
+
+    fn newtype_variant_seed<T: DeserializeSeed<'de>>(self, seed: T) -> Result<T::Value, Error> {
+        seed.deserialize(self)
+    }
+
+    fn tuple_variant<V: Visitor<'de>>(self, _len: usize, visitor: V) -> Result<V::Value, Error> {
+        de::Deserializer::deserialize_seq(self, visitor)
+    }
+
+    fn struct_variant<V: Visitor<'de>>(self, _fields: &'static [&'static str], visitor: V) -> Result<V::Value, Error> {
+        de::Deserializer::deserialize_map(self, visitor)
+    }
+}
+
+fn invalid_node(node: u8) -> Error {
+    de::Error::custom(format!("invalid compiled node {node}"))
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+    use crate::Macros;
+
+    #[test]
+    fn matches_source() {
+        let recipes = [
+            &include_bytes!("../../../test/llvm-stone.yml")[..],
+            &include_bytes!("../../../test/boulder-stone.yml")[..],
+        ];
+        let macros = [
+            &include_bytes!("../../../test/base.yml")[..],
+            &include_bytes!("../../../test/x86_64.yml")[..],
+            &include_bytes!("../../../test/cmake.yml")[..],
+        ];
+
+        for input in recipes {
+            let compiled = compile(input).unwrap();
+            let recipe = from_compiled::<crate::Recipe>(&compiled).unwrap();
+            assert_eq!(recipe, crate::from_slice(input).unwrap());
+        }
+
+        for input in macros {
+            let compiled = compile(input).unwrap();
+            let macros = from_compiled::<Macros>(&compiled).unwrap();
+            assert_eq!(macros, crate::macros::from_slice(input).unwrap());
+        }
+
+        // Plain scalars read as another type than YAML resolved them to may differ
+        #[derive(Debug, PartialEq, Deserialize)]
+        struct Version {
+            version: String,
+        }
+        let input = b"version: 010";
+        let compiled = compile(input).unwrap();
+        assert_ne!(
+            from_compiled::<Version>(&compiled).unwrap(),
+            serde_yaml::from_slice::<Version>(input).unwrap()
+        );
+
+        // Corrupt documents are an error
+        let compiled = compile(recipes[0]).unwrap();
+        assert!(from_compiled::<crate::Recipe>(&compiled[..compiled.len() / 2]).is_err());
+        assert!(from_compiled::<crate::Recipe>(&[VERSION + 1]).is_err());
+    }
+}
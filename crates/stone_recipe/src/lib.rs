@@ -14,6 +14,7 @@ pub use self::macros::Macros;
 pub use self::script::Script;
 pub use self::tuning::Tuning;
 
+pub mod compiled;
 pub mod macros;
 pub mod script;
 pub mod tuning;
@@ -26,7 +27,7 @@ pub fn from_str(s: &str) -> Result<Recipe, Error> {
     serde_yaml::from_str(s)
 }
 
-#[derive(Debug, Clone, Deserialize)]
+#[derive(Debug, Clone, PartialEq, Deserialize)]
 pub struct Recipe {
     #[serde(flatten)]
     pub source: Source,
@@ -52,13 +53,13 @@ pub struct Recipe {
     pub mold: bool,
 }
 
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, PartialEq)]
 pub struct KeyValue<T> {
     pub key: String,
     pub value: T,
 }
 
-#[derive(Debug, Clone, Deserialize)]
+#[derive(Debug, Clone, PartialEq, Deserialize)]
 pub struct Source {
     pub name: String,
     #[serde(deserialize_with = "force_string")]
@@ -69,7 +70,7 @@ pub struct Source {
     pub license: Vec<String>,
 }
 
-#[derive(Debug, Clone, Deserialize)]
+#[derive(Debug, Clone, PartialEq, Deserialize)]
 pub struct Build {
     pub setup: Option<String>,
     pub build: Option<String>,
@@ -83,7 +84,7 @@ pub struct Build {
     pub check_deps: Vec<String>,
 }
 
-#[derive(Debug, Clone, Deserialize)]
+#[derive(Debug, Clone, PartialEq, Deserialize)]
 pub struct Options {
     #[serde(default)]
     pub toolchain: tuning::Toolchain,
@@ -97,7 +98,7 @@ pub struct Options {
     pub networking: bool,
 }
 
-#[derive(Debug, Clone, Deserialize)]
+#[derive(Debug, Clone, PartialEq, Deserialize)]
 pub struct Package {
     pub summary: Option<String>,
     pub description: Option<String>,
@@ -109,7 +110,7 @@ pub struct Package {
     pub conflicts: Vec<String>,
 }
 
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, PartialEq)]
 pub enum Upstream {
     Plain {
         uri: Url,
@@ -14,7 +14,7 @@ pub fn from_slice(bytes: &[u8]) -> Result<Macros, Error> {
     serde_yaml::from_slice(bytes)
 }
 
-#[derive(Debug, Clone, Deserialize)]
+#[derive(Debug, Clone, PartialEq, Deserialize)]
 #[serde(rename_all = "camelCase")]
 pub struct Macros {
     #[serde(default, deserialize_with = "sequence_of_key_value")]
@@ -31,7 +31,7 @@ pub struct Macros {
     pub default_tuning_groups: Vec<String>,
 }
 
-#[derive(Debug, Clone, Deserialize)]
+#[derive(Debug, Clone, PartialEq, Deserialize)]
 pub struct Action {
     pub description: String,
     pub example: Option<String>,
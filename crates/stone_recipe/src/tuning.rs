@@ -8,7 +8,7 @@ use thiserror::Error;
 
 use crate::{sequence_of_key_value, single_as_sequence, KeyValue, Macros};
 
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, PartialEq)]
 pub enum Tuning {
     Enable,
     Disable,
@@ -59,7 +59,7 @@ impl<'de> Deserialize<'de> for KeyValue<Tuning> {
     }
 }
 
-#[derive(Debug, Clone, Deserialize)]
+#[derive(Debug, Clone, PartialEq, Deserialize)]
 pub struct TuningFlag {
     #[serde(flatten)]
     root: CompilerFlags,
@@ -88,7 +88,7 @@ pub enum CompilerFlag {
     Ld,
 }
 
-#[derive(Debug, Clone, Deserialize, Default)]
+#[derive(Debug, Clone, PartialEq, Deserialize, Default)]
 pub struct CompilerFlags {
     c: Option<String>,
     cxx: Option<String>,
@@ -109,7 +109,7 @@ impl CompilerFlags {
     }
 }
 
-#[derive(Debug, Clone, Copy, Default, Deserialize)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default, Deserialize)]
 #[serde(rename_all = "lowercase")]
 pub enum Toolchain {
     #[default]
@@ -117,7 +117,7 @@ pub enum Toolchain {
     Gnu,
 }
 
-#[derive(Debug, Clone, Deserialize)]
+#[derive(Debug, Clone, PartialEq, Deserialize)]
 pub struct TuningOption {
     #[serde(default, deserialize_with = "single_as_sequence")]
     pub enabled: Vec<String>,
@@ -125,7 +125,7 @@ pub struct TuningOption {
     pub disabled: Vec<String>,
 }
 
-#[derive(Debug, Clone, Deserialize)]
+#[derive(Debug, Clone, PartialEq, Deserialize)]
 pub struct TuningGroup {
     #[serde(flatten, default)]
     pub root: TuningOption,
@@ -39,17 +39,22 @@ impl CompiledHandler {
 impl Handler {
     /// Substitute all paths using matched variables
     pub fn compiled(&self, with_match: &fnmatch::Match) -> CompiledHandler {
+        self.substituted(&with_match.variables)
+    }
+
+    /// Substitute all paths using the given captured variables
+    pub fn substituted(&self, variables: &BTreeMap<String, String>) -> CompiledHandler {
         match self {
             Handler::Run { run, args } => {
                 let mut run = run.clone();
-                for (key, value) in &with_match.variables {
+                for (key, value) in variables {
                     run = run.replace(&format!("$({key})"), value);
                 }
                 let args = args
                     .iter()
                     .map(|a| {
                         let mut a = a.clone();
-                        for (key, value) in &with_match.variables {
+                        for (key, value) in variables {
                             a = a.replace(&format!("$({key})"), value);
                         }
                         a
@@ -14,14 +14,19 @@ pub mod format;
 /// Grouped management of a set of triggers
 pub struct Collection<'a> {
     handlers: Vec<ExtractedHandler>,
+    /// Every distinct trigger path pattern
+    patterns: fnmatch::PatternSet,
+    /// Indices into `handlers` for each pattern in `patterns`
+    pattern_handlers: Vec<Vec<usize>>,
     triggers: BTreeMap<String, &'a Trigger>,
     hits: BTreeMap<String, BTreeSet<format::CompiledHandler>>,
+    /// Captured variables each handler has already been compiled with
+    compiled: Vec<BTreeSet<BTreeMap<String, String>>>,
 }
 
 #[derive(Debug)]
 struct ExtractedHandler {
     id: String,
-    pattern: fnmatch::Pattern,
     handler: format::Handler,
 }
 
@@ -29,12 +34,18 @@ struct ExtractedHandler {
 pub enum Error {
     #[error("missing handler reference in {0}: {1}")]
     MissingHandler(String, String),
+
+    #[error("pattern")]
+    Pattern(#[from] fnmatch::Error),
 }
 
 impl<'a> Collection<'a> {
     /// Create a new [Collection] using the given triggers
+    // Pattern keys hold a Regex, but aren't ordered by it
+    #[allow(clippy::mutable_key_type)]
     pub fn new(triggers: impl IntoIterator<Item = &'a Trigger>) -> Result<Self, Error> {
         let mut handlers = vec![];
+        let mut patterns = BTreeMap::<&fnmatch::Pattern, Vec<usize>>::new();
         let mut trigger_set = BTreeMap::new();
         for trigger in triggers.into_iter() {
             trigger_set.insert(trigger.name.clone(), trigger);
@@ -45,35 +56,59 @@ impl<'a> Collection<'a> {
                         .handlers
                         .get(used_handler)
                         .ok_or(Error::MissingHandler(trigger.name.clone(), used_handler.clone()))?;
+                    patterns.entry(p).or_default().push(handlers.len());
                     handlers.push(ExtractedHandler {
                         id: trigger.name.clone(),
-                        pattern: p.clone(),
                         handler: handler.clone(),
                     });
                 }
             }
         }
 
+        let (patterns, pattern_handlers): (Vec<_>, Vec<_>) =
+            patterns.into_iter().map(|(p, indices)| (p.clone(), indices)).unzip();
+
         Ok(Self {
+            compiled: vec![BTreeSet::new(); handlers.len()],
             handlers,
+            patterns: fnmatch::PatternSet::new(patterns)?,
+            pattern_handlers,
             triggers: trigger_set,
             hits: BTreeMap::new(),
         })
     }
 
     /// Process a batch set of paths and record the "hit"
-    pub fn process_paths(&mut self, paths: impl Iterator<Item = String>) {
-        let results = paths.into_iter().flat_map(|p| {
-            self.handlers
-                .iter()
-                .filter_map(move |h| h.pattern.match_path(&p).map(|m| (h.id.clone(), h.handler.compiled(&m))))
-        });
-
-        for (id, handler) in results {
-            if let Some(map) = self.hits.get_mut(&id) {
-                map.insert(handler);
-            } else {
-                self.hits.insert(id, BTreeSet::from_iter([handler]));
+    ///
+    /// Each path is matched against all trigger patterns in a single pass, and
+    /// a handler is only compiled once per distinct set of captured variables.
+    pub fn process_paths(&mut self, paths: impl IntoIterator<Item = impl AsRef<str>>) {
+        for path in paths {
+            let path = path.as_ref();
+
+            for index in self.patterns.matches(path) {
+                let pattern = &self.patterns.patterns()[index];
+                let variables = if pattern.has_groups() {
+                    match pattern.match_path(path) {
+                        Some(m) => m.variables,
+                        None => continue,
+                    }
+                } else {
+                    BTreeMap::new()
+                };
+
+                for &handler in &self.pattern_handlers[index] {
+                    if self.compiled[handler].contains(&variables) {
+                        continue;
+                    }
+
+                    let extracted = &self.handlers[handler];
+                    self.hits
+                        .entry(extracted.id.clone())
+                        .or_default()
+                        .insert(extracted.handler.substituted(&variables));
+                    self.compiled[handler].insert(variables.clone());
+                }
             }
         }
     }
@@ -126,3 +161,30 @@ impl<'a> Collection<'a> {
         Ok(results)
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_process_paths() {
+        let trigger: Trigger = serde_yaml::from_str(include_str!("../../../test/trigger.yml")).unwrap();
+        let mut collection = Collection::new([&trigger]).unwrap();
+
+        collection.process_paths([
+            "/usr/lib/modules/6.6.7-267.current/kernel",
+            "/usr/lib/modules/6.6.7-267.current/kernel",
+            "/usr/lib/modules/6.6.8-268.current/kernel",
+            "/usr/lib/modules/6.6.8-268.current/build",
+            "/usr/bin/bash",
+        ]);
+
+        // One handler per distinct kernel version
+        let handlers = collection.bake().unwrap();
+        assert_eq!(handlers.len(), 2);
+        assert!(matches!(
+            handlers[0].handler(),
+            format::Handler::Run { args, .. } if args[1] == "6.6.7-267.current"
+        ));
+    }
+}
@@ -3,7 +3,7 @@
 // SPDX-License-Identifier: MPL-2.0
 
 //! Build a vfs tree incrementally
-use std::collections::BTreeMap;
+use std::collections::{BTreeMap, HashSet};
 
 use crate::path;
 use crate::tree::{Kind, Tree};
@@ -12,22 +12,17 @@ use super::{BlitFile, Error, File};
 
 /// Builder used to generate a full tree, free of conflicts
 pub struct TreeBuilder<T: BlitFile> {
+    // Paths of all explicit entries, stored back to back
+    paths: String,
+
     // Explicitly requested incoming paths
     explicit: Vec<File<T>>,
-
-    // Implicitly created paths
-    implicit_dirs: BTreeMap<String, File<T>>,
 }
 
-/// Special sort algorithm for files by directory
-fn sorted_paths<T>(a: &File<T>, b: &File<T>) -> std::cmp::Ordering {
-    let a_path_len = a.path.matches('/').count();
-    let b_path_len = b.path.matches('/').count();
-    if a_path_len != b_path_len {
-        a_path_len.cmp(&b_path_len)
-    } else {
-        a.path.cmp(&b.path)
-    }
+/// Special sort key for files by directory, directories first for equal paths
+fn sort_key<'a, T>(paths: &'a str, file: &File<T>) -> (usize, &'a str, bool) {
+    let path = file.path.get(paths);
+    (path.matches('/').count(), path, !matches!(file.kind, Kind::Directory))
 }
 
 impl<T: BlitFile> Default for TreeBuilder<T> {
@@ -39,96 +34,97 @@ impl<T: BlitFile> Default for TreeBuilder<T> {
 impl<T: BlitFile> TreeBuilder<T> {
     pub fn new() -> Self {
         TreeBuilder {
+            paths: String::new(),
             explicit: vec![],
-            implicit_dirs: BTreeMap::new(),
         }
     }
 
     /// Push an item to the builder - we don't care if we have duplicates yet
     pub fn push(&mut self, item: T) {
-        let file = File::new(item);
-
-        // Find all parent paths
-        if let Some(parent) = file.parent.as_ref() {
-            let mut leading_path: Option<String> = None;
-            // Build a set of parent paths skipping `/`, yielding `usr`, `usr/bin`, etc.
-            for component in path::components(parent) {
-                let full_path = match leading_path {
-                    Some(fp) => path::join(&fp, component),
-                    None => component.to_owned(),
-                };
-                leading_path = Some(full_path.clone());
-                self.implicit_dirs
-                    .insert(full_path.clone(), File::new(full_path.into()));
-            }
-        }
+        let file = File::new(&mut self.paths, item);
         self.explicit.push(file);
     }
 
-    /// Sort incoming entries and remove duplicates
+    /// Sort incoming entries
     pub fn bake(&mut self) {
-        self.explicit.sort_by(sorted_paths);
-
-        // Walk again to remove accidental dupes
-        for i in self.explicit.iter() {
-            self.implicit_dirs.remove(&i.path);
-        }
+        let paths = &self.paths;
+        self.explicit.sort_by_cached_key(|f| sort_key(paths, f));
     }
 
     /// Generate the final tree by baking all inputs
     pub fn tree(&self) -> Result<Tree<T>, Error> {
-        // Chain all directories, replace implicits with explicit
-        let all_dirs = self
+        let explicit_paths = self
             .explicit
             .iter()
-            .filter(|f| matches!(f.kind, Kind::Directory))
-            .chain(self.implicit_dirs.values())
-            .map(|d| (&d.path, d))
-            .collect::<BTreeMap<_, _>>();
-
-        // build a set of redirects
-        let mut redirects = BTreeMap::new();
-
-        // Resolve symlinks-to-dirs
-        for link in self.explicit.iter() {
-            if let Kind::Symlink(target) = &link.kind {
-                // Resolve the link.
-                let target = if target.starts_with('/') {
-                    target.clone()
-                } else if let Some(parent) = link.parent.as_ref() {
-                    path::join(parent, target)
-                } else {
-                    target.clone()
-                };
-                if all_dirs.contains_key(&target) {
-                    redirects.insert(&link.path, target);
+            .map(|f| f.path.get(&self.paths))
+            .collect::<HashSet<_>>();
+
+        // Parent directories with no explicit entry of their own
+        let mut implicit_dirs = HashSet::new();
+        for file in self.explicit.iter() {
+            let mut parent = path::parent(file.path.get(&self.paths));
+            while let Some(dir) = parent {
+                if explicit_paths.contains(dir) || !implicit_dirs.insert(dir) {
+                    break;
                 }
+                parent = path::parent(dir);
             }
         }
 
-        // Insert everything WITHOUT redirects, directory first.
-        let mut full_set = all_dirs
-            .into_values()
-            .chain(self.explicit.iter().filter(|m| !matches!(m.kind, Kind::Directory)))
-            .collect::<Vec<_>>();
-        full_set.sort_by(|a, b| sorted_paths(a, b));
+        let mut tree: Tree<T> = Tree::with_capacity(self.explicit.len() + implicit_dirs.len(), self.paths.clone());
 
-        let estimated_capacity = self.implicit_dirs.len() + self.explicit.len();
-        let mut tree: Tree<T> = Tree::with_capacity(estimated_capacity);
+        // Insert everything WITHOUT redirects, parents first.
+        let mut full_set = self.explicit.clone();
+        for dir in implicit_dirs {
+            full_set.push(tree.new_file(dir.to_owned().into()));
+        }
+        full_set.sort_by_cached_key(|f| sort_key(&tree.paths, f));
 
-        // Build the initial full tree now.
-        for entry in full_set {
-            // New node for this guy
-            let node = tree.new_node(entry.clone());
+        // build a set of redirects
+        let mut redirects = BTreeMap::new();
 
-            if let Some(parent) = entry.parent.as_ref() {
-                tree.add_child_to_node(node, parent)?;
+        // Build the initial full tree now, caching the parent as siblings are adjacent.
+        let mut last_parent = None;
+        for entry in full_set {
+            let path = tree.str(entry.path);
+
+            // Resolve symlinks-to-dirs once all directories exist
+            if let Kind::Symlink(target) = &entry.kind {
+                redirects.insert(
+                    path.to_owned(),
+                    match path::parent(path) {
+                        Some(parent) if !target.starts_with('/') => path::join(parent, target),
+                        _ => target.clone(),
+                    },
+                );
             }
+
+            let parent = match path::parent(path) {
+                Some(parent) => Some(match &last_parent {
+                    Some((cached, node)) if cached == parent => *node,
+                    _ => {
+                        let node = tree
+                            .resolve_node(parent)
+                            .ok_or_else(|| Error::MissingParent(parent.to_owned()))?;
+                        last_parent = Some((parent.to_owned(), node));
+                        node
+                    }
+                }),
+                None => None,
+            };
+
+            tree.insert(entry, parent, true);
         }
 
+        // Only symlinks to directories of the initial tree redirect
+        redirects.retain(|_, target| {
+            tree.resolve_node(target)
+                .is_some_and(|n| matches!(tree.arena[n].get().kind, Kind::Directory))
+        });
+
         // Reparent any symlink redirects.
         for (source_tree, target_tree) in redirects {
-            tree.reparent(source_tree, &target_tree)?;
+            tree.reparent(&source_tree, &target_tree)?;
         }
         Ok(tree)
     }
@@ -216,4 +212,38 @@ mod tests {
         b.bake();
         b.tree().unwrap();
     }
+
+    #[test]
+    fn test_duplicates() {
+        let mut b: TreeBuilder<CustomFile> = TreeBuilder::new();
+        for (path, kind, id) in [
+            ("/usr/lib/libz.so", Kind::Regular, "zlib"),
+            ("/usr/lib", Kind::Directory, "filesystem"),
+            ("/usr/lib/libz.so", Kind::Regular, "zlib-ng"),
+            ("/usr/lib", Kind::Directory, "glibc"),
+        ] {
+            b.push(CustomFile {
+                path: path.into(),
+                kind,
+                id: id.into(),
+            });
+        }
+        b.bake();
+        let tree = b.tree().unwrap();
+
+        let files = tree
+            .iter()
+            .map(|f| (f.path.as_str(), f.id.as_str()))
+            .collect::<Vec<_>>();
+        assert_eq!(
+            files,
+            [
+                ("/", "Virtual"),
+                ("/usr", "Virtual"),
+                ("/usr/lib", "glibc"),
+                ("/usr/lib/libz.so", "zlib")
+            ]
+        );
+        assert_eq!(tree.len(), 4);
+    }
 }
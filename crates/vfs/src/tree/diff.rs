@@ -0,0 +1,171 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Compute the minimal set of changes between two trees
+use std::collections::HashMap;
+
+use super::{BlitFile, File, Tree};
+
+/// Changes required to transform a source [`Tree`] into a target [`Tree`]
+#[derive(Debug)]
+pub struct Diff<'a, T: BlitFile> {
+    /// Entries missing from the target, or replaced by an entry of another kind.
+    /// Ordered children first so they can be removed in sequence.
+    pub removed: Vec<&'a T>,
+
+    /// Entries missing from the source, or replacing an entry of another kind.
+    /// Ordered parents first so they can be created in sequence.
+    pub added: Vec<&'a T>,
+
+    /// `(source, target)` entries of the same kind at the same path which
+    /// otherwise differ. Ordered parents first.
+    pub modified: Vec<(&'a T, &'a T)>,
+}
+
+impl<T: BlitFile> Diff<'_, T> {
+    /// Total number of changed entries
+    pub fn len(&self) -> usize {
+        self.removed.len() + self.added.len() + self.modified.len()
+    }
+
+    /// Returns true if both trees are identical
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+}
+
+impl<T: BlitFile> Tree<T> {
+    /// Iterate all live nodes, parents first, starting at the `/` node
+    fn files(&self) -> impl Iterator<Item = &File<T>> {
+        self.resolve_node("/")
+            .into_iter()
+            .flat_map(|root| root.descendants(&self.arena))
+            .filter_map(|id| self.arena.get(id))
+            .map(|node| node.get())
+    }
+
+    /// Compute the [`Diff`] from this tree to `target`
+    ///
+    /// Entries are keyed by path & [`super::Kind`], `eq` decides whether two entries of
+    /// the same kind at the same path are equivalent.
+    pub fn diff<'a>(&'a self, target: &'a Tree<T>, eq: impl Fn(&T, &T) -> bool) -> Diff<'a, T> {
+        let source_files = self.files().map(|f| (self.str(f.path), f)).collect::<HashMap<_, _>>();
+        let target_files = target
+            .files()
+            .map(|f| (target.str(f.path), f))
+            .collect::<HashMap<_, _>>();
+
+        let mut removed = self
+            .files()
+            .filter(|f| match target_files.get(self.str(f.path)) {
+                Some(t) => t.kind != f.kind,
+                None => true,
+            })
+            .map(|f| &f.inner)
+            .collect::<Vec<_>>();
+        removed.reverse();
+
+        let mut added = vec![];
+        let mut modified = vec![];
+
+        for file in target.files() {
+            match source_files.get(target.str(file.path)) {
+                Some(s) if s.kind == file.kind => {
+                    if !eq(&s.inner, &file.inner) {
+                        modified.push((&s.inner, &file.inner));
+                    }
+                }
+                _ => added.push(&file.inner),
+            }
+        }
+
+        Diff {
+            removed,
+            added,
+            modified,
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use crate::tree::{builder::TreeBuilder, BlitFile, Kind, Tree};
+
+    #[derive(Clone, Debug, PartialEq, Eq)]
+    struct CustomFile {
+        path: String,
+        kind: Kind,
+        mode: u32,
+    }
+
+    impl From<String> for CustomFile {
+        fn from(value: String) -> Self {
+            Self {
+                path: value,
+                kind: Kind::Directory,
+                mode: 0o755,
+            }
+        }
+    }
+
+    impl BlitFile for CustomFile {
+        fn path(&self) -> String {
+            self.path.clone()
+        }
+
+        fn kind(&self) -> Kind {
+            self.kind.clone()
+        }
+
+        fn id(&self) -> String {
+            "test".into()
+        }
+
+        fn cloned_to(&self, path: String) -> Self {
+            Self { path, ..self.clone() }
+        }
+    }
+
+    fn tree(files: &[(&str, Kind, u32)]) -> Tree<CustomFile> {
+        let mut b = TreeBuilder::new();
+        for (path, kind, mode) in files {
+            b.push(CustomFile {
+                path: (*path).to_owned(),
+                kind: kind.clone(),
+                mode: *mode,
+            });
+        }
+        b.bake();
+        b.tree().unwrap()
+    }
+
+    #[test]
+    fn test_diff() {
+        let old = tree(&[
+            ("/usr/bin/nano", Kind::Regular, 0o755),
+            ("/usr/bin/rnano", Kind::Symlink("nano".into()), 0o777),
+            ("/usr/share/nano/a", Kind::Regular, 0o644),
+            ("/usr/share/vim", Kind::Regular, 0o644),
+        ]);
+        let new = tree(&[
+            ("/usr/bin/nano", Kind::Regular, 0o700),
+            ("/usr/bin/rnano", Kind::Symlink("nano".into()), 0o777),
+            ("/usr/share/vim/a", Kind::Regular, 0o644),
+        ]);
+
+        let diff = old.diff(&new, |a, b| a == b);
+
+        let removed = diff.removed.iter().map(|f| f.path.as_str()).collect::<Vec<_>>();
+        let added = diff.added.iter().map(|f| f.path.as_str()).collect::<Vec<_>>();
+        let modified = diff.modified.iter().map(|(_, f)| f.path.as_str()).collect::<Vec<_>>();
+
+        // Children are removed before their parents
+        assert_eq!(removed, ["/usr/share/vim", "/usr/share/nano/a", "/usr/share/nano"]);
+        // Parents are created before their children
+        assert_eq!(added, ["/usr/share/vim", "/usr/share/vim/a"]);
+        assert_eq!(modified, ["/usr/bin/nano"]);
+
+        assert!(new.diff(&new, |a, b| a == b).is_empty());
+    }
+}
@@ -6,6 +6,7 @@
 
 use core::fmt::Debug;
 use std::collections::HashMap;
+use std::hash::{BuildHasher, RandomState};
 use std::vec;
 
 use indextree::{Arena, Descendants, NodeId};
@@ -14,6 +15,7 @@ use thiserror::Error;
 use crate::path;
 
 pub mod builder;
+pub mod diff;
 
 #[derive(Clone, Default, Debug, PartialEq, Eq, PartialOrd, Ord)]
 pub enum Kind {
@@ -39,28 +41,48 @@ pub trait BlitFile: Clone + Sized + Debug + From<String> {
     fn cloned_to(&self, path: String) -> Self;
 }
 
+/// Byte range of a string within a tree's path buffer
+#[derive(Debug, Clone, Copy)]
+struct Span {
+    start: u32,
+    len: u32,
+}
+
+impl Span {
+    fn get(self, paths: &str) -> &str {
+        &paths[self.start as usize..(self.start + self.len) as usize]
+    }
+}
+
 #[derive(Debug, Clone)]
 struct File<T> {
-    // Cache these to avoid reallocation
-    id: String,
-    path: String,
-    file_name: Option<String>,
-    parent: Option<String>,
+    // Both index into the shared path buffer to avoid per entry allocations
+    path: Span,
+    file_name: Span,
     kind: Kind,
     inner: T,
 }
 
 impl<T: BlitFile> File<T> {
-    pub fn new(inner: T) -> Self {
+    /// Record the path of `inner` at the end of `paths`
+    fn new(paths: &mut String, inner: T) -> Self {
         let path = inner.path();
-        let file_name = path::file_name(&path).map(String::from);
-        let parent = path::parent(&path).map(String::from);
+
+        let trimmed = path.trim_end_matches('/');
+        let name_start = trimmed.rfind('/').map_or(0, |i| i + 1);
+
+        let start = paths.len() as u32;
+        paths.push_str(&path);
 
         Self {
-            id: inner.id(),
-            path,
-            file_name,
-            parent,
+            path: Span {
+                start,
+                len: path.len() as u32,
+            },
+            file_name: Span {
+                start: start + name_start as u32,
+                len: (trimmed.len() - name_start) as u32,
+            },
             kind: inner.kind(),
             inner,
         }
@@ -71,16 +93,24 @@ impl<T: BlitFile> File<T> {
 #[derive(Debug)]
 pub struct Tree<T: BlitFile> {
     arena: Arena<File<T>>,
-    map: HashMap<String, NodeId>,
+    // All paths in the tree, stored back to back
+    paths: String,
+    // Children of each node, keyed by the hash of their file name
+    children: HashMap<(NodeId, u64), NodeId>,
+    hasher: RandomState,
+    root: Option<NodeId>,
     length: u64,
 }
 
 impl<T: BlitFile> Tree<T> {
-    /// Construct a new Tree with specified capacity
-    fn with_capacity(capacity: usize) -> Self {
+    /// Construct a new Tree with specified capacity, reusing an existing path buffer
+    fn with_capacity(capacity: usize, paths: String) -> Self {
         Tree {
             arena: Arena::with_capacity(capacity),
-            map: HashMap::with_capacity(capacity),
+            paths,
+            children: HashMap::with_capacity(capacity),
+            hasher: RandomState::new(),
+            root: None,
             length: 0_u64,
         }
     }
@@ -95,60 +125,121 @@ impl<T: BlitFile> Tree<T> {
         self.length == 0
     }
 
-    /// Generate a new node, store the path mapping for it
+    fn str(&self, span: Span) -> &str {
+        span.get(&self.paths)
+    }
+
+    /// Create a [`File`] backed by this tree's path buffer
+    fn new_file(&mut self, inner: T) -> File<T> {
+        File::new(&mut self.paths, inner)
+    }
+
+    /// Generate a new node
     fn new_node(&mut self, data: File<T>) -> NodeId {
-        let path = data.path.clone();
         let node = self.arena.new_node(data);
-        self.map.insert(path, node);
         self.length += 1;
         node
     }
 
+    /// Find the direct child of `parent` with the given file name
+    fn child(&self, parent: NodeId, file_name: &str) -> Option<NodeId> {
+        let node = *self.children.get(&(parent, self.hasher.hash_one(file_name)))?;
+
+        if self.str(self.arena[node].get().file_name) == file_name {
+            Some(node)
+        } else {
+            // Hash collision, fall back to scanning the siblings
+            parent
+                .children(&self.arena)
+                .find(|c| self.str(self.arena[*c].get().file_name) == file_name)
+        }
+    }
+
     /// Resolve a node using the path
-    fn resolve_node(&self, data: &str) -> Option<&NodeId> {
-        self.map.get(data)
+    fn resolve_node(&self, path: &str) -> Option<NodeId> {
+        let mut components = path::components(path);
+
+        if components.next()? != "/" {
+            return None;
+        }
+
+        components.try_fold(self.root?, |node, name| self.child(node, name))
     }
 
-    /// Add a child to the given parent node
-    fn add_child_to_node(&mut self, node_id: NodeId, parent: &str) -> Result<(), Error> {
-        let node = self.arena.get(node_id).unwrap();
-        let Some(parent_node) = self.map.get(parent) else {
-            return Err(Error::MissingParent(parent.to_owned()));
+    /// Insert `file` as a child of `parent`
+    ///
+    /// If `parent` already has an entry with the same name the duplicate is reported and
+    /// dropped, unless both are directories: these silently merge, keeping the existing
+    /// entry unless `replace` is set.
+    fn insert(&mut self, file: File<T>, parent: Option<NodeId>, replace: bool) {
+        let Some(parent) = parent else {
+            let is_root = self.str(file.path) == "/";
+            match self.root {
+                Some(root) if is_root => self.merge(root, file, replace),
+                _ => {
+                    let node = self.new_node(file);
+                    if is_root {
+                        self.root = Some(node);
+                    }
+                }
+            }
+            return;
         };
 
-        let others = parent_node
-            .children(&self.arena)
-            .filter_map(|n| {
-                let n = self.arena.get(n)?.get();
-                if n.file_name == node.get().file_name {
-                    Some(n)
-                } else {
-                    None
+        let file_name = self.str(file.file_name);
+
+        match self.child(parent, file_name) {
+            Some(existing) => self.merge(existing, file, replace),
+            None => {
+                let key = (parent, self.hasher.hash_one(file_name));
+                let node = self.new_node(file);
+                parent.append(node, &mut self.arena);
+                self.children.entry(key).or_insert(node);
+            }
+        }
+    }
+
+    /// Handle `file` attempting to occupy the same path as `existing`
+    fn merge(&mut self, existing: NodeId, file: File<T>, replace: bool) {
+        let current = self.arena[existing].get_mut();
+
+        if matches!((&current.kind, &file.kind), (Kind::Directory, Kind::Directory)) {
+            if replace {
+                current.inner = file.inner;
+            }
+            return;
+        }
+
+        // TODO: Reenable
+        // Err(Error::Duplicate(...))
+
+        // Report duplicate and skip for now
+        eprintln!(
+            "error: {}",
+            Error::Duplicate(
+                file.path.get(&self.paths).to_owned(),
+                file.inner.id(),
+                current.inner.id()
+            )
+        );
+    }
+
+    /// Remove `node` and all of its descendants
+    fn remove_subtree(&mut self, node: NodeId) {
+        for id in node.descendants(&self.arena).collect::<Vec<_>>() {
+            let item = self.arena[id].get();
+
+            if let Some(parent) = self.arena[id].parent() {
+                let key = (parent, self.hasher.hash_one(self.str(item.file_name)));
+                if self.children.get(&key) == Some(&id) {
+                    self.children.remove(&key);
                 }
-            })
-            .collect::<Vec<_>>();
-        if !others.is_empty() {
-            // TODO: Reenable
-            // Err(Error::Duplicate(
-            //     node.get().path(),
-            //     node.get().id(),
-            //     others.first().unwrap().id(),
-            // ))
-
-            // Report duplicate and skip for now
-            eprintln!(
-                "error: {}",
-                Error::Duplicate(
-                    node.get().path.clone(),
-                    node.get().id.clone(),
-                    others.first().unwrap().id.clone()
-                )
-            );
-        } else {
-            parent_node.append(node_id, &mut self.arena);
+            }
+
+            self.length -= 1;
         }
 
-        Ok(())
+        node.remove_subtree(&mut self.arena);
     }
 
     pub fn print(&self) {
@@ -159,38 +250,37 @@ impl<T: BlitFile> Tree<T> {
     /// For all descendents of the given source tree, return a set of the reparented nodes,
     /// and remove the originals from the tree
     fn reparent(&mut self, source_path: &str, target_path: &str) -> Result<(), Error> {
-        let mut mutations = vec![];
-        let mut orphans = vec![];
-        if let Some(source) = self.map.get(source_path) {
-            if let Some(_target) = self.map.get(target_path) {
-                for child in source.descendants(&self.arena).skip(1) {
-                    mutations.push(child);
-                }
-            }
+        let Some(source) = self.resolve_node(source_path) else {
+            return Ok(());
+        };
 
-            for i in mutations {
-                let original = self.arena.get(i).unwrap().get();
-                let relapath = path::join(target_path, original.path.strip_prefix(source_path).unwrap());
-                orphans.push(File::new(original.inner.cloned_to(relapath)));
+        let mut orphans = vec![];
+        if self.resolve_node(target_path).is_some() {
+            for child in source.descendants(&self.arena).skip(1) {
+                let original = self.arena[child].get();
+                let relapath = path::join(target_path, self.str(original.path).strip_prefix(source_path).unwrap());
+                orphans.push(original.inner.cloned_to(relapath));
             }
+        }
 
-            // Remove descendents
-            let children = source.children(&self.arena).collect::<Vec<_>>();
-            for child in children.iter() {
-                child.remove_subtree(&mut self.arena);
-            }
+        // Remove descendents
+        let children = source.children(&self.arena).collect::<Vec<_>>();
+        for child in children {
+            self.remove_subtree(child);
         }
 
+        // Descendants are ordered parents first, so all parents will exist
         for orphan in orphans {
-            let path = &orphan.path;
-            // Do we have this node already?
-            let node = match self.resolve_node(path) {
-                Some(n) => *n,
-                None => self.new_node(orphan.clone()),
+            let file = self.new_file(orphan);
+            let path = self.str(file.path);
+            let parent = match path::parent(path) {
+                Some(parent) => Some(
+                    self.resolve_node(parent)
+                        .ok_or_else(|| Error::MissingParent(parent.to_owned()))?,
+                ),
+                None => None,
             };
-            if let Some(parent) = orphan.parent.as_ref() {
-                self.add_child_to_node(node, parent)?;
-            }
+            self.insert(file, parent, false);
         }
 
         Ok(())
@@ -206,14 +296,14 @@ impl<T: BlitFile> Tree<T> {
 
     /// Return structured view beginning at `/`
     pub fn structured(&self) -> Option<Element<'_, T>> {
-        self.resolve_node("/").map(|root| self.structured_children(root))
+        self.resolve_node("/").map(|root| self.structured_children(&root))
     }
 
     /// For the given node, recursively convert to Element::Directory of Child
     fn structured_children(&self, start: &NodeId) -> Element<'_, T> {
         let node = &self.arena[*start];
         let item = node.get();
-        let partial = item.file_name.as_deref().unwrap_or_default();
+        let partial = self.str(item.file_name);
 
         match item.kind {
             Kind::Directory => {
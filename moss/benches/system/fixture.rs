@@ -0,0 +1,424 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Synthetic large-system fixture
+//!
+//! [`System::generate`] builds a deterministic system shaped like a desktop
+//! install: thousands of packages, each with binaries, a versioned shared
+//! library and a tree of data files, sharing parent directories and depending
+//! on earlier packages by name and soname. Regular files draw from a limited
+//! pool of assets, so hardlinks are shared between layouts as they are in a
+//! real asset store.
+
+use std::{
+    env,
+    io::{BufWriter, Write},
+    path::{Path, PathBuf},
+    process,
+    sync::atomic::{AtomicUsize, Ordering},
+};
+
+use fs_err::{self as fs, File};
+use moss::{
+    client::{cache, PendingFile},
+    db, dependency, package, Dependency, Installation, Provider,
+};
+use serde::Deserialize;
+use stone::payload::{layout, Index, Layout};
+use triggers::format::Trigger;
+use xxhash_rust::xxh3::xxh3_128;
+
+/// Number of packages in the default system
+pub const NUM_PACKAGES: usize = 2_400;
+/// Layouts per package, for 230k+ entries in the default system
+pub const LAYOUTS_PER_PACKAGE: usize = 96;
+/// Distinct assets referenced by regular files
+const NUM_ASSETS: u64 = 8_192;
+
+/// Transaction & system triggers matching paths of the generated system
+const TRIGGERS: &str = r#"
+name: depmod
+description: Update kernel module dependencies
+handlers:
+    depmod:
+        run: /sbin/depmod
+        args: ["-a", "$(version)"]
+paths:
+    "/usr/lib/modules/(version:*)/kernel":
+        handlers:
+            - depmod
+        type: directory
+---
+name: ldconfig
+description: Update the shared library cache
+handlers:
+    ldconfig:
+        run: /sbin/ldconfig
+        args: ["-X"]
+paths:
+    "/usr/lib/lib*.so.*":
+        handlers:
+            - ldconfig
+---
+name: glib2-schemas
+description: Compile GSettings schemas
+handlers:
+    compile:
+        run: /usr/bin/glib-compile-schemas
+        args: ["/usr/share/glib-2.0/schemas"]
+paths:
+    "/usr/share/glib-2.0/schemas/*.xml":
+        handlers:
+            - compile
+---
+name: icon-cache
+description: Update icon theme caches
+handlers:
+    update:
+        run: /usr/bin/gtk-update-icon-cache
+        args: ["-ftq", "/usr/share/icons/$(theme)"]
+paths:
+    "/usr/share/icons/(theme:*)/index.theme":
+        handlers:
+            - update
+---
+name: sysusers
+description: Create system users
+handlers:
+    sysusers:
+        run: /usr/bin/systemd-sysusers
+        args: []
+paths:
+    "/usr/lib/sysusers.d/*.conf":
+        handlers:
+            - sysusers
+"#;
+
+#[derive(Debug, Clone)]
+pub struct Package {
+    pub id: package::Id,
+    pub meta: package::Meta,
+    pub layouts: Vec<Layout>,
+}
+
+#[derive(Debug, Clone)]
+pub struct System {
+    pub packages: Vec<Package>,
+}
+
+impl System {
+    pub fn generate(num_packages: usize, layouts_per_package: usize) -> Self {
+        Self {
+            packages: (0..num_packages)
+                .map(|i| generate_package(i, 1, layouts_per_package))
+                .collect(),
+        }
+    }
+
+    /// The same system with every `nth` package rebuilt at a new release, changing its
+    /// id and the assets of its regular files
+    pub fn upgraded(&self, nth: usize) -> Self {
+        Self {
+            packages: self
+                .packages
+                .iter()
+                .enumerate()
+                .map(|(i, package)| {
+                    if i % nth == 0 {
+                        generate_package(i, package.meta.source_release + 1, package.layouts.len())
+                    } else {
+                        package.clone()
+                    }
+                })
+                .collect(),
+        }
+    }
+
+    pub fn ids(&self) -> impl Iterator<Item = &package::Id> {
+        self.packages.iter().map(|package| &package.id)
+    }
+
+    pub fn layouts(&self) -> impl Iterator<Item = (&package::Id, &Layout)> {
+        self.packages
+            .iter()
+            .flat_map(|package| package.layouts.iter().map(move |layout| (&package.id, layout)))
+    }
+
+    pub fn num_layouts(&self) -> usize {
+        self.packages.iter().map(|package| package.layouts.len()).sum()
+    }
+
+    pub fn metas(&self) -> Vec<(package::Id, package::Meta)> {
+        self.packages
+            .iter()
+            .map(|package| (package.id.clone(), package.meta.clone()))
+            .collect()
+    }
+
+    pub fn pending_files(&self) -> Vec<PendingFile> {
+        self.layouts()
+            .map(|(id, layout)| PendingFile {
+                id: id.clone(),
+                layout: layout.clone(),
+            })
+            .collect()
+    }
+
+    pub fn meta_db(&self) -> db::meta::Database {
+        let db = db::meta::Database::new(":memory:").expect("meta db");
+        db.batch_add(self.metas()).expect("add metas");
+        db
+    }
+
+    /// Create an empty asset for every regular file, as blitting only links them
+    pub fn write_assets(&self, installation: &Installation) {
+        for (_, layout) in self.layouts() {
+            if let layout::Entry::Regular(hash, _) = &layout.entry {
+                let path = cache::asset_path(installation, &format!("{hash:02x}"));
+
+                if !path.exists() {
+                    fs::create_dir_all(path.parent().expect("asset dir")).expect("create asset dir");
+                    File::create(path).expect("create asset");
+                }
+            }
+        }
+    }
+}
+
+fn generate_package(position: usize, release: u64, num_layouts: usize) -> Package {
+    let name = format!("pkg-{position:04}");
+    let soname = format!("lib{name}.so.1");
+
+    let mut dependencies = vec![];
+    if position > 0 {
+        // Always depend on earlier packages, so the graph stays acyclic
+        let by_name = (position * 31 + 7) % position;
+        let by_soname = (position * 17 + 3) % position;
+        dependencies.push(Dependency {
+            kind: dependency::Kind::PackageName,
+            name: format!("pkg-{by_name:04}"),
+        });
+        dependencies.push(Dependency {
+            kind: dependency::Kind::SharedLibrary,
+            name: format!("libpkg-{by_soname:04}.so.1(x86_64)"),
+        });
+    }
+
+    let meta = package::Meta {
+        name: package::Name::from(name.clone()),
+        version_identifier: "1.0.0".to_owned(),
+        source_release: release,
+        build_release: 1,
+        architecture: "x86_64".to_owned(),
+        summary: format!("Synthetic package {name}"),
+        description: format!("Synthetic package {name}, generated for benchmarking"),
+        source_id: name.clone(),
+        homepage: "https://serpentos.com".to_owned(),
+        licenses: vec!["MPL-2.0".to_owned()],
+        dependencies: dependencies.into_iter().collect(),
+        providers: [
+            Provider {
+                kind: dependency::Kind::PackageName,
+                name: name.clone(),
+            },
+            Provider {
+                kind: dependency::Kind::SharedLibrary,
+                name: format!("{soname}(x86_64)"),
+            },
+            Provider {
+                kind: dependency::Kind::Binary,
+                name: name.clone(),
+            },
+        ]
+        .into(),
+        conflicts: Default::default(),
+        uri: Some(format!("{name}-1.0.0-{release}-1-x86_64.stone")),
+        hash: Some(format!("{:032x}", digest(position as u64, release))),
+        download_size: Some(1024 * 1024),
+    };
+
+    let mut seed = position as u64 * num_layouts as u64 + (release << 48);
+    let mut regular = |path: String| {
+        seed += 1;
+        entry(layout::Entry::Regular(asset(seed), path), 0o644)
+    };
+
+    let mut layouts = vec![
+        entry(layout::Entry::Directory("bin".to_owned()), 0o755),
+        entry(layout::Entry::Directory("lib".to_owned()), 0o755),
+        entry(layout::Entry::Directory("share".to_owned()), 0o755),
+        entry(layout::Entry::Directory(format!("share/{name}")), 0o755),
+        entry(layout::Entry::Directory("share/doc".to_owned()), 0o755),
+        entry(layout::Entry::Directory(format!("share/doc/{name}")), 0o755),
+        regular(format!("bin/{name}")),
+        entry(
+            layout::Entry::Symlink(name.clone(), format!("bin/{name}-compat")),
+            0o777,
+        ),
+        regular(format!("lib/{soname}.0.0")),
+        entry(
+            layout::Entry::Symlink(format!("{soname}.0.0"), format!("lib/{soname}")),
+            0o777,
+        ),
+        regular(format!("share/doc/{name}/README")),
+    ];
+
+    // Sprinkle in the paths that system triggers act on
+    if position % 200 == 0 {
+        let kernel = format!("lib/modules/6.{}.0-{release}.current", position / 200);
+        layouts.push(entry(layout::Entry::Directory("lib/modules".to_owned()), 0o755));
+        layouts.push(entry(layout::Entry::Directory(kernel.clone()), 0o755));
+        layouts.push(entry(layout::Entry::Directory(format!("{kernel}/kernel")), 0o755));
+    }
+    if position % 10 == 0 {
+        layouts.push(entry(layout::Entry::Directory("share/glib-2.0".to_owned()), 0o755));
+        layouts.push(entry(
+            layout::Entry::Directory("share/glib-2.0/schemas".to_owned()),
+            0o755,
+        ));
+        layouts.push(regular(format!("share/glib-2.0/schemas/org.{name}.gschema.xml")));
+    }
+    if position % 100 == 0 {
+        let theme = format!("share/icons/{name}-theme");
+        layouts.push(entry(layout::Entry::Directory("share/icons".to_owned()), 0o755));
+        layouts.push(entry(layout::Entry::Directory(theme.clone()), 0o755));
+        layouts.push(regular(format!("{theme}/index.theme")));
+    }
+    if position % 50 == 0 {
+        layouts.push(entry(layout::Entry::Directory("lib/sysusers.d".to_owned()), 0o755));
+        layouts.push(regular(format!("lib/sysusers.d/{name}.conf")));
+    }
+
+    // Fill up with data files, spread over a few subdirectories
+    for j in 0.. {
+        if layouts.len() >= num_layouts {
+            break;
+        }
+
+        let dir = format!("share/{name}/{:02}", j % 8);
+        if j < 8 {
+            layouts.push(entry(layout::Entry::Directory(dir), 0o755));
+        } else {
+            layouts.push(regular(format!("{dir}/{j:04}.dat")));
+        }
+    }
+
+    layouts.truncate(num_layouts);
+
+    Package {
+        id: package::Id::from(format!("{:032x}", digest(position as u64, release) ^ 1)),
+        meta,
+        layouts,
+    }
+}
+
+fn entry(entry: layout::Entry, mode: u32) -> Layout {
+    Layout {
+        uid: 0,
+        gid: 0,
+        mode,
+        tag: 0,
+        entry,
+    }
+}
+
+fn digest(a: u64, b: u64) -> u128 {
+    xxh3_128(&[a.to_le_bytes(), b.to_le_bytes()].concat())
+}
+
+fn asset(seed: u64) -> u128 {
+    digest(seed.wrapping_mul(0x9E37_79B9_7F4A_7C15) % NUM_ASSETS, 0)
+}
+
+/// Triggers acting on the generated system
+pub fn triggers() -> Vec<Trigger> {
+    serde_yaml::Deserializer::from_str(TRIGGERS)
+        .map(|document| Trigger::deserialize(document).expect("valid trigger"))
+        .collect()
+}
+
+/// Write a package stone with `num_files` distinct entries of mixed size,
+/// returning its meta and content size
+pub fn write_stone(path: &Path, num_files: u64) -> (package::Meta, u64) {
+    let contents = (0..num_files).map(content).collect::<Vec<_>>();
+
+    let mut start = 0;
+    let indices = contents
+        .iter()
+        .map(|content| {
+            let index = Index {
+                start,
+                end: start + content.len() as u64,
+                digest: xxh3_128(content),
+            };
+            start = index.end;
+            index
+        })
+        .collect();
+
+    let mut out = BufWriter::new(File::create(path).expect("create stone"));
+    let mut writer = stone::Writer::new(&mut out, stone::header::v1::FileType::Binary)
+        .expect("stone writer")
+        .with_framed_content(indices, 8 * 1024 * 1024, 0)
+        .expect("content writer");
+    for content in &contents {
+        writer.add_content(&mut content.as_slice()).expect("add content");
+    }
+    writer.finalize().expect("finalize stone");
+    out.flush().expect("flush stone");
+
+    let mut meta = generate_package(0, 1, 0).meta;
+    meta.uri = Some(
+        url::Url::from_file_path(fs::canonicalize(path).expect("stone path"))
+            .expect("file url")
+            .to_string(),
+    );
+    meta.hash = Some(format!("{:032x}", digest(num_files, u64::MAX)));
+
+    (meta, start)
+}
+
+/// Deterministic, moderately compressible file content of 1-64 KiB
+fn content(n: u64) -> Vec<u8> {
+    let size = ((n * 7_919) % 64 + 1) as usize * 1024;
+    let mut content = Vec::with_capacity(size + 64);
+
+    for line in 0.. {
+        if content.len() >= size {
+            break;
+        }
+        let _ = writeln!(content, "{n:08x} {line:06} {:032x}", digest(n, line / 4));
+    }
+
+    content.truncate(size);
+    content
+}
+
+/// A directory in the system temp dir, removed on drop
+pub struct Scratch(PathBuf);
+
+impl Scratch {
+    pub fn new(name: &str) -> Self {
+        static COUNT: AtomicUsize = AtomicUsize::new(0);
+
+        let path = env::temp_dir().join(format!(
+            "moss-bench-{}-{name}-{}",
+            process::id(),
+            COUNT.fetch_add(1, Ordering::Relaxed)
+        ));
+        fs::create_dir_all(&path).expect("create scratch dir");
+
+        Self(path)
+    }
+
+    pub fn path(&self) -> &Path {
+        &self.0
+    }
+}
+
+impl Drop for Scratch {
+    fn drop(&mut self) {
+        let _ = fs::remove_dir_all(&self.0);
+    }
+}
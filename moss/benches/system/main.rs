@@ -0,0 +1,240 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Benchmarks of the moss hot paths against a synthetic large system
+//!
+//! Compare runs across commits with `just bench <baseline>`
+
+use std::sync::LazyLock;
+
+use criterion::{black_box, criterion_group, criterion_main, BatchSize, Criterion, Throughput};
+use fs_err as fs;
+use moss::{
+    client::{cache, PendingFile},
+    db,
+    registry::plugin,
+    repository, runtime,
+    state::Selection,
+    Client, Installation, Registry,
+};
+use vfs::tree::{builder::TreeBuilder, BlitFile};
+
+use self::fixture::{Scratch, System};
+
+mod fixture;
+
+static SYSTEM: LazyLock<System> =
+    LazyLock::new(|| System::generate(fixture::NUM_PACKAGES, fixture::LAYOUTS_PER_PACKAGE));
+
+/// Files in the stone unpacked by the `cache` benches
+const NUM_UNPACK_FILES: u64 = 2_048;
+
+fn tree_builder(files: Vec<PendingFile>) -> TreeBuilder<PendingFile> {
+    let mut builder = TreeBuilder::new();
+    for file in files {
+        builder.push(file);
+    }
+    builder
+}
+
+fn is_equivalent(a: &PendingFile, b: &PendingFile) -> bool {
+    a.layout.entry == b.layout.entry && a.layout.mode == b.layout.mode
+}
+
+fn vfs(c: &mut Criterion) {
+    let files = SYSTEM.pending_files();
+
+    let mut group = c.benchmark_group("vfs");
+    group.sample_size(10);
+    group.throughput(Throughput::Elements(files.len() as u64));
+
+    group.bench_function("push", |b| {
+        b.iter_batched(|| files.clone(), tree_builder, BatchSize::LargeInput);
+    });
+    group.bench_function("bake", |b| {
+        b.iter_batched(
+            || tree_builder(files.clone()),
+            |mut builder| {
+                builder.bake();
+                builder
+            },
+            BatchSize::LargeInput,
+        );
+    });
+
+    let mut builder = tree_builder(files.clone());
+    builder.bake();
+    group.bench_function("tree", |b| b.iter(|| builder.tree().unwrap()));
+
+    let tree = builder.tree().unwrap();
+    let mut upgraded = tree_builder(SYSTEM.upgraded(20).pending_files());
+    upgraded.bake();
+    let upgraded = upgraded.tree().unwrap();
+    group.bench_function("diff", |b| {
+        b.iter(|| black_box(tree.diff(&upgraded, is_equivalent).len()));
+    });
+
+    group.finish();
+}
+
+fn layout_db(c: &mut Criterion) {
+    let ids = SYSTEM.ids().cloned().collect::<Vec<_>>();
+
+    let mut group = c.benchmark_group("layout_db");
+    group.sample_size(10);
+    group.throughput(Throughput::Elements(SYSTEM.num_layouts() as u64));
+
+    group.bench_function("replace_package_layouts", |b| {
+        b.iter_batched(
+            || db::layout::Database::new(":memory:").unwrap(),
+            |db| {
+                db.replace_package_layouts(SYSTEM.layouts()).unwrap();
+                db
+            },
+            BatchSize::PerIteration,
+        );
+    });
+
+    let db = db::layout::Database::new(":memory:").unwrap();
+    db.replace_package_layouts(SYSTEM.layouts()).unwrap();
+    group.bench_function("query", |b| b.iter(|| db.query(&ids).unwrap()));
+
+    group.finish();
+}
+
+fn resolve(c: &mut Criterion) {
+    let mut registry = Registry::default();
+    registry.add_plugin(plugin::Plugin::Repository(plugin::Repository::new(
+        repository::Cached {
+            id: repository::Id::new("bench"),
+            repository: repository::Repository {
+                description: "Synthetic system".to_owned(),
+                uri: "https://localhost/stone.index".parse().unwrap(),
+                priority: repository::Priority::new(0),
+                active: true,
+                mirrors: vec![],
+            },
+            db: SYSTEM.meta_db(),
+        },
+    )));
+    let ids = SYSTEM.ids().cloned().collect::<Vec<_>>();
+
+    let mut group = c.benchmark_group("transaction");
+    group.sample_size(10);
+    group.throughput(Throughput::Elements(ids.len() as u64));
+
+    group.bench_function("update", |b| {
+        b.iter(|| {
+            let mut transaction = registry.transaction().unwrap();
+            transaction.add(ids.clone()).unwrap();
+            black_box(transaction.finalize().count())
+        });
+    });
+
+    group.finish();
+}
+
+fn trigger_collection(c: &mut Criterion) {
+    let triggers = fixture::triggers();
+    let paths = SYSTEM.pending_files().iter().map(BlitFile::path).collect::<Vec<_>>();
+
+    let mut group = c.benchmark_group("triggers");
+    group.sample_size(10);
+    group.throughput(Throughput::Elements(paths.len() as u64));
+
+    group.bench_function("process_paths", |b| {
+        b.iter_batched(
+            || triggers::Collection::new(&triggers).unwrap(),
+            |mut collection| {
+                collection.process_paths(&paths);
+                black_box(collection.bake().unwrap().len())
+            },
+            BatchSize::SmallInput,
+        );
+    });
+
+    group.finish();
+}
+
+/// Ephemeral blits of the whole system, as boulder does for each build root
+fn blit(c: &mut Criterion) {
+    let scratch = Scratch::new("blit");
+    let root = scratch.path().join("root");
+    let blit_root = scratch.path().join("blit");
+    fs::create_dir_all(&root).unwrap();
+    fs::create_dir_all(&blit_root).unwrap();
+
+    let installation = Installation::open(&root, None).unwrap();
+    SYSTEM.write_assets(&installation);
+    db::layout::Database::new(installation.db_path("layout").to_str().unwrap())
+        .unwrap()
+        .replace_package_layouts(SYSTEM.layouts())
+        .unwrap();
+
+    let client = Client::with_explicit_repositories("moss-bench", installation, repository::Map::default())
+        .unwrap()
+        .ephemeral(&blit_root)
+        .unwrap();
+    let selections = SYSTEM
+        .ids()
+        .map(|id| Selection {
+            package: id.clone(),
+            explicit: true,
+            reason: None,
+        })
+        .collect::<Vec<_>>();
+
+    let mut group = c.benchmark_group("blit");
+    group.sample_size(10);
+    group.throughput(Throughput::Elements(SYSTEM.num_layouts() as u64));
+
+    group.bench_function("full", |b| {
+        b.iter_batched(
+            // Without the manifest of the previous blit, the root is rebuilt from scratch
+            || {
+                let _ = fs::remove_file(scratch.path().join(".blit.blitManifest"));
+            },
+            |()| client.new_state(&selections, "bench").unwrap(),
+            BatchSize::PerIteration,
+        );
+    });
+    group.bench_function("unchanged", |b| {
+        b.iter(|| client.new_state(&selections, "bench").unwrap());
+    });
+
+    group.finish();
+}
+
+fn unpack(c: &mut Criterion) {
+    let scratch = Scratch::new("stone");
+    let (meta, content_size) = fixture::write_stone(&scratch.path().join("bench.stone"), NUM_UNPACK_FILES);
+
+    let _guard = runtime::init();
+
+    let mut group = c.benchmark_group("cache");
+    group.sample_size(10);
+    group.throughput(Throughput::Bytes(content_size));
+
+    group.bench_function("unpack", |b| {
+        b.iter_batched(
+            || {
+                let root = Scratch::new("unpack");
+                let installation = Installation::open(root.path(), None).unwrap();
+                let download = runtime::block_on(cache::fetch(&meta, &installation, |_| {})).unwrap();
+                (root, download)
+            },
+            |(root, download)| {
+                download.unpack(cache::UnpackingInProgress::default(), |_| {}).unwrap();
+                // Keep the installation until after the measurement
+                root
+            },
+            BatchSize::PerIteration,
+        );
+    });
+
+    group.finish();
+}
+
+criterion_group!(benches, vfs, layout_db, resolve, trigger_collection, blit, unpack);
+criterion_main!(benches);
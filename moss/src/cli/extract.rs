@@ -4,6 +4,7 @@
 
 use std::{
     io::{copy, Read, Seek, SeekFrom},
+    num::NonZeroUsize,
     os::unix::fs::symlink,
     path::PathBuf,
 };
@@ -11,7 +12,10 @@ use std::{
 use clap::{arg, ArgMatches, Command};
 use fs_err::{self as fs, File};
 use moss::package::{self, MissingMetaFieldError};
-use stone::{payload::layout, read::PayloadKind};
+use stone::{
+    payload::{self, layout},
+    read::PayloadKind,
+};
 use thiserror::{self, Error};
 use tui::{ProgressBar, ProgressStyle};
 
@@ -20,6 +24,10 @@ pub fn command() -> Command {
         .about("Extract a `.stone` content to disk")
         .long_about("For all valid content-bearing archives, extract to disk")
         .arg(arg!(<PATH> ... "files to inspect").value_parser(clap::value_parser!(PathBuf)))
+        .arg(
+            arg!(-j --threads <COUNT> "frames of content to decode at once, defaults to the available cores")
+                .value_parser(clap::value_parser!(NonZeroUsize)),
+        )
 }
 
 /// Handle the `extract` command
@@ -30,6 +38,11 @@ pub fn handle(args: &ArgMatches) -> Result<(), Error> {
         .flatten()
         .cloned()
         .collect::<Vec<_>>();
+    let threads = args
+        .get_one::<NonZeroUsize>("threads")
+        .copied()
+        .or_else(|| std::thread::available_parallelism().ok())
+        .unwrap_or(NonZeroUsize::MIN);
 
     // Begin unpack
     fs::create_dir_all(".stoneStore")?;
@@ -40,7 +53,7 @@ pub fn handle(args: &ArgMatches) -> Result<(), Error> {
         println!("Extract: {path:?}");
 
         let rdr = File::open(path).map_err(Error::IO)?;
-        let mut reader = stone::read(rdr).map_err(Error::Format)?;
+        let mut reader = stone::read(&rdr).map_err(Error::Format)?;
 
         let payloads = reader.payloads()?.collect::<Result<Vec<_>, _>>()?;
         let content = payloads.iter().find_map(PayloadKind::content);
@@ -68,7 +81,14 @@ pub fn handle(args: &ArgMatches) -> Result<(), Error> {
                     .unwrap()
                     .progress_chars("■≡=- "),
             );
-            reader.unpack_content(content, &mut progress.wrap_write(&content_file))?;
+
+            // Framed content decodes in parallel from the mapped stone
+            let mapped = stone::Mapped::open(rdr.file())?;
+            mapped
+                .payloads_of(payload::Kind::Content)
+                .next()
+                .ok_or(Error::MissingContent)??
+                .unpack_content_parallel(&mut progress.wrap_write(&content_file), threads)?;
 
             // Extract all indices from the `.stoneContent` into hash-indexed unique files
             payloads
@@ -139,6 +159,9 @@ pub enum Error {
     #[error("Missing metadata")]
     MissingMeta,
 
+    #[error("Missing content")]
+    MissingContent,
+
     #[error("malformed meta")]
     MalformedMeta(#[from] MissingMetaFieldError),
 
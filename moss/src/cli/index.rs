@@ -2,8 +2,8 @@
 //
 // SPDX-License-Identifier: MPL-2.0
 use std::{
-    collections::{btree_map, BTreeMap},
-    io,
+    collections::{btree_map, BTreeMap, BTreeSet},
+    io::{self, BufReader, Write},
     path::{Path, PathBuf, StripPrefixError},
     time::Duration,
 };
@@ -13,30 +13,74 @@ use fs_err as fs;
 use moss::{
     client,
     package::{self, Meta, MissingMetaFieldError},
+    repository::{
+        dictionary,
+        index_cache::{IndexCache, Stat},
+        manifest, Manifest,
+    },
+    Installation,
 };
 use rayon::iter::{IntoParallelRefIterator, ParallelIterator};
 use sha2::{Digest, Sha256};
 use thiserror::Error;
 use tui::{MultiProgress, ProgressBar, ProgressStyle, Styled};
 
+/// Size of each read while hashing stones
+const HASH_BUFFER_SIZE: usize = 1024 * 1024;
+
 pub fn command() -> Command {
     Command::new("index")
         .visible_alias("ix")
         .about("Index a collection of packages")
         .arg(arg!(<INDEX_DIR> "directory of index files").value_parser(value_parser!(PathBuf)))
+        .arg(
+            arg!(--dictionary "Compress the index with a trained zstd dictionary")
+                .long_help("Compress the index with a zstd dictionary trained on its metadata, published as stone.dict. The published dictionary is reused if there is one, so unchanged packages aren't fetched again by clients. Clients must support dictionaries to read the index."),
+        )
+        .arg(
+            arg!(--"retrain-dictionary" "Train a new dictionary instead of reusing the published one")
+                .requires("dictionary"),
+        )
 }
 
-pub fn handle(args: &ArgMatches) -> Result<(), Error> {
+pub fn handle(args: &ArgMatches, installation: Installation) -> Result<(), Error> {
     let dir = args.get_one::<PathBuf>("INDEX_DIR").unwrap().canonicalize()?;
+    let use_dictionary = args.get_flag("dictionary");
+    let retrain = args.get_flag("retrain-dictionary");
 
     let stone_files = enumerate_stone_files(&dir)?;
 
-    println!("Indexing {} files\n", stone_files.len());
+    // Only stones which changed since the last run need to be read
+    let cache_path = IndexCache::path(&installation, &dir);
+    let mut cache = IndexCache::load(&cache_path).unwrap_or_else(|error| {
+        log::warn!("ignoring index cache {}: {error}", cache_path.display());
+        IndexCache::default()
+    });
+
+    let stones = stone_files
+        .iter()
+        .map(|path| {
+            let relative_path = format!("{}", path.strip_prefix(&dir)?.display());
+            Ok((path, relative_path, Stat::new(&fs::metadata(path)?)))
+        })
+        .collect::<Result<Vec<_>, Error>>()?;
+
+    let mut list = vec![];
+    let mut changed = vec![];
+
+    for (path, relative_path, stat) in &stones {
+        match cache.get(relative_path, *stat) {
+            Some(meta) => list.push(meta),
+            None => changed.push((path, relative_path, *stat)),
+        }
+    }
+
+    println!("Indexing {} files ({} cached)\n", stone_files.len(), list.len());
 
     let multi_progress = MultiProgress::new();
 
     let total_progress = multi_progress.add(
-        ProgressBar::new(stone_files.len() as u64).with_style(
+        ProgressBar::new(changed.len() as u64).with_style(
             ProgressStyle::with_template("\n|{bar:20.cyan/blue}| {pos}/{len}")
                 .unwrap()
                 .progress_chars("■≡=- "),
@@ -44,10 +88,30 @@ pub fn handle(args: &ArgMatches) -> Result<(), Error> {
     );
     total_progress.tick();
 
-    let list = stone_files
+    let indexed = changed
         .par_iter()
-        .map(|path| get_meta(path, &dir, &multi_progress, &total_progress))
-        .collect::<Result<Vec<_>, _>>()?;
+        .map(|(path, relative_path, stat)| {
+            let meta = get_meta(path, relative_path, &multi_progress, &total_progress)?;
+            Ok(((*relative_path).clone(), *stat, meta))
+        })
+        .collect::<Result<Vec<_>, Error>>()?;
+
+    // Forget stones which were removed
+    let current = stones
+        .iter()
+        .map(|(_, relative_path, _)| relative_path.as_str())
+        .collect::<BTreeSet<_>>();
+    cache.retain(|relative_path| current.contains(relative_path));
+
+    for (relative_path, stat, meta) in indexed {
+        cache.insert(relative_path, stat, &meta);
+        list.push(meta);
+    }
+
+    // The cache only saves work, so failing to keep it doesn't fail the index
+    if let Err(error) = cache.save(&cache_path) {
+        log::warn!("failed to save index cache {}: {error}", cache_path.display());
+    }
 
     let mut map = BTreeMap::new();
 
@@ -75,16 +139,37 @@ pub fn handle(args: &ArgMatches) -> Result<(), Error> {
         }
     }
 
-    write_index(&dir, map, &total_progress)?;
+    let dictionary = write_index(&dir, map, use_dictionary, retrain, &total_progress)?;
 
     multi_progress.clear()?;
 
     println!("\nIndex file written to {:?}", dir.join("stone.index").display());
+    println!("Manifest file written to {:?}", dir.join(manifest::FILE_NAME).display());
+    if let Some((dictionary, trained)) = dictionary {
+        println!(
+            "Dictionary {:08x} {} {:?}",
+            dictionary.id(),
+            if trained { "written to" } else { "reused from" },
+            dir.join(dictionary::FILE_NAME).display()
+        );
+    }
 
     Ok(())
 }
 
-fn write_index(dir: &Path, map: BTreeMap<package::Name, Meta>, total_progress: &ProgressBar) -> Result<(), Error> {
+/// Writes the index, its manifest and dictionary, returning the dictionary
+/// used and whether it was trained by this run
+///
+/// Each file is replaced atomically, in the order clients need them: the
+/// dictionary before the index compressed with it, and the index before the
+/// manifest describing it.
+fn write_index(
+    dir: &Path,
+    map: BTreeMap<package::Name, Meta>,
+    use_dictionary: bool,
+    retrain: bool,
+    total_progress: &ProgressBar,
+) -> Result<Option<(stone::Dictionary, bool)>, Error> {
     total_progress.set_message("Writing index file");
     total_progress.set_style(
         ProgressStyle::with_template("\n {spinner} {wide_msg}")
@@ -93,34 +178,96 @@ fn write_index(dir: &Path, map: BTreeMap<package::Name, Meta>, total_progress: &
     );
     total_progress.enable_steady_tick(Duration::from_millis(150));
 
-    let mut file = fs::File::create(dir.join("stone.index"))?;
+    let payloads = map
+        .into_values()
+        .map(|meta| meta.to_stone_payload())
+        .collect::<Vec<_>>();
+
+    let index_path = dir.join("stone.index");
+
+    // Payloads compressed with the same dictionary keep their checksum, so
+    // reusing it means the manifest only lists packages which changed
+    let published = if use_dictionary && !retrain {
+        dictionary::load(&index_path)?
+    } else {
+        None
+    };
+
+    let dictionary = match published {
+        Some(dictionary) => Some((dictionary, false)),
+        None if use_dictionary => {
+            total_progress.set_message("Training dictionary");
+            let dictionary = dictionary::train(&payloads)?;
+            publish(dir, dictionary::FILE_NAME, |file| {
+                Ok(file.write_all(dictionary.as_bytes())?)
+            })?;
+            Some((dictionary, true))
+        }
+        None => None,
+    };
 
-    let mut writer = stone::Writer::new(&mut file, stone::header::v1::FileType::Repository)?;
+    total_progress.set_message("Writing index file");
 
-    for (_, meta) in map {
-        let payload = meta.to_stone_payload();
-        writer.add_payload(payload.as_slice())?;
+    let manifest = publish(dir, "stone.index", |file| {
+        let mut writer = stone::Writer::new(&mut *file, stone::header::v1::FileType::Repository)?;
+        if let Some((dictionary, _)) = &dictionary {
+            writer = writer.with_dictionary(dictionary)?;
+        }
+
+        for payload in &payloads {
+            writer.add_payload(payload.as_slice())?;
+        }
+
+        writer.finalize()?;
+
+        let mut index = stone::Mapped::open(file.file())?;
+        if let Some((dictionary, _)) = &dictionary {
+            index = index.with_dictionary(dictionary.clone());
+        }
+        Ok(Manifest::from_index(&index)?)
+    })?;
+
+    // Publish the per-package manifest so clients can sync deltas
+    publish(dir, manifest::FILE_NAME, |file| {
+        Ok(file.write_all(manifest.encode().as_bytes())?)
+    })?;
+
+    // Don't leave a stale dictionary behind for clients to fetch
+    let dictionary_path = dir.join(dictionary::FILE_NAME);
+    if dictionary.is_none() && dictionary_path.exists() {
+        fs::remove_file(&dictionary_path)?;
     }
 
-    writer.finalize()?;
+    Ok(dictionary)
+}
 
-    Ok(())
+/// Writes `name` in `dir` through a temporary file which is then renamed
+/// over it, so readers only ever see a complete file
+fn publish<T>(dir: &Path, name: &str, write: impl FnOnce(&mut fs::File) -> Result<T, Error>) -> Result<T, Error> {
+    let temp = dir.join(format!(".{name}.tmp"));
+
+    let mut file = fs::File::create(&temp)?;
+    let output = write(&mut file)?;
+    file.sync_all()?;
+    drop(file);
+
+    fs::rename(&temp, dir.join(name))?;
+
+    Ok(output)
 }
 
 fn get_meta(
     path: &Path,
-    dir: &Path,
+    relative_path: &str,
     multi_progress: &MultiProgress,
     total_progress: &ProgressBar,
 ) -> Result<Meta, Error> {
-    let relative_path = format!("{}", path.strip_prefix(dir)?.display());
-
     let progress = multi_progress.insert_before(total_progress, ProgressBar::new_spinner());
     progress.enable_steady_tick(Duration::from_millis(150));
 
-    let (size, hash) = stat_file(path, &relative_path, &progress)?;
+    let (size, hash) = stat_file(path, relative_path, &progress)?;
 
-    progress.set_message(format!("{} {}", "Indexing".yellow(), relative_path.clone().bold()));
+    progress.set_message(format!("{} {}", "Indexing".yellow(), relative_path.bold()));
     progress.set_style(
         ProgressStyle::with_template(" {spinner} {wide_msg}")
             .unwrap()
@@ -139,7 +286,7 @@ fn get_meta(
     let mut meta = Meta::from_stone_payload(&payload.body)?;
     meta.hash = Some(hash);
     meta.download_size = Some(size);
-    meta.uri = Some(relative_path.clone());
+    meta.uri = Some(relative_path.to_owned());
 
     progress.finish();
     multi_progress.remove(&progress);
@@ -162,7 +309,10 @@ fn stat_file(path: &Path, relative_path: &str, progress: &ProgressBar) -> Result
     );
 
     let mut hasher = Sha256::new();
-    io::copy(&mut &file, &mut progress.wrap_write(&mut hasher))?;
+    io::copy(
+        &mut BufReader::with_capacity(HASH_BUFFER_SIZE, progress.wrap_read(file)),
+        &mut hasher,
+    )?;
 
     let hash = hex::encode(hasher.finalize());
 
@@ -198,6 +348,12 @@ pub enum Error {
     #[error("stone write")]
     StoneWrite(#[from] stone::write::Error),
 
+    #[error("manifest")]
+    Manifest(#[from] manifest::Error),
+
+    #[error("dictionary")]
+    Dictionary(#[from] stone::dictionary::Error),
+
     #[error("package {0} has two files with the same release {1}")]
     DuplicateRelease(package::Name, u64),
 
@@ -5,7 +5,7 @@
 use std::path::PathBuf;
 
 use clap::{arg, value_parser, ArgMatches, Command};
-use moss::{client::Client, environment, Installation};
+use moss::Installation;
 
 pub use moss::client::install::Error;
 
@@ -37,7 +37,7 @@ pub fn handle(args: &ArgMatches, installation: Installation) -> Result<(), Error
     let yes = *args.get_one::<bool>("yes").unwrap();
 
     // Grab a client for the root
-    let mut client = Client::new(environment::NAME, installation)?;
+    let mut client = super::client(args, installation)?;
 
     // Make ephemeral if a blit target was provided
     if let Some(blit_target) = args.get_one::<PathBuf>("to").cloned() {
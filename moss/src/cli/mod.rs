@@ -2,15 +2,15 @@
 //
 // SPDX-License-Identifier: MPL-2.0
 
-use std::{env, fs, io, path::Path, path::PathBuf};
+use std::{env, fs, io, num::NonZeroUsize, path::Path, path::PathBuf};
 
-use clap::{Arg, ArgAction, Command};
+use clap::{Arg, ArgAction, ArgMatches, Command};
 use clap_complete::{
     generate_to,
     shells::{Bash, Fish, Zsh},
 };
 use clap_mangen::Man;
-use moss::{installation, runtime, Installation};
+use moss::{client, environment, installation, runtime, timing, Client, Installation};
 use thiserror::Error;
 
 mod boot;
@@ -65,6 +65,32 @@ fn command() -> Command {
                 .help("Assume yes for all questions")
                 .action(ArgAction::SetTrue),
         )
+        .arg(
+            Arg::new("timings")
+                .long("timings")
+                .global(true)
+                .help("Write a Chrome trace of the time spent in each phase to FILE")
+                .action(ArgAction::Set)
+                .value_name("FILE")
+                .value_parser(clap::value_parser!(PathBuf)),
+        )
+        .arg(
+            Arg::new("blit-threads")
+                .long("blit-threads")
+                .global(true)
+                .help("Worker threads used to blit the filesystem, defaults to the available cores (up to 16)")
+                .action(ArgAction::Set)
+                .value_name("COUNT")
+                .value_parser(clap::value_parser!(NonZeroUsize)),
+        )
+        .arg(
+            Arg::new("io-uring")
+                .long("io-uring")
+                .global(true)
+                .help("Batch the syscalls of the filesystem blit through io_uring, where supported")
+                .action(ArgAction::SetTrue)
+                .hide(!cfg!(feature = "io-uring")),
+        )
         .arg(
             Arg::new("generate-manpages")
                 .long("generate-manpages")
@@ -97,6 +123,17 @@ fn command() -> Command {
         .subcommand(version::command())
 }
 
+/// Construct the [`Client`] of a command which blits, honouring the global blit options
+fn client(args: &ArgMatches, installation: Installation) -> Result<Client, client::Error> {
+    let mut client = Client::new(environment::NAME, installation)?.with_io_uring(args.get_flag("io-uring"));
+
+    if let Some(threads) = args.get_one::<NonZeroUsize>("blit-threads") {
+        client = client.with_blit_concurrency(threads.get());
+    }
+
+    Ok(client)
+}
+
 /// Generate manpages for all commands recursively
 fn generate_manpages(cmd: &Command, dir: &Path, prefix: Option<&str>) -> io::Result<()> {
     let name = cmd.get_name();
@@ -161,16 +198,21 @@ pub fn process() -> Result<(), Error> {
 
     let root = matches.get_one::<PathBuf>("root").unwrap();
     let cache = matches.get_one::<PathBuf>("cache");
+    let timings = matches.get_one::<PathBuf>("timings");
+
+    if timings.is_some() {
+        timing::enable();
+    }
 
     // Make async runtime available to all of moss
     let _guard = runtime::init();
 
     let installation = Installation::open(root, cache.cloned())?;
 
-    match matches.subcommand() {
+    let result = match matches.subcommand() {
         Some(("boot", args)) => boot::handle(args, installation).map_err(Error::Boot),
         Some(("extract", args)) => extract::handle(args).map_err(Error::Extract),
-        Some(("index", args)) => index::handle(args).map_err(Error::Index),
+        Some(("index", args)) => index::handle(args, installation).map_err(Error::Index),
         Some(("info", args)) => info::handle(args, installation).map_err(Error::Info),
         Some(("inspect", args)) => inspect::handle(args).map_err(Error::Inspect),
         Some(("install", args)) => install::handle(args, installation).map_err(Error::Install),
@@ -189,7 +231,14 @@ pub fn process() -> Result<(), Error> {
             Ok(())
         }
         _ => unreachable!(),
+    };
+
+    // Also written on failure, to see which phase it happened in
+    if let Some(path) = timings {
+        timing::write_chrome_trace(io::BufWriter::new(fs::File::create(path)?))?;
     }
+
+    result
 }
 
 fn replace_aliases(args: env::Args) -> Vec<String> {
@@ -7,14 +7,7 @@ use itertools::{Either, Itertools};
 use std::collections::BTreeSet;
 use thiserror::Error;
 
-use moss::{
-    client::{self, Client},
-    environment,
-    package::Flags,
-    registry::transaction,
-    state::Selection,
-    Installation, Provider,
-};
+use moss::{client, package::Flags, registry::transaction, state::Selection, Installation, Provider};
 use tui::{
     dialoguer::{theme::ColorfulTheme, Confirm},
     pretty::autoprint_columns,
@@ -40,7 +33,7 @@ pub fn handle(args: &ArgMatches, installation: Installation) -> Result<(), Error
     let yes = *args.get_one::<bool>("yes").unwrap();
 
     // Grab a client for the target, enumerate packages
-    let client = Client::new(environment::NAME, installation)?;
+    let client = super::client(args, installation)?;
 
     let installed = client.registry.list_installed(Flags::default()).collect::<Vec<_>>();
     let installed_ids = installed.iter().map(|p| p.id.clone()).collect::<BTreeSet<_>>();
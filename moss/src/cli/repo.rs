@@ -139,6 +139,7 @@ fn add(
             uri,
             priority,
             active: true,
+            mirrors: vec![],
         },
     )?;
 
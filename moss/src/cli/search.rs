@@ -19,7 +19,7 @@ pub fn command() -> Command {
     Command::new("search")
         .visible_alias("sr")
         .about("Search packages")
-        .long_about("Search packages by looking into package names and summaries.")
+        .long_about("Search packages by looking into package names, summaries, descriptions and providers.")
         .arg(
             Arg::new(ARG_KEYWORD)
                 .required(true)
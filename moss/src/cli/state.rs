@@ -40,7 +40,8 @@ pub fn command() -> Command {
                 .arg(
                     arg!(--"include-newer" "Include states newer than the active state when pruning")
                         .action(ArgAction::SetTrue),
-                ),
+                )
+                .arg(arg!(--rescan "Scan the asset & download stores for orphaned files").action(ArgAction::SetTrue)),
         )
         .subcommand(
             Command::new("remove").about("Remove an archived state").arg(
@@ -52,7 +53,8 @@ pub fn command() -> Command {
         .subcommand(
             Command::new("verify")
                 .about("Verify TODO")
-                .arg(arg!(--verbose "Vebose output").action(ArgAction::SetTrue)),
+                .arg(arg!(--verbose "Vebose output").action(ArgAction::SetTrue))
+                .arg(arg!(--full "Re-hash every asset, ignoring the verification cache").action(ArgAction::SetTrue)),
         )
 }
 
@@ -116,10 +118,11 @@ pub fn activate(args: &ArgMatches, installation: Installation) -> Result<(), Err
 pub fn prune(args: &ArgMatches, installation: Installation) -> Result<(), Error> {
     let keep = *args.get_one::<u64>("keep").unwrap();
     let include_newer = args.get_flag("include-newer");
+    let rescan = args.get_flag("rescan");
     let yes = args.get_flag("yes");
 
     let client = Client::new(environment::NAME, installation)?;
-    client.prune(prune::Strategy::KeepRecent { keep, include_newer }, yes)?;
+    client.prune(prune::Strategy::KeepRecent { keep, include_newer }, yes, rescan)?;
 
     Ok(())
 }
@@ -129,7 +132,7 @@ pub fn remove(args: &ArgMatches, installation: Installation) -> Result<(), Error
     let yes = args.get_flag("yes");
 
     let client = Client::new(environment::NAME, installation)?;
-    client.prune(prune::Strategy::Remove(id.into()), yes)?;
+    client.prune(prune::Strategy::Remove(id.into()), yes, false)?;
 
     Ok(())
 }
@@ -137,9 +140,10 @@ pub fn remove(args: &ArgMatches, installation: Installation) -> Result<(), Error
 pub fn verify(args: &ArgMatches, installation: Installation) -> Result<(), Error> {
     let verbose = args.get_flag("verbose");
     let yes = args.get_flag("yes");
+    let full = args.get_flag("full");
 
-    let client = Client::new(environment::NAME, installation)?;
-    client.verify(yes, verbose)?;
+    let client = super::client(args, installation)?;
+    client.verify(yes, verbose, full)?;
 
     Ok(())
 }
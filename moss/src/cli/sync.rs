@@ -13,7 +13,7 @@ use moss::{
     package::{self},
     Package,
 };
-use moss::{environment, runtime, Installation};
+use moss::{runtime, Installation};
 use thiserror::Error;
 
 use tui::dialoguer::theme::ColorfulTheme;
@@ -43,7 +43,7 @@ pub fn handle(args: &ArgMatches, installation: Installation) -> Result<(), Error
     let update = *args.get_one::<bool>("update").unwrap();
     let upgrade_only = *args.get_one::<bool>("upgrade-only").unwrap();
 
-    let mut client = Client::new(environment::NAME, installation)?;
+    let mut client = super::client(args, installation)?;
 
     // Make ephemeral if a blit target was provided
     if let Some(blit_target) = args.get_one::<PathBuf>("to").cloned() {
@@ -5,6 +5,7 @@
 //! Boot management integration in moss
 
 use std::{
+    collections::{BTreeMap, BTreeSet},
     io,
     path::{Path, PathBuf},
     str::FromStr,
@@ -48,7 +49,7 @@ pub enum Error {
 }
 
 /// Simple mapping type for kernel discovery paths, retaining the layout reference
-#[derive(Debug)]
+#[derive(Debug, Clone)]
 struct KernelCandidate {
     path: PathBuf,
     _layout: Layout,
@@ -62,10 +63,10 @@ impl AsRef<Path> for KernelCandidate {
 
 /// From a given set of input paths, produce a set of match pairs
 /// This is applied against the given system root
-fn kernel_files_from_state<'a>(layouts: &'a [(Id, Layout)], pattern: &'a Pattern) -> Vec<KernelCandidate> {
+fn kernel_files_from_layouts(layouts: &[Layout], pattern: &Pattern) -> Vec<KernelCandidate> {
     let mut kernel_entries = vec![];
 
-    for (_, path) in layouts.iter() {
+    for path in layouts.iter() {
         match &path.entry {
             layout::Entry::Regular(_, target) => {
                 if pattern.match_path(target).is_some() {
@@ -90,6 +91,20 @@ fn kernel_files_from_state<'a>(layouts: &'a [(Id, Layout)], pattern: &'a Pattern
     kernel_entries
 }
 
+/// Kernel candidates of every package shipping any
+fn kernel_packages<'a>(
+    layouts: &'a BTreeMap<Id, Vec<Layout>>,
+    pattern: &Pattern,
+) -> BTreeMap<&'a Id, Vec<KernelCandidate>> {
+    layouts
+        .iter()
+        .filter_map(|(package, layouts)| {
+            let candidates = kernel_files_from_layouts(layouts, pattern);
+            (!candidates.is_empty()).then_some((package, candidates))
+        })
+        .collect()
+}
+
 /// Find bootloader assets in the new state
 fn boot_files_from_new_state<'a>(
     install: &Installation,
@@ -109,9 +124,33 @@ fn boot_files_from_new_state<'a>(
     rets
 }
 
-/// Grab all layouts for the provided state, mapped to package id
-fn layouts_for_state(client: &Client, state: &State) -> Result<Vec<(Id, Layout)>, db::Error> {
-    client.layout_db.query(state.selections.iter().map(|s| &s.package))
+/// Grab the boot relevant layouts of every package in the provided states
+///
+/// Most packages are shared by all retained states, so each is only read
+/// once from the boot index of the layout db.
+fn boot_layouts(client: &Client, states: &[State]) -> Result<BTreeMap<Id, Vec<Layout>>, db::Error> {
+    let packages = states
+        .iter()
+        .flat_map(|state| state.selections.iter().map(|s| &s.package))
+        .collect::<BTreeSet<_>>();
+
+    let mut layouts = BTreeMap::<Id, Vec<Layout>>::new();
+
+    client.layout_db.visit_boot(packages, |package, entry| {
+        layouts.entry(package.clone()).or_default().push(entry.to_layout());
+    })?;
+
+    Ok(layouts)
+}
+
+/// The boot relevant layouts for the provided state, mapped to package id
+fn layouts_for_state(layouts: &BTreeMap<Id, Vec<Layout>>, state: &State) -> Vec<(Id, Layout)> {
+    state
+        .selections
+        .iter()
+        .filter_map(|s| Some((&s.package, layouts.get(&s.package)?)))
+        .flat_map(|(package, layouts)| layouts.iter().map(|layout| (package.clone(), layout.clone())))
+        .collect()
 }
 
 /// Return an additional 4 older states excluding the current state
@@ -149,14 +188,16 @@ pub fn synchronize(client: &Client, state: &State) -> Result<(), Error> {
         vfs: "/".into(),
     };
 
+    let mut all_states = states_except_new(client, state)?;
+    all_states.insert(0, state.clone());
+    let layouts = boot_layouts(client, &all_states)?;
+
     // For the new/active state
-    let head_layouts = layouts_for_state(client, state)?;
-    let kernel_pattern = Pattern::from_str("lib/kernel/(version:*)/*")?;
-    let systemd = Pattern::from_str("lib*/systemd/boot/efi/*.efi")?;
+    let head_layouts = layouts_for_state(&layouts, state);
+    let kernel_pattern = Pattern::from_str(db::layout::KERNEL_PATTERN)?;
+    let systemd = Pattern::from_str(db::layout::BOOTLOADER_PATTERN)?;
     let booty_bits = boot_files_from_new_state(&client.installation, &head_layouts, &systemd);
 
-    let mut all_states = states_except_new(client, state)?;
-
     // no fun times without a bootloder
     if booty_bits.is_empty() {
         return Ok(());
@@ -170,21 +211,36 @@ pub fn synchronize(client: &Client, state: &State) -> Result<(), Error> {
         os_release: &os_release,
     };
 
-    // Grab the entries for the new state
+    // Retained states mostly share their kernel packages, so kernels are only
+    // discovered once per distinct set of them
+    let kernel_packages = kernel_packages(&layouts, &kernel_pattern);
+    let mut discovered = BTreeMap::<BTreeSet<&Id>, _>::new();
     let mut all_kernels = vec![];
-    all_states.insert(0, state.clone());
     for state in all_states.iter() {
-        let layouts = layouts_for_state(client, state)?;
-        let local_kernels = kernel_files_from_state(&layouts, &kernel_pattern);
-        let mapped = schema.discover_system_kernels(local_kernels.into_iter())?;
-        all_kernels.push((mapped, state.id));
+        let packages = state
+            .selections
+            .iter()
+            .map(|s| &s.package)
+            .filter(|package| kernel_packages.contains_key(package))
+            .collect::<BTreeSet<_>>();
+
+        if !discovered.contains_key(&packages) {
+            let local_kernels = packages
+                .iter()
+                .flat_map(|package| kernel_packages[package].iter().cloned())
+                .collect::<Vec<_>>();
+            let mapped = schema.discover_system_kernels(local_kernels.into_iter())?;
+            discovered.insert(packages.clone(), mapped);
+        }
+
+        all_kernels.push((packages, state.id));
     }
 
     // pipe all of our entries into blsforme
     let mut entries = all_kernels
         .iter()
-        .flat_map(|(kernels, state_id)| {
-            kernels
+        .flat_map(|(packages, state_id)| {
+            discovered[packages]
                 .iter()
                 .filter_map(|k| {
                     let sysroot = if state.id == *state_id {
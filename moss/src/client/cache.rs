@@ -6,17 +6,27 @@
 
 use std::collections::BTreeSet;
 use std::{
-    io,
-    path::PathBuf,
-    sync::{Arc, Mutex},
+    io::{self, Write},
+    path::{Path, PathBuf},
+    sync::{
+        atomic::{AtomicU64, Ordering},
+        Arc, Mutex,
+    },
 };
 
+use fs_err::{self as fs, File};
 use futures_util::StreamExt;
+use rayon::iter::{IntoParallelIterator, ParallelIterator};
 use thiserror::Error;
 use tokio::io::AsyncWriteExt;
 use url::Url;
 
-use stone::{payload, read::PayloadKind};
+use stone::{
+    payload::{self, content::Frame},
+    read::{self, PayloadKind},
+    write::digest,
+    Payload,
+};
 
 use crate::{package, request, Installation};
 
@@ -62,7 +72,7 @@ pub async fn fetch(
     installation: &Installation,
     on_progress: impl Fn(Progress),
 ) -> Result<Download, Error> {
-    use fs_err::tokio::{self as fs, File};
+    use fs_err::tokio as fs;
 
     let url = meta.uri.as_ref().ok_or(Error::MissingUri)?.parse::<Url>()?;
     let hash = meta.hash.as_ref().ok_or(Error::MissingHash)?;
@@ -83,27 +93,45 @@ pub async fn fetch(
         });
     }
 
-    let mut bytes = request::get(url).await?;
-    let mut out = File::create(&partial_path).await?;
-
-    let mut total = 0;
+    // Bytes delivered through `on_progress` so far, which retries mustn't report again
+    let mut reported = 0;
+
+    // Fall back to the next mirror, resuming from wherever the last one got to
+    let mut result = Ok(());
+    'mirrors: for url in request::mirrored(&url) {
+        loop {
+            let resumed = match download(
+                url.clone(),
+                &partial_path,
+                meta.download_size,
+                &mut reported,
+                &on_progress,
+            )
+            .await
+            {
+                Ok(resumed) => resumed,
+                Err(error) => {
+                    result = Err(error);
+                    continue 'mirrors;
+                }
+            };
 
-    while let Some(chunk) = bytes.next().await {
-        let bytes = chunk?;
-        let delta = bytes.len() as u64;
-        total += delta;
-        out.write_all(&bytes).await?;
+            result = verify(&partial_path, meta.download_size, hash).await;
+            if result.is_ok() {
+                break 'mirrors;
+            }
 
-        (on_progress)(Progress {
-            delta,
-            completed: total,
-            total: meta.download_size.unwrap_or(total),
-        });
+            // Spliced from a stale partial download or another mirror, so start over
+            remove_partial(&partial_path).await?;
+            if !resumed {
+                continue 'mirrors;
+            }
+        }
     }
+    result?;
 
-    out.flush().await?;
-
-    fs::rename(partial_path, &destination_path).await?;
+    fs::rename(&partial_path, &destination_path).await?;
+    let _ = fs::remove_file(validator_path(&partial_path)).await;
 
     Ok(Download {
         id: meta.id().into(),
@@ -113,6 +141,115 @@ pub async fn fetch(
     })
 }
 
+/// Download `url` into `partial_path`, resuming any previous partial download
+///
+/// Returns whether a previous partial download was resumed
+async fn download(
+    url: Url,
+    partial_path: &Path,
+    download_size: Option<u64>,
+    reported: &mut u64,
+    on_progress: impl Fn(Progress),
+) -> Result<bool, Error> {
+    use fs_err::tokio::{self as fs, File, OpenOptions};
+
+    let existing = fs::metadata(partial_path)
+        .await
+        .map(|metadata| metadata.len())
+        .unwrap_or(0);
+    let validator = fs::read_to_string(validator_path(partial_path)).await.ok();
+
+    let ranged = request::get_from(url, existing, validator.as_deref()).await?;
+    let mut bytes = ranged.stream;
+
+    let (mut out, mut total) = if ranged.resumed {
+        (OpenOptions::new().append(true).open(partial_path).await?, existing)
+    } else {
+        match &ranged.validator {
+            Some(validator) => fs::write(validator_path(partial_path), validator).await?,
+            None => {
+                let _ = fs::remove_file(validator_path(partial_path)).await;
+            }
+        }
+        (File::create(partial_path).await?, 0)
+    };
+
+    let mut report = |completed: u64| {
+        // Only count bytes not yet reported during this fetch, i.e. by a failed mirror
+        let delta = completed.saturating_sub(*reported);
+        *reported += delta;
+
+        if delta > 0 {
+            (on_progress)(Progress {
+                delta,
+                completed,
+                total: download_size.unwrap_or(completed),
+            });
+        }
+    };
+
+    report(total);
+
+    while let Some(chunk) = bytes.next().await {
+        let bytes = chunk?;
+        total += bytes.len() as u64;
+        out.write_all(&bytes).await?;
+
+        report(total);
+    }
+
+    out.flush().await?;
+
+    Ok(ranged.resumed)
+}
+
+/// Check a finished download against the size & hash of its package
+async fn verify(path: &Path, download_size: Option<u64>, hash: &str) -> Result<(), Error> {
+    use sha2::{Digest, Sha256};
+    use tokio::io::AsyncReadExt;
+
+    let mut file = fs_err::tokio::File::open(path).await?;
+    let mut hasher = Sha256::new();
+    let mut buffer = vec![0; 64 * 1024];
+    let mut size = 0;
+
+    loop {
+        let read = file.read(&mut buffer).await?;
+        if read == 0 {
+            break;
+        }
+        hasher.update(&buffer[..read]);
+        size += read as u64;
+    }
+
+    if let Some(expected) = download_size.filter(|&expected| expected != size) {
+        return Err(Error::SizeMismatch { expected, got: size });
+    }
+    if !hex::encode(hasher.finalize()).eq_ignore_ascii_case(hash) {
+        return Err(Error::HashMismatch(hash.to_owned()));
+    }
+
+    Ok(())
+}
+
+async fn remove_partial(partial_path: &Path) -> Result<(), Error> {
+    use fs_err::tokio as fs;
+
+    for path in [partial_path.to_owned(), validator_path(partial_path)] {
+        match fs::remove_file(path).await {
+            Err(error) if error.kind() != io::ErrorKind::NotFound => return Err(error.into()),
+            _ => {}
+        }
+    }
+
+    Ok(())
+}
+
+/// Validator of the response a partial download started from, see [`request::get_from`]
+fn validator_path(partial_path: &Path) -> PathBuf {
+    partial_path.with_extension("part.validator")
+}
+
 /// A package that has been downloaded to the installation
 pub struct Download {
     id: package::Id,
@@ -135,38 +272,16 @@ impl Download {
         unpacking_in_progress: UnpackingInProgress,
         on_progress: impl Fn(Progress) + Send + 'static,
     ) -> Result<UnpackedAsset, Error> {
-        use fs_err::{self as fs, File, OpenOptions};
-        use std::io::{self, Read, Seek, SeekFrom, Write};
-
         struct ProgressWriter<'a, W> {
             writer: W,
-            total: u64,
-            written: u64,
-            on_progress: &'a dyn Fn(Progress),
-        }
-
-        impl<'a, W> ProgressWriter<'a, W> {
-            pub fn new(writer: W, total: u64, on_progress: &'a impl Fn(Progress)) -> Self {
-                Self {
-                    writer,
-                    total,
-                    written: 0,
-                    on_progress,
-                }
-            }
+            on_write: &'a (dyn Fn(u64) + Sync),
         }
 
         impl<W: Write> Write for ProgressWriter<'_, W> {
             fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
                 let bytes = self.writer.write(buf)?;
 
-                self.written += bytes as u64;
-
-                (self.on_progress)(Progress {
-                    delta: bytes as u64,
-                    completed: self.written,
-                    total: self.total,
-                });
+                (self.on_write)(bytes as u64);
 
                 Ok(bytes)
             }
@@ -176,11 +291,6 @@ impl Download {
             }
         }
 
-        let content_dir = self.installation.cache_path("content");
-        let content_path = content_dir.join(self.id);
-
-        fs::create_dir_all(&content_dir)?;
-
         let mut reader = stone::read(File::open(&self.path)?)?;
 
         let payloads = reader.payloads()?.collect::<Result<Vec<_>, _>>()?;
@@ -201,60 +311,296 @@ impl Download {
             .find_map(PayloadKind::content)
             .ok_or(Error::MissingContent)?;
 
-        let content_file = OpenOptions::new()
-            .read(true)
-            .write(true)
-            .create(true)
-            .truncate(true)
-            .open(&content_path)?;
+        let total = content.header.plain_size;
+        let completed = AtomicU64::new(0);
+        let on_progress = Mutex::new(on_progress);
+        let on_write = |delta| {
+            let completed = completed.fetch_add(delta, Ordering::Relaxed) + delta;
+
+            (on_progress.lock().expect("mutex lock"))(Progress {
+                delta,
+                completed,
+                total,
+            });
+        };
+
+        match framed_indices(content, &indices) {
+            // Frames decode independently, so spread them over all cores
+            Some(frames) => {
+                let frames = frames
+                    .into_iter()
+                    .map(|(frame, indices)| {
+                        let assets = AssetWriter::new(
+                            &self.installation,
+                            indices,
+                            frame.plain.start,
+                            unpacking_in_progress.clone(),
+                        );
+                        (frame, assets)
+                    })
+                    .collect::<Vec<_>>();
+
+                // Frames with nothing to write are skipped entirely
+                let (frames, skipped) = frames
+                    .into_iter()
+                    .partition::<Vec<_>, _>(|(_, assets)| !assets.is_noop());
+                completed.store(
+                    skipped
+                        .iter()
+                        .map(|(frame, _)| frame.plain.end - frame.plain.start)
+                        .sum(),
+                    Ordering::Relaxed,
+                );
+
+                frames.into_par_iter().try_for_each_init(
+                    || None,
+                    |reader, (frame, mut assets)| {
+                        let reader = match reader {
+                            Some(reader) => reader,
+                            None => reader.insert(stone::read(File::open(&self.path)?)?),
+                        };
+
+                        reader.unpack_frame(
+                            content,
+                            frame,
+                            &mut ProgressWriter {
+                                writer: &mut assets,
+                                on_write: &on_write,
+                            },
+                        )?;
+
+                        assets.finish()?;
+
+                        Ok(()) as Result<_, Error>
+                    },
+                )?;
+            }
+            None => {
+                let mut assets = AssetWriter::new(&self.installation, indices, 0, unpacking_in_progress);
+
+                // Every asset exists or is being unpacked by another worker
+                if assets.is_noop() {
+                    return Ok(UnpackedAsset { payloads });
+                }
+
+                reader.unpack_content(
+                    content,
+                    &mut ProgressWriter {
+                        writer: &mut assets,
+                        on_write: &on_write,
+                    },
+                )?;
+
+                assets.finish()?;
+            }
+        }
+
+        Ok(UnpackedAsset { payloads })
+    }
+}
+
+/// Indices grouped by the content frame holding them, if the content is
+/// framed and no entry spans multiple frames
+fn framed_indices<'a>(
+    content: &'a Payload<read::Content>,
+    indices: &[&'a payload::Index],
+) -> Option<Vec<(&'a Frame, Vec<&'a payload::Index>)>> {
+    let table = content.body.seek_table()?;
+    let mut frames = table.frames().iter().map(|frame| (frame, vec![])).collect::<Vec<_>>();
+
+    for index in indices {
+        let (frame, indices) = &mut frames[table.position(index.start)?];
 
-        reader.unpack_content(
-            content,
-            &mut ProgressWriter::new(&content_file, content.header.plain_size, &on_progress),
-        )?;
+        if index.end > frame.plain.end {
+            return None;
+        }
+        indices.push(*index);
+    }
+
+    Some(frames)
+}
 
-        indices
+/// Streams decoded content straight into the asset store, splitting it
+/// over the index ranges as the bytes arrive.
+///
+/// Ranges of assets which already exist, or are claimed by another worker
+/// via [`UnpackingInProgress`], are discarded. Each asset is verified against
+/// its digest before being considered complete.
+struct AssetWriter<'a> {
+    /// Index ranges in content order, with the target path if we own the asset
+    ranges: Vec<(&'a payload::Index, Option<PathBuf>)>,
+    /// Position of the current range
+    next: usize,
+    /// Offset into the decoded content
+    position: u64,
+    /// Asset currently being written
+    current: Option<File>,
+    hasher: digest::Hasher,
+    unpacking_in_progress: UnpackingInProgress,
+}
+
+impl<'a> AssetWriter<'a> {
+    /// Writer for decoded content starting at `position`
+    fn new(
+        installation: &Installation,
+        mut indices: Vec<&'a payload::Index>,
+        position: u64,
+        unpacking_in_progress: UnpackingInProgress,
+    ) -> Self {
+        indices.sort_by_key(|index| index.start);
+
+        let ranges = indices
             .into_iter()
-            .map(|idx| {
-                let path = asset_path(&self.installation, &format!("{:02x}", idx.digest));
+            .map(|index| {
+                let path = asset_path(installation, &format!("{:02x}", index.digest));
 
                 // If file is already being unpacked by another worker, skip
                 // to prevent clobbering IO
                 if !unpacking_in_progress.add(path.clone()) {
-                    return Ok(());
+                    return (index, None);
                 }
 
                 // This asset already exists
                 if path.exists() {
                     unpacking_in_progress.remove(&path);
-                    return Ok(());
+                    return (index, None);
                 }
 
-                // Create parent dir
-                if let Some(parent) = path.parent() {
-                    fs::create_dir_all(parent)?;
-                }
+                (index, Some(path))
+            })
+            .collect();
+
+        Self {
+            ranges,
+            next: 0,
+            position,
+            current: None,
+            hasher: digest::Hasher::new(),
+            unpacking_in_progress,
+        }
+    }
 
-                // Split file reader over index range
-                let mut file = &content_file;
-                file.seek(SeekFrom::Start(idx.start))?;
-                let mut split_file = (&mut file).take(idx.end - idx.start);
+    /// Returns true if there are no assets to write
+    fn is_noop(&self) -> bool {
+        self.ranges.iter().all(|(_, target)| target.is_none())
+    }
 
-                let mut output = File::create(&path)?;
+    /// Complete any trailing (empty) assets, ensuring all content was received
+    fn finish(mut self) -> io::Result<()> {
+        while let Some((index, _)) = self.ranges.get(self.next) {
+            if self.position < index.end {
+                return Err(io::Error::from(io::ErrorKind::UnexpectedEof));
+            }
+            self.finish_current()?;
+        }
 
-                io::copy(&mut split_file, &mut output)?;
+        Ok(())
+    }
 
-                // Remove file from in-progress
-                unpacking_in_progress.remove(&path);
+    /// Close the current asset, validate it & move onto the next range
+    fn finish_current(&mut self) -> io::Result<()> {
+        let (index, target) = &mut self.ranges[self.next];
+        self.next += 1;
 
+        let Some(path) = target.take() else {
+            return Ok(());
+        };
+
+        // Empty assets never received any bytes
+        let result = match self.current.take() {
+            Some(_) => Ok(()),
+            None => create_asset(&path).map(drop),
+        }
+        .and_then(|_| {
+            if self.hasher.digest128() == index.digest {
                 Ok(())
-            })
-            .collect::<Result<Vec<_>, Error>>()?;
+            } else {
+                Err(io::Error::new(io::ErrorKind::InvalidData, "asset digest mismatch"))
+            }
+        });
 
-        fs::remove_file(&content_path)?;
+        if result.is_err() {
+            let _ = fs::remove_file(&path);
+        }
+        self.unpacking_in_progress.remove(&path);
+        self.hasher.reset();
 
-        Ok(UnpackedAsset { payloads })
+        result
+    }
+}
+
+impl Write for AssetWriter<'_> {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        let mut remaining = buf;
+
+        while !remaining.is_empty() {
+            // Trailing bytes aren't referenced by any index
+            let Some((index, target)) = self.ranges.get(self.next) else {
+                break;
+            };
+
+            // Range complete (or empty)
+            if self.position >= index.end {
+                self.finish_current()?;
+                continue;
+            }
+
+            // Skip bytes before the range starts
+            if self.position < index.start {
+                let len = (index.start - self.position).min(remaining.len() as u64) as usize;
+                self.position += len as u64;
+                remaining = &remaining[len..];
+                continue;
+            }
+
+            let len = (index.end - self.position).min(remaining.len() as u64) as usize;
+            let (chunk, rest) = remaining.split_at(len);
+
+            if let Some(path) = target {
+                let file = match &mut self.current {
+                    Some(file) => file,
+                    None => self.current.insert(create_asset(path)?),
+                };
+                file.write_all(chunk)?;
+                self.hasher.update(chunk);
+            }
+
+            self.position += len as u64;
+            remaining = rest;
+        }
+
+        Ok(buf.len())
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        Ok(())
+    }
+}
+
+impl Drop for AssetWriter<'_> {
+    fn drop(&mut self) {
+        // Remove a partially written asset
+        if self.current.take().is_some() {
+            if let Some((_, Some(path))) = self.ranges.get(self.next) {
+                let _ = fs::remove_file(path);
+            }
+        }
+
+        // Release claims of all unfinished assets
+        for (_, target) in self.ranges.iter().skip(self.next) {
+            if let Some(path) = target {
+                self.unpacking_in_progress.remove(path);
+            }
+        }
+    }
+}
+
+/// Create a new asset file, including its parent directories
+fn create_asset(path: &Path) -> io::Result<File> {
+    if let Some(parent) = path.parent() {
+        fs::create_dir_all(parent)?;
     }
+    File::create(path)
 }
 
 /// Returns true if all assets already exist in the installation
@@ -305,6 +651,10 @@ pub enum Error {
     MissingContent,
     #[error("Malformed download hash: {0}")]
     MalformedHash(String),
+    #[error("Download size mismatch, expected {expected} got {got}")]
+    SizeMismatch { expected: u64, got: u64 },
+    #[error("Download hash mismatch, expected {0}")]
+    HashMismatch(String),
     #[error("stone format")]
     Format(#[from] stone::read::Error),
     #[error("invalid url")]
@@ -127,6 +127,17 @@ pub fn install(client: &mut Client, pkgs: &[&str], yes: bool) -> Result<Timing,
     Ok(timing)
 }
 
+/// Resolve the complete set of packages installing `pkgs` would select,
+/// including all of their dependencies
+pub fn resolve(client: &Client, pkgs: &[&str]) -> Result<Vec<package::Id>, Error> {
+    let input = resolve_input(pkgs, client)?;
+
+    let mut tx = client.registry.transaction()?;
+    tx.add(input)?;
+
+    Ok(tx.finalize().cloned().collect())
+}
+
 /// Resolves the package arguments as valid input packages. Returns an error
 /// if any args are invalid.
 fn resolve_input(pkgs: &[&str], client: &Client) -> Result<Vec<package::Id>, Error> {
@@ -10,14 +10,18 @@
 
 use std::{
     borrow::Borrow,
+    collections::BTreeSet,
     fmt, io,
+    num::NonZeroUsize,
     os::{fd::RawFd, unix::fs::symlink},
     path::{Path, PathBuf},
+    sync::OnceLock,
+    thread,
     time::{Duration, Instant},
 };
 
 use fs_err as fs;
-use futures_util::{stream, StreamExt, TryStreamExt};
+use futures_util::{future, stream, Stream, StreamExt};
 use nix::{
     errno::Errno,
     fcntl::{self, OFlag},
@@ -26,10 +30,12 @@ use nix::{
     unistd::{close, linkat, mkdir, symlinkat},
 };
 use postblit::TriggerScope;
+use rayon::iter::{IntoParallelIterator, ParallelIterator};
 use stone::{payload::layout, read::PayloadKind};
 use thiserror::Error;
+use tokio::sync::mpsc;
 use tui::{MultiProgress, ProgressBar, ProgressStyle, Styled};
-use vfs::tree::{builder::TreeBuilder, BlitFile, Element};
+use vfs::tree::{builder::TreeBuilder, diff::Diff, BlitFile, Element};
 
 use self::install::install;
 use self::prune::prune;
@@ -39,7 +45,7 @@ use crate::{
     registry::plugin::{self, Plugin},
     repository, runtime, signal,
     state::{self, Selection},
-    Installation, Package, Registry, Signal, State,
+    timing, Installation, Package, Registry, Signal, State,
 };
 
 pub mod boot;
@@ -47,6 +53,8 @@ pub mod cache;
 pub mod install;
 mod postblit;
 pub mod prune;
+#[cfg(feature = "io-uring")]
+mod uring;
 mod verify;
 
 /// A Client is a connection to the underlying package management systems
@@ -75,6 +83,15 @@ pub struct Client {
 
     /// Operational scope (real systems, ephemeral, etc)
     scope: Scope,
+
+    /// Number of worker threads used when blitting a new root
+    blit_concurrency: usize,
+
+    /// Worker pool of [`Self::blit_concurrency`] threads, built on the first blit
+    blit_pool: OnceLock<rayon::ThreadPool>,
+
+    /// Batch blit syscalls through io_uring, where supported
+    blit_io_uring: bool,
 }
 
 impl Client {
@@ -122,9 +139,32 @@ impl Client {
             state_db,
             layout_db,
             scope: Scope::Stateful,
+            blit_concurrency: default_blit_concurrency(),
+            blit_pool: OnceLock::new(),
+            blit_io_uring: false,
         })
     }
 
+    /// Set the number of worker threads used to blit the filesystem
+    ///
+    /// Fast flash storage benefits from a wide pool, whereas spinning disks
+    /// are best served by only a few threads (or `1` for a fully serial blit).
+    pub fn with_blit_concurrency(mut self, threads: usize) -> Self {
+        self.blit_concurrency = threads.max(1);
+        self.blit_pool = OnceLock::new();
+        self
+    }
+
+    /// Batch the syscalls issued while blitting through io_uring
+    ///
+    /// Kernels without io_uring support for `linkat`, `mkdirat` and `symlinkat`
+    /// (< 5.15), or where it has been disabled, silently use regular syscalls, as
+    /// do builds without the `io-uring` feature.
+    pub fn with_io_uring(mut self, enabled: bool) -> Self {
+        self.blit_io_uring = enabled;
+        self
+    }
+
     /// Returns `true` if this is an ephemeral client
     pub fn is_ephemeral(&self) -> bool {
         matches!(self.scope, Scope::Ephemeral { .. })
@@ -135,6 +175,11 @@ impl Client {
         install(self, packages, yes)
     }
 
+    /// Resolve the packages an [`install::install`] would select, without installing them
+    pub fn resolve_install(&self, packages: &[&str]) -> Result<Vec<package::Id>, install::Error> {
+        install::resolve(self, packages)
+    }
+
     /// Transition to an ephemeral client that doesn't record state changes
     /// and blits to a different root.
     ///
@@ -180,11 +225,13 @@ impl Client {
         Ok(())
     }
 
-    pub fn verify(&self, yes: bool, verbose: bool) -> Result<(), Error> {
+    /// Verify installed assets & states, only re-hashing assets changed since
+    /// their last verification unless `full` is set
+    pub fn verify(&self, yes: bool, verbose: bool, full: bool) -> Result<(), Error> {
         if self.scope.is_ephemeral() {
             return Err(Error::EphemeralProhibitedOperation);
         }
-        verify(self, yes, verbose)?;
+        verify(self, yes, verbose, full)?;
         Ok(())
     }
 
@@ -192,7 +239,7 @@ impl Client {
     ///
     /// This allows automatic removal of unused states (and their associated assets)
     /// from the disk, acting as a garbage collection facility.
-    pub fn prune(&self, strategy: prune::Strategy, yes: bool) -> Result<(), Error> {
+    pub fn prune(&self, strategy: prune::Strategy, yes: bool, rescan: bool) -> Result<(), Error> {
         if self.scope.is_ephemeral() {
             return Err(Error::EphemeralProhibitedOperation);
         }
@@ -204,6 +251,7 @@ impl Client {
             &self.layout_db,
             &self.installation,
             yes,
+            rescan,
         )?;
         Ok(())
     }
@@ -216,9 +264,12 @@ impl Client {
         &self,
         packages: impl IntoIterator<Item = &'a package::Id>,
     ) -> Result<Vec<Package>, Error> {
-        let mut metadata = packages
-            .into_iter()
-            .map(|id| self.registry.by_id(id).next().ok_or(Error::MissingMetadata(id.clone())))
+        let ids = packages.into_iter().cloned().collect::<Vec<_>>();
+        let found = self.registry.by_ids(&ids);
+
+        let mut metadata = ids
+            .iter()
+            .map(|id| found.get(id).cloned().ok_or_else(|| Error::MissingMetadata(id.clone())))
             .collect::<Result<Vec<_>, _>>()?;
         metadata.sort_by_key(|p| p.meta.name.to_string());
         metadata.dedup_by_key(|p| p.meta.name.to_string());
@@ -312,7 +363,9 @@ impl Client {
 
     /// Apply all triggers with the given scope, wrapping with a progressbar.
     fn apply_triggers(scope: TriggerScope<'_>, fstree: &vfs::Tree<PendingFile>) -> Result<(), postblit::Error> {
+        let mut timer = timing::begin(timing::Phase::Triggers);
         let triggers = postblit::triggers(scope, fstree)?;
+        timer.add_entries(triggers.len() as u64);
 
         let progress = ProgressBar::new(triggers.len() as u64).with_style(
             ProgressStyle::with_template("\n|{bar:20.green/blue}| {pos}/{len} {msg}")
@@ -326,6 +379,7 @@ impl Client {
         };
 
         for trigger in progress.wrap_iter(triggers.iter()) {
+            let _timer = timing::begin(timing::Phase::Triggers).with_label(trigger);
             trigger.execute()?;
         }
 
@@ -359,7 +413,9 @@ impl Client {
         // At this point we're allowed to run system triggers
         Self::apply_triggers(TriggerScope::System(&self.installation, &self.scope), &fstree)?;
 
+        let timer = timing::begin(timing::Phase::BootSync);
         boot::synchronize(self, state)?;
+        timer.finish();
 
         Ok(())
     }
@@ -392,6 +448,8 @@ impl Client {
             return Err(Error::EphemeralProhibitedOperation);
         }
 
+        let _timer = timing::begin(timing::Phase::Promote);
+
         let usr_target = self.installation.root.join("usr");
         let usr_source = self.installation.staging_path("usr");
 
@@ -445,6 +503,14 @@ impl Client {
     }
 
     /// Download & unpack the provided packages. Packages already cached will be validated & skipped.
+    ///
+    /// Caching runs as a pipeline of overlapping stages, each with its own bounded concurrency:
+    ///
+    /// * Network: packages are downloaded, up to [`environment::MAX_NETWORK_CONCURRENCY`] at a time
+    /// * Unpack: content is decoded straight into the asset store, up to
+    ///   [`environment::MAX_DISK_CONCURRENCY`] at a time
+    /// * Store: layouts & metadata are committed to the databases in batches of up to
+    ///   [`environment::DB_BATCH_SIZE`] packages while later packages are still in flight
     pub async fn cache_packages<T>(&self, packages: &[T]) -> Result<(), Error>
     where
         T: Borrow<Package>,
@@ -464,116 +530,177 @@ impl Client {
 
         let unpacking_in_progress = cache::UnpackingInProgress::default();
 
-        // Download and unpack each package
-        let cached = stream::iter(packages)
-            .map(|package| async {
-                let package: &Package = package.borrow();
-
-                // Setup the progress bar and set as downloading
-                let progress_bar = multi_progress.insert_before(
-                    &total_progress,
-                    ProgressBar::new(package.meta.download_size.unwrap_or_default())
-                        .with_message(format!(
-                            "{} {}",
-                            "Downloading".blue(),
-                            package.meta.name.to_string().bold(),
-                        ))
-                        .with_style(
-                            ProgressStyle::with_template(
-                                " {spinner} |{percent:>3}%| {wide_msg} {binary_bytes_per_sec:>.dim} ",
-                            )
-                            .unwrap()
-                            .tick_chars("--=≡■≡=--"),
-                        ),
-                );
-                progress_bar.enable_steady_tick(Duration::from_millis(150));
-
-                // Download and update progress
-                let download = cache::fetch(&package.meta, &self.installation, |progress| {
-                    progress_bar.inc(progress.delta);
+        let (unpack_sender, unpack_receiver) =
+            mpsc::channel::<(Package, cache::Download, ProgressBar)>(environment::MAX_DISK_CONCURRENCY);
+        let (store_sender, store_receiver) =
+            mpsc::channel::<(Package, cache::UnpackedAsset)>(environment::DB_BATCH_SIZE);
+
+        let multi_progress = &multi_progress;
+        let total_progress = &total_progress;
+
+        // Download each package, handing it over to be unpacked
+        let fetch = async move {
+            let mut downloads = stream::iter(packages)
+                .map(|package| async move {
+                    let package: &Package = package.borrow();
+
+                    // Setup the progress bar and set as downloading
+                    let progress_bar = multi_progress.insert_before(
+                        total_progress,
+                        ProgressBar::new(package.meta.download_size.unwrap_or_default())
+                            .with_message(format!(
+                                "{} {}",
+                                "Downloading".blue(),
+                                package.meta.name.to_string().bold(),
+                            ))
+                            .with_style(
+                                ProgressStyle::with_template(
+                                    " {spinner} |{percent:>3}%| {wide_msg} {binary_bytes_per_sec:>.dim} ",
+                                )
+                                .unwrap()
+                                .tick_chars("--=≡■≡=--"),
+                            ),
+                    );
+                    progress_bar.enable_steady_tick(Duration::from_millis(150));
+
+                    let mut timer = timing::begin(timing::Phase::Fetch).with_label(&package.meta.name);
+
+                    // Download and update progress
+                    let download = cache::fetch(&package.meta, &self.installation, |progress| {
+                        progress_bar.inc(progress.delta);
+                    })
+                    .await?;
+
+                    if !download.was_cached {
+                        timer.add_bytes(package.meta.download_size.unwrap_or_default());
+                    }
+                    timer.finish();
+
+                    Ok((package.clone(), download, progress_bar)) as Result<_, Error>
                 })
-                .await?;
-                let is_cached = download.was_cached;
+                // Use max network concurrency since we download files here
+                .buffer_unordered(environment::MAX_NETWORK_CONCURRENCY);
 
-                // Move rest of blocking code to threadpool
+            while let Some(download) = downloads.next().await {
+                // Unpack stage failed, its error is reported instead
+                if unpack_sender.send(download?).await.is_err() {
+                    break;
+                }
+            }
 
-                let multi_progress = multi_progress.clone();
-                let total_progress = total_progress.clone();
-                let unpacking_in_progress = unpacking_in_progress.clone();
-                let package = (*package).clone();
+            Ok(()) as Result<_, Error>
+        };
 
-                runtime::unblock(move || {
-                    let package_name = package.meta.name.to_string();
+        // Unpack each downloaded package, handing it over to be stored
+        let unpack = async move {
+            let mut unpacked = receiver_stream(unpack_receiver)
+                .map(|(package, download, progress_bar)| {
+                    let is_cached = download.was_cached;
 
-                    // Set progress to unpacking
-                    progress_bar.set_message(format!("{} {}", "Unpacking".yellow(), package_name.clone().bold()));
-                    progress_bar.set_length(1000);
-                    progress_bar.set_position(0);
+                    // Move rest of blocking code to threadpool
 
-                    // Unpack and update progress
-                    let unpacked = download.unpack(unpacking_in_progress.clone(), {
-                        let progress_bar = progress_bar.clone();
+                    let multi_progress = multi_progress.clone();
+                    let total_progress = total_progress.clone();
+                    let unpacking_in_progress = unpacking_in_progress.clone();
 
-                        move |progress| {
-                            progress_bar.set_position((progress.pct() * 1000.0) as u64);
+                    runtime::unblock(move || {
+                        let package_name = package.meta.name.to_string();
+
+                        // Set progress to unpacking
+                        progress_bar.set_message(format!("{} {}", "Unpacking".yellow(), package_name.clone().bold()));
+                        progress_bar.set_length(1000);
+                        progress_bar.set_position(0);
+
+                        let mut timer = timing::begin(timing::Phase::Unpack).with_label(&package_name);
+
+                        // Unpack and update progress
+                        let unpacked = download.unpack(unpacking_in_progress.clone(), {
+                            let progress_bar = progress_bar.clone();
+
+                            move |progress| {
+                                progress_bar.set_position((progress.pct() * 1000.0) as u64);
+                            }
+                        })?;
+
+                        if !is_cached {
+                            let content = unpacked.payloads.iter().find_map(PayloadKind::content);
+                            let indices = unpacked.payloads.iter().filter_map(PayloadKind::index);
+                            timer.add_bytes(content.map_or(0, |content| content.header.plain_size));
+                            timer.add_entries(indices.map(|indices| indices.body.len() as u64).sum());
                         }
-                    })?;
+                        timer.finish();
 
-                    // Remove this progress bar
-                    progress_bar.finish();
-                    multi_progress.remove(&progress_bar);
+                        // Remove this progress bar
+                        progress_bar.finish();
+                        multi_progress.remove(&progress_bar);
 
-                    let cached_tag = is_cached
-                        .then_some(format!("{}", " (cached)".dim()))
-                        .unwrap_or_default();
+                        let cached_tag = is_cached
+                            .then_some(format!("{}", " (cached)".dim()))
+                            .unwrap_or_default();
 
-                    // Write installed line
-                    multi_progress
-                        .suspend(|| println!("{} {}{cached_tag}", "Installed".green(), package_name.clone().bold()));
+                        // Write installed line
+                        multi_progress.suspend(|| {
+                            println!("{} {}{cached_tag}", "Installed".green(), package_name.clone().bold());
+                        });
 
-                    // Inc total progress by 1
-                    total_progress.inc(1);
+                        // Inc total progress by 1
+                        total_progress.inc(1);
 
-                    Ok((package, unpacked)) as Result<(Package, cache::UnpackedAsset), Error>
+                        Ok((package, unpacked)) as Result<(Package, cache::UnpackedAsset), Error>
+                    })
                 })
-                .await
-            })
-            // Use max network concurrency since we download files here
-            .buffer_unordered(environment::MAX_NETWORK_CONCURRENCY)
-            .try_collect::<Vec<_>>()
-            .await?;
-
-        // Add layouts & packages to DBs
-        runtime::unblock({
-            let layout_db = self.layout_db.clone();
-            let install_db = self.install_db.clone();
-            move || {
-                total_progress.set_position(0);
-                total_progress.set_length(2);
-                total_progress.set_message("Storing DB layouts");
-                total_progress.tick();
-
-                // Add layouts
-                layout_db.batch_add(cached.iter().flat_map(|(p, u)| {
-                    u.payloads
-                        .iter()
-                        .flat_map(PayloadKind::layout)
-                        .flat_map(|p| p.body.as_slice())
-                        .map(|layout| (&p.id, layout))
-                }))?;
-
-                total_progress.inc(1);
-                total_progress.set_message("Storing DB packages");
-
-                // Add packages
-                install_db.batch_add(cached.into_iter().map(|(p, _)| (p.id, p.meta)).collect())?;
-
-                total_progress.inc(1);
-
-                Ok(()) as Result<_, Error>
+                // Bound the decoding & disk writes in flight
+                .buffer_unordered(environment::MAX_DISK_CONCURRENCY);
+
+            while let Some(unpacked) = unpacked.next().await {
+                // Store stage failed, its error is reported instead
+                if store_sender.send(unpacked?).await.is_err() {
+                    break;
+                }
             }
-        })
-        .await?;
+
+            Ok(()) as Result<_, Error>
+        };
+
+        // Add layouts & packages to DBs, batching whatever is ready
+        let store = async move {
+            let mut batches = receiver_stream(store_receiver).ready_chunks(environment::DB_BATCH_SIZE);
+
+            while let Some(batch) = batches.next().await {
+                let layout_db = self.layout_db.clone();
+                let install_db = self.install_db.clone();
+
+                runtime::unblock(move || {
+                    let mut timer = timing::begin(timing::Phase::Store);
+                    timer.add_entries(
+                        batch
+                            .iter()
+                            .flat_map(|(_, u)| u.payloads.iter().filter_map(PayloadKind::layout))
+                            .map(|p| p.body.len() as u64)
+                            .sum(),
+                    );
+
+                    // Store layouts, each batch holds every layout of its packages
+                    layout_db.replace_package_layouts(batch.iter().flat_map(|(p, u)| {
+                        u.payloads
+                            .iter()
+                            .flat_map(PayloadKind::layout)
+                            .flat_map(|p| p.body.as_slice())
+                            .map(|layout| (&p.id, layout))
+                    }))?;
+
+                    // Add packages
+                    install_db.batch_add(batch.into_iter().map(|(p, _)| (p.id, p.meta)).collect())?;
+
+                    Ok(()) as Result<_, Error>
+                })
+                .await?;
+            }
+
+            Ok(()) as Result<_, Error>
+        };
+
+        future::try_join3(fetch, unpack, store).await?;
 
         // Remove progress
         multi_progress.clear()?;
@@ -589,14 +716,8 @@ impl Client {
         &self,
         packages: impl IntoIterator<Item = &'a package::Id>,
     ) -> Result<vfs::Tree<PendingFile>, Error> {
-        let mut tbuild = TreeBuilder::new();
         let layouts = self.layout_db.query(packages)?;
-        for (id, layout) in layouts {
-            tbuild.push(PendingFile { id: id.clone(), layout });
-        }
-        tbuild.bake();
-        let tree = tbuild.tree()?;
-        Ok(tree)
+        vfs_from_layouts(layouts)
     }
 
     /// Blit the packages to a filesystem root
@@ -611,10 +732,19 @@ impl Client {
     ///
     /// This provides a very quick means to generate a hardlinked "snapshot" on-demand,
     /// which can then be activated via [`Self::promote_staging`]
+    ///
+    /// Directory subtrees are distributed across a work-stealing thread pool sized by
+    /// [`Self::with_blit_concurrency`]. Every directory is created before any of its
+    /// children are scheduled, so workers only ever operate within an existing parent.
+    ///
+    /// Ephemeral roots are disposable, so when the previous blit to the same root was
+    /// recorded we only apply the [`vfs::tree::diff::Diff`] between both trees in place.
     fn blit_root<'a>(
         &self,
         packages: impl IntoIterator<Item = &'a package::Id>,
     ) -> Result<vfs::tree::Tree<PendingFile>, Error> {
+        let packages = packages.into_iter().collect::<Vec<_>>();
+
         let progress = ProgressBar::new(1).with_style(
             ProgressStyle::with_template("\n|{bar:20.red/blue}| {pos}/{len} {msg}")
                 .unwrap()
@@ -625,12 +755,10 @@ impl Client {
         progress.tick();
 
         let now = Instant::now();
-        let mut stats = BlitStats::default();
 
-        let tree = self.vfs(packages)?;
-
-        progress.set_length(tree.len());
-        progress.set_position(0_u64);
+        let mut timer = timing::begin(timing::Phase::Vfs);
+        let tree = self.vfs(packages.iter().copied())?;
+        timer.add_entries(tree.len());
 
         let cache_dir = self.installation.assets_path("v2");
         let cache_fd = fcntl::open(&cache_dir, OFlag::O_DIRECTORY | OFlag::O_RDONLY, Mode::empty())?;
@@ -640,20 +768,54 @@ impl Client {
             Scope::Ephemeral { blit_root } => blit_root.to_owned(),
         };
 
-        // undirt.
-        fs::remove_dir_all(&blit_target)?;
+        // Stateful staging always starts from scratch as the live & archived
+        // trees must remain untouched
+        let previous = match &self.scope {
+            Scope::Stateful => None,
+            Scope::Ephemeral { .. } => self.previous_blit(&blit_target)?,
+        };
+        timer.finish();
 
-        if let Some(root) = tree.structured() {
-            let _ = mkdir(&blit_target, Mode::from_bits_truncate(0o755));
-            let root_dir = fcntl::open(&blit_target, OFlag::O_DIRECTORY | OFlag::O_RDONLY, Mode::empty())?;
+        let mut timer = timing::begin(timing::Phase::Blit);
 
-            if let Element::Directory(_, _, children) = root {
-                for child in children {
-                    self.blit_element(root_dir, cache_fd, child, &progress, &mut stats)?;
+        let patched = previous.as_ref().and_then(|previous| {
+            let diff = previous.diff(&tree, PendingFile::is_equivalent);
+
+            // Not worth patching, rebuild instead
+            if diff.len() as u64 > tree.len() / 2 {
+                return None;
+            }
+
+            progress.set_length(diff.len() as u64);
+            progress.set_position(0_u64);
+
+            // On failure the full blit below starts over from a clean root
+            match Self::blit_diff(&blit_target, cache_fd, &diff, &progress) {
+                Ok(stats) => Some(stats),
+                Err(error) => {
+                    log::warn!("Failed to patch {}, blitting it again: {error}", blit_target.display());
+                    None
                 }
             }
+        });
 
-            close(root_dir)?;
+        let (stats, verb) = match patched {
+            Some(stats) => (stats, "updated"),
+            None => {
+                progress.set_length(tree.len());
+                progress.set_position(0_u64);
+
+                (self.blit_full(&blit_target, cache_fd, &tree, &progress)?, "blitted")
+            }
+        };
+
+        timer.add_entries(stats.num_entries());
+        timer.finish();
+
+        close(cache_fd)?;
+
+        if self.scope.is_ephemeral() {
+            record_blit_manifest(&blit_target, &packages)?;
         }
 
         progress.finish_and_clear();
@@ -662,7 +824,7 @@ impl Client {
         let num_entries = stats.num_entries();
 
         println!(
-            "\n{} entries blitted in {} {}",
+            "\n{} entries {verb} in {} {}",
             num_entries.to_string().bold(),
             format!("{:.2}s", elapsed.as_secs_f32()).bold(),
             format!("({:.1}k / s)", num_entries as f32 / elapsed.as_secs_f32() / 1_000.0).dim()
@@ -671,33 +833,222 @@ impl Client {
         Ok(tree)
     }
 
+    /// Wipe the blit target and write the complete tree to it
+    fn blit_full(
+        &self,
+        blit_target: &Path,
+        cache: RawFd,
+        tree: &vfs::Tree<PendingFile>,
+        progress: &ProgressBar,
+    ) -> Result<BlitStats, Error> {
+        // undirt.
+        fs::remove_dir_all(blit_target)?;
+
+        let pool = self.blit_pool()?;
+
+        let mut stats = BlitStats::default();
+
+        if let Some(root) = tree.structured() {
+            let _ = mkdir(blit_target, Mode::from_bits_truncate(0o755));
+            let root_dir = fcntl::open(blit_target, OFlag::O_DIRECTORY | OFlag::O_RDONLY, Mode::empty())?;
+
+            if let Element::Directory(_, _, children) = root {
+                stats =
+                    pool.install(|| Self::blit_children(root_dir, cache, children, progress, self.blit_io_uring))?;
+            }
+
+            close(root_dir)?;
+        }
+
+        Ok(stats)
+    }
+
+    /// Worker pool shared by all blits of this client
+    fn blit_pool(&self) -> Result<&rayon::ThreadPool, Error> {
+        if let Some(pool) = self.blit_pool.get() {
+            return Ok(pool);
+        }
+
+        let pool = rayon::ThreadPoolBuilder::new()
+            .num_threads(self.blit_concurrency)
+            .thread_name(|i| format!("moss-blit-{i}"))
+            .build()?;
+
+        Ok(self.blit_pool.get_or_init(|| pool))
+    }
+
+    /// Rebuild the [`vfs::Tree`] last blitted to `blit_target`, if it was recorded and
+    /// the layouts of all its packages are still available.
+    fn previous_blit(&self, blit_target: &Path) -> Result<Option<vfs::Tree<PendingFile>>, Error> {
+        let manifest = blit_manifest_path(blit_target);
+
+        let Ok(contents) = fs::read_to_string(&manifest) else {
+            return Ok(None);
+        };
+
+        // Invalidate the record up front so an interrupted patch forces a full blit
+        fs::remove_file(&manifest)?;
+
+        if !blit_target.exists() {
+            return Ok(None);
+        }
+
+        let packages = contents
+            .lines()
+            .map(|id| package::Id::from(id.to_owned()))
+            .collect::<BTreeSet<_>>();
+
+        // Packages without any layouts have no stored blob, they only need to still be cached
+        let stored = self.layout_db.stored(&packages)?;
+        let layoutless = packages.difference(&stored).collect::<Vec<_>>();
+        if !layoutless.is_empty() && self.install_db.get_many(layoutless.iter().copied())?.len() != layoutless.len() {
+            return Ok(None);
+        }
+
+        Ok(Some(vfs_from_layouts(self.layout_db.query(&packages)?)?))
+    }
+
+    /// Patch a previously blitted root in place
+    ///
+    /// Stale entries are removed children first, modified directories only have their
+    /// mode updated and everything else is (re)blitted parents first.
+    fn blit_diff(
+        blit_target: &Path,
+        cache: RawFd,
+        diff: &Diff<'_, PendingFile>,
+        progress: &ProgressBar,
+    ) -> Result<BlitStats, Error> {
+        let mut stats = BlitStats::default();
+
+        for item in &diff.removed {
+            progress.inc(1);
+            remove_blitted(blit_target, item)?;
+        }
+
+        for (old, new) in &diff.modified {
+            progress.inc(1);
+
+            if let layout::Entry::Directory(_) = &new.layout.entry {
+                fchmodat(
+                    None,
+                    &blitted_path(blit_target, new),
+                    Mode::from_bits_truncate(new.layout.mode),
+                    nix::sys::stat::FchmodatFlags::NoFollowSymlink,
+                )?;
+                stats.num_dirs += 1;
+            } else {
+                remove_blitted(blit_target, old)?;
+                Self::blit_path(blit_target, cache, new, &mut stats)?;
+            }
+        }
+
+        for item in &diff.added {
+            progress.inc(1);
+            Self::blit_path(blit_target, cache, item, &mut stats)?;
+        }
+
+        Ok(stats)
+    }
+
+    /// Write a single inode into an existing parent directory of the blit target
+    fn blit_path(blit_target: &Path, cache: RawFd, item: &PendingFile, stats: &mut BlitStats) -> Result<(), Error> {
+        let path = item.path();
+
+        // Root always exists
+        let (Some(parent), Some(name)) = (vfs::path::parent(&path), vfs::path::file_name(&path)) else {
+            return Ok(());
+        };
+
+        let parent_dir = fcntl::open(
+            &blit_target.join(parent.trim_start_matches('/')),
+            OFlag::O_DIRECTORY | OFlag::O_RDONLY,
+            Mode::empty(),
+        )?;
+        let result = Self::blit_element_item(parent_dir, cache, name, item, stats);
+        close(parent_dir)?;
+
+        result
+    }
+
+    /// Write all children of a directory, fanning out across the current thread pool.
+    ///
+    /// Each worker accumulates its own [`BlitStats`] which are merged once all
+    /// children have been written, avoiding any shared counters on the hot path.
+    ///
+    /// With `io_uring` enabled, and supported by the running kernel, all entries of
+    /// the directory are created in a single batched submission before descending.
+    /// Builds without the `io-uring` feature always issue the regular syscalls.
+    fn blit_children(
+        parent: RawFd,
+        cache: RawFd,
+        children: Vec<Element<'_, PendingFile>>,
+        progress: &ProgressBar,
+        io_uring: bool,
+    ) -> Result<BlitStats, Error> {
+        #[cfg(feature = "io-uring")]
+        let batched = io_uring
+            .then(|| uring::with_ring(|ring| Self::blit_batch(ring, parent, cache, &children)))
+            .flatten();
+        #[cfg(not(feature = "io-uring"))]
+        let batched = None::<Result<BlitStats, Error>>;
+
+        if let Some(result) = batched {
+            let stats = result?;
+            progress.inc(children.len() as u64);
+
+            // Entries exist, descend into the new directories
+            let nested = children
+                .into_par_iter()
+                .filter_map(|child| match child {
+                    Element::Directory(name, _, children) => Some((name, children)),
+                    Element::Child(..) => None,
+                })
+                .map(|(name, children)| {
+                    let newdir = fcntl::openat(parent, name, OFlag::O_RDONLY | OFlag::O_DIRECTORY, Mode::empty())?;
+                    let result = Self::blit_children(newdir, cache, children, progress, io_uring);
+                    close(newdir)?;
+                    result
+                })
+                .try_reduce(BlitStats::default, |a, b| Ok(a.merge(b)))?;
+
+            return Ok(stats.merge(nested));
+        }
+
+        children
+            .into_par_iter()
+            .try_fold(BlitStats::default, |mut stats, child| {
+                Self::blit_element(parent, cache, child, progress, &mut stats, io_uring)?;
+                Ok(stats)
+            })
+            .try_reduce(BlitStats::default, |a, b| Ok(a.merge(b)))
+    }
+
     /// Recursively write a directory, or a single flat inode, to the staging tree.
     /// Care is taken to retain the directory file descriptor to avoid costly path
     /// resolution at runtime.
     fn blit_element(
-        &self,
         parent: RawFd,
         cache: RawFd,
         element: Element<'_, PendingFile>,
         progress: &ProgressBar,
         stats: &mut BlitStats,
+        io_uring: bool,
     ) -> Result<(), Error> {
         progress.inc(1);
         match element {
             Element::Directory(name, item, children) => {
                 // Construct within the parent
-                self.blit_element_item(parent, cache, name, item, stats)?;
+                Self::blit_element_item(parent, cache, name, item, stats)?;
 
-                // open the new dir
+                // open the new dir, shared by all workers writing its children
                 let newdir = fcntl::openat(parent, name, OFlag::O_RDONLY | OFlag::O_DIRECTORY, Mode::empty())?;
-                for child in children.into_iter() {
-                    self.blit_element(newdir, cache, child, progress, stats)?;
-                }
+                let result = Self::blit_children(newdir, cache, children, progress, io_uring);
                 close(newdir)?;
+                *stats = stats.merge(result?);
                 Ok(())
             }
             Element::Child(name, item) => {
-                self.blit_element_item(parent, cache, name, item, stats)?;
+                Self::blit_element_item(parent, cache, name, item, stats)?;
                 Ok(())
             }
         }
@@ -712,7 +1063,6 @@ impl Client {
     /// * `subpath` - the base name of the new inode
     /// * `item`    - New inode being recorded
     fn blit_element_item(
-        &self,
         parent: RawFd,
         cache: RawFd,
         subpath: &str,
@@ -721,20 +1071,13 @@ impl Client {
     ) -> Result<(), Error> {
         match &item.layout.entry {
             layout::Entry::Regular(id, _) => {
-                let hash = format!("{id:02x}");
-                let directory = if hash.len() >= 10 {
-                    PathBuf::from(&hash[..2]).join(&hash[2..4]).join(&hash[4..6])
-                } else {
-                    "".into()
-                };
-
                 // Link relative from cache to target
-                let fp = directory.join(hash);
+                let fp = asset_relative_path(*id);
 
                 match *id {
                     // Mystery empty-file hash. Do not allow dupes!
                     // https://github.com/serpent-os/tools/issues/372
-                    0x99aa_06d3_0147_98d8_6001_c324_468d_497f => {
+                    EMPTY_FILE_HASH => {
                         let fd = fcntl::openat(
                             parent,
                             subpath,
@@ -785,6 +1128,76 @@ impl Client {
     }
 }
 
+/// Adapt a channel receiver into a [`Stream`] ending once all senders are dropped
+fn receiver_stream<T>(receiver: mpsc::Receiver<T>) -> impl Stream<Item = T> {
+    stream::unfold(receiver, |mut receiver| async move {
+        receiver.recv().await.map(|item| (item, receiver))
+    })
+}
+
+/// Hash of an empty file, which is never linked from the asset store
+const EMPTY_FILE_HASH: u128 = 0x99aa_06d3_0147_98d8_6001_c324_468d_497f;
+
+/// Path of an asset relative to the asset store
+fn asset_relative_path(id: u128) -> PathBuf {
+    let hash = format!("{id:02x}");
+    let directory = if hash.len() >= 10 {
+        PathBuf::from(&hash[..2]).join(&hash[2..4]).join(&hash[4..6])
+    } else {
+        "".into()
+    };
+
+    directory.join(hash)
+}
+
+/// Build a [`vfs::Tree`] from the given layouts
+fn vfs_from_layouts(
+    layouts: impl IntoIterator<Item = (package::Id, layout::Layout)>,
+) -> Result<vfs::Tree<PendingFile>, Error> {
+    let mut tbuild = TreeBuilder::new();
+    for (id, layout) in layouts {
+        tbuild.push(PendingFile { id, layout });
+    }
+    tbuild.bake();
+    let tree = tbuild.tree()?;
+    Ok(tree)
+}
+
+/// Host path of a blitted inode
+fn blitted_path(blit_target: &Path, item: &PendingFile) -> PathBuf {
+    blit_target.join(item.path().trim_start_matches('/'))
+}
+
+/// Remove a blitted inode, including any unmanaged contents of a directory
+fn remove_blitted(blit_target: &Path, item: &PendingFile) -> io::Result<()> {
+    let path = blitted_path(blit_target, item);
+
+    let result = match &item.layout.entry {
+        layout::Entry::Directory(_) => fs::remove_dir_all(&path),
+        _ => fs::remove_file(&path),
+    };
+
+    match result {
+        Err(e) if e.kind() == io::ErrorKind::NotFound => Ok(()),
+        result => result,
+    }
+}
+
+/// Location of the record of packages blitted to an ephemeral root
+///
+/// It's kept next to the root rather than within it, so it never ends up in the tree
+fn blit_manifest_path(blit_target: &Path) -> PathBuf {
+    let name = blit_target.file_name().unwrap_or_default().to_string_lossy();
+    blit_target.with_file_name(format!(".{name}.blitManifest"))
+}
+
+/// Record the packages blitted to an ephemeral root so the next blit can be incremental
+fn record_blit_manifest(blit_target: &Path, packages: &[&package::Id]) -> Result<(), Error> {
+    let manifest = packages.iter().map(|id| format!("{id}\n")).collect::<String>();
+    fs::write(blit_manifest_path(blit_target), manifest)?;
+    Ok(())
+}
+
 /// Add root symlinks & os-release file
 fn create_root_links(root: &Path) -> io::Result<()> {
     let links = vec![
@@ -870,6 +1283,13 @@ pub struct PendingFile {
     pub layout: layout::Layout,
 }
 
+impl PendingFile {
+    /// Returns true if blitting either file produces the same inode
+    fn is_equivalent(&self, other: &Self) -> bool {
+        self.layout.entry == other.layout.entry && self.layout.mode == other.layout.mode
+    }
+}
+
 impl BlitFile for PendingFile {
     /// Match internal kind to minimalist vfs kind
     fn kind(&self) -> vfs::tree::Kind {
@@ -968,7 +1388,15 @@ fn build_registry(
     Ok(registry)
 }
 
-#[derive(Debug, Default)]
+/// Default number of blit workers, bounded by [`environment::MAX_DISK_CONCURRENCY`]
+fn default_blit_concurrency() -> usize {
+    thread::available_parallelism()
+        .map(NonZeroUsize::get)
+        .unwrap_or(1)
+        .min(environment::MAX_DISK_CONCURRENCY)
+}
+
+#[derive(Debug, Default, Clone, Copy)]
 struct BlitStats {
     num_files: u64,
     num_symlinks: u64,
@@ -979,6 +1407,15 @@ impl BlitStats {
     fn num_entries(&self) -> u64 {
         self.num_files + self.num_symlinks + self.num_dirs
     }
+
+    /// Combine the counters of two workers
+    fn merge(self, other: Self) -> Self {
+        Self {
+            num_files: self.num_files + other.num_files,
+            num_symlinks: self.num_symlinks + other.num_symlinks,
+            num_dirs: self.num_dirs + other.num_dirs,
+        }
+    }
 }
 
 /// Client-relevant error mapping type
@@ -1012,6 +1449,8 @@ pub enum Error {
     Filesystem(#[from] vfs::tree::Error),
     #[error("blit")]
     Blit(#[from] Errno),
+    #[error("blit thread pool")]
+    BlitPool(#[from] rayon::ThreadPoolBuildError),
     #[error("postblit")]
     PostBlit(#[from] postblit::Error),
     #[error("boot")]
@@ -9,6 +9,7 @@
 //! Note that currently we only load from `/usr/share/moss/triggers/{tx,sys.d}/*.yaml`
 //! and do not yet support local triggers
 use std::{
+    fmt,
     path::{Path, PathBuf},
     process,
 };
@@ -190,6 +191,15 @@ impl TriggerRunner<'_> {
     }
 }
 
+impl fmt::Display for TriggerRunner<'_> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self.trigger.handler() {
+            Handler::Run { run, args } => write!(f, "{run} {}", args.join(" ")),
+            Handler::Delete { delete } => write!(f, "delete {}", delete.join(" ")),
+        }
+    }
+}
+
 /// Internal executor for triggers.
 fn execute_trigger_directly(trigger: &CompiledHandler) -> Result<(), Error> {
     match trigger.handler() {
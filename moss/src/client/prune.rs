@@ -6,7 +6,9 @@
 //!
 //! Quite simply this is a strategy based garbage collector for unused/unwanted
 //! system states (i.e. historical snapshots) that cleans up database entries
-//! and assets on disk by way of refcounting.
+//! and assets on disk by way of refcounting. Orphaned assets are found through
+//! the layout database's asset index, so the asset store is only walked when
+//! explicitly rescanning.
 
 use std::collections::{BTreeMap, BTreeSet};
 use std::{
@@ -44,6 +46,7 @@ pub enum Strategy {
 /// * - `install_db`   - Installation's "installed" database
 /// * - `layout_db`    - Installation's layout database
 /// * - `installation` - Client specific target filesystem encapsulation
+/// * - `rescan`       - Walk the download & asset stores for orphans instead of trusting the asset index
 pub fn prune(
     strategy: Strategy,
     state_db: &db::state::Database,
@@ -51,6 +54,7 @@ pub fn prune(
     layout_db: &db::layout::Database,
     installation: &Installation,
     yes: bool,
+    rescan: bool,
 ) -> Result<(), Error> {
     // Only prune if the moss root has an active state (otherwise
     // it's probably borked or not setup yet)
@@ -99,6 +103,9 @@ pub fn prune(
     // Bail if there's no states to remove
     if removal_ids.is_empty() {
         // TODO: Print no states to be removed
+        if rescan {
+            rescan_orphaned_files(install_db, layout_db, installation)?;
+        }
         return Ok(());
     }
 
@@ -156,28 +163,41 @@ pub fn prune(
         return Err(Error::Cancelled);
     }
 
+    // Downloads of the removed packages, recorded before their metadata is pruned
+    let removed_downloads = package_removals
+        .iter()
+        .filter_map(|package| install_db.get(package).ok()?.hash)
+        .collect::<BTreeSet<_>>();
+
     // Prune these states / packages from all dbs
     prune_databases(&removals, &package_removals, state_db, install_db, layout_db)?;
 
-    // Remove orphaned downloads
-    remove_orphaned_files(
-        // root
-        installation.cache_path("downloads").join("v1"),
-        // final set of hashes to compare against
-        install_db.file_hashes()?,
-        // path builder using hash
-        |hash| cache::download_path(installation, &hash).ok(),
-    )?;
-
-    // Remove orphaned assets
-    remove_orphaned_files(
-        // root
-        installation.assets_path("v2"),
-        // final set of hashes to compare against
-        layout_db.file_hashes()?,
-        // path builder using hash
-        |hash| Some(cache::asset_path(installation, &hash)),
-    )?;
+    if rescan {
+        rescan_orphaned_files(install_db, layout_db, installation)?;
+    } else {
+        // Remove orphaned downloads
+        let remaining_downloads = install_db.file_hashes()?;
+        remove_files(
+            // root
+            installation.cache_path("downloads").join("v1"),
+            // hashes no longer used by any package
+            removed_downloads.difference(&remaining_downloads),
+            // path builder using hash
+            |hash| cache::download_path(installation, hash).ok(),
+        )?;
+
+        // Remove assets which lost their last reference
+        let orphaned_assets = layout_db.unreferenced_assets()?;
+        remove_files(
+            // root
+            installation.assets_path("v2"),
+            // hashes no longer used by any layout
+            &orphaned_assets,
+            // path builder using hash
+            |hash| Some(cache::asset_path(installation, hash)),
+        )?;
+        layout_db.forget_assets(orphaned_assets.iter().map(String::as_str))?;
+    }
 
     // Remove each state's archive folder
     for state in removals {
@@ -219,20 +239,60 @@ fn prune_databases(
     Ok(())
 }
 
+/// Recovery mode: recount the asset index, then walk the download & asset
+/// stores and remove every file not referenced by the databases
+fn rescan_orphaned_files(
+    install_db: &db::meta::Database,
+    layout_db: &db::layout::Database,
+    installation: &Installation,
+) -> Result<(), Error> {
+    layout_db.rebuild_asset_index()?;
+
+    // Remove orphaned downloads
+    remove_orphaned_files(
+        // root
+        installation.cache_path("downloads").join("v1"),
+        // final set of hashes to compare against
+        install_db.file_hashes()?,
+        // path builder using hash
+        |hash| cache::download_path(installation, hash).ok(),
+    )?;
+
+    // Remove orphaned assets
+    remove_orphaned_files(
+        // root
+        installation.assets_path("v2"),
+        // final set of hashes to compare against
+        layout_db.file_hashes()?,
+        // path builder using hash
+        |hash| Some(cache::asset_path(installation, hash)),
+    )?;
+
+    Ok(())
+}
+
 /// Removes all files under `root` that no longer exist in the provided `final_hashes` set
 fn remove_orphaned_files(
     root: PathBuf,
     final_hashes: BTreeSet<String>,
-    compute_path: impl Fn(String) -> Option<PathBuf>,
+    compute_path: impl Fn(&str) -> Option<PathBuf>,
 ) -> Result<(), Error> {
     // Compute hashes to remove by (installed - final)
     let installed_hashes = enumerate_file_hashes(&root)?;
-    let hashes_to_remove = installed_hashes.difference(&final_hashes);
 
+    remove_files(root, installed_hashes.difference(&final_hashes), compute_path)
+}
+
+/// Removes the files for each of `hashes` under `root`, along with any parent dirs left empty
+fn remove_files<'a>(
+    root: PathBuf,
+    hashes: impl IntoIterator<Item = &'a String>,
+    compute_path: impl Fn(&str) -> Option<PathBuf>,
+) -> Result<(), Error> {
     // Remove each and it's parent dir if empty
-    hashes_to_remove.into_iter().try_for_each(|hash| {
+    hashes.into_iter().try_for_each(|hash| {
         // Compute path to file using hash
-        let Some(file) = compute_path(hash.clone()) else {
+        let Some(file) = compute_path(hash) else {
             return Ok(());
         };
         let partial = file.with_extension("part");
@@ -0,0 +1,399 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! io_uring submission backend for blitting
+//!
+//! Only the filesystem namespace operations used while blitting (`linkat`,
+//! `mkdirat` and `symlinkat`) are supported. These were added in Linux 5.15,
+//! on older kernels (or where io_uring is disabled) [`Ring::new`] fails and
+//! callers are expected to fall back to the regular syscalls.
+
+use std::{
+    cell::RefCell,
+    ffi::{CStr, CString},
+    io,
+    os::fd::RawFd,
+};
+
+use io_uring::{opcode, squeue, types, IoUring, Probe};
+use nix::{
+    errno::Errno,
+    sys::stat::{fchmodat, Mode},
+};
+use stone::payload::layout;
+use vfs::tree::Element;
+
+use super::{asset_relative_path, BlitStats, Client, Error, PendingFile, EMPTY_FILE_HASH};
+
+/// Default number of submission queue entries per ring
+const RING_ENTRIES: u32 = 256;
+
+thread_local! {
+    /// Lazily initialised ring for the current worker thread, `None` if unsupported
+    static RING: RefCell<Option<Option<Ring>>> = const { RefCell::new(None) };
+}
+
+/// Run `f` with the io_uring instance of the current thread
+///
+/// Returns `None` if io_uring isn't available, in which case the caller should
+/// use the synchronous syscalls instead.
+pub fn with_ring<R>(f: impl FnOnce(&mut Ring) -> R) -> Option<R> {
+    RING.with(|ring| {
+        let mut ring = ring.borrow_mut();
+        ring.get_or_insert_with(|| Ring::new(RING_ENTRIES).ok()).as_mut().map(f)
+    })
+}
+
+/// A single filesystem operation to be submitted
+///
+/// All paths are borrowed and must outlive the submission.
+#[derive(Debug, Clone, Copy)]
+pub enum Op<'a> {
+    /// `linkat(old_dir, old_path, new_dir, new_path, 0)`
+    Link {
+        old_dir: RawFd,
+        old_path: &'a CStr,
+        new_dir: RawFd,
+        new_path: &'a CStr,
+    },
+    /// `mkdirat(dir, path, mode)`
+    Mkdir { dir: RawFd, path: &'a CStr, mode: u32 },
+    /// `symlinkat(target, dir, path)`
+    Symlink {
+        target: &'a CStr,
+        dir: RawFd,
+        path: &'a CStr,
+    },
+}
+
+impl Op<'_> {
+    fn entry(&self, user_data: u64) -> squeue::Entry {
+        let entry = match *self {
+            Op::Link {
+                old_dir,
+                old_path,
+                new_dir,
+                new_path,
+            } => opcode::LinkAt::new(
+                types::Fd(old_dir),
+                old_path.as_ptr(),
+                types::Fd(new_dir),
+                new_path.as_ptr(),
+            )
+            .build(),
+            Op::Mkdir { dir, path, mode } => opcode::MkDirAt::new(types::Fd(dir), path.as_ptr()).mode(mode).build(),
+            Op::Symlink { target, dir, path } => {
+                opcode::SymlinkAt::new(types::Fd(dir), target.as_ptr(), path.as_ptr()).build()
+            }
+        };
+
+        entry.user_data(user_data)
+    }
+}
+
+/// An io_uring instance which supports all blit operations
+pub struct Ring {
+    ring: IoUring,
+}
+
+impl Ring {
+    /// Setup a new ring, ensuring all blit operations are supported by the kernel
+    pub fn new(entries: u32) -> io::Result<Self> {
+        let ring = IoUring::new(entries)?;
+
+        let mut probe = Probe::new();
+        ring.submitter().register_probe(&mut probe)?;
+
+        if [opcode::LinkAt::CODE, opcode::MkDirAt::CODE, opcode::SymlinkAt::CODE]
+            .into_iter()
+            .all(|code| probe.is_supported(code))
+        {
+            Ok(Self { ring })
+        } else {
+            Err(io::Error::from(io::ErrorKind::Unsupported))
+        }
+    }
+
+    /// Submit all operations in batches of the ring size, waiting for them to complete
+    ///
+    /// Returns the raw result of each operation in submission order, a negative
+    /// value being the negated errno.
+    pub fn submit_all(&mut self, ops: &[Op<'_>]) -> io::Result<Vec<i32>> {
+        let mut results = vec![0; ops.len()];
+        let batch_size = self.ring.params().sq_entries() as usize;
+
+        for (chunk_index, chunk) in ops.chunks(batch_size).enumerate() {
+            let base = chunk_index * batch_size;
+
+            {
+                let mut submission = self.ring.submission();
+
+                for (i, op) in chunk.iter().enumerate() {
+                    let entry = op.entry((base + i) as u64);
+
+                    // SAFETY: The chunk fits the empty queue, and the borrowed paths
+                    // outlive the submission as it's completed before returning
+                    unsafe { submission.push(&entry) }.expect("submission queue is drained");
+                }
+            }
+
+            let mut remaining = chunk.len();
+
+            while remaining > 0 {
+                match self.ring.submit_and_wait(1) {
+                    Ok(_) => {}
+                    Err(err) if err.kind() == io::ErrorKind::Interrupted => continue,
+                    Err(err) => return Err(err),
+                }
+
+                for cqe in self.ring.completion() {
+                    results[cqe.user_data() as usize] = cqe.result();
+                    remaining -= 1;
+                }
+            }
+        }
+
+        Ok(results)
+    }
+}
+
+impl Client {
+    /// Create all entries of a directory via io_uring, without descending
+    ///
+    /// Links, directories and symlinks are submitted as one batch, permissions of
+    /// linked assets are fixed up once the links exist.
+    pub(super) fn blit_batch(
+        ring: &mut Ring,
+        parent: RawFd,
+        cache: RawFd,
+        children: &[Element<'_, PendingFile>],
+    ) -> Result<BlitStats, Error> {
+        let mut stats = BlitStats::default();
+
+        let items = children
+            .iter()
+            .map(|child| match child {
+                Element::Directory(name, item, _) | Element::Child(name, item) => (*name, *item),
+            })
+            .collect::<Vec<_>>();
+
+        // Paths must remain alive until the submission completes
+        let c_string = |s: &str| CString::new(s).map_err(|_| Errno::EINVAL);
+        let names = items
+            .iter()
+            .map(|(name, _)| c_string(name))
+            .collect::<Result<Vec<_>, _>>()?;
+        let sources = items
+            .iter()
+            .map(|(_, item)| match &item.layout.entry {
+                layout::Entry::Regular(id, _) => c_string(asset_relative_path(*id).to_str().unwrap_or_default()),
+                layout::Entry::Symlink(source, _) => c_string(source),
+                _ => Ok(CString::default()),
+            })
+            .collect::<Result<Vec<_>, _>>()?;
+
+        let mut ops = vec![];
+        let mut submitted = vec![];
+
+        for (i, (name, item)) in items.iter().enumerate() {
+            let op = match &item.layout.entry {
+                layout::Entry::Regular(EMPTY_FILE_HASH, _) => None,
+                layout::Entry::Regular(..) => Some(Op::Link {
+                    old_dir: cache,
+                    old_path: &sources[i],
+                    new_dir: parent,
+                    new_path: &names[i],
+                }),
+                layout::Entry::Symlink(..) => Some(Op::Symlink {
+                    target: &sources[i],
+                    dir: parent,
+                    path: &names[i],
+                }),
+                layout::Entry::Directory(_) => Some(Op::Mkdir {
+                    dir: parent,
+                    path: &names[i],
+                    mode: item.layout.mode,
+                }),
+                _ => None,
+            };
+
+            match op {
+                Some(op) => {
+                    ops.push(op);
+                    submitted.push(i);
+                }
+                // Not batched, write it directly
+                None => Self::blit_element_item(parent, cache, name, item, &mut stats)?,
+            }
+        }
+
+        let results = ring.submit_all(&ops)?;
+
+        for (i, result) in submitted.into_iter().zip(results) {
+            let (_, item) = items[i];
+
+            // Opcodes are probed up front, so every failure is a genuine one
+            if result < 0 {
+                return Err(Errno::from_i32(-result).into());
+            }
+
+            match &item.layout.entry {
+                layout::Entry::Regular(..) => {
+                    // Fix permissions
+                    fchmodat(
+                        Some(parent),
+                        names[i].as_c_str(),
+                        Mode::from_bits_truncate(item.layout.mode),
+                        nix::sys::stat::FchmodatFlags::NoFollowSymlink,
+                    )?;
+                    stats.num_files += 1;
+                }
+                layout::Entry::Symlink(..) => stats.num_symlinks += 1,
+                _ => stats.num_dirs += 1,
+            }
+        }
+
+        Ok(stats)
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use std::{ffi::CString, fs, os::fd::AsRawFd, os::unix::fs::PermissionsExt};
+
+    use super::*;
+
+    #[test]
+    fn blit_ops() {
+        // Kernel may lack support or io_uring may be disabled (i.e. containers)
+        let Ok(mut ring) = Ring::new(4) else {
+            return;
+        };
+
+        let root = std::env::temp_dir().join(format!("moss-uring-{}", std::process::id()));
+        let _ = fs::remove_dir_all(&root);
+        fs::create_dir_all(&root).unwrap();
+        fs::write(root.join("source"), "hello").unwrap();
+
+        let dir = fs::File::open(&root).unwrap();
+        let fd = dir.as_raw_fd();
+
+        let names = ["source", "link", "sub", "symlink", "missing", "link2"].map(|name| CString::new(name).unwrap());
+
+        let ops = [
+            Op::Link {
+                old_dir: fd,
+                old_path: &names[0],
+                new_dir: fd,
+                new_path: &names[1],
+            },
+            Op::Mkdir {
+                dir: fd,
+                path: &names[2],
+                mode: 0o755,
+            },
+            Op::Symlink {
+                target: &names[0],
+                dir: fd,
+                path: &names[3],
+            },
+            Op::Link {
+                old_dir: fd,
+                old_path: &names[4],
+                new_dir: fd,
+                new_path: &names[5],
+            },
+            // Exceeds ring size, forcing a second batch
+            Op::Mkdir {
+                dir: fd,
+                path: &names[2],
+                mode: 0o755,
+            },
+        ];
+
+        let results = ring.submit_all(&ops).unwrap();
+
+        assert_eq!(results, [0, 0, 0, -nix::libc::ENOENT, -nix::libc::EEXIST]);
+        assert_eq!(fs::read_to_string(root.join("link")).unwrap(), "hello");
+        assert!(root.join("sub").is_dir());
+        assert_eq!(fs::read_link(root.join("symlink")).unwrap().to_str(), Some("source"));
+
+        fs::remove_dir_all(&root).unwrap();
+    }
+
+    #[test]
+    fn blit_tree() {
+        use stone::payload::layout::{Entry, Layout};
+        use tui::ProgressBar;
+        use vfs::tree::Element;
+
+        use crate::{
+            client::{asset_relative_path, vfs_from_layouts, Client, PendingFile},
+            package,
+        };
+
+        if with_ring(|_| ()).is_none() {
+            return;
+        }
+
+        let root = std::env::temp_dir().join(format!("moss-uring-blit-{}", std::process::id()));
+        let _ = fs::remove_dir_all(&root);
+        let assets = root.join("assets");
+        let target = root.join("target");
+        fs::create_dir_all(assets.join(asset_relative_path(1)).parent().unwrap()).unwrap();
+        fs::create_dir_all(&target).unwrap();
+        fs::write(assets.join(asset_relative_path(1)), "hello").unwrap();
+
+        let layout = |mode, entry| {
+            (
+                package::Id::from("test".to_owned()),
+                Layout {
+                    uid: 0,
+                    gid: 0,
+                    mode,
+                    tag: 0,
+                    entry,
+                },
+            )
+        };
+        let tree = vfs_from_layouts([
+            layout(0o40755, Entry::Directory("bin".to_owned())),
+            layout(0o100755, Entry::Regular(1, "bin/hello".to_owned())),
+            layout(0o120777, Entry::Symlink("hello".to_owned(), "bin/greet".to_owned())),
+            layout(0o40700, Entry::Directory("share/private".to_owned())),
+        ])
+        .unwrap();
+
+        let Some(Element::Directory(_, _, children)) = tree.structured() else {
+            panic!("tree has a root");
+        };
+        let parent = fs::File::open(&target).unwrap();
+        let cache = fs::File::open(&assets).unwrap();
+
+        let stats = Client::blit_children(
+            parent.as_raw_fd(),
+            cache.as_raw_fd(),
+            children,
+            &ProgressBar::hidden(),
+            true,
+        )
+        .unwrap();
+
+        let usr = target.join("usr");
+        assert_eq!(stats.num_files, 1);
+        assert_eq!(stats.num_symlinks, 1);
+        assert_eq!(fs::read_to_string(usr.join("bin/hello")).unwrap(), "hello");
+        assert_eq!(
+            fs::metadata(usr.join("bin/hello")).unwrap().permissions().mode() & 0o7777,
+            0o755
+        );
+        assert_eq!(fs::read_link(usr.join("bin/greet")).unwrap().to_str(), Some("hello"));
+        assert_eq!(
+            fs::metadata(usr.join("share/private")).unwrap().permissions().mode() & 0o7777,
+            0o700
+        );
+
+        fs::remove_dir_all(&root).unwrap();
+    }
+}
@@ -2,12 +2,19 @@
 //
 // SPDX-License-Identifier: MPL-2.0
 
-use std::{collections::BTreeSet, fmt, io, path::PathBuf};
+use std::{
+    collections::{BTreeSet, HashMap},
+    fmt::{self, Write as _},
+    io::{self, Read},
+    os::unix::fs::MetadataExt,
+    path::{Path, PathBuf},
+};
 
 use itertools::Itertools;
+use rayon::iter::{IntoParallelIterator, ParallelIterator};
 
 use fs_err as fs;
-use stone::{payload::layout, write::digest};
+use stone::write::digest;
 use tui::{
     dialoguer::{theme::ColorfulTheme, Confirm},
     ProgressBar, ProgressStyle, Styled,
@@ -16,29 +23,35 @@ use vfs::tree::BlitFile;
 
 use crate::{
     client::{self, cache},
-    package, runtime, signal, state, Client, Package, Signal,
+    db::layout::blob,
+    environment, package, runtime, signal, state, Client, Package, Signal,
 };
 
-pub fn verify(client: &Client, yes: bool, verbose: bool) -> Result<(), client::Error> {
+pub fn verify(client: &Client, yes: bool, verbose: bool, full: bool) -> Result<(), client::Error> {
     println!("Verifying assets");
 
-    // Get all installed layouts, this is our source of truth
-    let layouts = client.layout_db.all()?;
+    // Group all installed regular files by unique asset (hash), the layout db is our source of truth
+    let mut unique_assets = HashMap::<_, Vec<_>>::new();
 
-    // Group by unique assets (hash)
-    let unique_assets = layouts
-        .into_iter()
-        .filter_map(|(package, layout)| {
-            if let layout::Entry::Regular(hash, file) = layout.entry {
-                Some((format!("{hash:02x}"), (package, file)))
-            } else {
-                None
-            }
-        })
-        .into_group_map();
+    client.layout_db.visit_all(|package, entry| {
+        if let blob::Kind::Regular(hash) = entry.kind {
+            unique_assets
+                .entry(format!("{hash:02x}"))
+                .or_default()
+                .push((package.clone(), entry.target().to_string()));
+        }
+    })?;
 
     let mut issues = vec![];
-    let mut hasher = digest::Hasher::new();
+
+    // Assets whose stat is unchanged since they were last verified are trusted,
+    // unless a full verification is requested
+    let cache_path = client.installation.db_path("verify");
+    let cache = if full {
+        Cache::default()
+    } else {
+        Cache::load(&cache_path)
+    };
 
     let pb = ProgressBar::new(unique_assets.len() as u64)
         .with_message("Verifying")
@@ -49,62 +62,69 @@ pub fn verify(client: &Client, yes: bool, verbose: bool) -> Result<(), client::E
         );
     pb.tick();
 
-    // For each asset, ensure it exists in the content store and isn't corrupt (hash is correct)
-    for (hash, meta) in unique_assets
+    let assets = unique_assets
         .into_iter()
         .sorted_by_key(|(key, _)| format!("{key:0>32}"))
-    {
-        let display_hash = format!("{hash:0>32}");
+        .collect::<Vec<_>>();
+
+    let installation = &client.installation;
+
+    // For each asset, ensure it exists in the content store and isn't corrupt (hash is correct).
+    // Each worker gets its own hasher & read buffer.
+    let outcomes = assets
+        .into_par_iter()
+        .map_init(
+            || (digest::Hasher::new(), vec![0; environment::FILE_READ_BUFFER_SIZE]),
+            |(hasher, buffer), (hash, meta)| {
+                let display_hash = format!("{hash:0>32}");
+                pb.set_message(format!("Verifying {display_hash}"));
+
+                let path = cache::asset_path(installation, &hash);
+                let outcome = verify_asset(&path, &hash, &cache, hasher, buffer)?;
+
+                pb.inc(1);
+                if verbose {
+                    let mark = if matches!(outcome, Outcome::Verified(_)) {
+                        "»".green()
+                    } else {
+                        "×".yellow()
+                    };
+                    let files = meta.iter().map(|(_, file)| file).collect::<BTreeSet<_>>();
+                    pb.suspend(|| println!(" {mark} {display_hash} - {files:?}"));
+                }
 
-        let path = cache::asset_path(&client.installation, &hash);
+                Ok::<_, io::Error>((hash, meta, outcome))
+            },
+        )
+        .collect::<Result<Vec<_>, _>>()?;
 
-        let files = meta.iter().map(|(_, file)| file).cloned().collect::<BTreeSet<_>>();
+    let mut verified = Cache::default();
 
-        pb.set_message(format!("Verifying {display_hash}"));
+    for (hash, meta, outcome) in outcomes {
+        let display_hash = format!("{hash:0>32}");
+        let files = meta.iter().map(|(_, file)| file).cloned().collect::<BTreeSet<_>>();
+        let packages = meta.into_iter().map(|(package, _)| package).collect();
 
-        if !path.exists() {
-            pb.inc(1);
-            if verbose {
-                pb.suspend(|| println!(" {} {display_hash} - {files:?}", "×".yellow()));
+        match outcome {
+            Outcome::Verified(stat) => {
+                verified.0.insert(hash, stat);
             }
-            issues.push(Issue::MissingAsset {
+            Outcome::Missing => issues.push(Issue::MissingAsset {
                 hash: display_hash,
                 files,
-                packages: meta.into_iter().map(|(package, _)| package).collect(),
-            });
-            continue;
-        }
-
-        hasher.reset();
-
-        let mut digest_writer = digest::Writer::new(io::sink(), &mut hasher);
-        let mut file = fs::File::open(&path)?;
-
-        // Copy bytes to null sink so we don't
-        // explode memory
-        io::copy(&mut file, &mut digest_writer)?;
-
-        let verified_hash = format!("{:02x}", hasher.digest128());
-
-        if verified_hash != hash {
-            pb.inc(1);
-            if verbose {
-                pb.suspend(|| println!(" {} {display_hash} - {files:?}", "×".yellow()));
-            }
-            issues.push(Issue::CorruptAsset {
+                packages,
+            }),
+            Outcome::Corrupt => issues.push(Issue::CorruptAsset {
                 hash: display_hash,
                 files,
-                packages: meta.into_iter().map(|(package, _)| package).collect(),
-            });
-            continue;
-        }
-
-        pb.inc(1);
-        if verbose {
-            pb.suspend(|| println!(" {} {display_hash} - {files:?}", "»".green()));
+                packages,
+            }),
         }
     }
 
+    // Only currently installed, intact assets are retained
+    verified.save(&cache_path)?;
+
     // Get all states
     let states = client.state_db.all()?;
 
@@ -130,25 +150,30 @@ pub fn verify(client: &Client, yes: bool, verbose: bool) -> Result<(), client::E
 
         let files = vfs.iter().collect::<Vec<_>>();
 
-        let mut num_issues = 0;
-
-        for file in files {
-            let path = base.join(file.path().strip_prefix("/usr/").unwrap_or_default());
-
-            // All symlinks for non-active states are broken
-            // since they resolve to the active state path
-            //
-            // Use try_exists to ensure we only check if symlink
-            // itself is missing
-            match path.try_exists() {
-                Ok(true) => {}
-                Ok(false) if path.is_symlink() => {}
-                _ => {
-                    num_issues += 1;
-                    issues.push(Issue::MissingVFSPath { path, state: state.id });
+        let missing = files
+            .into_par_iter()
+            .filter_map(|file| {
+                let path = base.join(file.path().strip_prefix("/usr/").unwrap_or_default());
+
+                // All symlinks for non-active states are broken
+                // since they resolve to the active state path
+                //
+                // Use try_exists to ensure we only check if symlink
+                // itself is missing
+                match path.try_exists() {
+                    Ok(true) => None,
+                    Ok(false) if path.is_symlink() => None,
+                    _ => Some(path),
                 }
-            }
-        }
+            })
+            .collect::<Vec<_>>();
+
+        let num_issues = missing.len();
+        issues.extend(
+            missing
+                .into_iter()
+                .map(|path| Issue::MissingVFSPath { path, state: state.id }),
+        );
 
         pb.inc(1);
         if verbose {
@@ -276,6 +301,125 @@ pub fn verify(client: &Client, yes: bool, verbose: bool) -> Result<(), client::E
     Ok(())
 }
 
+/// Result of verifying a single asset
+enum Outcome {
+    Verified(Stat),
+    Missing,
+    Corrupt,
+}
+
+fn verify_asset(
+    path: &Path,
+    hash: &str,
+    cache: &Cache,
+    hasher: &mut digest::Hasher,
+    buffer: &mut [u8],
+) -> io::Result<Outcome> {
+    let metadata = match fs::metadata(path) {
+        Ok(metadata) => metadata,
+        Err(e) if e.kind() == io::ErrorKind::NotFound => return Ok(Outcome::Missing),
+        Err(e) => return Err(e),
+    };
+    let stat = Stat::from(&metadata);
+
+    if cache.0.get(hash) == Some(&stat) {
+        return Ok(Outcome::Verified(stat));
+    }
+
+    hasher.reset();
+
+    // Stream through a large buffer so we don't explode memory
+    let mut file = fs::File::open(path)?;
+    loop {
+        match file.read(buffer) {
+            Ok(0) => break,
+            Ok(n) => hasher.update(&buffer[..n]),
+            Err(e) if e.kind() == io::ErrorKind::Interrupted => {}
+            Err(e) => return Err(e),
+        }
+    }
+
+    if format!("{:02x}", hasher.digest128()) == hash {
+        Ok(Outcome::Verified(stat))
+    } else {
+        Ok(Outcome::Corrupt)
+    }
+}
+
+/// Identity of an asset at the time it was last verified
+///
+/// Any write or replacement of the asset moves at least one of these. ctime is
+/// deliberately left out: every blit hardlinks the asset and `fchmodat`s the
+/// link, bumping the ctime of the shared inode, so it would miss on every run
+/// after a blit. The trade-off is that a write which keeps the size and
+/// restores the mtime goes unnoticed until the next `--full` verify.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+struct Stat {
+    ino: u64,
+    size: u64,
+    mtime: (i64, i64),
+}
+
+impl From<&std::fs::Metadata> for Stat {
+    fn from(metadata: &std::fs::Metadata) -> Self {
+        Self {
+            ino: metadata.ino(),
+            size: metadata.size(),
+            mtime: (metadata.mtime(), metadata.mtime_nsec()),
+        }
+    }
+}
+
+/// Side cache of verified assets, keyed by hash
+///
+/// Stored as one `hash ino size mtime mtime_nsec` line per asset.
+#[derive(Debug, Default)]
+struct Cache(HashMap<String, Stat>);
+
+impl Cache {
+    /// Load the cache, an unreadable cache is treated as empty
+    fn load(path: &Path) -> Self {
+        let Ok(contents) = fs::read_to_string(path) else {
+            return Self::default();
+        };
+
+        Self(contents.lines().filter_map(Self::parse_line).collect())
+    }
+
+    fn parse_line(line: &str) -> Option<(String, Stat)> {
+        let mut fields = line.split_ascii_whitespace();
+        let hash = fields.next()?.to_owned();
+        let ino = fields.next()?.parse().ok()?;
+        let size = fields.next()?.parse().ok()?;
+        let mut next = || fields.next()?.parse::<i64>().ok();
+
+        let stat = Stat {
+            ino,
+            size,
+            mtime: (next()?, next()?),
+        };
+
+        Some((hash, stat))
+    }
+
+    /// Atomically replace the cache on disk
+    fn save(&self, path: &Path) -> io::Result<()> {
+        let mut contents = String::new();
+
+        for (hash, stat) in self.0.iter().sorted_by_key(|(hash, _)| *hash) {
+            let _ = writeln!(
+                contents,
+                "{hash} {} {} {} {}",
+                stat.ino, stat.size, stat.mtime.0, stat.mtime.1
+            );
+        }
+
+        let staging = path.with_extension("new");
+        fs::write(&staging, contents)?;
+        fs::rename(&staging, path)
+    }
+}
+
 #[derive(Debug)]
 enum Issue {
     CorruptAsset {
@@ -327,3 +471,66 @@ impl fmt::Display for Issue {
         }
     }
 }
+
+#[cfg(test)]
+mod test {
+    use std::os::fd::AsRawFd;
+
+    use stone::payload::layout;
+
+    use super::*;
+
+    #[test]
+    fn blit_keeps_cache() {
+        let root = std::env::temp_dir().join(format!("moss-verify-{}", std::process::id()));
+        let _ = fs::remove_dir_all(&root);
+
+        let content = b"verified asset";
+        let mut hasher = digest::Hasher::new();
+        hasher.update(content);
+        let id = hasher.digest128();
+        let hash = format!("{id:02x}");
+
+        let assets = root.join("assets");
+        let asset = assets.join(client::asset_relative_path(id));
+        let target = root.join("target");
+        fs::create_dir_all(asset.parent().unwrap()).unwrap();
+        fs::create_dir_all(&target).unwrap();
+        fs::write(&asset, content).unwrap();
+
+        let mut buffer = vec![0; 4096];
+        let mut cache = Cache::default();
+        let Outcome::Verified(stat) = verify_asset(&asset, &hash, &cache, &mut hasher, &mut buffer).unwrap() else {
+            panic!("asset should verify");
+        };
+        cache.0.insert(hash.clone(), stat);
+
+        // Blit the asset with another mode, which chmods the shared inode
+        let item = client::PendingFile {
+            id: package::Id::from("test".to_owned()),
+            layout: layout::Layout {
+                uid: 0,
+                gid: 0,
+                mode: 0o100755,
+                tag: 0,
+                entry: layout::Entry::Regular(id, "file".to_owned()),
+            },
+        };
+        let parent = std::fs::File::open(&target).unwrap();
+        let cache_dir = std::fs::File::open(&assets).unwrap();
+        Client::blit_element_item(
+            parent.as_raw_fd(),
+            cache_dir.as_raw_fd(),
+            "file",
+            &item,
+            &mut Default::default(),
+        )
+        .unwrap();
+
+        let metadata = fs::metadata(&asset).unwrap();
+        assert_eq!(metadata.nlink(), 2);
+        assert_eq!(cache.0.get(&hash), Some(&Stat::from(&metadata)));
+
+        fs::remove_dir_all(&root).unwrap();
+    }
+}
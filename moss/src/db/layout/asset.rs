@@ -0,0 +1,90 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Reference counted index of the assets used by stored layouts
+//!
+//! Every distinct regular file hash of a package holds one reference, so an
+//! asset with no references left is no longer used by any installed package.
+
+use std::collections::BTreeSet;
+
+use diesel::prelude::*;
+use diesel::{connection::DefaultLoadingMode, SqliteConnection};
+
+use super::{blob, schema::asset, schema::layout_blob, Error, MAX_VARIABLE_NUMBER};
+
+/// Adjust the reference count of every distinct asset in the layout `data` by `delta`
+pub fn adjust(tx: &mut SqliteConnection, data: &[u8], delta: i32) -> Result<(), Error> {
+    let hashes = blob::Blob::new(data)?.hashes().collect::<BTreeSet<_>>();
+
+    for hash in hashes {
+        diesel::insert_into(asset::table)
+            .values((asset::hash.eq(&hash.to_be_bytes()[..]), asset::refs.eq(delta)))
+            .on_conflict(asset::hash)
+            .do_update()
+            .set(asset::refs.eq(asset::refs + delta))
+            .execute(tx)?;
+    }
+
+    Ok(())
+}
+
+/// Recount all references from the stored layouts
+pub fn rebuild(tx: &mut SqliteConnection) -> Result<(), Error> {
+    diesel::delete(asset::table).execute(tx)?;
+
+    let blobs = layout_blob::table
+        .select(layout_blob::data)
+        .load_iter::<Vec<u8>, DefaultLoadingMode>(tx)?
+        .collect::<Result<Vec<_>, _>>()?;
+
+    for data in blobs {
+        adjust(tx, &data, 1)?;
+    }
+
+    Ok(())
+}
+
+/// Rebuild the index if layouts predate it
+pub fn migrate(conn: &mut SqliteConnection) -> Result<(), Error> {
+    let indexed = diesel::select(diesel::dsl::exists(asset::table)).get_result::<bool>(conn)?;
+    let stored = diesel::select(diesel::dsl::exists(layout_blob::table)).get_result::<bool>(conn)?;
+
+    if stored && !indexed {
+        conn.exclusive_transaction(rebuild)?;
+    }
+
+    Ok(())
+}
+
+/// Hashes of all assets which are no longer referenced
+pub fn unreferenced(conn: &mut SqliteConnection) -> Result<Vec<u128>, Error> {
+    asset::table
+        .select(asset::hash)
+        .filter(asset::refs.le(0))
+        .order(asset::hash)
+        .load_iter::<Vec<u8>, DefaultLoadingMode>(conn)?
+        .map(|hash| decode(&hash?))
+        .collect()
+}
+
+/// Drop the given hashes from the index, if they're still unreferenced
+pub fn forget(tx: &mut SqliteConnection, hashes: &[u128]) -> Result<(), Error> {
+    let hashes = hashes
+        .iter()
+        .map(|hash| hash.to_be_bytes().to_vec())
+        .collect::<Vec<_>>();
+
+    for chunk in hashes.chunks(MAX_VARIABLE_NUMBER) {
+        diesel::delete(asset::table.filter(asset::hash.eq_any(chunk)).filter(asset::refs.le(0))).execute(tx)?;
+    }
+
+    Ok(())
+}
+
+fn decode(hash: &[u8]) -> Result<u128, Error> {
+    Ok(u128::from_be_bytes(
+        hash.try_into().map_err(|_| Error::LayoutEntryDecode)?,
+    ))
+}
@@ -0,0 +1,426 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Compact columnar encoding of a single package layout
+//!
+//! All integers are little endian and no field requires alignment, so a [`Blob`]
+//! can be read in place from an SQLite row or a mapped file:
+//!
+//! ```text
+//! header   magic (4) | entries (u32) | hashes (u32) | strings (u32)
+//! hash     [u128; hashes]      raw hash of each regular entry, in entry order
+//! uid      [u32; entries]
+//! gid      [u32; entries]
+//! mode     [u32; entries]
+//! tag      [u32; entries]
+//! dir      [u32; entries]      string id of the parent directory, or NONE
+//! name     [u32; entries]      string id of the file name
+//! source   [u32; entries]      string id of the symlink source, or NONE
+//! kind     [u8; entries]
+//! offsets  [u32; strings + 1]  string table offsets
+//! bytes    [u8]                interned UTF-8 strings
+//! ```
+//!
+//! Targets are split into parent directory and file name so the highly
+//! repetitive directory strings are only stored once per package.
+
+use std::{collections::HashMap, fmt};
+
+use stone::payload::{self, layout};
+
+use super::Error;
+
+const MAGIC: [u8; 4] = *b"MLB\x01";
+const HEADER_LEN: usize = 16;
+const NONE: u32 = u32::MAX;
+
+const KIND_REGULAR: u8 = 0;
+const KIND_SYMLINK: u8 = 1;
+const KIND_DIRECTORY: u8 = 2;
+const KIND_CHARACTER_DEVICE: u8 = 3;
+const KIND_BLOCK_DEVICE: u8 = 4;
+const KIND_FIFO: u8 = 5;
+const KIND_SOCKET: u8 = 6;
+
+/// Encode the layout entries of a single package
+pub fn encode<'a>(layouts: impl IntoIterator<Item = &'a payload::Layout>) -> Vec<u8> {
+    let mut strings = Interner::default();
+    let mut columns = Columns::default();
+
+    for layout in layouts {
+        let (kind, source, target) = match &layout.entry {
+            layout::Entry::Regular(hash, target) => {
+                columns.hash.push(*hash);
+                (KIND_REGULAR, None, target)
+            }
+            layout::Entry::Symlink(source, target) => (KIND_SYMLINK, Some(source), target),
+            layout::Entry::Directory(target) => (KIND_DIRECTORY, None, target),
+            layout::Entry::CharacterDevice(target) => (KIND_CHARACTER_DEVICE, None, target),
+            layout::Entry::BlockDevice(target) => (KIND_BLOCK_DEVICE, None, target),
+            layout::Entry::Fifo(target) => (KIND_FIFO, None, target),
+            layout::Entry::Socket(target) => (KIND_SOCKET, None, target),
+        };
+
+        let (dir, name) = match target.rsplit_once('/') {
+            Some((dir, name)) => (strings.intern(dir), name),
+            None => (NONE, target.as_str()),
+        };
+
+        columns.uid.push(layout.uid);
+        columns.gid.push(layout.gid);
+        columns.mode.push(layout.mode);
+        columns.tag.push(layout.tag);
+        columns.dir.push(dir);
+        columns.name.push(strings.intern(name));
+        columns.source.push(source.map_or(NONE, |s| strings.intern(s)));
+        columns.kind.push(kind);
+    }
+
+    let entries = columns.kind.len();
+    let string_bytes = strings.list.iter().map(|s| s.len()).sum::<usize>();
+
+    let mut out = Vec::with_capacity(
+        HEADER_LEN + columns.hash.len() * 16 + entries * 29 + (strings.list.len() + 1) * 4 + string_bytes,
+    );
+
+    out.extend_from_slice(&MAGIC);
+    out.extend_from_slice(&(entries as u32).to_le_bytes());
+    out.extend_from_slice(&(columns.hash.len() as u32).to_le_bytes());
+    out.extend_from_slice(&(strings.list.len() as u32).to_le_bytes());
+
+    for hash in &columns.hash {
+        out.extend_from_slice(&hash.to_le_bytes());
+    }
+    for column in [
+        &columns.uid,
+        &columns.gid,
+        &columns.mode,
+        &columns.tag,
+        &columns.dir,
+        &columns.name,
+        &columns.source,
+    ] {
+        for value in column {
+            out.extend_from_slice(&value.to_le_bytes());
+        }
+    }
+    out.extend_from_slice(&columns.kind);
+
+    let mut offset = 0u32;
+    out.extend_from_slice(&offset.to_le_bytes());
+    for s in &strings.list {
+        offset += s.len() as u32;
+        out.extend_from_slice(&offset.to_le_bytes());
+    }
+    for s in &strings.list {
+        out.extend_from_slice(s.as_bytes());
+    }
+
+    out
+}
+
+/// A validated, borrowed view over an encoded layout
+#[derive(Debug, Clone, Copy)]
+pub struct Blob<'a> {
+    data: &'a [u8],
+    entries: usize,
+    hashes: usize,
+    strings: usize,
+    offsets: usize,
+    bytes: &'a str,
+}
+
+impl<'a> Blob<'a> {
+    /// Validate `data` up front so all later accessors are infallible
+    pub fn new(data: &'a [u8]) -> Result<Self, Error> {
+        if data.len() < HEADER_LEN || data[..4] != MAGIC {
+            return Err(Error::LayoutEntryDecode);
+        }
+
+        let entries = read_u32(data, 4) as usize;
+        let hashes = read_u32(data, 8) as usize;
+        let strings = read_u32(data, 12) as usize;
+
+        let offsets = hashes
+            .checked_mul(16)
+            .and_then(|n| entries.checked_mul(29)?.checked_add(n))
+            .and_then(|n| n.checked_add(HEADER_LEN))
+            .ok_or(Error::LayoutEntryDecode)?;
+        let bytes_start = strings
+            .checked_add(1)
+            .and_then(|n| n.checked_mul(4))
+            .and_then(|n| n.checked_add(offsets))
+            .filter(|n| *n <= data.len())
+            .ok_or(Error::LayoutEntryDecode)?;
+
+        let bytes = std::str::from_utf8(&data[bytes_start..]).map_err(|_| Error::LayoutEntryDecode)?;
+
+        let blob = Self {
+            data,
+            entries,
+            hashes,
+            strings,
+            offsets,
+            bytes,
+        };
+
+        // Every string id must resolve to a slice on a char boundary
+        let mut last = 0;
+        for i in 0..=strings {
+            let offset = read_u32(data, offsets + i * 4) as usize;
+            if offset < last || offset > bytes.len() || !bytes.is_char_boundary(offset) {
+                return Err(Error::LayoutEntryDecode);
+            }
+            last = offset;
+        }
+
+        let mut regular = 0;
+        for i in 0..entries {
+            let kind = data[blob.column(7) + i];
+            if kind > KIND_SOCKET {
+                return Err(Error::LayoutEntryDecode);
+            }
+            if kind == KIND_REGULAR {
+                regular += 1;
+            }
+
+            let dir = blob.u32_column(4, i);
+            let name = blob.u32_column(5, i);
+            let source = blob.u32_column(6, i);
+
+            let valid = |id: u32| (id as usize) < strings;
+            let source_ok = if kind == KIND_SYMLINK {
+                valid(source)
+            } else {
+                source == NONE
+            };
+
+            if !valid(name) || !(dir == NONE || valid(dir)) || !source_ok {
+                return Err(Error::LayoutEntryDecode);
+            }
+        }
+        if regular != hashes {
+            return Err(Error::LayoutEntryDecode);
+        }
+
+        Ok(blob)
+    }
+
+    /// Number of entries in the layout
+    pub fn len(&self) -> usize {
+        self.entries
+    }
+
+    /// Returns true if the layout has no entries
+    pub fn is_empty(&self) -> bool {
+        self.entries == 0
+    }
+
+    /// Hashes of all regular files, without decoding any other column
+    pub fn hashes(&self) -> impl Iterator<Item = u128> + 'a {
+        let data = self.data;
+        (0..self.hashes).map(move |i| read_u128(data, HEADER_LEN + i * 16))
+    }
+
+    /// Iterate all entries in their original order
+    pub fn iter(&self) -> impl Iterator<Item = Entry<'a>> + 'a {
+        let blob = *self;
+        let mut hash = 0;
+
+        (0..self.entries).map(move |i| {
+            let kind = match blob.data[blob.column(7) + i] {
+                KIND_REGULAR => {
+                    hash += 1;
+                    Kind::Regular(read_u128(blob.data, HEADER_LEN + (hash - 1) * 16))
+                }
+                KIND_SYMLINK => Kind::Symlink(blob.string(blob.u32_column(6, i))),
+                KIND_DIRECTORY => Kind::Directory,
+                KIND_CHARACTER_DEVICE => Kind::CharacterDevice,
+                KIND_BLOCK_DEVICE => Kind::BlockDevice,
+                KIND_FIFO => Kind::Fifo,
+                _ => Kind::Socket,
+            };
+            let dir = blob.u32_column(4, i);
+
+            Entry {
+                uid: blob.u32_column(0, i),
+                gid: blob.u32_column(1, i),
+                mode: blob.u32_column(2, i),
+                tag: blob.u32_column(3, i),
+                kind,
+                dir: (dir != NONE).then(|| blob.string(dir)),
+                name: blob.string(blob.u32_column(5, i)),
+            }
+        })
+    }
+
+    /// Byte offset of the nth fixed width column following the hashes
+    fn column(&self, n: usize) -> usize {
+        HEADER_LEN + self.hashes * 16 + n * self.entries * 4
+    }
+
+    fn u32_column(&self, n: usize, i: usize) -> u32 {
+        read_u32(self.data, self.column(n) + i * 4)
+    }
+
+    fn string(&self, id: u32) -> &'a str {
+        debug_assert!((id as usize) < self.strings);
+        let start = read_u32(self.data, self.offsets + id as usize * 4) as usize;
+        let end = read_u32(self.data, self.offsets + id as usize * 4 + 4) as usize;
+        &self.bytes[start..end]
+    }
+}
+
+/// A borrowed layout entry
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Entry<'a> {
+    pub uid: u32,
+    pub gid: u32,
+    pub mode: u32,
+    pub tag: u32,
+    pub kind: Kind<'a>,
+    dir: Option<&'a str>,
+    name: &'a str,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Kind<'a> {
+    Regular(u128),
+    Symlink(&'a str),
+    Directory,
+    CharacterDevice,
+    BlockDevice,
+    Fifo,
+    Socket,
+}
+
+impl<'a> Entry<'a> {
+    /// Target path of this entry, as a displayable value
+    pub fn target(&self) -> Target<'a> {
+        Target {
+            dir: self.dir,
+            name: self.name,
+        }
+    }
+
+    /// Convert into an owned [`payload::Layout`]
+    pub fn to_layout(&self) -> payload::Layout {
+        let target = self.target().to_string();
+
+        let entry = match self.kind {
+            Kind::Regular(hash) => layout::Entry::Regular(hash, target),
+            Kind::Symlink(source) => layout::Entry::Symlink(source.to_owned(), target),
+            Kind::Directory => layout::Entry::Directory(target),
+            Kind::CharacterDevice => layout::Entry::CharacterDevice(target),
+            Kind::BlockDevice => layout::Entry::BlockDevice(target),
+            Kind::Fifo => layout::Entry::Fifo(target),
+            Kind::Socket => layout::Entry::Socket(target),
+        };
+
+        payload::Layout {
+            uid: self.uid,
+            gid: self.gid,
+            mode: self.mode,
+            tag: self.tag,
+            entry,
+        }
+    }
+}
+
+/// Target path of an [`Entry`], joined lazily from its interned parts
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Target<'a> {
+    dir: Option<&'a str>,
+    name: &'a str,
+}
+
+impl<'a> Target<'a> {
+    /// Parent directory, if the target has one
+    pub fn dir(&self) -> Option<&'a str> {
+        self.dir
+    }
+}
+
+impl fmt::Display for Target<'_> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self.dir {
+            Some(dir) => write!(f, "{dir}/{}", self.name),
+            None => f.write_str(self.name),
+        }
+    }
+}
+
+#[derive(Default)]
+struct Columns {
+    hash: Vec<u128>,
+    uid: Vec<u32>,
+    gid: Vec<u32>,
+    mode: Vec<u32>,
+    tag: Vec<u32>,
+    dir: Vec<u32>,
+    name: Vec<u32>,
+    source: Vec<u32>,
+    kind: Vec<u8>,
+}
+
+#[derive(Default)]
+struct Interner<'a> {
+    ids: HashMap<&'a str, u32>,
+    list: Vec<&'a str>,
+}
+
+impl<'a> Interner<'a> {
+    fn intern(&mut self, s: &'a str) -> u32 {
+        *self.ids.entry(s).or_insert_with(|| {
+            self.list.push(s);
+            self.list.len() as u32 - 1
+        })
+    }
+}
+
+fn read_u32(data: &[u8], offset: usize) -> u32 {
+    u32::from_le_bytes(data[offset..offset + 4].try_into().expect("4 bytes"))
+}
+
+fn read_u128(data: &[u8], offset: usize) -> u128 {
+    u128::from_le_bytes(data[offset..offset + 16].try_into().expect("16 bytes"))
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    fn layout(entry: layout::Entry) -> payload::Layout {
+        payload::Layout {
+            uid: 0,
+            gid: 1,
+            mode: 0o100644,
+            tag: 2,
+            entry,
+        }
+    }
+
+    #[test]
+    fn roundtrip() {
+        let layouts = vec![
+            layout(layout::Entry::Directory("share/nano".into())),
+            layout(layout::Entry::Regular(u128::MAX - 7, "share/nano/a".into())),
+            layout(layout::Entry::Symlink("a".into(), "share/nano/b".into())),
+            layout(layout::Entry::Regular(42, "share/nano/ä".into())),
+            layout(layout::Entry::Fifo("fifo".into())),
+            layout(layout::Entry::Regular(7, "/abs".into())),
+        ];
+
+        let data = encode(&layouts);
+        let blob = Blob::new(&data).unwrap();
+
+        assert_eq!(blob.len(), layouts.len());
+        assert_eq!(blob.hashes().collect::<Vec<_>>(), [u128::MAX - 7, 42, 7]);
+        assert_eq!(blob.iter().map(|e| e.to_layout()).collect::<Vec<_>>(), layouts);
+
+        assert!(Blob::new(&data[..data.len() - 1]).is_err());
+        assert!(Blob::new(&[]).is_err());
+        assert!(Blob::new(&encode(&[])).unwrap().is_empty());
+    }
+}
@@ -0,0 +1,82 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Index of the boot relevant entries of each stored layout
+//!
+//! Only the entries boot sync matches against, kernel files & systemd-boot
+//! assets, are indexed, so it reads a handful of entries per package instead
+//! of every layout of every retained state. Each package holds a row, empty
+//! if it ships nothing bootable, so an index predating the layouts can be told
+//! apart.
+
+use std::{str::FromStr, sync::LazyLock};
+
+use diesel::prelude::*;
+use diesel::{connection::DefaultLoadingMode, SqliteConnection};
+use fnmatch::Pattern;
+use stone::payload::{self, layout};
+
+use super::{blob, schema::boot_layout, schema::layout_blob, Error};
+
+/// Kernel files, either regular files or symlinks
+pub const KERNEL_PATTERN: &str = "lib/kernel/(version:*)/*";
+/// Bootloader assets, regular files only
+pub const BOOTLOADER_PATTERN: &str = "lib*/systemd/boot/efi/*.efi";
+
+static KERNEL: LazyLock<Pattern> = LazyLock::new(|| Pattern::from_str(KERNEL_PATTERN).expect("valid pattern"));
+static BOOTLOADER: LazyLock<Pattern> = LazyLock::new(|| Pattern::from_str(BOOTLOADER_PATTERN).expect("valid pattern"));
+
+/// Whether boot sync would pick up the entry
+fn is_boot_entry(entry: &layout::Entry) -> bool {
+    match entry {
+        layout::Entry::Regular(_, target) => {
+            KERNEL.match_path(target).is_some() || BOOTLOADER.match_path(target).is_some()
+        }
+        layout::Entry::Symlink(_, target) => KERNEL.match_path(target).is_some(),
+        _ => false,
+    }
+}
+
+/// Encode the boot relevant subset of `layouts`
+pub fn encode<'a>(layouts: impl IntoIterator<Item = &'a payload::Layout>) -> Vec<u8> {
+    blob::encode(layouts.into_iter().filter(|layout| is_boot_entry(&layout.entry)))
+}
+
+/// Reindex all stored layouts
+pub fn rebuild(tx: &mut SqliteConnection) -> Result<(), Error> {
+    diesel::delete(boot_layout::table).execute(tx)?;
+
+    let rows = layout_blob::table
+        .select((layout_blob::package_id, layout_blob::data))
+        .load_iter::<(String, Vec<u8>), DefaultLoadingMode>(tx)?
+        .collect::<Result<Vec<_>, _>>()?;
+
+    for (package_id, data) in rows {
+        let layouts = blob::Blob::new(&data)?
+            .iter()
+            .map(|entry| entry.to_layout())
+            .collect::<Vec<_>>();
+
+        diesel::insert_into(boot_layout::table)
+            .values((
+                boot_layout::package_id.eq(package_id),
+                boot_layout::data.eq(encode(&layouts)),
+            ))
+            .execute(tx)?;
+    }
+
+    Ok(())
+}
+
+/// Rebuild the index if layouts predate it
+pub fn migrate(conn: &mut SqliteConnection) -> Result<(), Error> {
+    let indexed = diesel::select(diesel::dsl::exists(boot_layout::table)).get_result::<bool>(conn)?;
+    let stored = diesel::select(diesel::dsl::exists(layout_blob::table)).get_result::<bool>(conn)?;
+
+    if stored && !indexed {
+        conn.exclusive_transaction(rebuild)?;
+    }
+
+    Ok(())
+}
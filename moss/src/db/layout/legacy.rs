@@ -0,0 +1,101 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Migration from the original row-per-entry `layout` table
+
+use diesel::prelude::*;
+use diesel::SqliteConnection;
+
+use stone::payload;
+
+use super::{blob, schema::layout, schema::layout_blob, Error};
+use crate::package;
+
+/// Re-encode any rows left in the legacy `layout` table as blobs,
+/// then drop them from the table
+pub fn migrate(conn: &mut SqliteConnection) -> Result<(), Error> {
+    let pending = diesel::select(diesel::dsl::exists(layout::table)).get_result::<bool>(conn)?;
+
+    if !pending {
+        return Ok(());
+    }
+
+    conn.exclusive_transaction(|tx| {
+        let rows = layout::table
+            .select(Layout::as_select())
+            .order_by((layout::package_id, layout::id))
+            .load_iter(tx)?
+            .map(map_layout)
+            .collect::<Result<Vec<_>, _>>()?;
+
+        for group in rows.chunk_by(|(a, _), (b, _)| a == b) {
+            let package_id: &str = group[0].0.as_ref();
+
+            diesel::replace_into(layout_blob::table)
+                .values((
+                    layout_blob::package_id.eq(package_id),
+                    layout_blob::data.eq(blob::encode(group.iter().map(|(_, layout)| layout))),
+                ))
+                .execute(tx)?;
+        }
+
+        diesel::delete(layout::table).execute(tx)?;
+
+        Ok(())
+    })
+}
+
+fn map_layout(result: QueryResult<Layout>) -> Result<(package::Id, payload::Layout), Error> {
+    let row = result?;
+
+    let entry = decode_entry(row.entry_type, row.entry_value1, row.entry_value2).ok_or(Error::LayoutEntryDecode)?;
+
+    let layout = payload::Layout {
+        uid: row.uid as u32,
+        gid: row.gid as u32,
+        mode: row.mode as u32,
+        tag: row.tag as u32,
+        entry,
+    };
+
+    Ok((row.package_id, layout))
+}
+
+fn decode_entry(
+    entry_type: String,
+    entry_value1: Option<String>,
+    entry_value2: Option<String>,
+) -> Option<payload::layout::Entry> {
+    use payload::layout::Entry;
+
+    match entry_type.as_str() {
+        "regular" => {
+            let hash = entry_value1?.parse::<u128>().ok()?;
+            let name = entry_value2?;
+
+            Some(Entry::Regular(hash, name))
+        }
+        "symlink" => Some(Entry::Symlink(entry_value1?, entry_value2?)),
+        "directory" => Some(Entry::Directory(entry_value1?)),
+        "character-device" => Some(Entry::CharacterDevice(entry_value1?)),
+        "block-device" => Some(Entry::BlockDevice(entry_value1?)),
+        "fifo" => Some(Entry::Fifo(entry_value1?)),
+        "socket" => Some(Entry::Socket(entry_value1?)),
+        _ => None,
+    }
+}
+
+#[derive(Queryable, Selectable)]
+#[diesel(table_name = layout)]
+struct Layout {
+    #[diesel(deserialize_as = String)]
+    package_id: package::Id,
+    uid: i32,
+    gid: i32,
+    mode: i32,
+    tag: i32,
+    entry_type: String,
+    entry_value1: Option<String>,
+    entry_value2: Option<String>,
+}
@@ -0,0 +1,6 @@
+-- Your SQL goes here
+
+CREATE TABLE IF NOT EXISTS layout_blob (
+    package_id TEXT NOT NULL PRIMARY KEY,
+    data BLOB NOT NULL
+);
@@ -0,0 +1,4 @@
+-- This file should undo anything in `up.sql`
+
+DROP INDEX IF EXISTS asset_unreferenced;
+DROP TABLE IF EXISTS asset;
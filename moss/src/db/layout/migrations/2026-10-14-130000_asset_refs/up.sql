@@ -0,0 +1,8 @@
+-- Your SQL goes here
+
+CREATE TABLE IF NOT EXISTS asset (
+    hash BLOB NOT NULL PRIMARY KEY,
+    refs INTEGER NOT NULL
+) WITHOUT ROWID;
+
+CREATE INDEX IF NOT EXISTS asset_unreferenced ON asset (refs) WHERE refs <= 0;
@@ -0,0 +1,6 @@
+-- Your SQL goes here
+
+CREATE TABLE IF NOT EXISTS boot_layout (
+    package_id TEXT NOT NULL PRIMARY KEY,
+    data BLOB NOT NULL
+) WITHOUT ROWID;
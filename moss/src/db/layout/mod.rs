@@ -3,9 +3,9 @@
 // SPDX-License-Identifier: MPL-2.0
 
 use diesel::prelude::*;
-use diesel::{Connection as _, SqliteConnection};
+use diesel::{connection::DefaultLoadingMode, Connection as _, SqliteConnection};
 use diesel_migrations::{embed_migrations, EmbeddedMigrations, MigrationHarness};
-use std::collections::BTreeSet;
+use std::collections::{BTreeMap, BTreeSet};
 
 use stone::payload;
 
@@ -16,8 +16,15 @@ use super::{Connection, MAX_VARIABLE_NUMBER};
 
 const MIGRATIONS: EmbeddedMigrations = embed_migrations!("src/db/layout/migrations");
 
+mod asset;
+pub mod blob;
+mod boot;
+mod legacy;
 mod schema;
 
+pub use self::boot::{BOOTLOADER_PATTERN, KERNEL_PATTERN};
+
+/// Layouts are stored as one [`blob`] per package, keyed by package id
 #[derive(Debug, Clone)]
 pub struct Database {
     conn: Connection,
@@ -28,6 +35,9 @@ impl Database {
         let mut conn = SqliteConnection::establish(url)?;
 
         conn.run_pending_migrations(MIGRATIONS).map_err(Error::Migration)?;
+        legacy::migrate(&mut conn)?;
+        asset::migrate(&mut conn)?;
+        boot::migrate(&mut conn)?;
 
         Ok(Database {
             conn: Connection::new(conn),
@@ -39,88 +49,178 @@ impl Database {
         &self,
         packages: impl IntoIterator<Item = &'a package::Id>,
     ) -> Result<Vec<(package::Id, payload::Layout)>, Error> {
+        let mut output = vec![];
+        self.visit(packages, |package, entry| {
+            output.push((package.clone(), entry.to_layout()))
+        })?;
+        Ok(output)
+    }
+
+    /// The given packages which have layouts stored
+    pub fn stored<'a>(
+        &self,
+        packages: impl IntoIterator<Item = &'a package::Id>,
+    ) -> Result<BTreeSet<package::Id>, Error> {
         self.conn.exec(|conn| {
             let packages = packages.into_iter().map(AsRef::<str>::as_ref).collect::<Vec<_>>();
-
-            let mut output = vec![];
+            let mut stored = BTreeSet::new();
 
             for chunk in packages.chunks(MAX_VARIABLE_NUMBER) {
-                output.extend(
-                    model::layout::table
-                        .select(model::Layout::as_select())
-                        .filter(model::layout::package_id.eq_any(chunk))
-                        .load_iter(conn)?
-                        .map(map_layout)
-                        .collect::<Result<Vec<_>, _>>()?,
-                );
+                for package_id in model::layout_blob::table
+                    .select(model::layout_blob::package_id)
+                    .filter(model::layout_blob::package_id.eq_any(chunk))
+                    .load_iter::<String, DefaultLoadingMode>(conn)?
+                {
+                    stored.insert(package::Id::from(package_id?));
+                }
             }
 
-            Ok(output)
+            Ok(stored)
         })
     }
 
     pub fn all(&self) -> Result<Vec<(package::Id, payload::Layout)>, Error> {
+        let mut output = vec![];
+        self.visit_all(|package, entry| output.push((package.clone(), entry.to_layout())))?;
+        Ok(output)
+    }
+
+    /// Visit all entries for the given packages in place, without
+    /// allocating owned layouts
+    pub fn visit<'a>(
+        &self,
+        packages: impl IntoIterator<Item = &'a package::Id>,
+        mut f: impl FnMut(&package::Id, blob::Entry<'_>),
+    ) -> Result<(), Error> {
         self.conn.exec(|conn| {
-            model::layout::table
-                .select(model::Layout::as_select())
-                .load_iter(conn)?
-                .map(map_layout)
-                .collect()
+            let packages = packages.into_iter().map(AsRef::<str>::as_ref).collect::<Vec<_>>();
+
+            for chunk in packages.chunks(MAX_VARIABLE_NUMBER) {
+                let rows = model::layout_blob::table
+                    .select(model::LayoutBlob::as_select())
+                    .filter(model::layout_blob::package_id.eq_any(chunk))
+                    .load_iter(conn)?;
+
+                visit_rows(rows, &mut f)?;
+            }
+
+            Ok(())
         })
     }
 
-    pub fn file_hashes(&self) -> Result<BTreeSet<String>, Error> {
+    /// Visit the boot relevant entries (kernels & bootloader assets) for the
+    /// given packages in place
+    pub fn visit_boot<'a>(
+        &self,
+        packages: impl IntoIterator<Item = &'a package::Id>,
+        mut f: impl FnMut(&package::Id, blob::Entry<'_>),
+    ) -> Result<(), Error> {
+        self.conn.exec(|conn| {
+            let packages = packages.into_iter().map(AsRef::<str>::as_ref).collect::<Vec<_>>();
+
+            for chunk in packages.chunks(MAX_VARIABLE_NUMBER) {
+                let rows = model::boot_layout::table
+                    .select((model::boot_layout::package_id, model::boot_layout::data))
+                    .filter(model::boot_layout::package_id.eq_any(chunk))
+                    .load_iter::<(String, Vec<u8>), DefaultLoadingMode>(conn)?;
+
+                for row in rows {
+                    let (package_id, data) = row?;
+                    let package = package::Id::from(package_id);
+
+                    for entry in blob::Blob::new(&data)?.iter() {
+                        f(&package, entry);
+                    }
+                }
+            }
+
+            Ok(())
+        })
+    }
+
+    /// Visit every installed entry in place
+    pub fn visit_all(&self, mut f: impl FnMut(&package::Id, blob::Entry<'_>)) -> Result<(), Error> {
         self.conn.exec(|conn| {
-            let hashes = model::layout::table
-                .select(model::layout::entry_value1.assume_not_null())
-                .distinct()
-                .filter(model::layout::entry_type.eq("regular"))
-                .load::<String>(conn)?;
+            let rows = model::layout_blob::table
+                .select(model::LayoutBlob::as_select())
+                .load_iter(conn)?;
 
-            Ok(hashes
-                .into_iter()
-                .filter_map(|hash| hash.parse::<u128>().ok().map(|hash| format!("{hash:02x}")))
-                .collect())
+            visit_rows(rows, &mut f)
         })
     }
 
-    pub fn add(&self, package: &package::Id, layout: &payload::Layout) -> Result<(), Error> {
-        self.batch_add(vec![(package, layout)])
+    pub fn file_hashes(&self) -> Result<BTreeSet<String>, Error> {
+        self.conn.exec(|conn| {
+            let mut hashes = BTreeSet::new();
+
+            for data in model::layout_blob::table
+                .select(model::layout_blob::data)
+                .load_iter::<Vec<u8>, DefaultLoadingMode>(conn)?
+            {
+                let data = data?;
+                hashes.extend(blob::Blob::new(&data)?.hashes().map(|hash| format!("{hash:02x}")));
+            }
+
+            Ok(hashes)
+        })
     }
 
-    pub fn batch_add<'a>(
+    /// Store the layouts of each package, replacing whatever was stored for it
+    ///
+    /// Each package's layouts are stored as a single blob, so `layouts` must hold
+    /// the complete set of every package it mentions. Packages it doesn't mention
+    /// are left untouched.
+    pub fn replace_package_layouts<'a>(
         &self,
         layouts: impl IntoIterator<Item = (&'a package::Id, &'a payload::Layout)>,
     ) -> Result<(), Error> {
-        self.conn.exclusive_tx(|tx| {
-            let mut ids = vec![];
+        let mut packages = BTreeMap::<&package::Id, Vec<_>>::new();
 
-            let values = layouts
-                .into_iter()
-                .map(|(package_id, layout)| {
-                    ids.push(package_id.as_ref());
-
-                    let (entry_type, entry_value1, entry_value2) = encode_entry(layout.entry.clone());
-
-                    model::NewLayout {
-                        package_id: package_id.to_string(),
-                        uid: layout.uid as i32,
-                        gid: layout.gid as i32,
-                        mode: layout.mode as i32,
-                        tag: layout.tag as i32,
-                        entry_type,
-                        entry_value1,
-                        entry_value2,
-                    }
-                })
-                .collect::<Vec<_>>();
+        for (package_id, layout) in layouts {
+            packages.entry(package_id).or_default().push(layout);
+        }
+
+        // Encode outside of the transaction to keep the lock short
+        let (values, boot_values) = packages
+            .into_iter()
+            .map(|(package_id, layouts)| {
+                (
+                    model::NewLayoutBlob {
+                        package_id: package_id.as_ref(),
+                        data: blob::encode(layouts.iter().copied()),
+                    },
+                    model::NewBootLayout {
+                        package_id: package_id.as_ref(),
+                        data: boot::encode(layouts),
+                    },
+                )
+            })
+            .unzip::<_, _, Vec<_>, Vec<_>>();
 
-            ids.sort();
-            ids.dedup();
-            batch_remove_impl(&ids, tx)?;
+        self.conn.exclusive_tx(|tx| {
+            for value in &values {
+                // Release the assets of any layout being replaced
+                if let Some(previous) = model::layout_blob::table
+                    .select(model::layout_blob::data)
+                    .find(value.package_id)
+                    .first::<Vec<u8>>(tx)
+                    .optional()?
+                {
+                    asset::adjust(tx, &previous, -1)?;
+                }
+
+                asset::adjust(tx, &value.data, 1)?;
+            }
 
-            for chunk in values.chunks(MAX_VARIABLE_NUMBER / 8) {
-                diesel::insert_into(model::layout::table).values(chunk).execute(tx)?;
+            for chunk in values.chunks(MAX_VARIABLE_NUMBER / 2) {
+                diesel::replace_into(model::layout_blob::table)
+                    .values(chunk)
+                    .execute(tx)?;
+            }
+            for chunk in boot_values.chunks(MAX_VARIABLE_NUMBER / 2) {
+                diesel::replace_into(model::boot_layout::table)
+                    .values(chunk)
+                    .execute(tx)?;
             }
 
             Ok(())
@@ -135,107 +235,94 @@ impl Database {
         self.conn.exclusive_tx(|tx| {
             let packages = packages.into_iter().map(AsRef::<str>::as_ref).collect::<Vec<_>>();
 
-            batch_remove_impl(&packages, tx)?;
+            for chunk in packages.chunks(MAX_VARIABLE_NUMBER) {
+                let removed = model::layout_blob::table
+                    .select(model::layout_blob::data)
+                    .filter(model::layout_blob::package_id.eq_any(chunk))
+                    .load::<Vec<u8>>(tx)?;
+
+                for data in removed {
+                    asset::adjust(tx, &data, -1)?;
+                }
+
+                diesel::delete(model::layout_blob::table.filter(model::layout_blob::package_id.eq_any(chunk)))
+                    .execute(tx)?;
+                diesel::delete(model::boot_layout::table.filter(model::boot_layout::package_id.eq_any(chunk)))
+                    .execute(tx)?;
+            }
 
             Ok(())
         })
     }
-}
 
-fn batch_remove_impl(packages: &[&str], tx: &mut SqliteConnection) -> Result<(), Error> {
-    for chunk in packages.chunks(MAX_VARIABLE_NUMBER) {
-        diesel::delete(model::layout::table.filter(model::layout::package_id.eq_any(chunk))).execute(tx)?;
+    /// Hashes of all assets no longer referenced by any stored layout
+    pub fn unreferenced_assets(&self) -> Result<Vec<String>, Error> {
+        self.conn.exec(|conn| {
+            Ok(asset::unreferenced(conn)?
+                .into_iter()
+                .map(|hash| format!("{hash:02x}"))
+                .collect())
+        })
     }
-    Ok(())
-}
-
-fn map_layout(result: QueryResult<model::Layout>) -> Result<(package::Id, payload::Layout), Error> {
-    let row = result?;
 
-    let entry = decode_entry(row.entry_type, row.entry_value1, row.entry_value2).ok_or(Error::LayoutEntryDecode)?;
+    /// Drop removed assets from the asset index
+    pub fn forget_assets<'a>(&self, hashes: impl IntoIterator<Item = &'a str>) -> Result<(), Error> {
+        let hashes = hashes
+            .into_iter()
+            .map(|hash| u128::from_str_radix(hash, 16).map_err(|_| Error::LayoutEntryDecode))
+            .collect::<Result<Vec<_>, _>>()?;
 
-    let layout = payload::Layout {
-        uid: row.uid as u32,
-        gid: row.gid as u32,
-        mode: row.mode as u32,
-        tag: row.tag as u32,
-        entry,
-    };
+        self.conn.exclusive_tx(|tx| asset::forget(tx, &hashes))
+    }
 
-    Ok((row.package_id, layout))
+    /// Recount the asset index from all stored layouts
+    pub fn rebuild_asset_index(&self) -> Result<(), Error> {
+        self.conn.exclusive_tx(asset::rebuild)
+    }
 }
 
-fn decode_entry(
-    entry_type: String,
-    entry_value1: Option<String>,
-    entry_value2: Option<String>,
-) -> Option<payload::layout::Entry> {
-    use payload::layout::Entry;
-
-    match entry_type.as_str() {
-        "regular" => {
-            let hash = entry_value1?.parse::<u128>().ok()?;
-            let name = entry_value2?;
+fn visit_rows(
+    rows: impl Iterator<Item = QueryResult<model::LayoutBlob>>,
+    f: &mut impl FnMut(&package::Id, blob::Entry<'_>),
+) -> Result<(), Error> {
+    for row in rows {
+        let row = row?;
 
-            Some(Entry::Regular(hash, name))
+        for entry in blob::Blob::new(&row.data)?.iter() {
+            f(&row.package_id, entry);
         }
-        "symlink" => Some(Entry::Symlink(entry_value1?, entry_value2?)),
-        "directory" => Some(Entry::Directory(entry_value1?)),
-        "character-device" => Some(Entry::CharacterDevice(entry_value1?)),
-        "block-device" => Some(Entry::BlockDevice(entry_value1?)),
-        "fifo" => Some(Entry::Fifo(entry_value1?)),
-        "socket" => Some(Entry::Socket(entry_value1?)),
-        _ => None,
     }
-}
 
-fn encode_entry(entry: payload::layout::Entry) -> (&'static str, Option<String>, Option<String>) {
-    use payload::layout::Entry;
-
-    match entry {
-        Entry::Regular(hash, name) => ("regular", Some(hash.to_string()), Some(name)),
-        Entry::Symlink(a, b) => ("symlink", Some(a), Some(b)),
-        Entry::Directory(name) => ("directory", Some(name), None),
-        Entry::CharacterDevice(name) => ("character-device", Some(name), None),
-        Entry::BlockDevice(name) => ("block-device", Some(name), None),
-        Entry::Fifo(name) => ("fifo", Some(name), None),
-        Entry::Socket(name) => ("socket", Some(name), None),
-    }
+    Ok(())
 }
 
 mod model {
-    use diesel::{associations::Identifiable, deserialize::Queryable, prelude::Insertable, Selectable};
+    use diesel::{deserialize::Queryable, prelude::Insertable, Selectable};
 
     use crate::package;
 
-    pub use super::schema::layout;
+    pub use super::schema::{boot_layout, layout_blob};
 
-    #[derive(Queryable, Selectable, Identifiable)]
-    #[diesel(table_name = layout)]
-    pub struct Layout {
-        pub id: i32,
+    #[derive(Queryable, Selectable)]
+    #[diesel(table_name = layout_blob)]
+    pub struct LayoutBlob {
         #[diesel(deserialize_as = String)]
         pub package_id: package::Id,
-        pub uid: i32,
-        pub gid: i32,
-        pub mode: i32,
-        pub tag: i32,
-        pub entry_type: String,
-        pub entry_value1: Option<String>,
-        pub entry_value2: Option<String>,
+        pub data: Vec<u8>,
+    }
+
+    #[derive(Insertable)]
+    #[diesel(table_name = layout_blob)]
+    pub struct NewLayoutBlob<'a> {
+        pub package_id: &'a str,
+        pub data: Vec<u8>,
     }
 
     #[derive(Insertable)]
-    #[diesel(table_name = layout)]
-    pub struct NewLayout<'a> {
-        pub package_id: String,
-        pub uid: i32,
-        pub gid: i32,
-        pub mode: i32,
-        pub tag: i32,
-        pub entry_type: &'a str,
-        pub entry_value1: Option<String>,
-        pub entry_value2: Option<String>,
+    #[diesel(table_name = boot_layout)]
+    pub struct NewBootLayout<'a> {
+        pub package_id: &'a str,
+        pub data: Vec<u8>,
     }
 }
 
@@ -263,10 +350,179 @@ mod test {
 
         let count = layouts.len();
 
-        database.batch_add(layouts.iter().map(|(p, l)| (p, *l))).unwrap();
+        database
+            .replace_package_layouts(layouts.iter().map(|(p, l)| (p, *l)))
+            .unwrap();
 
         let all = database.all().unwrap();
 
         assert_eq!(count, all.len());
+        assert_eq!(
+            all.iter().map(|(_, l)| l).collect::<Vec<_>>(),
+            layouts.iter().map(|(_, l)| *l).collect::<Vec<_>>()
+        );
+    }
+
+    #[test]
+    fn migrate_legacy_rows() {
+        let database = Database::new(":memory:").unwrap();
+
+        database.conn.exec(|conn| {
+            diesel::insert_into(schema::layout::table)
+                .values(vec![
+                    (
+                        schema::layout::package_id.eq("a"),
+                        schema::layout::uid.eq(0),
+                        schema::layout::gid.eq(0),
+                        schema::layout::mode.eq(0o100644),
+                        schema::layout::tag.eq(0),
+                        schema::layout::entry_type.eq("regular"),
+                        schema::layout::entry_value1.eq(Some("42")),
+                        schema::layout::entry_value2.eq(Some("bin/a")),
+                    ),
+                    (
+                        schema::layout::package_id.eq("a"),
+                        schema::layout::uid.eq(0),
+                        schema::layout::gid.eq(0),
+                        schema::layout::mode.eq(0o40755),
+                        schema::layout::tag.eq(0),
+                        schema::layout::entry_type.eq("directory"),
+                        schema::layout::entry_value1.eq(Some("bin")),
+                        schema::layout::entry_value2.eq(None::<&str>),
+                    ),
+                ])
+                .execute(conn)
+                .unwrap();
+
+            legacy::migrate(conn).unwrap();
+        });
+
+        let layouts = database.query([&package::Id::from("a".to_owned())]).unwrap();
+
+        assert_eq!(layouts.len(), 2);
+        assert_eq!(
+            layouts[0].1.entry,
+            payload::layout::Entry::Regular(42, "bin/a".to_owned())
+        );
+        assert_eq!(database.file_hashes().unwrap(), BTreeSet::from(["2a".to_owned()]));
+    }
+
+    #[test]
+    fn asset_refcounts() {
+        let database = Database::new(":memory:").unwrap();
+
+        let (a, b) = (package::Id::from("a".to_owned()), package::Id::from("b".to_owned()));
+        let file = |hash, target: &str| payload::Layout {
+            uid: 0,
+            gid: 0,
+            mode: 0o100644,
+            tag: 0,
+            entry: payload::layout::Entry::Regular(hash, target.to_owned()),
+        };
+        let (shared, only_a, only_b) = (file(1, "bin/x"), file(2, "bin/a"), file(3, "bin/b"));
+
+        database
+            .replace_package_layouts([(&a, &shared), (&a, &only_a), (&b, &shared), (&b, &only_b)])
+            .unwrap();
+        assert!(database.unreferenced_assets().unwrap().is_empty());
+
+        // Replacing a layout releases its previous assets
+        database.replace_package_layouts([(&b, &shared)]).unwrap();
+        assert_eq!(database.unreferenced_assets().unwrap(), ["3"]);
+
+        database.remove(&a).unwrap();
+        assert_eq!(database.unreferenced_assets().unwrap(), ["2", "3"]);
+
+        database.forget_assets(["2", "3"]).unwrap();
+        assert!(database.unreferenced_assets().unwrap().is_empty());
+
+        database.remove(&b).unwrap();
+        assert_eq!(database.unreferenced_assets().unwrap(), ["1"]);
+
+        database.rebuild_asset_index().unwrap();
+        assert!(database.unreferenced_assets().unwrap().is_empty());
+    }
+
+    #[test]
+    fn boot_index() {
+        let database = Database::new(":memory:").unwrap();
+
+        let (kernel, other) = (
+            package::Id::from("kernel".to_owned()),
+            package::Id::from("other".to_owned()),
+        );
+        let layout = |entry| payload::Layout {
+            uid: 0,
+            gid: 0,
+            mode: 0o100644,
+            tag: 0,
+            entry,
+        };
+        let vmlinuz = layout(payload::layout::Entry::Regular(1, "lib/kernel/6.1/vmlinuz".to_owned()));
+        let efi = layout(payload::layout::Entry::Regular(
+            3,
+            "lib/systemd/boot/efi/systemd-bootx64.efi".to_owned(),
+        ));
+
+        database
+            .replace_package_layouts([
+                (&kernel, &vmlinuz),
+                (
+                    &kernel,
+                    &layout(payload::layout::Entry::Directory("lib/kernel".to_owned())),
+                ),
+                (
+                    &kernel,
+                    &layout(payload::layout::Entry::Regular(
+                        4,
+                        "lib/modules/6.1/kernel/fs/ext4.ko".to_owned(),
+                    )),
+                ),
+                (&other, &efi),
+                (
+                    &other,
+                    &layout(payload::layout::Entry::Regular(5, "lib/libother.so".to_owned())),
+                ),
+                (
+                    &other,
+                    &layout(payload::layout::Entry::Regular(2, "bin/other".to_owned())),
+                ),
+            ])
+            .unwrap();
+
+        let boot = |database: &Database| {
+            let mut layouts = vec![];
+            database
+                .visit_boot([&kernel, &other], |package, entry| {
+                    layouts.push((package.clone(), entry.to_layout()))
+                })
+                .unwrap();
+            layouts
+        };
+
+        assert_eq!(
+            boot(&database),
+            [(kernel.clone(), vmlinuz.clone()), (other.clone(), efi.clone())]
+        );
+
+        // Layouts stored before the index are picked up
+        database
+            .conn
+            .exec(|conn| {
+                diesel::delete(schema::boot_layout::table).execute(conn)?;
+                boot::migrate(conn)
+            })
+            .unwrap();
+        assert_eq!(
+            boot(&database),
+            [(kernel.clone(), vmlinuz), (other.clone(), efi.clone())]
+        );
+
+        database.remove(&kernel).unwrap();
+        assert_eq!(boot(&database), [(other.clone(), efi)]);
+        assert_eq!(
+            database.stored([&kernel, &other]).unwrap(),
+            BTreeSet::from([other.clone()])
+        );
     }
 }
@@ -1,5 +1,19 @@
 // @generated automatically by Diesel CLI.
 
+diesel::table! {
+    asset (hash) {
+        hash -> Binary,
+        refs -> Integer,
+    }
+}
+
+diesel::table! {
+    boot_layout (package_id) {
+        package_id -> Text,
+        data -> Binary,
+    }
+}
+
 diesel::table! {
     layout (id) {
         id -> Integer,
@@ -13,3 +27,12 @@ diesel::table! {
         entry_value2 -> Nullable<Text>,
     }
 }
+
+diesel::table! {
+    layout_blob (package_id) {
+        package_id -> Text,
+        data -> Binary,
+    }
+}
+
+diesel::allow_tables_to_appear_in_same_query!(asset, boot_layout, layout, layout_blob);
@@ -0,0 +1,110 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Bounded memo of decoded [`Meta`] rows
+//!
+//! Entries are held in two generations: hits are promoted into the hot
+//! set and once it fills up, the cold set is dropped and replaced by it.
+//! This approximates LRU eviction without tracking per-entry recency.
+
+use std::collections::HashMap;
+use std::mem;
+
+use crate::package::{self, Meta};
+
+/// Upper bound of entries held in each generation
+const CAPACITY: usize = 4096;
+
+#[derive(Debug, Default)]
+pub struct Cache {
+    /// Db generation the entries were loaded from
+    generation: u64,
+    hot: HashMap<package::Id, Meta>,
+    cold: HashMap<package::Id, Meta>,
+}
+
+impl Cache {
+    pub fn get(&mut self, id: &package::Id, generation: u64) -> Option<Meta> {
+        if !self.sync(generation) {
+            return None;
+        }
+
+        if let Some(meta) = self.hot.get(id) {
+            return Some(meta.clone());
+        }
+
+        let meta = self.cold.remove(id)?;
+        self.promote(id.clone(), meta.clone());
+
+        Some(meta)
+    }
+
+    pub fn insert(&mut self, id: package::Id, meta: Meta, generation: u64) {
+        if self.sync(generation) {
+            self.promote(id, meta);
+        }
+    }
+
+    /// Drop everything loaded from a previous db generation
+    ///
+    /// Rows are loaded without holding the memo, so a caller may get here with an
+    /// older generation than the entries. Returns false for those, which bypass it.
+    fn sync(&mut self, generation: u64) -> bool {
+        if generation > self.generation {
+            self.generation = generation;
+            self.hot.clear();
+            self.cold.clear();
+        }
+
+        generation == self.generation
+    }
+
+    fn promote(&mut self, id: package::Id, meta: Meta) {
+        if self.hot.len() >= CAPACITY {
+            self.cold = mem::take(&mut self.hot);
+        }
+
+        self.hot.insert(id, meta);
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn stale_generation() {
+        let mut cache = Cache::default();
+        let id = package::Id::from("a".to_owned());
+        let meta = |release| Meta {
+            name: "a".to_owned().into(),
+            version_identifier: "1".to_owned(),
+            source_release: release,
+            build_release: 1,
+            architecture: "x86_64".to_owned(),
+            summary: String::new(),
+            description: String::new(),
+            source_id: "a".to_owned(),
+            homepage: String::new(),
+            licenses: vec![],
+            dependencies: Default::default(),
+            providers: Default::default(),
+            conflicts: Default::default(),
+            uri: None,
+            hash: None,
+            download_size: None,
+        };
+
+        cache.insert(id.clone(), meta(2), 1);
+
+        // Rows loaded before a write don't replace those loaded after it
+        cache.insert(id.clone(), meta(1), 0);
+        assert_eq!(cache.get(&id, 1), Some(meta(2)));
+        assert_eq!(cache.get(&id, 0), None);
+
+        cache.insert(id.clone(), meta(3), 2);
+        assert_eq!(cache.get(&id, 1), None);
+        assert_eq!(cache.get(&id, 2), Some(meta(3)));
+    }
+}
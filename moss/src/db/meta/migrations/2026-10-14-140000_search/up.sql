@@ -0,0 +1,18 @@
+-- Your SQL goes here
+
+-- Trigram index over the searchable fields of each package, matching
+-- keywords as case insensitive substrings
+CREATE VIRTUAL TABLE IF NOT EXISTS meta_search USING fts5 (
+    package UNINDEXED,
+    name,
+    summary,
+    description,
+    providers,
+    tokenize = 'trigram'
+);
+
+INSERT INTO meta_search (package, name, summary, description, providers)
+SELECT meta.package, meta.name, meta.summary, meta.description, COALESCE(group_concat(meta_providers.provider, ' '), '')
+FROM meta
+LEFT JOIN meta_providers ON meta_providers.package = meta.package
+GROUP BY meta.package;
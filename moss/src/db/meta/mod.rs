@@ -3,10 +3,17 @@
 // SPDX-License-Identifier: MPL-2.0
 
 use std::collections::{BTreeMap, BTreeSet};
+use std::sync::{
+    atomic::{AtomicU64, Ordering},
+    Arc, Mutex,
+};
 
+use diesel::dsl::sql;
 use diesel::prelude::*;
+use diesel::sql_types::{Bool, Text};
 use diesel::{Connection as _, SqliteConnection};
 use diesel_migrations::{embed_migrations, EmbeddedMigrations, MigrationHarness};
+use itertools::Itertools;
 
 use crate::db::Connection;
 use crate::package::{self, Meta};
@@ -17,6 +24,7 @@ use super::MAX_VARIABLE_NUMBER;
 
 const MIGRATIONS: EmbeddedMigrations = embed_migrations!("src/db/meta/migrations");
 
+mod cache;
 mod schema;
 
 #[derive(Debug)]
@@ -30,6 +38,10 @@ pub enum Filter<'a> {
 #[derive(Debug, Clone)]
 pub struct Database {
     conn: Connection,
+    /// Bumped on every write, shared by all clones
+    generation: Arc<AtomicU64>,
+    /// Decoded rows of the current generation, see [`Database::get`]
+    cache: Arc<Mutex<cache::Cache>>,
 }
 
 impl Database {
@@ -40,61 +52,103 @@ impl Database {
 
         Ok(Database {
             conn: Connection::new(conn),
+            generation: Arc::default(),
+            cache: Arc::default(),
         })
     }
 
+    /// Generation of the db contents, which changes whenever it's written to
+    ///
+    /// Used to invalidate any lookups derived from the db
+    pub fn generation(&self) -> u64 {
+        self.generation.load(Ordering::Acquire)
+    }
+
+    fn bump_generation(&self) {
+        self.generation.fetch_add(1, Ordering::AcqRel);
+    }
+
     pub fn wipe(&self) -> Result<(), Error> {
-        self.conn.exclusive_tx(|tx| {
-            // Cascading wipes other tables
-            diesel::delete(model::meta::table).execute(tx)?;
-            Ok(())
-        })
+        self.conn
+            .exclusive_tx(|tx| {
+                // Cascading wipes other tables
+                diesel::delete(model::meta::table).execute(tx)?;
+                // Except for the search index, which is a virtual table
+                diesel::delete(model::meta_search::table).execute(tx)?;
+                Ok(())
+            })
+            .inspect(|_| self.bump_generation())
     }
 
+    /// Retrieve a single package, memoized until the next write
     pub fn get(&self, package: &package::Id) -> Result<Meta, Error> {
-        self.conn.exec(|conn| {
-            let meta = model::meta::table
-                .select(model::Meta::as_select())
-                .find(package.to_string())
-                .first::<model::Meta>(conn)?;
-            let licenses = model::License::belonging_to(&meta)
-                .select(model::meta_licenses::license)
-                .load::<String>(conn)?;
-            let dependencies = model::Dependency::belonging_to(&meta)
-                .select(model::Dependency::as_select())
-                .load_iter(conn)?
-                .map(|d| Ok(d?.dependency))
-                .collect::<Result<_, Error>>()?;
-            let providers = model::Provider::belonging_to(&meta)
-                .select(model::Provider::as_select())
-                .load_iter(conn)?
-                .map(|p| Ok(p?.provider))
-                .collect::<Result<_, Error>>()?;
-            let conflicts = model::Conflict::belonging_to(&meta)
-                .select(model::Conflict::as_select())
-                .load_iter(conn)?
-                .map(|p| Ok(p?.conflict))
-                .collect::<Result<_, Error>>()?;
-
-            Ok(Meta {
-                name: meta.name,
-                version_identifier: meta.version_identifier,
-                source_release: meta.source_release as u64,
-                build_release: meta.build_release as u64,
-                architecture: meta.architecture,
-                summary: meta.summary,
-                description: meta.description,
-                source_id: meta.source_id,
-                homepage: meta.homepage,
-                licenses,
-                dependencies,
-                providers,
-                conflicts,
-                uri: meta.uri,
-                hash: meta.hash,
-                download_size: meta.download_size.map(|size| size as u64),
-            })
-        })
+        self.get_many([package])?
+            .pop()
+            .map(|(_, meta)| meta)
+            .ok_or(Error::RowNotFound)
+    }
+
+    /// Retrieve all packages found for the given ids
+    ///
+    /// Relations are loaded for all packages at once, so this takes a fixed
+    /// number of queries per [`MAX_VARIABLE_NUMBER`] packages. Ids which
+    /// aren't found are skipped.
+    pub fn get_many<'a>(
+        &self,
+        packages: impl IntoIterator<Item = &'a package::Id>,
+    ) -> Result<Vec<(package::Id, Meta)>, Error> {
+        let generation = self.generation();
+
+        let mut found = vec![];
+        let mut missing = vec![];
+
+        // The memo is only locked around lookups, not while rows are loaded
+        {
+            let mut cache = self.cache.lock().expect("mutex guard");
+
+            for package in packages {
+                match cache.get(package, generation) {
+                    Some(meta) => found.push((package.clone(), meta)),
+                    None => missing.push(package.as_ref()),
+                }
+            }
+        }
+
+        if missing.is_empty() {
+            return Ok(found);
+        }
+
+        let loaded = self.conn.exec(|conn| {
+            let mut entries = BTreeMap::new();
+
+            for chunk in missing.chunks(MAX_VARIABLE_NUMBER) {
+                model::meta::table
+                    .select(model::Meta::as_select())
+                    .filter(model::meta::package.eq_any(chunk))
+                    .load_iter::<model::Meta, _>(conn)?
+                    .try_for_each::<_, Result<_, Error>>(|result| {
+                        let (id, meta) = decode_meta(result?);
+                        entries.insert(id, meta);
+                        Ok(())
+                    })?;
+            }
+
+            load_relations(conn, &mut entries)?;
+
+            Ok::<_, Error>(entries)
+        })?;
+
+        {
+            let mut cache = self.cache.lock().expect("mutex guard");
+
+            for (id, meta) in &loaded {
+                cache.insert(id.clone(), meta.clone(), generation);
+            }
+        }
+
+        found.extend(loaded);
+
+        Ok(found)
     }
 
     pub fn provider_packages(&self, provider: &Provider) -> Result<Vec<package::Id>, Error> {
@@ -112,34 +166,36 @@ impl Database {
         })
     }
 
-    pub fn query(&self, filter: Option<Filter<'_>>) -> Result<Vec<(package::Id, Meta)>, Error> {
+    /// Every provider in the db, with the package providing it
+    pub fn all_providers(&self) -> Result<Vec<(package::Id, Provider)>, Error> {
         self.conn.exec(|conn| {
-            let map_row = |result| {
-                let meta: model::Meta = result?;
-
-                Ok((
-                    meta.package.into(),
-                    Meta {
-                        name: meta.name,
-                        version_identifier: meta.version_identifier,
-                        source_release: meta.source_release as u64,
-                        build_release: meta.build_release as u64,
-                        architecture: meta.architecture,
-                        summary: meta.summary,
-                        description: meta.description,
-                        source_id: meta.source_id,
-                        homepage: meta.homepage,
-                        licenses: Default::default(),
-                        dependencies: Default::default(),
-                        providers: Default::default(),
-                        conflicts: Default::default(),
-                        uri: meta.uri,
-                        hash: meta.hash,
-                        download_size: meta.download_size.map(|size| size as u64),
-                    },
-                ))
-            };
+            model::meta_providers::table
+                .select(model::Provider::as_select())
+                .load_iter(conn)?
+                .map(|result| {
+                    let row = result?;
+                    Ok((row.package.into(), row.provider))
+                })
+                .collect()
+        })
+    }
 
+    /// Every dependency in the db, with the package depending on it
+    pub fn all_dependencies(&self) -> Result<Vec<(package::Id, Dependency)>, Error> {
+        self.conn.exec(|conn| {
+            model::meta_dependencies::table
+                .select(model::Dependency::as_select())
+                .load_iter(conn)?
+                .map(|result| {
+                    let row = result?;
+                    Ok((row.package.into(), row.dependency))
+                })
+                .collect()
+        })
+    }
+
+    pub fn query(&self, filter: Option<Filter<'_>>) -> Result<Vec<(package::Id, Meta)>, Error> {
+        self.conn.exec(|conn| {
             let mut entries: BTreeMap<package::Id, Meta> = match &filter {
                 Some(Filter::Provider(provider)) => model::meta::table
                     .select(model::Meta::as_select())
@@ -155,14 +211,34 @@ impl Database {
                     .select(model::Meta::as_select())
                     .filter(model::meta::name.eq(name.to_string()))
                     .load_iter::<model::Meta, _>(conn)?,
+                // Keywords are served from the trigram search index, which matches
+                // a quoted phrase as a substring of any indexed column
+                Some(Filter::Keyword(keyword)) if keyword.chars().count() >= 3 => model::meta::table
+                    .select(model::Meta::as_select())
+                    .filter(
+                        model::meta::package.eq_any(
+                            model::meta_search::table.select(model::meta_search::package).filter(
+                                sql::<Bool>("meta_search MATCH ")
+                                    .bind::<Text, _>(format!("\"{}\"", keyword.replace('"', "\"\""))),
+                            ),
+                        ),
+                    )
+                    .load_iter::<model::Meta, _>(conn)?,
+                // Too short for a trigram lookup, so scan the index instead
                 Some(Filter::Keyword(keyword)) => {
                     let pattern = format!("%{keyword}%");
                     model::meta::table
                         .select(model::Meta::as_select())
                         .filter(
-                            model::meta::name
-                                .like(pattern.clone())
-                                .or(model::meta::summary.like(pattern)),
+                            model::meta::package.eq_any(
+                                model::meta_search::table.select(model::meta_search::package).filter(
+                                    model::meta_search::name
+                                        .like(pattern.clone())
+                                        .or(model::meta_search::summary.like(pattern.clone()))
+                                        .or(model::meta_search::description.like(pattern.clone()))
+                                        .or(model::meta_search::providers.like(pattern)),
+                                ),
+                            ),
                         )
                         .load_iter::<model::Meta, _>(conn)?
                 }
@@ -170,61 +246,10 @@ impl Database {
                     .select(model::Meta::as_select())
                     .load_iter::<model::Meta, _>(conn)?,
             }
-            .map(map_row)
+            .map(|result| Ok(decode_meta(result?)))
             .collect::<Result<_, Error>>()?;
 
-            let package_ids = entries
-                .keys()
-                .cloned()
-                .map(String::from)
-                .map(|id| model::PackageId { id })
-                .collect::<Vec<_>>();
-
-            for chunk in package_ids.chunks(MAX_VARIABLE_NUMBER) {
-                // Add licenses
-                model::License::belonging_to(chunk)
-                    .load_iter::<model::License, _>(conn)?
-                    .try_for_each::<_, Result<_, Error>>(|result| {
-                        let row = result?;
-                        if let Some(meta) = entries.get_mut(&row.package.into()) {
-                            meta.licenses.push(row.license);
-                        }
-                        Ok(())
-                    })?;
-
-                // Add dependencies
-                model::Dependency::belonging_to(chunk)
-                    .load_iter::<model::Dependency, _>(conn)?
-                    .try_for_each::<_, Result<_, Error>>(|result| {
-                        let row = result?;
-                        if let Some(meta) = entries.get_mut(&row.package.into()) {
-                            meta.dependencies.insert(row.dependency);
-                        }
-                        Ok(())
-                    })?;
-
-                // Add providers
-                model::Provider::belonging_to(chunk)
-                    .load_iter::<model::Provider, _>(conn)?
-                    .try_for_each::<_, Result<_, Error>>(|result| {
-                        let row = result?;
-                        if let Some(meta) = entries.get_mut(&row.package.into()) {
-                            meta.providers.insert(row.provider);
-                        }
-                        Ok(())
-                    })?;
-
-                // Add conflicts
-                model::Conflict::belonging_to(chunk)
-                    .load_iter::<model::Conflict, _>(conn)?
-                    .try_for_each::<_, Result<_, Error>>(|result| {
-                        let row = result?;
-                        if let Some(meta) = entries.get_mut(&row.package.into()) {
-                            meta.conflicts.insert(row.conflict);
-                        }
-                        Ok(())
-                    })?;
-            }
+            load_relations(conn, &mut entries)?;
 
             Ok(entries.into_iter().collect())
         })
@@ -241,125 +266,260 @@ impl Database {
         })
     }
 
+    /// All package ids in the db
+    pub fn package_ids(&self) -> Result<BTreeSet<package::Id>, Error> {
+        self.conn.exec(|conn| {
+            Ok(model::meta::table
+                .select(model::meta::package)
+                .load_iter::<String, _>(conn)?
+                .map(|id| id.map(package::Id::from))
+                .collect::<Result<_, _>>()?)
+        })
+    }
+
     pub fn add(&self, id: package::Id, meta: Meta) -> Result<(), Error> {
         self.batch_add(vec![(id, meta)])
     }
 
     pub fn batch_add(&self, packages: Vec<(package::Id, Meta)>) -> Result<(), Error> {
-        self.conn.exclusive_tx(|tx| {
-            let ids = packages.iter().map(|(id, _)| id.as_ref()).collect::<Vec<_>>();
-            let entries = packages
-                .iter()
-                .map(|(package, meta)| model::NewMeta {
-                    package: package.as_ref(),
-                    name: meta.name.as_ref(),
-                    version_identifier: &meta.version_identifier,
-                    source_release: meta.source_release as i32,
-                    build_release: meta.build_release as i32,
-                    architecture: &meta.architecture,
-                    summary: &meta.summary,
-                    description: &meta.description,
-                    source_id: &meta.source_id,
-                    homepage: &meta.homepage,
-                    uri: meta.uri.as_deref(),
-                    hash: meta.hash.as_deref(),
-                    download_size: meta.download_size.map(|size| size as i64),
-                })
-                .collect::<Vec<_>>();
-            let licenses = packages
-                .iter()
-                .flat_map(|(package, meta)| {
-                    meta.licenses.iter().map(|license| {
-                        (
-                            model::meta_licenses::package.eq(<package::Id as AsRef<str>>::as_ref(package)),
-                            model::meta_licenses::license.eq(license),
-                        )
-                    })
-                })
-                .collect::<Vec<_>>();
-            let dependencies = packages
-                .iter()
-                .flat_map(|(package, meta)| {
-                    meta.dependencies.iter().map(|dependency| {
-                        (
-                            model::meta_dependencies::package.eq(<package::Id as AsRef<str>>::as_ref(package)),
-                            model::meta_dependencies::dependency.eq(dependency.to_string()),
-                        )
-                    })
-                })
-                .collect::<Vec<_>>();
-            let providers = packages
-                .iter()
-                .flat_map(|(package, meta)| {
-                    meta.providers.iter().map(|provider| {
-                        (
-                            model::meta_providers::package.eq(<package::Id as AsRef<str>>::as_ref(package)),
-                            model::meta_providers::provider.eq(provider.to_string()),
-                        )
-                    })
-                })
-                .collect::<Vec<_>>();
-            let conflicts = packages
-                .iter()
-                .flat_map(|(package, meta)| {
-                    meta.conflicts.iter().map(|conflict| {
-                        (
-                            model::meta_conflicts::package.eq(<package::Id as AsRef<str>>::as_ref(package)),
-                            model::meta_conflicts::conflict.eq(conflict.to_string()),
-                        )
-                    })
-                })
-                .collect::<Vec<_>>();
-
-            batch_remove_impl(&ids, tx)?;
-
-            for chunk in entries.chunks(MAX_VARIABLE_NUMBER / 13) {
-                diesel::insert_into(model::meta::table).values(chunk).execute(tx)?;
-            }
-            for chunk in licenses.chunks(MAX_VARIABLE_NUMBER / 2) {
-                diesel::insert_or_ignore_into(model::meta_licenses::table)
-                    .values(chunk)
-                    .execute(tx)?;
-            }
-            for chunk in dependencies.chunks(MAX_VARIABLE_NUMBER / 2) {
-                diesel::insert_or_ignore_into(model::meta_dependencies::table)
-                    .values(chunk)
-                    .execute(tx)?;
-            }
-            for chunk in providers.chunks(MAX_VARIABLE_NUMBER / 2) {
-                diesel::insert_or_ignore_into(model::meta_providers::table)
-                    .values(chunk)
-                    .execute(tx)?;
-            }
-            for chunk in conflicts.chunks(MAX_VARIABLE_NUMBER / 2) {
-                diesel::insert_or_ignore_into(model::meta_conflicts::table)
-                    .values(chunk)
-                    .execute(tx)?;
-            }
-
-            Ok(())
-        })
+        self.conn
+            .exclusive_tx(|tx| batch_add_impl(&packages, tx))
+            .inspect(|_| self.bump_generation())
     }
 
     pub fn remove(&self, package: &package::Id) -> Result<(), Error> {
         self.batch_remove(Some(package))
     }
 
+    /// Add & remove packages within a single transaction
+    pub fn apply_delta<'a>(
+        &self,
+        added: Vec<(package::Id, Meta)>,
+        removed: impl IntoIterator<Item = &'a package::Id>,
+    ) -> Result<(), Error> {
+        self.conn
+            .exclusive_tx(|tx| {
+                let removed = removed
+                    .into_iter()
+                    .map(<package::Id as AsRef<str>>::as_ref)
+                    .collect::<Vec<_>>();
+                batch_remove_impl(&removed, tx)?;
+                batch_add_impl(&added, tx)
+            })
+            .inspect(|_| self.bump_generation())
+    }
+
     pub fn batch_remove<'a>(&self, packages: impl IntoIterator<Item = &'a package::Id>) -> Result<(), Error> {
-        self.conn.exclusive_tx(|tx| {
-            let packages = packages
-                .into_iter()
-                .map(<package::Id as AsRef<str>>::as_ref)
-                .collect::<Vec<_>>();
-            batch_remove_impl(&packages, tx)?;
-            Ok(())
+        self.conn
+            .exclusive_tx(|tx| {
+                let packages = packages
+                    .into_iter()
+                    .map(<package::Id as AsRef<str>>::as_ref)
+                    .collect::<Vec<_>>();
+                batch_remove_impl(&packages, tx)?;
+                Ok(())
+            })
+            .inspect(|_| self.bump_generation())
+    }
+}
+
+fn decode_meta(meta: model::Meta) -> (package::Id, Meta) {
+    (
+        meta.package.into(),
+        Meta {
+            name: meta.name,
+            version_identifier: meta.version_identifier,
+            source_release: meta.source_release as u64,
+            build_release: meta.build_release as u64,
+            architecture: meta.architecture,
+            summary: meta.summary,
+            description: meta.description,
+            source_id: meta.source_id,
+            homepage: meta.homepage,
+            licenses: Default::default(),
+            dependencies: Default::default(),
+            providers: Default::default(),
+            conflicts: Default::default(),
+            uri: meta.uri,
+            hash: meta.hash,
+            download_size: meta.download_size.map(|size| size as u64),
+        },
+    )
+}
+
+/// Load licenses, dependencies, providers & conflicts of all `entries`
+fn load_relations(conn: &mut SqliteConnection, entries: &mut BTreeMap<package::Id, Meta>) -> Result<(), Error> {
+    let package_ids = entries
+        .keys()
+        .cloned()
+        .map(String::from)
+        .map(|id| model::PackageId { id })
+        .collect::<Vec<_>>();
+
+    for chunk in package_ids.chunks(MAX_VARIABLE_NUMBER) {
+        // Add licenses
+        model::License::belonging_to(chunk)
+            .load_iter::<model::License, _>(conn)?
+            .try_for_each::<_, Result<_, Error>>(|result| {
+                let row = result?;
+                if let Some(meta) = entries.get_mut(&row.package.into()) {
+                    meta.licenses.push(row.license);
+                }
+                Ok(())
+            })?;
+
+        // Add dependencies
+        model::Dependency::belonging_to(chunk)
+            .load_iter::<model::Dependency, _>(conn)?
+            .try_for_each::<_, Result<_, Error>>(|result| {
+                let row = result?;
+                if let Some(meta) = entries.get_mut(&row.package.into()) {
+                    meta.dependencies.insert(row.dependency);
+                }
+                Ok(())
+            })?;
+
+        // Add providers
+        model::Provider::belonging_to(chunk)
+            .load_iter::<model::Provider, _>(conn)?
+            .try_for_each::<_, Result<_, Error>>(|result| {
+                let row = result?;
+                if let Some(meta) = entries.get_mut(&row.package.into()) {
+                    meta.providers.insert(row.provider);
+                }
+                Ok(())
+            })?;
+
+        // Add conflicts
+        model::Conflict::belonging_to(chunk)
+            .load_iter::<model::Conflict, _>(conn)?
+            .try_for_each::<_, Result<_, Error>>(|result| {
+                let row = result?;
+                if let Some(meta) = entries.get_mut(&row.package.into()) {
+                    meta.conflicts.insert(row.conflict);
+                }
+                Ok(())
+            })?;
+    }
+
+    Ok(())
+}
+
+fn batch_add_impl(packages: &[(package::Id, Meta)], tx: &mut SqliteConnection) -> Result<(), Error> {
+    let ids = packages.iter().map(|(id, _)| id.as_ref()).collect::<Vec<_>>();
+    let entries = packages
+        .iter()
+        .map(|(package, meta)| model::NewMeta {
+            package: package.as_ref(),
+            name: meta.name.as_ref(),
+            version_identifier: &meta.version_identifier,
+            source_release: meta.source_release as i32,
+            build_release: meta.build_release as i32,
+            architecture: &meta.architecture,
+            summary: &meta.summary,
+            description: &meta.description,
+            source_id: &meta.source_id,
+            homepage: &meta.homepage,
+            uri: meta.uri.as_deref(),
+            hash: meta.hash.as_deref(),
+            download_size: meta.download_size.map(|size| size as i64),
+        })
+        .collect::<Vec<_>>();
+    let licenses = packages
+        .iter()
+        .flat_map(|(package, meta)| {
+            meta.licenses.iter().map(|license| {
+                (
+                    model::meta_licenses::package.eq(<package::Id as AsRef<str>>::as_ref(package)),
+                    model::meta_licenses::license.eq(license),
+                )
+            })
+        })
+        .collect::<Vec<_>>();
+    let dependencies = packages
+        .iter()
+        .flat_map(|(package, meta)| {
+            meta.dependencies.iter().map(|dependency| {
+                (
+                    model::meta_dependencies::package.eq(<package::Id as AsRef<str>>::as_ref(package)),
+                    model::meta_dependencies::dependency.eq(dependency.to_string()),
+                )
+            })
+        })
+        .collect::<Vec<_>>();
+    let providers = packages
+        .iter()
+        .flat_map(|(package, meta)| {
+            meta.providers.iter().map(|provider| {
+                (
+                    model::meta_providers::package.eq(<package::Id as AsRef<str>>::as_ref(package)),
+                    model::meta_providers::provider.eq(provider.to_string()),
+                )
+            })
+        })
+        .collect::<Vec<_>>();
+    let search = packages
+        .iter()
+        .map(|(package, meta)| {
+            (
+                model::meta_search::package.eq(<package::Id as AsRef<str>>::as_ref(package)),
+                model::meta_search::name.eq(meta.name.as_ref()),
+                model::meta_search::summary.eq(&meta.summary),
+                model::meta_search::description.eq(&meta.description),
+                model::meta_search::providers.eq(meta.providers.iter().join(" ")),
+            )
         })
+        .collect::<Vec<_>>();
+    let conflicts = packages
+        .iter()
+        .flat_map(|(package, meta)| {
+            meta.conflicts.iter().map(|conflict| {
+                (
+                    model::meta_conflicts::package.eq(<package::Id as AsRef<str>>::as_ref(package)),
+                    model::meta_conflicts::conflict.eq(conflict.to_string()),
+                )
+            })
+        })
+        .collect::<Vec<_>>();
+
+    batch_remove_impl(&ids, tx)?;
+
+    for chunk in entries.chunks(MAX_VARIABLE_NUMBER / 13) {
+        diesel::insert_into(model::meta::table).values(chunk).execute(tx)?;
+    }
+    for chunk in licenses.chunks(MAX_VARIABLE_NUMBER / 2) {
+        diesel::insert_or_ignore_into(model::meta_licenses::table)
+            .values(chunk)
+            .execute(tx)?;
+    }
+    for chunk in dependencies.chunks(MAX_VARIABLE_NUMBER / 2) {
+        diesel::insert_or_ignore_into(model::meta_dependencies::table)
+            .values(chunk)
+            .execute(tx)?;
+    }
+    for chunk in providers.chunks(MAX_VARIABLE_NUMBER / 2) {
+        diesel::insert_or_ignore_into(model::meta_providers::table)
+            .values(chunk)
+            .execute(tx)?;
+    }
+    for chunk in conflicts.chunks(MAX_VARIABLE_NUMBER / 2) {
+        diesel::insert_or_ignore_into(model::meta_conflicts::table)
+            .values(chunk)
+            .execute(tx)?;
+    }
+    for chunk in search.chunks(MAX_VARIABLE_NUMBER / 5) {
+        diesel::insert_into(model::meta_search::table)
+            .values(chunk)
+            .execute(tx)?;
     }
+
+    Ok(())
 }
 
 fn batch_remove_impl(packages: &[&str], tx: &mut SqliteConnection) -> Result<(), Error> {
     for chunk in packages.chunks(MAX_VARIABLE_NUMBER) {
         diesel::delete(model::meta::table.filter(model::meta::package.eq_any(chunk))).execute(tx)?;
+        diesel::delete(model::meta_search::table.filter(model::meta_search::package.eq_any(chunk))).execute(tx)?;
     }
     Ok(())
 }
@@ -372,7 +532,9 @@ mod model {
         Selectable,
     };
 
-    pub use crate::db::meta::schema::{meta, meta_conflicts, meta_dependencies, meta_licenses, meta_providers};
+    pub use crate::db::meta::schema::{
+        meta, meta_conflicts, meta_dependencies, meta_licenses, meta_providers, meta_search,
+    };
     use crate::package;
 
     #[derive(Queryable, Selectable, Identifiable)]
@@ -499,6 +661,18 @@ mod test {
         let fetched = db.query(Some(lookup)).unwrap();
         assert_eq!(fetched.len(), 1);
 
+        // Keywords match any searchable field, case insensitively
+        for keyword in ["Bash-Compl", "sh", &meta.summary[1..], "name(bash-completion)"] {
+            assert_eq!(db.query(Some(Filter::Keyword(keyword))).unwrap().len(), 1, "{keyword}");
+        }
+        assert!(db.query(Some(Filter::Keyword("nothing like it"))).unwrap().is_empty());
+
+        // Batch lookups skip unknown ids, repeated lookups are memoized
+        let missing = package::Id::from("missing".to_owned());
+        assert_eq!(db.get_many([&id, &missing]).unwrap(), vec![(id.clone(), meta.clone())]);
+        assert_eq!(db.get(&id).unwrap(), meta);
+
+        // Writes invalidate the memo
         db.remove(&id).unwrap();
 
         let result = db.get(&id);
@@ -506,10 +680,16 @@ mod test {
         assert!(result.is_err());
 
         // Test wipe
-        db.add(id.clone(), meta).unwrap();
+        db.add(id.clone(), meta.clone()).unwrap();
         db.wipe().unwrap();
         let result = db.get(&id);
         assert!(result.is_err());
+
+        // Test delta
+        let other = package::Id::from("other".to_owned());
+        db.add(id.clone(), meta.clone()).unwrap();
+        db.apply_delta(vec![(other.clone(), meta)], [&id]).unwrap();
+        assert_eq!(db.package_ids().unwrap(), BTreeSet::from([other]));
     }
 
     #[test]
@@ -46,9 +46,26 @@ diesel::table! {
     }
 }
 
+diesel::table! {
+    meta_search (package) {
+        package -> Text,
+        name -> Text,
+        summary -> Text,
+        description -> Text,
+        providers -> Text,
+    }
+}
+
 diesel::joinable!(meta_conflicts -> meta (package));
 diesel::joinable!(meta_dependencies -> meta (package));
 diesel::joinable!(meta_licenses -> meta (package));
 diesel::joinable!(meta_providers -> meta (package));
 
-diesel::allow_tables_to_appear_in_same_query!(meta, meta_conflicts, meta_dependencies, meta_licenses, meta_providers);
+diesel::allow_tables_to_appear_in_same_query!(
+    meta,
+    meta_conflicts,
+    meta_dependencies,
+    meta_licenses,
+    meta_providers,
+    meta_search,
+);
@@ -7,6 +7,8 @@ pub const NAME: &str = env!("CARGO_PKG_NAME");
 pub const MAX_DISK_CONCURRENCY: usize = 16;
 /// Max concurrency for network tasks
 pub const MAX_NETWORK_CONCURRENCY: usize = 8;
+/// Max number of packages committed to the databases in a single batch
+pub const DB_BATCH_SIZE: usize = 32;
 /// Buffer size used when reading a file, 4 MiB
 pub const FILE_READ_BUFFER_SIZE: usize = 4 * 1024 * 1024;
 /// Threshold to begin chunking file during read, 16 KiB
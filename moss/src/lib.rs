@@ -23,3 +23,4 @@ pub mod request;
 pub mod runtime;
 pub mod signal;
 pub mod state;
+pub mod timing;
@@ -0,0 +1,202 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! In-memory lookups for the resolver hot path
+//!
+//! Resolving a transaction performs several provider lookups per dependency
+//! edge. Rather than a db round trip for each, plugins backed by a meta db
+//! build an [`Index`] of it once and reuse it until the db generation changes.
+
+use std::collections::HashMap;
+use std::hash::Hash;
+use std::ops::Range;
+use std::sync::{Arc, Mutex};
+
+use crate::db::meta;
+use crate::{package, Dependency, Provider};
+
+/// Provider and dependency lookups over a single meta db generation
+#[derive(Debug)]
+pub struct Index {
+    generation: u64,
+    /// All packages, sorted, addressed by position from the tables below
+    ids: Vec<package::Id>,
+    positions: HashMap<package::Id, u32>,
+    providers: Table<Provider>,
+    dependencies: Vec<Range<u32>>,
+    dependency_list: Vec<Dependency>,
+}
+
+impl Index {
+    pub fn new(db: &meta::Database) -> Result<Self, meta::Error> {
+        // Read before loading, so a write during the load invalidates us
+        let generation = db.generation();
+
+        let ids = db.package_ids()?.into_iter().collect::<Vec<_>>();
+        let positions = ids
+            .iter()
+            .enumerate()
+            .map(|(position, id)| (id.clone(), position as u32))
+            .collect::<HashMap<_, _>>();
+
+        let providers = Table::new(
+            db.all_providers()?
+                .into_iter()
+                .filter_map(|(id, provider)| Some((provider, *positions.get(&id)?))),
+        );
+
+        let mut dependencies = db
+            .all_dependencies()?
+            .into_iter()
+            .filter_map(|(id, dependency)| Some((*positions.get(&id)?, dependency)))
+            .collect::<Vec<_>>();
+        // Same order as the dependencies of a loaded `Meta`
+        dependencies.sort();
+        dependencies.dedup();
+
+        let mut ranges = vec![0..0; ids.len()];
+        let mut dependency_list = Vec::with_capacity(dependencies.len());
+
+        for group in dependencies.chunk_by(|(a, _), (b, _)| a == b) {
+            let start = dependency_list.len() as u32;
+            dependency_list.extend(group.iter().map(|(_, dependency)| dependency.clone()));
+            ranges[group[0].0 as usize] = start..dependency_list.len() as u32;
+        }
+
+        Ok(Self {
+            generation,
+            ids,
+            positions,
+            providers,
+            dependencies: ranges,
+            dependency_list,
+        })
+    }
+
+    /// Packages providing `provider`, sorted by id
+    pub fn providers<'a>(&'a self, provider: &Provider) -> impl Iterator<Item = &'a package::Id> + 'a {
+        self.providers
+            .get(provider)
+            .iter()
+            .map(|&position| &self.ids[position as usize])
+    }
+
+    /// Dependencies of the package, or `None` if it's not in the index
+    pub fn dependencies(&self, id: &package::Id) -> Option<&[Dependency]> {
+        let range = self.dependencies[*self.positions.get(id)? as usize].clone();
+        Some(&self.dependency_list[range.start as usize..range.end as usize])
+    }
+}
+
+/// Keys interned over one flat list of package positions
+#[derive(Debug)]
+struct Table<K> {
+    keys: HashMap<K, Range<u32>>,
+    positions: Vec<u32>,
+}
+
+impl<K: Hash + Eq> Table<K> {
+    fn new(rows: impl IntoIterator<Item = (K, u32)>) -> Self {
+        let mut groups = HashMap::<K, Vec<u32>>::new();
+
+        for (key, position) in rows {
+            groups.entry(key).or_default().push(position);
+        }
+
+        let mut positions = Vec::with_capacity(groups.values().map(Vec::len).sum());
+        let keys = groups
+            .into_iter()
+            .map(|(key, mut group)| {
+                // Positions follow the sorted id order
+                group.sort_unstable();
+                group.dedup();
+
+                let start = positions.len() as u32;
+                positions.extend(group);
+                (key, start..positions.len() as u32)
+            })
+            .collect();
+
+        Self { keys, positions }
+    }
+
+    fn get(&self, key: &K) -> &[u32] {
+        self.keys.get(key).map_or(&[][..], |range| {
+            &self.positions[range.start as usize..range.end as usize]
+        })
+    }
+}
+
+/// A lazily (re)built [`Index`] of a meta db, shared between clones
+#[derive(Debug, Clone, Default)]
+pub struct Cache(Arc<Mutex<Option<Arc<Index>>>>);
+
+impl Cache {
+    /// Index of the current `db` generation, building it if needed
+    pub fn get(&self, db: &meta::Database) -> Result<Arc<Index>, meta::Error> {
+        let mut cached = self.0.lock().expect("mutex guard");
+
+        if let Some(index) = cached.as_ref().filter(|index| index.generation == db.generation()) {
+            return Ok(index.clone());
+        }
+
+        let index = Arc::new(Index::new(db)?);
+        *cached = Some(index.clone());
+
+        Ok(index)
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+    use crate::dependency::Kind;
+
+    #[test]
+    fn invalidated_by_writes() {
+        let db = meta::Database::new(":memory:").unwrap();
+        let cache = Cache::default();
+
+        let provider = Provider {
+            kind: Kind::PackageName,
+            name: "a".to_owned(),
+        };
+        let meta = |name: &str| package::Meta {
+            name: package::Name::from(name.to_owned()),
+            version_identifier: Default::default(),
+            source_release: Default::default(),
+            build_release: Default::default(),
+            architecture: Default::default(),
+            summary: Default::default(),
+            description: Default::default(),
+            source_id: Default::default(),
+            homepage: Default::default(),
+            licenses: Default::default(),
+            dependencies: [Dependency {
+                kind: Kind::PackageName,
+                name: "b".to_owned(),
+            }]
+            .into(),
+            providers: [provider.clone()].into(),
+            conflicts: Default::default(),
+            uri: Default::default(),
+            hash: Default::default(),
+            download_size: Default::default(),
+        };
+        let (first, second) = (package::Id::from("1".to_owned()), package::Id::from("2".to_owned()));
+
+        db.add(second.clone(), meta("a")).unwrap();
+        let index = cache.get(&db).unwrap();
+        assert_eq!(index.providers(&provider).collect::<Vec<_>>(), [&second]);
+        assert_eq!(index.dependencies(&second).unwrap().len(), 1);
+        assert!(index.dependencies(&first).is_none());
+
+        // Unchanged db reuses the index
+        assert!(Arc::ptr_eq(&index, &cache.get(&db).unwrap()));
+
+        db.add(first.clone(), meta("a")).unwrap();
+        let index = cache.get(&db).unwrap();
+        assert_eq!(index.providers(&provider).collect::<Vec<_>>(), [&first, &second]);
+    }
+}
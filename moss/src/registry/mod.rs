@@ -5,15 +5,19 @@
 //! Defines an encapsulation of "query plugins", including an interface
 //! for managing and using them.
 
+use std::collections::HashMap;
+
 use itertools::Itertools;
 
 use crate::package::{self, Package};
-use crate::Provider;
+use crate::{Dependency, Provider};
 
 pub use self::plugin::Plugin;
 pub use self::transaction::Transaction;
 
+pub mod index;
 pub mod plugin;
+pub mod search;
 pub mod transaction;
 
 /// A registry is composed of multiple "query plugins" that
@@ -72,6 +76,40 @@ impl Registry {
         self.query(move |plugin| plugin.package(id))
     }
 
+    /// Return the highest priority [`Package`] for each of the given ids
+    ///
+    /// Each plugin is queried once for all ids it hasn't been resolved by a
+    /// higher priority plugin yet. Ids which cannot be located are omitted.
+    pub fn by_ids(&self, ids: &[package::Id]) -> HashMap<package::Id, Package> {
+        let mut found = HashMap::with_capacity(ids.len());
+        let mut remaining = ids.iter().unique().cloned().collect::<Vec<_>>();
+
+        for plugin in self
+            .plugins
+            .iter()
+            .sorted_by(|a, b| a.priority().cmp(&b.priority()).reverse())
+        {
+            if remaining.is_empty() {
+                break;
+            }
+
+            for package in plugin.packages(&remaining) {
+                found.entry(package.id.clone()).or_insert(package);
+            }
+
+            remaining.retain(|id| !found.contains_key(id));
+        }
+
+        found
+    }
+
+    /// Return the dependencies of the highest priority package matching id
+    pub fn dependencies_of(&self, id: &package::Id) -> Option<Vec<Dependency>> {
+        self.query(move |plugin| plugin.dependencies(id)).next()
+    }
+
+    /// Return a stream of [`Package`] matching `keyword`, by plugin priority
+    /// and then [`search::Relevance`]
     pub fn by_keyword<'a>(&'a self, keyword: &'a str, flags: package::Flags) -> impl Iterator<Item = Package> + 'a {
         self.query(move |plugin| plugin.query_keyword(keyword, flags))
     }
@@ -166,6 +204,12 @@ mod test {
                 _ => {}
             }
         }
+
+        // Batch lookups prefer the higher priority plugin
+        let ids = ["a", "c", "c", "z"].map(|id| package::Id::from(id.to_owned()));
+        let found = registry.by_ids(&ids);
+        assert_eq!(found.len(), 2);
+        assert_eq!(found[&ids[1]].meta.source_release, 50);
     }
 
     #[test]
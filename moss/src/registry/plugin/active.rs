@@ -2,15 +2,20 @@
 //
 // SPDX-License-Identifier: MPL-2.0
 
+use std::collections::HashMap;
+
 use log::warn;
 
-use crate::{db, package, Package, Provider, State};
+use crate::{db, package, registry::index, Dependency, Package, Provider, State};
 
 // TODO:
 #[derive(Debug, Clone)]
 pub struct Active {
     state: Option<State>,
     db: db::meta::Database,
+    /// Selected packages of `state`, mapped to whether they're explicit
+    selections: HashMap<package::Id, bool>,
+    index: index::Cache,
 }
 
 impl PartialEq for Active {
@@ -24,7 +29,18 @@ impl Eq for Active {}
 impl Active {
     /// Return a new Active plugin for the given state + install database
     pub fn new(state: Option<State>, db: db::meta::Database) -> Self {
-        Self { state, db }
+        let selections = state
+            .iter()
+            .flat_map(|state| &state.selections)
+            .map(|selection| (selection.package.clone(), selection.explicit))
+            .collect();
+
+        Self {
+            state,
+            db,
+            selections,
+            index: index::Cache::default(),
+        }
     }
 
     /// Query the given package
@@ -41,6 +57,25 @@ impl Active {
         }
     }
 
+    /// Query all of the given packages at once, skipping any not installed
+    pub fn packages(&self, ids: &[package::Id]) -> Vec<Package> {
+        let installed = ids.iter().filter(|id| self.selections.contains_key(id));
+
+        match self.db.get_many(installed) {
+            Ok(packages) => packages
+                .into_iter()
+                .filter_map(|(id, meta)| {
+                    self.installed_package(id)
+                        .map(|(id, flags)| Package { id, meta, flags })
+                })
+                .collect(),
+            Err(error) => {
+                warn!("failed to query installed packages: {error}");
+                vec![]
+            }
+        }
+    }
+
     /// Query, restricted to state
     fn query(&self, flags: package::Flags, filter: Option<db::meta::Filter<'_>>) -> Vec<Package> {
         if flags.installed || flags == package::Flags::default() {
@@ -89,18 +124,18 @@ impl Active {
     pub fn query_provider_id_only(&self, provider: &Provider, flags: package::Flags) -> Vec<package::Id> {
         if flags.installed || flags == package::Flags::default() {
             // TODO: Error handling
-            let packages = match self.db.provider_packages(provider) {
-                Ok(packages) => packages,
+            let index = match self.index.get(&self.db) {
+                Ok(index) => index,
                 Err(error) => {
-                    warn!("failed to query repository packages: {error}");
+                    warn!("failed to index installed packages: {error}");
                     return vec![];
                 }
             };
 
-            packages
-                .into_iter()
+            index
+                .providers(provider)
                 .filter_map(|id| {
-                    let (id, package_flags) = self.installed_package(id)?;
+                    let (id, package_flags) = self.installed_package(id.clone())?;
                     // Filter for explicit only packages, if applicable
                     if flags.explicit {
                         package_flags.explicit.then_some(id)
@@ -114,27 +149,35 @@ impl Active {
         }
     }
 
+    /// Dependencies of the given installed package, without loading its full metadata
+    pub fn dependencies(&self, id: &package::Id) -> Option<Vec<Dependency>> {
+        if !self.selections.contains_key(id) {
+            return None;
+        }
+
+        match self.index.get(&self.db) {
+            Ok(index) => index.dependencies(id).map(<[_]>::to_vec),
+            Err(error) => {
+                warn!("failed to index installed packages: {error}");
+                None
+            }
+        }
+    }
+
     pub fn priority(&self) -> u64 {
         u64::MAX
     }
 
     fn installed_package(&self, id: package::Id) -> Option<(package::Id, package::Flags)> {
-        match &self.state {
-            Some(st) => st
-                .selections
-                .iter()
-                .find(|selection| selection.package == id)
-                .map(|selection| {
-                    (
-                        id,
-                        if selection.explicit {
-                            package::Flags::new().with_installed().with_explicit()
-                        } else {
-                            package::Flags::new().with_installed()
-                        },
-                    )
-                }),
-            None => None,
-        }
+        let explicit = *self.selections.get(&id)?;
+
+        Some((
+            id,
+            if explicit {
+                package::Flags::new().with_installed().with_explicit()
+            } else {
+                package::Flags::new().with_installed()
+            },
+        ))
     }
 }
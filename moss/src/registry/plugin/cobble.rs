@@ -12,6 +12,7 @@ use thiserror::Error;
 use stone::read::PayloadKind;
 
 use crate::package::{self, meta, Meta, MissingMetaFieldError, Package};
+use crate::registry::search;
 use crate::Provider;
 
 // TODO:
@@ -19,6 +20,8 @@ use crate::Provider;
 pub struct Cobble {
     // Storage of local packages
     packages: BTreeMap<meta::Id, State>,
+    // Keyword index of `packages`
+    search: search::Index<meta::Id>,
 }
 
 impl Cobble {
@@ -45,6 +48,7 @@ impl Cobble {
         let id = meta.id();
         let ret = id.clone();
 
+        self.search.add(id.clone(), &meta);
         self.packages.insert(id, State { path, meta });
 
         Ok(ret)
@@ -72,10 +76,20 @@ impl Cobble {
         self.query(flags, |_| true)
     }
 
+    /// Candidate packages for `keyword`, served from the in-memory index
     pub fn query_keyword(&self, keyword: &str, flags: package::Flags) -> Vec<Package> {
-        self.query(flags, |meta| {
-            meta.name.contains(keyword) || meta.summary.contains(keyword)
-        })
+        if flags.available {
+            self.search
+                .candidates(keyword)
+                .into_iter()
+                .filter_map(|id| {
+                    let state = self.packages.get(&id)?;
+                    Some(state.package(package::Id::from(id)))
+                })
+                .collect()
+        } else {
+            vec![]
+        }
     }
 
     pub fn query_provider(&self, provider: &Provider, flags: package::Flags) -> Vec<Package> {
@@ -11,7 +11,8 @@
 //! [`Registry`]: super::Registry
 
 use crate::registry::package::{self, Package};
-use crate::Provider;
+use crate::registry::search;
+use crate::{Dependency, Provider};
 
 pub use self::active::Active;
 pub use self::cobble::Cobble;
@@ -50,6 +51,36 @@ impl Plugin {
         }
     }
 
+    /// Return all packages found for the given ids, in no particular order.
+    /// Ids which cannot be located are skipped.
+    ///
+    /// Plugins backed by a meta db load them in one batch
+    pub fn packages(&self, ids: &[package::Id]) -> Vec<Package> {
+        match self {
+            Plugin::Active(plugin) => plugin.packages(ids),
+            Plugin::Cobble(plugin) => ids.iter().filter_map(|id| plugin.package(id)).collect(),
+            Plugin::Repository(plugin) => plugin.packages(ids),
+
+            #[cfg(test)]
+            Plugin::Test(plugin) => ids.iter().filter_map(|id| plugin.package(id)).collect(),
+        }
+    }
+
+    /// Return the dependencies of the given [`package::Id`]. Returns `None` if
+    /// the `package` cannot be located.
+    ///
+    /// Plugins backed by a meta db answer this from their in-memory index
+    pub fn dependencies(&self, id: &package::Id) -> Option<Vec<Dependency>> {
+        match self {
+            Plugin::Active(plugin) => plugin.dependencies(id),
+            Plugin::Cobble(plugin) => plugin.package(id).map(|p| p.meta.dependencies.into_iter().collect()),
+            Plugin::Repository(plugin) => plugin.dependencies(id),
+
+            #[cfg(test)]
+            Plugin::Test(plugin) => plugin.package(id).map(|p| p.meta.dependencies.into_iter().collect()),
+        }
+    }
+
     /// List all packages with matching `flags`
     pub fn list(&self, flags: package::Flags) -> package::Sorted<Vec<Package>> {
         package::Sorted::new(match self {
@@ -62,15 +93,20 @@ impl Plugin {
         })
     }
 
-    pub fn query_keyword(&self, keyword: &str, flags: package::Flags) -> package::Sorted<Vec<Package>> {
-        package::Sorted::new(match self {
-            Plugin::Active(plugin) => plugin.query_keyword(keyword, flags),
-            Plugin::Cobble(plugin) => plugin.query_keyword(keyword, flags),
-            Plugin::Repository(plugin) => plugin.query_keyword(keyword, flags),
-
-            #[cfg(test)]
-            Plugin::Test(plugin) => plugin.query_keyword(keyword, flags),
-        })
+    /// Returns a list of packages matching `keyword` and `flags`, ranked by
+    /// [`search::Relevance`]
+    pub fn query_keyword(&self, keyword: &str, flags: package::Flags) -> Vec<Package> {
+        search::rank(
+            keyword,
+            match self {
+                Plugin::Active(plugin) => plugin.query_keyword(keyword, flags),
+                Plugin::Cobble(plugin) => plugin.query_keyword(keyword, flags),
+                Plugin::Repository(plugin) => plugin.query_keyword(keyword, flags),
+
+                #[cfg(test)]
+                Plugin::Test(plugin) => plugin.query_keyword(keyword, flags),
+            },
+        )
     }
 
     /// Returns a list of packages with matching `provider` and `flags`
@@ -7,17 +7,22 @@ use log::warn;
 use crate::{
     db,
     package::{self, Package},
-    repository, Provider,
+    registry::index,
+    repository, Dependency, Provider,
 };
 
 #[derive(Debug)]
 pub struct Repository {
     active: repository::Cached,
+    index: index::Cache,
 }
 
 impl Repository {
     pub fn new(active: repository::Cached) -> Self {
-        Self { active }
+        Self {
+            active,
+            index: index::Cache::default(),
+        }
     }
 
     pub fn priority(&self) -> u64 {
@@ -28,19 +33,7 @@ impl Repository {
         let result = self.active.db.get(id);
 
         match result {
-            Ok(meta) => Some(Package {
-                id: id.clone(),
-                meta: package::Meta {
-                    // TODO: Is there a more type-safe way to do this vs mutation? Can
-                    // a new type help here?
-                    uri: meta
-                        .uri
-                        .and_then(|relative| self.active.repository.uri.join(&relative).ok())
-                        .map(|url| url.to_string()),
-                    ..meta
-                },
-                flags: package::Flags::new().with_available(),
-            }),
+            Ok(meta) => Some(self.available_package(id.clone(), meta)),
             Err(db::meta::Error::RowNotFound) => None,
             Err(error) => {
                 warn!("failed to query repository package: {error}");
@@ -49,6 +42,36 @@ impl Repository {
         }
     }
 
+    /// Query all of the given packages at once, skipping any not found
+    pub fn packages(&self, ids: &[package::Id]) -> Vec<Package> {
+        match self.active.db.get_many(ids) {
+            Ok(packages) => packages
+                .into_iter()
+                .map(|(id, meta)| self.available_package(id, meta))
+                .collect(),
+            Err(error) => {
+                warn!("failed to query repository packages: {error}");
+                vec![]
+            }
+        }
+    }
+
+    fn available_package(&self, id: package::Id, meta: package::Meta) -> Package {
+        Package {
+            id,
+            meta: package::Meta {
+                // TODO: Is there a more type-safe way to do this vs mutation? Can
+                // a new type help here?
+                uri: meta
+                    .uri
+                    .and_then(|relative| self.active.repository.uri.join(&relative).ok())
+                    .map(|url| url.to_string()),
+                ..meta
+            },
+            flags: package::Flags::new().with_available(),
+        }
+    }
+
     fn query(&self, flags: package::Flags, filter: Option<db::meta::Filter<'_>>) -> Vec<Package> {
         if flags.available || flags == package::Flags::default() {
             // TODO: Error handling
@@ -93,10 +116,10 @@ impl Repository {
     pub fn query_provider_id_only(&self, provider: &Provider, flags: package::Flags) -> Vec<package::Id> {
         if flags.available || flags == package::Flags::default() {
             // TODO: Error handling
-            match self.active.db.provider_packages(provider) {
-                Ok(packages) => packages,
+            match self.index.get(&self.active.db) {
+                Ok(index) => index.providers(provider).cloned().collect(),
                 Err(error) => {
-                    warn!("failed to query repository packages: {error}");
+                    warn!("failed to index repository packages: {error}");
                     vec![]
                 }
             }
@@ -104,6 +127,17 @@ impl Repository {
             vec![]
         }
     }
+
+    /// Dependencies of the given package, without loading its full metadata
+    pub fn dependencies(&self, id: &package::Id) -> Option<Vec<Dependency>> {
+        match self.index.get(&self.active.db) {
+            Ok(index) => index.dependencies(id).map(<[_]>::to_vec),
+            Err(error) => {
+                warn!("failed to index repository packages: {error}");
+                None
+            }
+        }
+    }
 }
 
 impl PartialEq for Repository {
@@ -0,0 +1,207 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Ranked keyword search over package metadata
+//!
+//! Plugins narrow a search down to candidate packages through an index of
+//! trigrams, either the meta db search table or an in-memory [`Index`], and
+//! [`rank`] then orders the candidates by how well they match.
+
+use std::collections::{BTreeSet, HashMap};
+
+use itertools::Itertools;
+
+use crate::package::{Meta, Package};
+
+/// Where a keyword matched a package, best match first
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord)]
+pub enum Relevance {
+    Name,
+    NamePrefix,
+    NameSubstring,
+    Provider,
+    Summary,
+    Description,
+}
+
+impl Relevance {
+    /// Relevance of the package for `keyword`, or `None` if it doesn't match
+    pub fn of(meta: &Meta, keyword: &str) -> Option<Self> {
+        relevance(meta, &keyword.to_lowercase())
+    }
+}
+
+/// Order matching `packages` by [`Relevance`], then name, dropping any that
+/// don't match `keyword`
+pub fn rank(keyword: &str, packages: impl IntoIterator<Item = Package>) -> Vec<Package> {
+    let keyword = keyword.to_lowercase();
+
+    packages
+        .into_iter()
+        .filter_map(|package| Some((relevance(&package.meta, &keyword)?, package)))
+        .sorted_by(|(a, package_a), (b, package_b)| {
+            a.cmp(b)
+                .then_with(|| package_a.meta.name.cmp(&package_b.meta.name))
+                .then_with(|| package_a.cmp(package_b))
+        })
+        .map(|(_, package)| package)
+        .collect()
+}
+
+fn relevance(meta: &Meta, keyword: &str) -> Option<Relevance> {
+    let name = meta.name.to_string().to_lowercase();
+
+    if name == keyword {
+        Some(Relevance::Name)
+    } else if name.starts_with(keyword) {
+        Some(Relevance::NamePrefix)
+    } else if name.contains(keyword) {
+        Some(Relevance::NameSubstring)
+    } else if meta
+        .providers
+        .iter()
+        .any(|provider| provider.to_string().to_lowercase().contains(keyword))
+    {
+        Some(Relevance::Provider)
+    } else if meta.summary.to_lowercase().contains(keyword) {
+        Some(Relevance::Summary)
+    } else if meta.description.to_lowercase().contains(keyword) {
+        Some(Relevance::Description)
+    } else {
+        None
+    }
+}
+
+/// In-memory trigram index of the searchable package fields, for plugins
+/// not backed by a meta db
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Index<K> {
+    trigrams: HashMap<[char; 3], BTreeSet<K>>,
+    keys: BTreeSet<K>,
+}
+
+impl<K> Default for Index<K> {
+    fn default() -> Self {
+        Self {
+            trigrams: HashMap::new(),
+            keys: BTreeSet::new(),
+        }
+    }
+}
+
+impl<K: Ord + Clone> Index<K> {
+    pub fn add(&mut self, key: K, meta: &Meta) {
+        let fields = [meta.name.to_string(), meta.summary.clone(), meta.description.clone()]
+            .into_iter()
+            .chain(meta.providers.iter().map(ToString::to_string));
+
+        // Trigrams never span two fields
+        for field in fields {
+            for trigram in trigrams(&field.to_lowercase()) {
+                self.trigrams.entry(trigram).or_default().insert(key.clone());
+            }
+        }
+
+        self.keys.insert(key);
+    }
+
+    /// Keys of the packages which may contain `keyword`, to be confirmed by [`rank`]
+    ///
+    /// Keywords shorter than a trigram can't be narrowed down, so every key is returned
+    pub fn candidates(&self, keyword: &str) -> Vec<K> {
+        let trigrams = trigrams(&keyword.to_lowercase()).collect::<BTreeSet<_>>();
+
+        if trigrams.is_empty() {
+            return self.keys.iter().cloned().collect();
+        }
+
+        let Some(mut postings) = trigrams
+            .iter()
+            .map(|trigram| self.trigrams.get(trigram))
+            .collect::<Option<Vec<_>>>()
+        else {
+            return vec![];
+        };
+
+        // Intersect starting from the most selective trigram
+        postings.sort_by_key(|keys| keys.len());
+
+        postings[0]
+            .iter()
+            .filter(|key| postings[1..].iter().all(|keys| keys.contains(key)))
+            .cloned()
+            .collect()
+    }
+}
+
+fn trigrams(text: &str) -> impl Iterator<Item = [char; 3]> {
+    let chars = text.chars().collect::<Vec<_>>();
+
+    (0..chars.len().saturating_sub(2)).map(move |i| [chars[i], chars[i + 1], chars[i + 2]])
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+    use crate::dependency::Kind;
+    use crate::package::{self, Flags};
+    use crate::Provider;
+
+    fn package(name: &str, summary: &str, provider: &str) -> Package {
+        Package {
+            id: package::Id::from(name.to_owned()),
+            meta: package::Meta {
+                name: package::Name::from(name.to_owned()),
+                version_identifier: Default::default(),
+                source_release: Default::default(),
+                build_release: Default::default(),
+                architecture: Default::default(),
+                summary: summary.to_owned(),
+                description: Default::default(),
+                source_id: Default::default(),
+                homepage: Default::default(),
+                licenses: Default::default(),
+                dependencies: Default::default(),
+                providers: [Provider {
+                    kind: Kind::SharedLibrary,
+                    name: provider.to_owned(),
+                }]
+                .into(),
+                conflicts: Default::default(),
+                uri: Default::default(),
+                hash: Default::default(),
+                download_size: Default::default(),
+            },
+            flags: Flags::default(),
+        }
+    }
+
+    #[test]
+    fn ranked_candidates() {
+        let packages = [
+            package("zlib-devel", "Compression headers", "libz.so"),
+            package("nano", "Small editor", "libncurses.so"),
+            package("minizip", "Zip archives, built on Zlib", "libminizip.so"),
+            package("zlib", "Compression library", "libz.so.1"),
+        ];
+
+        let mut index = Index::default();
+        for package in &packages {
+            index.add(package.id.clone(), &package.meta);
+        }
+
+        let candidates = index.candidates("ZLIB");
+        assert_eq!(candidates.len(), 3);
+
+        let ranked = rank("ZLIB", packages.iter().filter(|p| candidates.contains(&p.id)).cloned());
+        assert_eq!(
+            ranked.iter().map(|p| p.meta.name.to_string()).collect::<Vec<_>>(),
+            ["zlib", "zlib-devel", "minizip"]
+        );
+
+        // Too short to narrow down
+        assert_eq!(index.candidates("z").len(), packages.len());
+        assert!(index.candidates("qqq").is_empty());
+    }
+}
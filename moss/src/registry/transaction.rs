@@ -5,7 +5,7 @@
 use dag::Dag;
 use thiserror::Error;
 
-use crate::{package, Provider, Registry};
+use crate::{package, timing, Provider, Registry};
 
 enum ProviderFilter {
     /// Must be installed
@@ -91,6 +91,7 @@ impl Transaction<'_> {
 
     /// Update internal package graph with all incoming packages & their deps
     fn update(&mut self, incoming: Vec<package::Id>, lookup: Lookup) -> Result<(), Error> {
+        let mut timer = timing::begin(timing::Phase::Resolve);
         let mut items = incoming;
 
         loop {
@@ -102,13 +103,12 @@ impl Transaction<'_> {
                 // Ensure node is added and get it's index
                 let check_node = self.packages.add_node_or_get_index(check_id.clone());
 
-                // Grab this package in question
-                let package = self
+                // Grab the dependencies of the package in question
+                let dependencies = self
                     .registry
-                    .by_id(check_id)
-                    .next()
+                    .dependencies_of(check_id)
                     .ok_or(Error::NoCandidate(check_id.clone().into()))?;
-                for dependency in package.meta.dependencies.iter() {
+                for dependency in dependencies.iter() {
                     let provider = Provider {
                         kind: dependency.kind,
                         name: dependency.name.clone(),
@@ -133,6 +133,7 @@ impl Transaction<'_> {
                     self.packages.add_edge(check_node, dep_node);
                 }
             }
+            timer.add_entries(items.len() as u64);
             items = next;
         }
 
@@ -0,0 +1,42 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Zstd dictionary published alongside a repository index
+//!
+//! Indexes written with a dictionary compress their meta payloads with a
+//! [`Dictionary`] trained on those same payloads. Clients fetch it next to
+//! `stone.index` and need it to decode the index.
+
+use std::{io, path::Path};
+
+use fs_err as fs;
+use stone::{dictionary, payload, Dictionary};
+
+/// File name of the dictionary, next to `stone.index`
+pub const FILE_NAME: &str = "stone.dict";
+
+/// Train a dictionary over the meta payloads of an index
+pub fn train(payloads: &[Vec<payload::Meta>]) -> Result<Dictionary, dictionary::Error> {
+    let samples = payloads
+        .iter()
+        .map(|records| {
+            let mut sample = vec![];
+            payload::encode_records(&mut sample, records).expect("write to vec");
+            sample
+        })
+        .collect::<Vec<_>>();
+
+    Dictionary::train(&samples, dictionary::MAX_SIZE)
+}
+
+/// Load the dictionary stored next to `index_path`, if there is one
+pub fn load(index_path: &Path) -> Result<Option<Dictionary>, io::Error> {
+    match fs::read(index_path.with_file_name(FILE_NAME)) {
+        Ok(data) => Dictionary::new(data)
+            .map(Some)
+            .map_err(|error| io::Error::new(io::ErrorKind::InvalidData, error)),
+        Err(error) if error.kind() == io::ErrorKind::NotFound => Ok(None),
+        Err(error) => Err(error),
+    }
+}
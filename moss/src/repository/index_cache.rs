@@ -0,0 +1,178 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Metadata of the stones read by `moss index`
+//!
+//! Each stone is keyed by its path relative to the index dir, and is only
+//! read again once its size, mtime or inode change. The cache lives in the
+//! moss cache dir rather than next to the index, so it's never published
+//! along with it.
+
+use std::{collections::BTreeMap, io, os::unix::fs::MetadataExt, path::Path, path::PathBuf};
+
+use fs_err as fs;
+use serde::{Deserialize, Serialize};
+use sha2::{Digest, Sha256};
+use stone::payload;
+use thiserror::Error;
+
+use crate::{package::Meta, Installation};
+
+#[derive(Debug, Clone, Default, PartialEq, Eq, Serialize, Deserialize)]
+pub struct IndexCache {
+    entries: BTreeMap<String, Entry>,
+}
+
+#[derive(Debug, Clone, PartialEq, Eq, Serialize, Deserialize)]
+struct Entry {
+    stat: Stat,
+    /// Number of records in `meta`
+    records: usize,
+    /// Hex encoded meta records, including the sha256 of the stone
+    meta: String,
+}
+
+/// What the stone was last written, so it changes whenever the stone is replaced or modified
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Serialize, Deserialize)]
+pub struct Stat {
+    pub size: u64,
+    pub mtime: i64,
+    pub mtime_nsec: i64,
+    pub ino: u64,
+}
+
+impl Stat {
+    pub fn new(metadata: &std::fs::Metadata) -> Self {
+        Self {
+            size: metadata.size(),
+            mtime: metadata.mtime(),
+            mtime_nsec: metadata.mtime_nsec(),
+            ino: metadata.ino(),
+        }
+    }
+}
+
+impl IndexCache {
+    /// Path of the cache for the index in `dir`
+    pub fn path(installation: &Installation, dir: &Path) -> PathBuf {
+        let digest = hex::encode(Sha256::digest(dir.as_os_str().as_encoded_bytes()));
+
+        installation.cache_path("index").join(format!("{digest}.json"))
+    }
+
+    /// Load the cache at `path`, empty if there is none yet
+    pub fn load(path: &Path) -> Result<Self, Error> {
+        match fs::read(path) {
+            Ok(data) => Ok(serde_json::from_slice(&data)?),
+            Err(error) if error.kind() == io::ErrorKind::NotFound => Ok(Self::default()),
+            Err(error) => Err(error.into()),
+        }
+    }
+
+    /// Write the cache to `path`, replacing any previous one atomically
+    pub fn save(&self, path: &Path) -> Result<(), Error> {
+        if let Some(parent) = path.parent() {
+            fs::create_dir_all(parent)?;
+        }
+
+        let temp = path.with_extension("json.tmp");
+        fs::write(&temp, serde_json::to_vec(self)?)?;
+        fs::rename(&temp, path)?;
+
+        Ok(())
+    }
+
+    /// The cached meta of the stone at `relative_path`, if it wasn't changed since
+    pub fn get(&self, relative_path: &str, stat: Stat) -> Option<Meta> {
+        let entry = self.entries.get(relative_path).filter(|entry| entry.stat == stat)?;
+
+        let data = hex::decode(&entry.meta).ok()?;
+        let records = payload::decode_records::<payload::Meta, _>(data.as_slice(), entry.records).ok()?;
+
+        Meta::from_stone_payload(&records).ok()
+    }
+
+    pub fn insert(&mut self, relative_path: String, stat: Stat, meta: &Meta) {
+        let records = meta.clone().to_stone_payload();
+
+        let mut data = vec![];
+        payload::encode_records(&mut data, &records).expect("write to vec");
+
+        self.entries.insert(
+            relative_path,
+            Entry {
+                stat,
+                records: records.len(),
+                meta: hex::encode(data),
+            },
+        );
+    }
+
+    /// Forget the stones for which `f` returns false
+    pub fn retain(&mut self, mut f: impl FnMut(&str) -> bool) {
+        self.entries.retain(|relative_path, _| f(relative_path));
+    }
+}
+
+#[derive(Debug, Error)]
+pub enum Error {
+    #[error("io")]
+    Io(#[from] io::Error),
+    #[error("json")]
+    Json(#[from] serde_json::Error),
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn roundtrip() {
+        let dir = std::env::temp_dir().join(format!("moss-index-cache-test-{}", std::process::id()));
+        let path = dir.join("nested").join("cache.json");
+
+        let stat = Stat {
+            size: 1024,
+            mtime: 1_700_000_000,
+            mtime_nsec: 42,
+            ino: 7,
+        };
+        let meta = Meta {
+            name: "nano".to_owned().into(),
+            version_identifier: "8.0".to_owned(),
+            source_release: 1,
+            build_release: 1,
+            architecture: "x86_64".to_owned(),
+            summary: "Text editor".to_owned(),
+            description: "Small text editor".to_owned(),
+            source_id: "nano".to_owned(),
+            homepage: "https://nano-editor.org".to_owned(),
+            licenses: vec!["GPL-3.0-or-later".to_owned()],
+            dependencies: Default::default(),
+            providers: Default::default(),
+            conflicts: Default::default(),
+            uri: Some("n/nano/nano-8.0-1-1-x86_64.stone".to_owned()),
+            hash: Some("ab".repeat(32)),
+            download_size: Some(1024),
+        };
+
+        assert!(IndexCache::load(&path).unwrap().entries.is_empty());
+
+        let mut cache = IndexCache::default();
+        cache.insert("nano.stone".to_owned(), stat, &meta);
+        cache.insert("gone.stone".to_owned(), stat, &meta);
+        cache.retain(|relative_path| relative_path != "gone.stone");
+        cache.save(&path).unwrap();
+
+        let cache = IndexCache::load(&path).unwrap();
+        assert_eq!(cache.entries.len(), 1);
+        assert_eq!(cache.get("nano.stone", stat), Some(meta));
+
+        // Rewritten stones are read again
+        assert_eq!(cache.get("nano.stone", Stat { ino: 8, ..stat }), None);
+        assert_eq!(cache.get("gone.stone", stat), None);
+
+        fs::remove_dir_all(&dir).unwrap();
+    }
+}
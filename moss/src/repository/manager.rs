@@ -2,21 +2,22 @@
 //
 // SPDX-License-Identifier: MPL-2.0
 
-use std::collections::BTreeMap;
+use std::collections::{BTreeMap, BTreeSet};
 use std::io;
 use std::path::{Path, PathBuf};
 use std::time::Duration;
 
 use fs_err::{self as fs, File};
 use futures_util::{stream, StreamExt, TryStreamExt};
+use log::warn;
 use thiserror::Error;
 use xxhash_rust::xxh3::xxh3_64;
 
 use tui::{MultiProgress, ProgressBar, ProgressStyle, Styled};
 
 use crate::db::meta;
-use crate::repository::{self, Repository};
-use crate::{environment, runtime};
+use crate::repository::{self, dictionary, manifest, Manifest, Repository};
+use crate::{environment, request, runtime};
 use crate::{package, Installation};
 
 enum Source {
@@ -86,6 +87,7 @@ impl Manager {
             .into_iter()
             .map(|(id, repository)| {
                 let db = open_meta_db(source.identifier(), &repository, &installation)?;
+                request::add_mirrors(&repository.uri, &repository.mirrors);
 
                 Ok((id.clone(), repository::Cached { id, repository, db }))
             })
@@ -113,6 +115,7 @@ impl Manager {
         }
 
         let db = open_meta_db(self.source.identifier(), &repository, &self.installation)?;
+        request::add_mirrors(&repository.uri, &repository.mirrors);
 
         self.repositories
             .insert(id.clone(), repository::Cached { id, repository, db });
@@ -126,11 +129,35 @@ impl Manager {
             return Err(Error::UnknownRepo(id.clone()));
         };
 
-        if repo.repository.active {
-            let file = fetch_index(self.source.identifier(), &repo, &self.installation).await?;
-            runtime::unblock(move || update_meta_db(&repo, &file)).await?;
+        if !repo.repository.active {
+            return Ok(());
         }
 
+        let dir = cache_dir(self.source.identifier(), &repo.repository, &self.installation);
+        tokio::fs::create_dir_all(&dir).await.map_err(Error::CreateDir)?;
+
+        let index_path = dir.join("stone.index");
+        let manifest = fetch_manifest(&repo.repository, &dir).await?;
+
+        // Skip the index entirely if the published manifest matches our db
+        if let Some(manifest) = &manifest {
+            let db = repo.db.clone();
+            let current = runtime::unblock(move || db.package_ids()).await?;
+            let published = manifest.entries.iter().map(|entry| &entry.id).collect::<BTreeSet<_>>();
+
+            if index_path.exists() && current.iter().eq(published) {
+                return Ok(());
+            }
+        }
+
+        repository::fetch_if_modified(repo.repository.uri.clone(), &index_path).await?;
+
+        let path = index_path.clone();
+        let dictionary = runtime::unblock(move || index_dictionary(&path)).await?;
+        fetch_dictionary(&repo.repository, &dir, dictionary).await?;
+
+        runtime::unblock(move || update_meta_db(&repo, &index_path, manifest.as_ref())).await?;
+
         Ok(())
     }
 
@@ -309,62 +336,155 @@ fn open_meta_db(identifier: &str, repo: &Repository, installation: &Installation
     Ok(db)
 }
 
-/// Fetches a stone index file from the repository URL
-/// and saves it to the repo installation path
-async fn fetch_index(
-    identifier: &str,
-    state: &repository::Cached,
-    installation: &Installation,
-) -> Result<PathBuf, Error> {
-    let out_dir = cache_dir(identifier, &state.repository, installation);
+/// Fetches the manifest published next to the repository index, if any
+async fn fetch_manifest(repo: &Repository, dir: &Path) -> Result<Option<Manifest>, Error> {
+    let Ok(url) = repo.uri.join(manifest::FILE_NAME) else {
+        return Ok(None);
+    };
+    let path = dir.join(manifest::FILE_NAME);
+
+    // The manifest is only an optimisation, so without one every payload is decoded
+    match repository::fetch_if_modified(url, &path).await {
+        Ok(_) => {}
+        // Repository doesn't publish one
+        Err(repository::FetchError::Request(error)) if error.is_not_found() => {
+            let _ = tokio::fs::remove_file(&path).await;
+            return Ok(None);
+        }
+        Err(error) => {
+            warn!("ignoring repository manifest: {error}");
+            let _ = tokio::fs::remove_file(&path).await;
+            return Ok(None);
+        }
+    }
+
+    let content = tokio::fs::read_to_string(&path).await.map_err(Error::OpenIndex)?;
 
-    tokio::fs::create_dir_all(&out_dir).await.map_err(Error::CreateDir)?;
+    match Manifest::parse(&content) {
+        Ok(manifest) => Ok(Some(manifest)),
+        Err(error) => {
+            warn!("ignoring repository manifest: {error}");
+            Ok(None)
+        }
+    }
+}
 
-    let out_path = out_dir.join("stone.index");
+/// Id of the dictionary the meta payloads of the index at `index_path` are compressed with, if any
+fn index_dictionary(index_path: &Path) -> Result<Option<u32>, Error> {
+    let file = File::open(index_path).map_err(Error::OpenIndex)?;
+    let stone = stone::Mapped::open(file.file())?;
 
-    // Fetch index & write to `out_path`
-    repository::fetch_index(state.repository.uri.clone(), &out_path).await?;
+    for payload in stone.payloads_of(stone::payload::Kind::Meta) {
+        if let Some(id) = payload?.dictionary_id() {
+            return Ok(Some(id));
+        }
+    }
 
-    Ok(out_path)
+    Ok(None)
 }
 
-/// Updates a stones metadata into the meta db
-fn update_meta_db(state: &repository::Cached, index_path: &Path) -> Result<(), Error> {
-    // Wipe db since we're refreshing from a new index file
-    state.db.wipe()?;
-
-    // Get a stream of payloads
-    let mut file = File::open(index_path).map_err(Error::OpenIndex)?;
-    let mut reader = stone::read(&mut file)?;
-
-    let payloads = reader.payloads()?.collect::<Result<Vec<_>, _>>()?;
-
-    // Construct Meta for each payload
-    let packages = payloads
-        .into_iter()
-        .filter_map(|payload| {
-            if let stone::read::PayloadKind::Meta(meta) = payload {
-                Some(meta)
-            } else {
-                None
-            }
-        })
-        .map(|payload| {
-            let meta = package::Meta::from_stone_payload(&payload.body)?;
+/// Fetches the dictionary needed to decode the repository index
+///
+/// Indexes which don't use one skip the request entirely, and drop any
+/// copy left over from a previous index. Failing to fetch the dictionary
+/// falls back to the cached copy, if any, as it's only needed to decode
+/// the index. Either way it must be the dictionary with the `id` the index
+/// references, as the index and dictionary are published one after the other.
+async fn fetch_dictionary(repo: &Repository, dir: &Path, id: Option<u32>) -> Result<(), Error> {
+    let path = dir.join(dictionary::FILE_NAME);
+
+    let Some(id) = id else {
+        let _ = tokio::fs::remove_file(&path).await;
+        return Ok(());
+    };
+
+    let Ok(url) = repo.uri.join(dictionary::FILE_NAME) else {
+        return Err(Error::MissingDictionary);
+    };
+
+    match repository::fetch_if_modified(url, &path).await {
+        Ok(_) => {}
+        Err(error) if path.exists() => warn!("using cached repository dictionary: {error}"),
+        Err(error) => return Err(error.into()),
+    }
 
-            // Create id from hash of meta
-            let hash = meta
-                .hash
-                .clone()
-                .ok_or(Error::MissingMetaField(stone::payload::meta::Tag::PackageHash))?;
-            let id = package::Id::from(hash);
+    let index_path = path.with_file_name("stone.index");
+    let got = runtime::unblock(move || dictionary::load(&index_path).map(|dictionary| dictionary.map(|d| d.id())))
+        .await
+        .map_err(Error::OpenIndex)?
+        .ok_or(Error::MissingDictionary)?;
 
-            Ok((id, meta))
-        })
-        .collect::<Result<Vec<_>, Error>>()?;
+    if got != id {
+        return Err(Error::DictionaryMismatch { expected: id, got });
+    }
+
+    Ok(())
+}
+
+/// Applies the changes between a stones metadata and the meta db
+///
+/// Payloads listed in `manifest` whose package is already in the db
+/// aren't decoded at all
+fn update_meta_db(state: &repository::Cached, index_path: &Path, manifest: Option<&Manifest>) -> Result<(), Error> {
+    let current = state.db.package_ids()?;
+
+    let file = File::open(index_path).map_err(Error::OpenIndex)?;
+    let mut stone = stone::Mapped::open(file.file())?;
+
+    if let Some(dictionary) = dictionary::load(index_path).map_err(Error::OpenIndex)? {
+        stone = stone.with_dictionary(dictionary);
+    }
+
+    // The manifest only describes this index if it lists every meta payload
+    let payloads = stone
+        .payloads_of(stone::payload::Kind::Meta)
+        .collect::<Result<Vec<_>, _>>()?;
+    let manifest = manifest.filter(|manifest| manifest.entries.len() == payloads.len());
+
+    let mut published = BTreeSet::new();
+    let mut added = vec![];
+
+    for (i, payload) in payloads.into_iter().enumerate() {
+        let listed = manifest
+            .map(|manifest| &manifest.entries[i])
+            .filter(|entry| u64::from_be_bytes(payload.header.checksum) == entry.checksum);
+
+        if let Some(entry) = listed.filter(|entry| current.contains(&entry.id)) {
+            published.insert(entry.id.clone());
+            continue;
+        }
+
+        let body = payload.decode()?;
+        let records = body
+            .meta()
+            .into_iter()
+            .flatten()
+            .map(|record| record.map(|record| record.to_meta()))
+            .collect::<Result<Vec<_>, _>>()?;
+        let meta = package::Meta::from_stone_payload(&records)?;
+
+        // Create id from hash of meta
+        let hash = meta
+            .hash
+            .clone()
+            .ok_or(Error::MissingMetaField(stone::payload::meta::Tag::PackageHash))?;
+        let id = package::Id::from(hash);
+
+        // With a manifest, payloads are only decoded when their checksum changed,
+        // so the existing row is stale and gets replaced
+        if published.insert(id.clone()) && (manifest.is_some() || !current.contains(&id)) {
+            added.push((id, meta));
+        }
+    }
+
+    let removed = current.difference(&published).collect::<Vec<_>>();
+
+    if added.is_empty() && removed.is_empty() {
+        return Ok(());
+    }
 
-    // Batch add to db
-    state.db.batch_add(packages)?;
+    // Apply the delta to the db in one go
+    state.db.apply_delta(added, removed)?;
 
     Ok(())
 }
@@ -383,6 +503,10 @@ pub enum Error {
     FetchIndex(#[from] repository::FetchError),
     #[error("open index file")]
     OpenIndex(#[source] io::Error),
+    #[error("index requires a dictionary")]
+    MissingDictionary,
+    #[error("index requires dictionary {expected:08x}, got {got:08x}")]
+    DictionaryMismatch { expected: u32, got: u32 },
     #[error("read index file")]
     ReadStone(#[from] stone::read::Error),
     #[error("meta db")]
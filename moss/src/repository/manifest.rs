@@ -0,0 +1,120 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Per-package manifest published alongside a repository index
+//!
+//! Each line records the [`package::Id`] of a meta payload in the index and
+//! the checksum of that payload, in index order. Clients compare it against
+//! their meta db to only decode and apply the packages which changed.
+
+use std::fmt::Write as _;
+
+use stone::payload::{meta, Kind};
+use stone::read::mapped::{KindRef, Mapped};
+use thiserror::Error;
+
+use crate::package;
+
+/// File name of the manifest, next to `stone.index`
+pub const FILE_NAME: &str = "stone.manifest";
+
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct Manifest {
+    pub entries: Vec<Entry>,
+}
+
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Entry {
+    pub id: package::Id,
+    /// Checksum of the index meta payload for this package
+    pub checksum: u64,
+}
+
+impl Manifest {
+    /// Build the manifest of a mapped index
+    pub fn from_index<B: AsRef<[u8]>>(index: &Mapped<B>) -> Result<Self, Error> {
+        let entries = index
+            .payloads_of(Kind::Meta)
+            .map(|payload| {
+                let payload = payload?;
+                let checksum = u64::from_be_bytes(payload.header.checksum);
+                let body = payload.decode()?;
+
+                for record in body.meta().into_iter().flatten() {
+                    let record = record?;
+
+                    if let (meta::Tag::PackageHash, KindRef::String(hash)) = (record.tag, record.kind) {
+                        return Ok(Entry {
+                            id: package::Id::from(hash.to_owned()),
+                            checksum,
+                        });
+                    }
+                }
+
+                Err(Error::MissingHash)
+            })
+            .collect::<Result<_, _>>()?;
+
+        Ok(Self { entries })
+    }
+
+    pub fn parse(content: &str) -> Result<Self, Error> {
+        let entries = content
+            .lines()
+            .filter(|line| !line.trim().is_empty())
+            .map(|line| {
+                let (id, checksum) = line.split_once(' ').ok_or_else(|| Error::Malformed(line.to_owned()))?;
+                let checksum = u64::from_str_radix(checksum, 16).map_err(|_| Error::Malformed(line.to_owned()))?;
+
+                Ok(Entry {
+                    id: package::Id::from(id.to_owned()),
+                    checksum,
+                })
+            })
+            .collect::<Result<_, _>>()?;
+
+        Ok(Self { entries })
+    }
+
+    pub fn encode(&self) -> String {
+        self.entries.iter().fold(String::new(), |mut out, entry| {
+            let _ = writeln!(out, "{} {:016x}", entry.id, entry.checksum);
+            out
+        })
+    }
+}
+
+#[derive(Debug, Error)]
+pub enum Error {
+    #[error("stone read")]
+    StoneRead(#[from] stone::read::Error),
+    #[error("meta payload is missing its package hash")]
+    MissingHash,
+    #[error("malformed manifest line: {0}")]
+    Malformed(String),
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn roundtrip() {
+        let manifest = Manifest {
+            entries: vec![
+                Entry {
+                    id: package::Id::from("a1".to_owned()),
+                    checksum: 0xdead,
+                },
+                Entry {
+                    id: package::Id::from("b2".to_owned()),
+                    checksum: u64::MAX,
+                },
+            ],
+        };
+
+        assert_eq!(Manifest::parse(&manifest.encode()).unwrap(), manifest);
+        assert!(Manifest::parse("nochecksum").is_err());
+    }
+}
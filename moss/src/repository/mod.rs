@@ -3,10 +3,10 @@
 // SPDX-License-Identifier: MPL-2.0
 
 use std::collections::BTreeMap;
-use std::path::PathBuf;
+use std::path::{Path, PathBuf};
 
 use derive_more::{Display, From, Into};
-use fs_err::tokio::File;
+use fs_err::tokio::{self as fs, File};
 use futures_util::StreamExt;
 use serde::{Deserialize, Serialize};
 use thiserror::Error;
@@ -18,8 +18,12 @@ use config::Config;
 use crate::{db::meta, request};
 
 pub use self::manager::Manager;
+pub use self::manifest::Manifest;
 
+pub mod dictionary;
+pub mod index_cache;
 pub mod manager;
+pub mod manifest;
 
 /// A unique [`Repository`] identifier
 #[derive(Debug, Clone, PartialEq, Eq, Serialize, Deserialize, Ord, PartialOrd, From, Display)]
@@ -45,6 +49,9 @@ pub struct Repository {
     pub priority: Priority,
     #[serde(default = "default_as_true")]
     pub active: bool,
+    /// Alternative uris of the index, serving the same packages
+    #[serde(default, skip_serializing_if = "Vec::is_empty")]
+    pub mirrors: Vec<Url>,
 }
 
 fn default_as_true() -> bool {
@@ -123,18 +130,71 @@ impl Config for Map {
     }
 }
 
-async fn fetch_index(url: Url, out_path: impl Into<PathBuf>) -> Result<(), FetchError> {
-    let mut stream = request::get(url).await?;
+/// Fetch `url` to `out_path`, unless the copy already at `out_path` is still current
+///
+/// Returns `true` if a new copy was written
+async fn fetch_if_modified(url: Url, out_path: &Path) -> Result<bool, FetchError> {
+    let validators_path = with_suffix(out_path, ".validators");
+
+    let cached = if out_path.exists() {
+        read_validators(&validators_path).await
+    } else {
+        request::Validators::default()
+    };
+
+    // Fall back to the next mirror of the repository
+    let mut result = None;
+    for url in request::mirrored(&url) {
+        match request::get_if_modified(url, &cached).await {
+            Ok(conditional) => {
+                result = Some(Ok(conditional));
+                break;
+            }
+            Err(error) => result = Some(Err(error)),
+        }
+    }
+
+    let request::Conditional::Modified { mut stream, validators } = result.expect("at least one uri")? else {
+        return Ok(false);
+    };
 
-    let mut out = File::create(out_path).await?;
+    // Keep the previous copy intact until the new one is complete
+    let part_path = with_suffix(out_path, ".part");
+    let mut out = File::create(&part_path).await?;
 
     while let Some(chunk) = stream.next().await {
         out.write_all(&chunk?).await?;
     }
 
     out.flush().await?;
+    drop(out);
+
+    fs::rename(&part_path, out_path).await?;
+
+    let encoded = [validators.etag, validators.last_modified]
+        .map(Option::unwrap_or_default)
+        .join("\n");
+    fs::write(&validators_path, encoded).await?;
+
+    Ok(true)
+}
+
+async fn read_validators(path: &Path) -> request::Validators {
+    let content = fs::read_to_string(path).await.unwrap_or_default();
+    let mut lines = content
+        .lines()
+        .map(|line| Some(line.to_owned()).filter(|line| !line.is_empty()));
+
+    request::Validators {
+        etag: lines.next().flatten(),
+        last_modified: lines.next().flatten(),
+    }
+}
 
-    Ok(())
+fn with_suffix(path: &Path, suffix: &str) -> PathBuf {
+    let mut path = path.as_os_str().to_owned();
+    path.push(suffix);
+    PathBuf::from(path)
 }
 
 #[derive(Debug, Error)]
@@ -2,7 +2,12 @@
 //
 // SPDX-License-Identifier: MPL-2.0
 
-use std::{io, path::PathBuf, sync::OnceLock};
+use std::{
+    io::{self, SeekFrom},
+    path::PathBuf,
+    sync::{OnceLock, RwLock},
+    time::UNIX_EPOCH,
+};
 
 use bytes::Bytes;
 use fs_err::tokio::File;
@@ -10,8 +15,9 @@ use futures_util::{
     stream::{self, BoxStream},
     Stream, StreamExt,
 };
+use reqwest::{header, StatusCode};
 use thiserror::Error;
-use tokio::io::AsyncReadExt;
+use tokio::io::{AsyncReadExt, AsyncSeekExt};
 use tokio_util::io::ReaderStream;
 use url::Url;
 
@@ -25,6 +31,8 @@ fn get_client() -> &'static reqwest::Client {
         reqwest::ClientBuilder::new()
             .referer(false)
             .user_agent(concat!(env!("CARGO_PKG_NAME"), "/", env!("CARGO_PKG_VERSION")))
+            // Many small stones are fetched concurrently over each connection
+            .http2_adaptive_window(true)
             .build()
             .expect("build reqwest client")
     })
@@ -38,6 +46,209 @@ pub async fn get(url: Url) -> Result<BoxStream<'static, Result<Bytes, Error>>, E
     }
 }
 
+/// Base uris of mirrored repositories with the base uris of their mirrors
+static MIRRORS: RwLock<Vec<(Url, Vec<Url>)>> = RwLock::new(Vec::new());
+
+/// Register `mirrors` as serving the same content as the repository at `uri`
+pub fn add_mirrors(uri: &Url, mirrors: &[Url]) {
+    let Some(base) = base_uri(uri) else {
+        return;
+    };
+    let mirrors = mirrors.iter().filter_map(base_uri).collect::<Vec<_>>();
+
+    let mut table = MIRRORS.write().expect("rwlock guard");
+    table.retain(|(existing, _)| *existing != base);
+    if !mirrors.is_empty() {
+        table.push((base, mirrors));
+    }
+}
+
+/// All uris serving the resource at `url`, itself included
+///
+/// Each resource starts at a different mirror, so concurrent downloads are
+/// spread across all of them.
+pub fn mirrored(url: &Url) -> Vec<Url> {
+    let table = MIRRORS.read().expect("rwlock guard");
+
+    let Some((base, mirrors)) = table.iter().find(|(base, _)| url.as_str().starts_with(base.as_str())) else {
+        return vec![url.clone()];
+    };
+    let relative = &url.as_str()[base.as_str().len()..];
+
+    let mut urls = [base]
+        .into_iter()
+        .chain(mirrors)
+        .filter_map(|base| base.join(relative).ok())
+        .collect::<Vec<_>>();
+    if urls.is_empty() {
+        return vec![url.clone()];
+    }
+    let start = xxhash_rust::xxh3::xxh3_64(relative.as_bytes()) as usize % urls.len();
+    urls.rotate_left(start);
+
+    urls
+}
+
+/// Directory holding the index file at `uri`, which package uris are relative to
+fn base_uri(uri: &Url) -> Option<Url> {
+    uri.join(".").ok()
+}
+
+/// A response to [`get_from`]
+pub struct Ranged {
+    pub stream: BoxStream<'static, Result<Bytes, Error>>,
+    /// `false` if the server ignored the range and is sending the whole resource instead
+    pub resumed: bool,
+    /// Identifies this version of the resource, to resume it later with [`get_from`]
+    pub validator: Option<String>,
+}
+
+/// Fetch a resource at the provided [`Url`] from byte `offset` onwards
+///
+/// The range is only honoured while the resource still matches `validator`, as
+/// returned by the request that fetched the earlier bytes. Otherwise the whole
+/// resource is sent again.
+pub async fn get_from(url: Url, offset: u64, validator: Option<&str>) -> Result<Ranged, Error> {
+    if let Some(path) = url_file(&url) {
+        let mut file = File::open(path).await?;
+        file.seek(SeekFrom::Start(offset)).await?;
+
+        let stream = ReaderStream::with_capacity(file, environment::FILE_READ_BUFFER_SIZE);
+
+        return Ok(Ranged {
+            stream: stream.map(|result| result.map_err(Error::Read)).boxed(),
+            resumed: offset > 0,
+            validator: None,
+        });
+    }
+
+    let mut request = get_client().get(url.clone());
+    if offset > 0 {
+        request = request.header(header::RANGE, format!("bytes={offset}-"));
+        if let Some(validator) = validator {
+            request = request.header(header::IF_RANGE, validator);
+        }
+    }
+    let response = request.send().await?;
+
+    if offset == 0 {
+        return Ok(ranged(response.error_for_status()?, false));
+    }
+
+    let resumed = response.status() == StatusCode::PARTIAL_CONTENT
+        && response
+            .headers()
+            .get(header::CONTENT_RANGE)
+            .and_then(|value| value.to_str().ok())
+            .is_some_and(|range| range.starts_with(&format!("bytes {offset}-")));
+
+    if !resumed && (!response.status().is_success() || response.status() == StatusCode::PARTIAL_CONTENT) {
+        // i.e. the range is no longer satisfiable, start over
+        let response = get_client().get(url).send().await?.error_for_status()?;
+        return Ok(ranged(response, false));
+    }
+
+    Ok(ranged(response, resumed))
+}
+
+fn ranged(response: reqwest::Response, resumed: bool) -> Ranged {
+    let headers = response.headers();
+    // Only strong etags are valid for `If-Range`
+    let validator = headers
+        .get(header::ETAG)
+        .and_then(|value| value.to_str().ok())
+        .filter(|etag| !etag.starts_with("W/"))
+        .or_else(|| headers.get(header::LAST_MODIFIED).and_then(|value| value.to_str().ok()))
+        .map(ToOwned::to_owned);
+
+    Ranged {
+        stream: response
+            .bytes_stream()
+            .map(|result| result.map_err(Error::Fetch))
+            .boxed(),
+        resumed,
+        validator,
+    }
+}
+
+/// Cache validators of a previously fetched resource
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct Validators {
+    pub etag: Option<String>,
+    pub last_modified: Option<String>,
+}
+
+/// Outcome of a [`get_if_modified`] request
+pub enum Conditional {
+    NotModified,
+    Modified {
+        stream: BoxStream<'static, Result<Bytes, Error>>,
+        validators: Validators,
+    },
+}
+
+/// Fetch a resource at the provided [`Url`] unless it's unchanged since it was
+/// last fetched with the supplied [`Validators`]
+pub async fn get_if_modified(url: Url, validators: &Validators) -> Result<Conditional, Error> {
+    match url_file(&url) {
+        Some(path) => {
+            // Local files are validated by their size & modification time
+            let metadata = fs_err::tokio::metadata(&path).await?;
+            let modified = metadata.modified()?.duration_since(UNIX_EPOCH).unwrap_or_default();
+            let current = Validators {
+                etag: Some(format!("{}-{}", metadata.len(), modified.as_nanos())),
+                last_modified: None,
+            };
+
+            if current == *validators {
+                Ok(Conditional::NotModified)
+            } else {
+                Ok(Conditional::Modified {
+                    stream: read(path).await?,
+                    validators: current,
+                })
+            }
+        }
+        _ => {
+            let mut request = get_client().get(url);
+
+            if let Some(etag) = &validators.etag {
+                request = request.header(header::IF_NONE_MATCH, etag);
+            }
+            if let Some(last_modified) = &validators.last_modified {
+                request = request.header(header::IF_MODIFIED_SINCE, last_modified);
+            }
+
+            let response = request.send().await?;
+
+            if response.status() == StatusCode::NOT_MODIFIED {
+                return Ok(Conditional::NotModified);
+            }
+
+            let response = response.error_for_status()?;
+            let value = |name: header::HeaderName| {
+                response
+                    .headers()
+                    .get(name)
+                    .and_then(|value| value.to_str().ok())
+                    .map(ToOwned::to_owned)
+            };
+            let validators = Validators {
+                etag: value(header::ETAG),
+                last_modified: value(header::LAST_MODIFIED),
+            };
+
+            Ok(Conditional::Modified {
+                stream: response
+                    .bytes_stream()
+                    .map(|result| result.map_err(Error::Fetch))
+                    .boxed(),
+                validators,
+            })
+        }
+    }
+}
+
 /// Internal fetch helper (sanity control) for `get`
 async fn fetch(url: Url) -> Result<impl Stream<Item = Result<Bytes, Error>>, Error> {
     let response = get_client().get(url).send().await?;
@@ -82,3 +293,39 @@ pub enum Error {
     #[error("io")]
     Read(#[from] io::Error),
 }
+
+impl Error {
+    /// The requested resource doesn't exist
+    pub fn is_not_found(&self) -> bool {
+        match self {
+            Error::Fetch(error) => error.status() == Some(StatusCode::NOT_FOUND),
+            Error::Read(error) => error.kind() == io::ErrorKind::NotFound,
+        }
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn mirrors() {
+        let index = "https://primary.test/repo/stone.index".parse::<Url>().unwrap();
+        add_mirrors(&index, &["https://mirror.test/x/stone.index".parse().unwrap()]);
+
+        let stone = index.join("pool/a/a.stone").unwrap();
+        let mut urls = mirrored(&stone).into_iter().map(String::from).collect::<Vec<_>>();
+        urls.sort();
+
+        assert_eq!(
+            urls,
+            [
+                "https://mirror.test/x/pool/a/a.stone",
+                "https://primary.test/repo/pool/a/a.stone"
+            ]
+        );
+
+        let unrelated = "https://other.test/stone.index".parse::<Url>().unwrap();
+        assert_eq!(mirrored(&unrelated), vec![unrelated]);
+    }
+}
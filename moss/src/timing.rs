@@ -0,0 +1,246 @@
+// SPDX-FileCopyrightText: Copyright © 2020-2025 Serpent OS Developers
+//
+// SPDX-License-Identifier: MPL-2.0
+
+//! Phase timings of moss transactions
+//!
+//! Once [`enable`]d, each phase of a transaction records a [`Span`] with its
+//! byte & entry counters, so slow upgrades can be attributed to a stage
+//! without profiling the host. Until then, timers are a no-op.
+//!
+//! [`write_chrome_trace`] exports the spans in the Chrome trace event format,
+//! which is plain JSON and opens in Perfetto or `about:tracing`.
+
+use std::{
+    io::{self, Write},
+    sync::{Mutex, OnceLock},
+    time::{Duration, Instant},
+};
+
+use serde::Serialize;
+use serde_json::json;
+
+static RECORDER: OnceLock<Recorder> = OnceLock::new();
+
+/// A stage of a moss transaction
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Serialize, strum::Display)]
+#[serde(rename_all = "kebab-case")]
+#[strum(serialize_all = "kebab-case")]
+pub enum Phase {
+    /// Dependency resolution of a transaction
+    Resolve,
+    /// Download of a package
+    Fetch,
+    /// Unpack of a package into the asset store
+    Unpack,
+    /// Insert of unpacked layouts & metadata into the databases
+    Store,
+    /// Build of the vfs tree for a blit
+    Vfs,
+    /// Write of the vfs tree to the staging or ephemeral root
+    Blit,
+    /// Run of a transaction or system trigger
+    Triggers,
+    /// Synchronisation of boot entries
+    BootSync,
+    /// Swap of the staging tree into place
+    Promote,
+}
+
+/// A single timed phase
+#[derive(Debug, Clone, PartialEq, Eq, Serialize)]
+pub struct Span {
+    pub phase: Phase,
+    /// What the phase acted on, i.e. a package name
+    pub label: Option<String>,
+    /// Start, relative to [`enable`]
+    pub start: Duration,
+    pub elapsed: Duration,
+    pub bytes: u64,
+    pub entries: u64,
+}
+
+#[derive(Debug)]
+struct Recorder {
+    epoch: Instant,
+    spans: Mutex<Vec<Span>>,
+}
+
+/// Start recording spans for the rest of the process
+pub fn enable() {
+    RECORDER.get_or_init(|| Recorder {
+        epoch: Instant::now(),
+        spans: Mutex::default(),
+    });
+}
+
+pub fn is_enabled() -> bool {
+    RECORDER.get().is_some()
+}
+
+/// Begin timing `phase`, recorded when the [`Timer`] is finished or dropped
+pub fn begin(phase: Phase) -> Timer {
+    Timer {
+        phase,
+        label: None,
+        start: Instant::now(),
+        bytes: 0,
+        entries: 0,
+    }
+}
+
+/// All spans recorded so far, in order of completion
+pub fn spans() -> Vec<Span> {
+    RECORDER
+        .get()
+        .map(|recorder| recorder.spans.lock().expect("mutex guard").clone())
+        .unwrap_or_default()
+}
+
+/// A running span
+#[derive(Debug)]
+#[must_use = "timer records when dropped"]
+pub struct Timer {
+    phase: Phase,
+    label: Option<String>,
+    start: Instant,
+    bytes: u64,
+    entries: u64,
+}
+
+impl Timer {
+    pub fn with_label(mut self, label: impl ToString) -> Self {
+        if is_enabled() {
+            self.label = Some(label.to_string());
+        }
+        self
+    }
+
+    pub fn add_bytes(&mut self, bytes: u64) {
+        self.bytes += bytes;
+    }
+
+    pub fn add_entries(&mut self, entries: u64) {
+        self.entries += entries;
+    }
+
+    pub fn finish(self) {}
+}
+
+impl Drop for Timer {
+    fn drop(&mut self) {
+        let Some(recorder) = RECORDER.get() else {
+            return;
+        };
+
+        let span = Span {
+            phase: self.phase,
+            label: self.label.take(),
+            start: self.start.saturating_duration_since(recorder.epoch),
+            elapsed: self.start.elapsed(),
+            bytes: self.bytes,
+            entries: self.entries,
+        };
+
+        recorder.spans.lock().expect("mutex guard").push(span);
+    }
+}
+
+/// Write all recorded spans as a Chrome trace
+///
+/// Unlabelled spans are the sequential stages of a transaction and share the
+/// first track. Labelled spans overlap, i.e. packages fetched concurrently,
+/// so each is placed on the first free track after it.
+pub fn write_chrome_trace<W: Write>(mut writer: W) -> io::Result<()> {
+    let mut spans = spans();
+    spans.sort_by_key(|span| span.start);
+
+    // End of the last span on each labelled track
+    let mut tracks = Vec::<Duration>::new();
+
+    let events = spans
+        .iter()
+        .map(|span| {
+            let track = if span.label.is_some() {
+                let end = span.start + span.elapsed;
+
+                match tracks.iter().position(|&free| free <= span.start) {
+                    Some(position) => {
+                        tracks[position] = end;
+                        position + 1
+                    }
+                    None => {
+                        tracks.push(end);
+                        tracks.len()
+                    }
+                }
+            } else {
+                0
+            };
+
+            let name = match &span.label {
+                Some(label) => format!("{} {label}", span.phase),
+                None => span.phase.to_string(),
+            };
+
+            json!({
+                "name": name,
+                "cat": span.phase,
+                "ph": "X",
+                "ts": span.start.as_micros() as u64,
+                "dur": span.elapsed.as_micros() as u64,
+                "pid": 1,
+                "tid": track,
+                "args": {
+                    "bytes": span.bytes,
+                    "entries": span.entries,
+                },
+            })
+        })
+        .collect::<Vec<_>>();
+
+    serde_json::to_writer(&mut writer, &json!({ "traceEvents": events, "displayTimeUnit": "ms" }))?;
+
+    writer.flush()
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn chrome_trace() {
+        enable();
+
+        let outer = begin(Phase::Blit);
+        let mut first = begin(Phase::Fetch).with_label("bench-a");
+        first.add_bytes(10);
+        let second = begin(Phase::Fetch).with_label("bench-b");
+        std::thread::sleep(Duration::from_millis(1));
+        first.finish();
+        second.finish();
+        begin(Phase::Fetch).with_label("bench-c").finish();
+        outer.finish();
+
+        let mut trace = vec![];
+        write_chrome_trace(&mut trace).unwrap();
+        let trace = serde_json::from_slice::<serde_json::Value>(&trace).unwrap();
+
+        let track = |name: &str| {
+            trace["traceEvents"]
+                .as_array()
+                .unwrap()
+                .iter()
+                .find(|event| event["name"] == name)
+                .map(|event| event["tid"].as_u64().unwrap())
+        };
+
+        assert_eq!(track("blit"), Some(0));
+        // Overlapping spans don't share a track
+        assert_ne!(track("fetch bench-a"), track("fetch bench-b"));
+        assert_eq!(track("fetch bench-c"), Some(1));
+        assert!(spans()
+            .iter()
+            .any(|span| span.label.as_deref() == Some("bench-a") && span.bytes == 10));
+    }
+}